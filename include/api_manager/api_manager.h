@@ -83,6 +83,9 @@ class ApiManager {
   // output
   virtual bool get_preserve_proto_field_names() = 0;
 
+  // server_config option to call service control over gRPC instead of HTTP
+  virtual bool get_service_control_grpc_transport() = 0;
+
   // Creates a RequestHandler to handle check and report for each request.
   // Its usage:
   //  1) Creates a RequestHandler object for each request,
@@ -47,6 +47,10 @@ class ApiManagerEnvInterface {
 
   virtual void Log(LogLevel level, const char *message) = 0;
 
+  // Returns false if messages of the level are dropped by Log, so callers
+  // can skip building expensive log messages.
+  virtual bool IsLogLevelEnabled(LogLevel level) { return true; }
+
   // Simple periodic timer support. API Manager uses this method to get
   // called at regular intervals of wall-clock time.
   // Warning: the returned timer object should NOT be destroyed at callback
@@ -29,7 +29,7 @@ class GRPCRequest {
  public:
   // GRPCRequest constructor without headers in the callback function.
   GRPCRequest(std::function<void(utils::Status, std::string&&)> callback)
-      : callback_(callback) {}
+      : callback_(callback), timeout_ms_(0), max_retries_(0) {}
 
   // A callback for the environment to invoke when the request is
   // complete. This will be invoked by the environment exactly once,
@@ -50,7 +50,9 @@ class GRPCRequest {
     return *this;
   }
 
-  // DNS or IP address of the gRPC server.
+  // DNS or IP address of the gRPC server, optionally with a port.  An
+  // "http://" prefix selects a plaintext channel and "https://" (the
+  // default) a TLS channel.
   const std::string& server() const { return server_; }
   GRPCRequest& set_server(const std::string& value) {
     server_ = value;
@@ -83,12 +85,37 @@ class GRPCRequest {
     return *this;
   }
 
+  // The OAuth token sent as the call's authorization metadata.
+  const std::string& auth_token() const { return auth_token_; }
+  GRPCRequest& set_auth_token(const std::string& value) {
+    auth_token_ = value;
+    return *this;
+  }
+
+  // The deadline of each attempt, 0 for none.
+  int timeout_ms() const { return timeout_ms_; }
+  GRPCRequest& set_timeout_ms(int value) {
+    timeout_ms_ = value;
+    return *this;
+  }
+
+  // The number of times the call is retried when the server is
+  // unavailable.
+  int max_retries() const { return max_retries_; }
+  GRPCRequest& set_max_retries(int value) {
+    max_retries_ = value;
+    return *this;
+  }
+
  private:
   std::function<void(utils::Status, std::string&&)> callback_;
   std::string method_;
   std::string server_;
   std::string service_;
   std::string body_;
+  std::string auth_token_;
+  int timeout_ms_;
+  int max_retries_;
 };
 
 }  // namespace api_manager
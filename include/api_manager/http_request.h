@@ -27,6 +27,18 @@ namespace api_manager {
 // processed by the environment.
 class HTTPRequest {
  public:
+  // The scheduling class of a request.  When requests to one server have
+  // to queue, higher priority (lower value) requests are sent first.
+  enum Priority {
+    CHECK = 0,
+    QUOTA,
+    KEY_FETCH,
+    OTHER,
+    REPORT,
+    TRACE,
+    NUM_PRIORITIES
+  };
+
   // HTTPRequest constructor without headers in the callback function.
   // Callback receives NGX_ERROR status code if the request fails to initiate or
   // complete.
@@ -40,7 +52,8 @@ class HTTPRequest {
         requires_response_headers_(false),
         timeout_ms_(0),
         max_retries_(0),
-        timeout_backoff_factor_(2.0) {}
+        timeout_backoff_factor_(2.0),
+        priority_(OTHER) {}
 
   // A callback for the environment to invoke when the request is
   // complete.  This will be invoked by the environment exactly once,
@@ -118,6 +131,12 @@ class HTTPRequest {
     return *this;
   }
 
+  Priority priority() const { return priority_; }
+  HTTPRequest& set_priority(Priority value) {
+    priority_ = value;
+    return *this;
+  }
+
   bool requires_response_headers() const { return requires_response_headers_; }
   HTTPRequest& set_requires_response_headers(bool value) {
     requires_response_headers_ = value;
@@ -144,6 +163,9 @@ class HTTPRequest {
 
   // Exponential back-off for the retries
   double timeout_backoff_factor_;
+
+  // The scheduling class of the request
+  Priority priority_;
 };
 
 }  // namespace api_manager
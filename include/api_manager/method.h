@@ -90,6 +90,10 @@ class MethodInfo {
   // Get the backend audience for this method.
   virtual const std::string &backend_jwt_audience() const = 0;
 
+  // Get the deadline of calls to the backend for this method, in seconds;
+  // 0 for none.
+  virtual double backend_deadline() const = 0;
+
   // Get the RPC method full name. The full name has the following form:
   // "/<API name>/<method name>".
   virtual const std::string &rpc_method_full_name() const = 0;
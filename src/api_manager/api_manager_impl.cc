@@ -62,10 +62,18 @@ ApiManagerImpl::ApiManagerImpl(std::unique_ptr<ApiManagerEnvInterface> env,
       std::istream_iterator<std::string> end;
       std::vector<std::string> parts(begin, end);
 
-      rewrite_rules_.push_back(std::unique_ptr<RewriteRule>(
+      rewrite_rules_.Add(std::unique_ptr<RewriteRule>(
           new RewriteRule(parts[0], parts[1], global_context_->env())));
     }
   }
+
+  if (global_context_->server_config() &&
+      global_context_->server_config()->has_service_config_rollout()) {
+    const auto &rollout =
+        global_context_->server_config()->service_config_rollout();
+    sticky_header_ = rollout.sticky_header();
+    sticky_query_parameter_ = rollout.sticky_query_parameter();
+  }
 }
 
 utils::Status ApiManagerImpl::LoadServiceRollouts() {
@@ -105,7 +113,6 @@ utils::Status ApiManagerImpl::LoadServiceRollouts() {
     if (config_loading_status.code() == Code::UNAVAILABLE && list.size() > 0) {
       config_loading_status = AddAndDeployConfigs(std::move(list), false);
     } else {
-      service_context_map_.clear();
       config_loading_status =
           utils::Status(Code::ABORTED, "Invalid service config");
     }
@@ -115,6 +122,13 @@ utils::Status ApiManagerImpl::LoadServiceRollouts() {
     config_loading_status = utils::Status(Code::ABORTED, err_msg);
   }
 
+  if (!config_loading_status.ok()) {
+    // Don't serve any part of a failed load, nor what was selected before.
+    service_context_map_.clear();
+    service_selector_.reset();
+    selected_services_.clear();
+  }
+
   return config_loading_status;
 }
 
@@ -147,7 +161,8 @@ utils::Status ApiManagerImpl::AddConfig(const std::string &service_config,
                                         bool initialize,
                                         std::string *config_id) {
   std::unique_ptr<Config> config =
-      Config::Create(global_context_->env(), service_config);
+      Config::Create(global_context_->env(), service_config,
+                     global_context_->routing_table_cache());
   if (config == nullptr) {
     return utils::Status(Code::INVALID_ARGUMENT, "Invalid service config");
   }
@@ -173,6 +188,8 @@ utils::Status ApiManagerImpl::AddConfig(const std::string &service_config,
 
   auto context_service = std::make_shared<context::ServiceContext>(
       global_context_, std::move(config));
+  // Starts the new config with the cache state of the current one.
+  context_service->InheritCaches(PrimaryServiceContext());
   if (initialize == true && context_service->service_control()) {
     context_service->service_control()->Init();
   }
@@ -181,10 +198,36 @@ utils::Status ApiManagerImpl::AddConfig(const std::string &service_config,
   return utils::Status::OK;
 }
 
+std::shared_ptr<context::ServiceContext>
+ApiManagerImpl::PrimaryServiceContext() const {
+  if (!service_selector_) {
+    return nullptr;
+  }
+  const std::pair<std::string, int> *primary = nullptr;
+  for (const auto &item : service_selector_->list()) {
+    if (primary == nullptr || item.second > primary->second) {
+      primary = &item;
+    }
+  }
+  if (primary == nullptr) {
+    return nullptr;
+  }
+  const auto &it = service_context_map_.find(primary->first);
+  if (it != service_context_map_.end()) {
+    return it->second;
+  }
+  return nullptr;
+}
+
 // Deploy these configs according to the traffic percentage.
 void ApiManagerImpl::DeployConfigs(
     std::vector<std::pair<std::string, int>> &&list) {
+  std::vector<std::shared_ptr<context::ServiceContext>> services;
+  for (const auto &item : list) {
+    services.push_back(service_context_map_[item.first]);
+  }
   service_selector_.reset(new WeightedSelector(std::move(list)));
+  selected_services_.swap(services);
 }
 
 utils::Status ApiManagerImpl::Init() {
@@ -268,14 +311,26 @@ const ::google::api::Service &ApiManagerImpl::service(
 }
 
 std::shared_ptr<context::ServiceContext> ApiManagerImpl::SelectService() {
-  if (service_context_map_.empty()) {
+  if (selected_services_.empty()) {
     return nullptr;
   }
-  const auto &it = service_context_map_.find(service_selector_->Select());
-  if (it != service_context_map_.end()) {
-    return it->second;
+  return selected_services_[service_selector_->SelectIndex()];
+}
+
+std::shared_ptr<context::ServiceContext> ApiManagerImpl::SelectService(
+    Request *request) {
+  // An optimization for a single config, the most popular case.
+  if (selected_services_.size() <= 1 || request == nullptr) {
+    return SelectService();
   }
-  return nullptr;
+
+  std::string key;
+  if ((!sticky_header_.empty() && request->FindHeader(sticky_header_, &key)) ||
+      (!sticky_query_parameter_.empty() &&
+       request->FindQuery(sticky_query_parameter_, &key))) {
+    return selected_services_[service_selector_->SelectIndexByKey(key)];
+  }
+  return SelectService();
 }
 
 utils::Status ApiManagerImpl::GetStatistics(
@@ -322,22 +377,14 @@ utils::Status ApiManagerImpl::GetServiceConfigRollouts(
 
 bool ApiManagerImpl::ReWriteURL(const char *uri, const size_t uri_len,
                                 std::string *destination_url, bool debug_mode) {
-  auto server_config = global_context_->server_config();
-
-  for (auto &rewrite_rule : this->rewrite_rules_) {
-    if (rewrite_rule->Check(uri, uri_len, destination_url, debug_mode) ==
-        true) {
-      return true;
-    }
-  }
-
-  return false;
+  return rewrite_rules_.Rewrite(uri, uri_len, destination_url, debug_mode);
 }
 
 std::unique_ptr<RequestHandlerInterface> ApiManagerImpl::CreateRequestHandler(
     std::unique_ptr<Request> request_data) {
+  auto service_context = SelectService(request_data.get());
   return std::unique_ptr<RequestHandlerInterface>(new RequestHandler(
-      check_workflow_, SelectService(), std::move(request_data)));
+      check_workflow_, service_context, std::move(request_data)));
 }
 
 std::shared_ptr<ApiManager> ApiManagerFactory::CreateApiManager(
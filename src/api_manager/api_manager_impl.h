@@ -58,6 +58,13 @@ class ApiManagerImpl : public ApiManager {
     return global_context_->preserve_proto_field_names();
   };
 
+  bool get_service_control_grpc_transport() override {
+    auto server_config = global_context_->server_config();
+    return server_config &&
+           server_config->service_control_config().transport() ==
+               proto::ServiceControlConfig::GRPC;
+  };
+
   utils::Status GetStatistics(ApiManagerStatistics *statistics) const override;
 
   // Add a new service config.
@@ -69,6 +76,10 @@ class ApiManagerImpl : public ApiManager {
   // Return ServiceContext for selected by WeightedSelector
   std::shared_ptr<context::ServiceContext> SelectService();
 
+  // Same as above, but uses the sticky key of the request if the sticky
+  // traffic split is configured.
+  std::shared_ptr<context::ServiceContext> SelectService(Request *request);
+
   // Load service rollouts. This can be called only once, the data is from
   // server_config.
   utils::Status LoadServiceRollouts() override;
@@ -97,6 +108,10 @@ class ApiManagerImpl : public ApiManager {
   // Send empty report to detect rollout ID change
   void DetectRolloutIDChange();
 
+  // Returns the ServiceContext receiving the most traffic in the currently
+  // deployed rollout, nullptr if no rollout is deployed yet.
+  std::shared_ptr<context::ServiceContext> PrimaryServiceContext() const;
+
   // The check work flow.
   std::shared_ptr<CheckWorkflow> check_workflow_;
 
@@ -113,11 +128,19 @@ class ApiManagerImpl : public ApiManager {
   // A weighted service selector.
   std::unique_ptr<WeightedSelector> service_selector_;
 
+  // The ServiceContext objects of the service_selector_ list, in the same
+  // order, so a selection does not need a map lookup.
+  std::vector<std::shared_ptr<context::ServiceContext>> selected_services_;
+
+  // The request header and query parameter for sticky traffic split.
+  std::string sticky_header_;
+  std::string sticky_query_parameter_;
+
   // A config manager will be initialized when server_config.rollout_strategy is
   // set to "managed"
   std::unique_ptr<ConfigManager> config_manager_;
 
-  std::vector<std::unique_ptr<RewriteRule>> rewrite_rules_;
+  RewriteRuleSet rewrite_rules_;
 };
 
 }  // namespace api_manager
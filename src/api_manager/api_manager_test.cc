@@ -62,6 +62,23 @@ const char kServerConfigWithPartialServiceConfig[] = R"(
 }
 )";
 
+const char kServerConfigWithStickyServiceConfig[] = R"(
+{
+  "google_authentication_secret": "{}",
+  "metadata_server_config": {
+    "enabled": true,
+    "url": "http://localhost"
+  },
+  "service_config_rollout": {
+    traffic_percentages: {
+      "src/api_manager/testdata/bookstore_service_config_1.json": 80,
+      "src/api_manager/testdata/bookstore_service_config_2.json": 20,
+    },
+    "sticky_header": "x-client-id"
+  }
+}
+)";
+
 const char kServerConfigWithPartialServiceConfigFailed[] = R"(
 {
   "google_authentication_secret": "{}",
@@ -407,6 +424,43 @@ TEST_F(ApiManagerTest, ManagedRolloutStrategy) {
   EXPECT_EQ("2017-05-01r1", service->service().id());
 }
 
+TEST_F(ApiManagerTest, ManagedRolloutInheritsCaches) {
+  std::unique_ptr<MockTimerApiManagerEnvironment> env(
+      new ::testing::NiceMock<MockTimerApiManagerEnvironment>());
+  MockTimerApiManagerEnvironment *raw_env = env.get();
+
+  EXPECT_CALL(*env.get(), DoRunHTTPRequest(_))
+      .WillOnce(Invoke([this](HTTPRequest *req) {
+        req->OnComplete(Status::OK, {}, kRolloutsResponse1);
+      }))
+      .WillOnce(Invoke([this](HTTPRequest *req) {
+        req->OnComplete(Status::OK, {}, kServiceConfig2);
+      }));
+
+  std::shared_ptr<ApiManagerImpl> api_manager(
+      std::dynamic_pointer_cast<ApiManagerImpl>(MakeApiManager(
+          std::move(env), kServerConfigWithManagedRolloutStrategy)));
+  EXPECT_OK(api_manager->LoadServiceRollouts());
+  api_manager->Init();
+
+  auto old_service = api_manager->SelectService();
+  EXPECT_TRUE(old_service);
+  EXPECT_EQ("2017-05-01r0", old_service->service().id());
+
+  api_manager->global_context()->rollout_id_func()("2017-05-01r111");
+  raw_env->RunTimer();
+
+  auto new_service = api_manager->SelectService();
+  EXPECT_TRUE(new_service);
+  EXPECT_EQ("2017-05-01r1", new_service->service().id());
+
+  // Both configs have the same authentication providers, all caches are
+  // shared with the new config.
+  EXPECT_EQ(&old_service->certs(), &new_service->certs());
+  EXPECT_EQ(&old_service->jwt_cache(), &new_service->jwt_cache());
+  EXPECT_EQ(&old_service->authz_cache(), &new_service->authz_cache());
+}
+
 TEST_F(ApiManagerTest, ServerConfigWithPartialServiceConfig) {
   std::unique_ptr<MockApiManagerEnvironment> env(
       new ::testing::NiceMock<MockApiManagerEnvironment>());
@@ -440,6 +494,45 @@ TEST_F(ApiManagerTest, ServerConfigWithPartialServiceConfig) {
   EXPECT_EQ(20, counter["2017-05-01r1"]);
 }
 
+TEST_F(ApiManagerTest, StickyServiceConfigSelection) {
+  std::unique_ptr<MockApiManagerEnvironment> env(
+      new ::testing::NiceMock<MockApiManagerEnvironment>());
+
+  std::shared_ptr<ApiManagerImpl> api_manager(
+      std::dynamic_pointer_cast<ApiManagerImpl>(MakeApiManager(
+          std::move(env), kServerConfigWithStickyServiceConfig)));
+  EXPECT_OK(api_manager->LoadServiceRollouts());
+  api_manager->Init();
+
+  // Requests with the same header value stay on one config.
+  for (int client = 0; client < 10; client++) {
+    std::string client_id = "client-" + std::to_string(client);
+    ::testing::NiceMock<MockRequest> request;
+    ON_CALL(request, FindHeader("x-client-id", _))
+        .WillByDefault(Invoke([client_id](const std::string &,
+                                          std::string *value) {
+          *value = client_id;
+          return true;
+        }));
+    auto first = api_manager->SelectService(&request);
+    ASSERT_TRUE(first);
+    for (int i = 0; i < 10; i++) {
+      EXPECT_EQ(first, api_manager->SelectService(&request));
+    }
+  }
+
+  // Requests without the header follow the traffic percentages.
+  std::unordered_map<std::string, int> counter;
+  for (int i = 0; i < 100; i++) {
+    ::testing::NiceMock<MockRequest> request;
+    auto service = api_manager->SelectService(&request);
+    ASSERT_TRUE(service);
+    counter[service->service().id()]++;
+  }
+  EXPECT_EQ(80, counter["2017-05-01r0"]);
+  EXPECT_EQ(20, counter["2017-05-01r1"]);
+}
+
 TEST_F(ApiManagerTest, ServerConfigWithInvalidServiceConfig) {
   std::unique_ptr<MockApiManagerEnvironment> env(
       new ::testing::NiceMock<MockApiManagerEnvironment>());
@@ -457,6 +550,29 @@ TEST_F(ApiManagerTest, ServerConfigWithInvalidServiceConfig) {
   EXPECT_FALSE(api_manager->Enabled());
 }
 
+TEST_F(ApiManagerTest, FailedReloadClearsSelectedServices) {
+  std::unique_ptr<MockApiManagerEnvironment> env(
+      new ::testing::NiceMock<MockApiManagerEnvironment>());
+
+  std::shared_ptr<ApiManagerImpl> api_manager(
+      std::dynamic_pointer_cast<ApiManagerImpl>(MakeApiManager(
+          std::move(env), kServerConfigWithSingleServiceConfig)));
+  EXPECT_OK(api_manager->LoadServiceRollouts());
+  EXPECT_TRUE(api_manager->SelectService());
+
+  auto *traffic_percentages =
+      api_manager->global_context()
+          ->server_config()
+          ->mutable_service_config_rollout()
+          ->mutable_traffic_percentages();
+  traffic_percentages->clear();
+  (*traffic_percentages)["not_found.json"] = 100;
+  EXPECT_FALSE(api_manager->LoadServiceRollouts().ok());
+
+  EXPECT_FALSE(api_manager->Enabled());
+  EXPECT_EQ(nullptr, api_manager->SelectService());
+}
+
 TEST_F(ApiManagerTest, ServerConfigServiceConfigNotSpecifed) {
   std::unique_ptr<MockApiManagerEnvironment> env(
       new ::testing::NiceMock<MockApiManagerEnvironment>());
@@ -16,6 +16,7 @@
 #define API_MANAGER_AUTH_CERTS_H_
 
 #include <chrono>
+#include <functional>
 #include <map>
 #include <string>
 
@@ -38,6 +39,17 @@ class Certs {
                : &(issuer_cert_map_[iss]);
   }
 
+  // Copies the certs of the issuers accepted by the filter from another
+  // Certs object.
+  void CopyFrom(const Certs& other,
+                const std::function<bool(const std::string&)>& filter) {
+    for (const auto& it : other.issuer_cert_map_) {
+      if (filter(it.first)) {
+        issuer_cert_map_[it.first] = it.second;
+      }
+    }
+  }
+
  private:
   // Map from issuer to a verification key and its absolute expiration time.
   std::map<std::string,
@@ -149,7 +149,7 @@ void AuthChecker::Check() {
   }
 
   // CreateSpan returns nullptr if trace is disabled.
-  trace_span_.reset(CreateSpan(context_->cloud_trace(), "CheckAuth"));
+  trace_span_ = CreateSpan(context_->cloud_trace(), "CheckAuth");
 
   GetAuthToken();
   if (auth_token_.empty()) {
@@ -449,7 +449,8 @@ void AuthChecker::HttpFetch(
     return;
   }
 
-  request->set_method("GET").set_url(url);
+  request->set_method("GET").set_url(url).set_priority(
+      HTTPRequest::KEY_FETCH);
   env_->RunHTTPRequest(std::move(request));
 }
 
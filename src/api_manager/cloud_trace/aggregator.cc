@@ -16,11 +16,16 @@
 //
 #include "src/api_manager/cloud_trace/aggregator.h"
 
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
+#include "src/api_manager/utils/compression.h"
 #include "src/api_manager/utils/marshalling.h"
 
 using google::api_manager::utils::Status;
 using google::devtools::cloudtrace::v1::Trace;
 using google::devtools::cloudtrace::v1::Traces;
+using google::protobuf::io::CodedOutputStream;
+using google::protobuf::io::StringOutputStream;
 
 namespace google {
 namespace api_manager {
@@ -29,6 +34,9 @@ namespace {
 
 const char kCloudTraceService[] = "/google.devtools.cloudtrace.v1.TraceService";
 
+// The tag of Traces.traces, a length delimited field 1.
+const uint8_t kTracesFieldTag = (Traces::kTracesFieldNumber << 3) | 2;
+
 }  // namespace
 
 Aggregator::Aggregator(auth::ServiceAccountToken *sa_token,
@@ -39,7 +47,7 @@ Aggregator::Aggregator(auth::ServiceAccountToken *sa_token,
       cloud_trace_address_(cloud_trace_address),
       aggregate_time_millisec_(aggregate_time_millisec),
       cache_max_size_(cache_max_size),
-      traces_(new Traces),
+      traces_bytes_(0),
       env_(env),
       sampler_(minimum_qps) {
   sa_token_->SetAudience(auth::ServiceAccountToken::JWT_TOKEN_FOR_CLOUD_TRACING,
@@ -62,17 +70,18 @@ Aggregator::~Aggregator() {
 }
 
 void Aggregator::SendAndClearTraces() {
-  if (traces_->traces_size() == 0 || project_id_.empty()) {
+  if (traces_.empty() || project_id_.empty()) {
     env_->LogDebug(
         "Not sending request to CloudTrace: no traces or "
         "project_id is empty.");
-    traces_->clear_traces();
+    traces_.clear();
+    traces_bytes_ = 0;
     return;
   }
 
   // Add project id into each trace object.
-  for (int i = 0; i < traces_->traces_size(); ++i) {
-    traces_->mutable_traces(i)->set_project_id(project_id_);
+  for (const auto &trace : traces_) {
+    trace->set_project_id(project_id_);
   }
 
   std::unique_ptr<HTTPRequest> http_request(new HTTPRequest(
@@ -80,7 +89,7 @@ void Aggregator::SendAndClearTraces() {
              std::string &&body) {
         if (status.code() < 0) {
           env_->LogError("Trace Request Failed." + status.ToString());
-        } else {
+        } else if (env_->IsLogLevelEnabled(ApiManagerEnvInterface::DEBUG)) {
           env_->LogDebug("Trace Response: " + status.ToString() + "\n" + body);
         }
       }));
@@ -88,26 +97,78 @@ void Aggregator::SendAndClearTraces() {
   std::string url =
       cloud_trace_address_ + "/v1/projects/" + project_id_ + "/traces";
 
+  // The JSON body is only built for binary export if it is logged. The
+  // traces live in their requests' arenas, they are copied into one Traces
+  // proto for it.
   std::string request_body;
-
-  ProtoToJson(*traces_, &request_body, utils::DEFAULT);
-  traces_->clear_traces();
-  env_->LogDebug("Sending request to Cloud Trace.");
-  env_->LogDebug(request_body);
+  bool debug = env_->IsLogLevelEnabled(ApiManagerEnvInterface::DEBUG);
+  if (!export_options_.binary || debug) {
+    Traces traces;
+    for (const auto &trace : traces_) {
+      *traces.add_traces() = *trace;
+    }
+    ProtoToJson(traces, &request_body, utils::DEFAULT);
+  }
+  if (debug) {
+    env_->LogDebug("Sending request to Cloud Trace.");
+    env_->LogDebug(request_body);
+  }
+  if (export_options_.binary) {
+    // Writes the traces as the repeated field of a Traces proto.
+    request_body.clear();
+    StringOutputStream string_stream(&request_body);
+    CodedOutputStream coded_stream(&string_stream);
+    for (const auto &trace : traces_) {
+      coded_stream.WriteTag(kTracesFieldTag);
+      coded_stream.WriteVarint32(trace->ByteSize());
+      trace->SerializeWithCachedSizes(&coded_stream);
+    }
+  }
+  traces_.clear();
+  traces_bytes_ = 0;
 
   http_request->set_url(url)
       .set_method("PATCH")
       .set_auth_token(sa_token_->GetAuthToken(
           auth::ServiceAccountToken::JWT_TOKEN_FOR_CLOUD_TRACING))
-      .set_header("Content-Type", "application/json")
-      .set_body(request_body);
+      .set_header("Content-Type", export_options_.binary
+                                      ? "application/x-protobuf"
+                                      : "application/json");
+
+  if (export_options_.gzip) {
+    std::string compressed_body;
+    if (utils::GzipCompress(request_body, &compressed_body)) {
+      request_body.swap(compressed_body);
+      http_request->set_header("Content-Encoding", "gzip");
+    } else {
+      env_->LogError("Failed to compress Cloud Trace request body.");
+    }
+  }
+  http_request->set_body(request_body);
+  http_request->set_priority(HTTPRequest::TRACE);
 
   env_->RunHTTPRequest(std::move(http_request));
 }
 
-void Aggregator::AppendTrace(Trace *trace) {
-  traces_->mutable_traces()->AddAllocated(trace);
-  if (traces_->traces_size() > cache_max_size_) {
+void Aggregator::AppendTrace(std::shared_ptr<Trace> trace) {
+  if (export_options_.max_batch_bytes > 0) {
+    // The project id is set here too so that it is counted.
+    trace->set_project_id(project_id_);
+    int trace_size = trace->ByteSize();
+    size_t trace_bytes =
+        1 + CodedOutputStream::VarintSize32(trace_size) + trace_size;
+    // Sends the cached traces first if the new trace would overflow the
+    // batch. A trace larger than the batch is still sent alone.
+    if (!traces_.empty() &&
+        traces_bytes_ + trace_bytes >
+            static_cast<size_t>(export_options_.max_batch_bytes)) {
+      SendAndClearTraces();
+    }
+    traces_bytes_ += trace_bytes;
+  }
+
+  traces_.push_back(std::move(trace));
+  if (traces_.size() > static_cast<size_t>(cache_max_size_)) {
     SendAndClearTraces();
   }
 }
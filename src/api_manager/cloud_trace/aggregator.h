@@ -16,6 +16,9 @@
 #ifndef API_MANAGER_CLOUD_TRACE_AGGREGATOR_H_
 #define API_MANAGER_CLOUD_TRACE_AGGREGATOR_H_
 
+#include <memory>
+#include <vector>
+
 #include "google/devtools/cloudtrace/v1/trace.pb.h"
 #include "include/api_manager/env_interface.h"
 #include "include/api_manager/periodic_timer.h"
@@ -26,6 +29,20 @@ namespace google {
 namespace api_manager {
 namespace cloud_trace {
 
+// Options to export traces to Cloud Trace API.
+struct ExportOptions {
+  // Sends traces as binary protobuf instead of JSON.
+  bool binary = false;
+
+  // Compresses the request body with gzip.
+  bool gzip = false;
+
+  // The maximum serialized size in bytes of the traces sent in one request,
+  // as measured when they are appended. If 0, traces are only batched by the
+  // cache size.
+  int max_batch_bytes = 0;
+};
+
 // TODO: The Aggregator class is not thread safe.
 // TODO: simplify class naming in this file.
 // Stores cloud trace configurations shared within the job. There should be
@@ -43,16 +60,29 @@ class Aggregator final {
   // invocation traces aggregated are sent to Cloud Trace API
   void Init();
 
-  // Flush traces cached and clear the traces_ proto.
+  // Flush traces cached and clear them.
   void SendAndClearTraces();
 
-  // Append a Trace to traces_, the appended trace may not be sent at the time
-  // of this function call.
-  void AppendTrace(google::devtools::cloudtrace::v1::Trace *trace);
+  // Appends a Trace to the cached traces, the appended trace may not be sent
+  // at the time of this function call. The trace is shared, it keeps the
+  // request's trace arena alive, and it is serialized when it is sent, so
+  // spans that end later are still included.
+  void AppendTrace(
+      std::shared_ptr<google::devtools::cloudtrace::v1::Trace> trace);
 
   // Sets the producer project id
   void SetProjectId(const std::string &project_id) { project_id_ = project_id; }
 
+  // Sets how traces are sent to Cloud Trace API.
+  void SetExportOptions(const ExportOptions &options) {
+    export_options_ = options;
+  }
+
+  // Switches the sampler to the adaptive mode.
+  void SetSamplingOptions(const SamplingOptions &options) {
+    sampler_ = Sampler(options);
+  }
+
   // Get the sampler.
   Sampler &sampler() { return sampler_; }
 
@@ -69,8 +99,16 @@ class Aggregator final {
   // The maximum number of traces that can be cached.
   int cache_max_size_;
 
-  // Traces protobuf to hold a list of Trace obejcts.
-  std::unique_ptr<google::devtools::cloudtrace::v1::Traces> traces_;
+  // The cached traces.
+  std::vector<std::shared_ptr<google::devtools::cloudtrace::v1::Trace>>
+      traces_;
+
+  // The serialized size of traces_ as a Traces proto when they were
+  // appended, only counted if max_batch_bytes is set.
+  size_t traces_bytes_;
+
+  // How traces are sent to Cloud Trace API.
+  ExportOptions export_options_;
 
   // The producer project id.
   std::string project_id_;
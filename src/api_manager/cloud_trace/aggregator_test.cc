@@ -0,0 +1,166 @@
+// Copyright (C) Extensible Service Proxy Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "src/api_manager/cloud_trace/aggregator.h"
+
+#include "google/devtools/cloudtrace/v1/trace.pb.h"
+#include "gtest/gtest.h"
+#include "src/api_manager/mock_api_manager_environment.h"
+#include "src/api_manager/utils/compression.h"
+
+using ::google::devtools::cloudtrace::v1::Trace;
+using ::google::devtools::cloudtrace::v1::Traces;
+using ::testing::_;
+using ::testing::HasSubstr;
+using ::testing::Invoke;
+using ::testing::NiceMock;
+
+namespace google {
+namespace api_manager {
+namespace cloud_trace {
+namespace {
+
+// A mock environment with debug logging disabled.
+class NoDebugEnvironment : public MockApiManagerEnvironment {
+ public:
+  bool IsLogLevelEnabled(LogLevel level) override { return level != DEBUG; }
+};
+
+struct SentRequest {
+  std::string body;
+  std::map<std::string, std::string> headers;
+};
+
+class AggregatorTest : public ::testing::Test {
+ public:
+  void SetUp() {
+    sa_token_ = std::unique_ptr<auth::ServiceAccountToken>(
+        new auth::ServiceAccountToken(&env_));
+    aggregator_.reset(new Aggregator(sa_token_.get(), "https://trace", 0,
+                                     1000, 0.1, &env_));
+    aggregator_->SetProjectId("project");
+
+    ON_CALL(env_, DoRunHTTPRequest(_))
+        .WillByDefault(Invoke([this](HTTPRequest *request) {
+          requests_.push_back({request->body(), request->request_headers()});
+        }));
+  }
+
+  std::shared_ptr<Trace> AppendTrace(const std::string &trace_id) {
+    auto trace = std::make_shared<Trace>();
+    trace->set_trace_id(trace_id);
+    trace->add_spans()->set_name(std::string(100, 'x'));
+    aggregator_->AppendTrace(trace);
+    return trace;
+  }
+
+  NiceMock<NoDebugEnvironment> env_;
+  std::unique_ptr<auth::ServiceAccountToken> sa_token_;
+  std::unique_ptr<Aggregator> aggregator_;
+  std::vector<SentRequest> requests_;
+};
+
+TEST_F(AggregatorTest, JsonExportByDefault) {
+  AppendTrace("trace-1");
+  aggregator_->SendAndClearTraces();
+
+  ASSERT_EQ(1, requests_.size());
+  EXPECT_EQ("application/json", requests_[0].headers["Content-Type"]);
+  EXPECT_EQ(0, requests_[0].headers.count("Content-Encoding"));
+  EXPECT_THAT(requests_[0].body, HasSubstr("\"traceId\":\"trace-1\""));
+}
+
+TEST_F(AggregatorTest, BinaryGzipExport) {
+  ExportOptions options;
+  options.binary = true;
+  options.gzip = true;
+  aggregator_->SetExportOptions(options);
+
+  // Debug logging is disabled, no JSON body is logged.
+  EXPECT_CALL(env_, Log(ApiManagerEnvInterface::DEBUG, _)).Times(0);
+
+  AppendTrace("trace-1");
+  AppendTrace("trace-2");
+  aggregator_->SendAndClearTraces();
+
+  ASSERT_EQ(1, requests_.size());
+  EXPECT_EQ("application/x-protobuf", requests_[0].headers["Content-Type"]);
+  EXPECT_EQ("gzip", requests_[0].headers["Content-Encoding"]);
+
+  std::string body;
+  ASSERT_TRUE(utils::GzipDecompress(requests_[0].body, &body));
+  Traces traces;
+  ASSERT_TRUE(traces.ParseFromString(body));
+  ASSERT_EQ(2, traces.traces_size());
+  EXPECT_EQ("trace-1", traces.traces(0).trace_id());
+  EXPECT_EQ("project", traces.traces(0).project_id());
+  EXPECT_EQ("trace-2", traces.traces(1).trace_id());
+}
+
+TEST_F(AggregatorTest, DropWithoutProjectId) {
+  AppendTrace("trace-1");
+  aggregator_->SetProjectId("");
+  aggregator_->SendAndClearTraces();
+  aggregator_->SetProjectId("project");
+  aggregator_->SendAndClearTraces();
+
+  EXPECT_EQ(0, requests_.size());
+}
+
+TEST_F(AggregatorTest, SerializeWhenSent) {
+  ExportOptions options;
+  options.binary = true;
+  aggregator_->SetExportOptions(options);
+
+  // A span ends after its trace is appended.
+  std::shared_ptr<Trace> trace = AppendTrace("trace-1");
+  trace->mutable_spans(0)->mutable_end_time()->set_seconds(10);
+  aggregator_->SendAndClearTraces();
+
+  ASSERT_EQ(1, requests_.size());
+  Traces traces;
+  ASSERT_TRUE(traces.ParseFromString(requests_[0].body));
+  ASSERT_EQ(1, traces.traces_size());
+  EXPECT_EQ(10, traces.traces(0).spans(0).end_time().seconds());
+}
+
+TEST_F(AggregatorTest, BatchBySize) {
+  ExportOptions options;
+  options.binary = true;
+  options.max_batch_bytes = 400;
+  aggregator_->SetExportOptions(options);
+
+  for (int i = 0; i < 7; ++i) {
+    AppendTrace("trace-" + std::to_string(i));
+  }
+  aggregator_->SendAndClearTraces();
+
+  // Each trace takes 124 bytes in a batch, 3 of them fit in a batch.
+  ASSERT_EQ(3, requests_.size());
+  int total = 0;
+  for (const auto &request : requests_) {
+    EXPECT_LE(request.body.size(), options.max_batch_bytes);
+    Traces traces;
+    ASSERT_TRUE(traces.ParseFromString(request.body));
+    total += traces.traces_size();
+  }
+  EXPECT_EQ(7, total);
+}
+
+}  // namespace
+}  // namespace cloud_trace
+}  // namespace api_manager
+}  // namespace google
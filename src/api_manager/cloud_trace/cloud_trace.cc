@@ -18,6 +18,7 @@
 
 #include <cctype>
 #include <chrono>
+#include <cstdio>
 #include <iomanip>
 #include <random>
 #include <sstream>
@@ -44,6 +45,8 @@ const char kCloudTraceAgentKey[] = "trace.cloud.google.com/agent";
 const char kServiceAgentPrefix[] = "esp/";
 // Default trace options
 const char kDefaultTraceOptions[] = "o=1";
+// The label of traces sampled by the sampler tail rules.
+const char kTailSampledKey[] = "esp/tail_sampled";
 
 // gRPC trace context constants
 constexpr size_t kTraceIdFieldIdPos = 1;
@@ -60,14 +63,10 @@ std::string RandomUInt128HexString();
 // Get the timestamp for now.
 void GetNow(Timestamp *ts);
 
-// Get a new Trace object stored in the trace parameter. The new object has
-// the given trace id and contains a root span with default settings.
-void GetNewTrace(std::string trace_id_str, const std::string &root_span_name,
-                 Trace **trace);
-
 // Parse the cloud trace context header.
-// Assigns Trace object to the trace pointer if context is parsed correctly and
-// trace is enabled. Otherwise the pointer is not modified.
+// Returns true if context is parsed correctly and trace is enabled, the trace
+// id and the parent span id are assigned then, the parent span id is 0 if not
+// provided. Otherwise returns false.
 // If trace is enabled, the option will be modified to the one passed in.
 //
 // Grammar of the context header:
@@ -76,24 +75,51 @@ void GetNewTrace(std::string trace_id_str, const std::string &root_span_name,
 // trace-id      := hex representation of a 128 bit value
 // span-id       := decimal representation of a 64 bit value
 // trace-options := decimal representation of a 32 bit value
-void GetTraceFromCloudTraceContextHeader(const std::string &trace_context,
-                                         const std::string &root_span_name,
-                                         Trace **trace, std::string *options);
+bool ParseCloudTraceContextHeader(const std::string &trace_context,
+                                  std::string *trace_id,
+                                  uint64_t *parent_span_id,
+                                  std::string *options);
 
 // Parse the grpc trace context header.
-// Assigns Trace object to the trace pointer if context is parsed correctly and
-// trace is enabled. Otherwise the pointer is not modified.
-// If trace is enabled, the option will be modified to the one passed in.
-void GetTraceFromGRpcTraceContextHeader(const std::string &raw_trace_context,
-                                        const std::string &root_span_name,
-                                        Trace **trace, std::string *options);
+// The same as ParseCloudTraceContextHeader for the grpc trace context header.
+bool ParseGRpcTraceContextHeader(const std::string &raw_trace_context,
+                                 std::string *trace_id,
+                                 uint64_t *parent_span_id,
+                                 std::string *options);
+
+// Uses the inline block of a CloudTrace as the first arena block.
+::google::protobuf::ArenaOptions GetArenaOptions(char *initial_block,
+                                                 size_t initial_block_size) {
+  ::google::protobuf::ArenaOptions options;
+  options.initial_block = initial_block;
+  options.initial_block_size = initial_block_size;
+  return options;
+}
+
 }  // namespace
 
-CloudTrace::CloudTrace(Trace *trace, const std::string &options,
+CloudTrace::CloudTrace(const std::string &trace_id,
+                       const std::string &root_span_name,
+                       uint64_t parent_span_id, const std::string &options,
                        HeaderType header_type)
-    : trace_(trace), options_(options), header_type_(header_type) {
-  // Root span must exist and must be the only span as of now.
-  root_span_ = trace_->mutable_spans(0);
+    : arena_(GetArenaOptions(initial_block_, sizeof(initial_block_))),
+      trace_(::google::protobuf::Arena::CreateMessage<Trace>(&arena_)),
+      options_(options),
+      header_type_(header_type) {
+  trace_->set_trace_id(trace_id);
+  root_span_ = trace_->add_spans();
+  root_span_->set_kind(TraceSpan_SpanKind::TraceSpan_SpanKind_RPC_SERVER);
+  root_span_->set_span_id(RandomUInt64());
+  root_span_->set_name(root_span_name);
+  // Set parent of root span to the given one if provided.
+  if (parent_span_id != 0) {
+    root_span_->set_parent_span_id(parent_span_id);
+  }
+  // Agent label is defined as "<agent>/<version>".
+  root_span_->mutable_labels()->insert(
+      {kCloudTraceAgentKey,
+       kServiceAgentPrefix + utils::Version::instance().get()});
+  GetNow(root_span_->mutable_start_time());
 }
 
 void CloudTrace::SetProjectId(const std::string &project_id) {
@@ -133,13 +159,13 @@ std::string CloudTrace::ToTraceContextHeader(uint64_t span_id) const {
 
 CloudTraceSpan::CloudTraceSpan(CloudTrace *cloud_trace,
                                const std::string &span_name)
-    : cloud_trace_(cloud_trace) {
+    : cloud_trace_(cloud_trace->shared_from_this()), message_count_(0) {
   InitWithParentSpanId(span_name, cloud_trace_->root_span()->span_id());
 }
 
 CloudTraceSpan::CloudTraceSpan(CloudTraceSpan *parent,
                                const std::string &span_name)
-    : cloud_trace_(parent->cloud_trace_) {
+    : cloud_trace_(parent->cloud_trace_), message_count_(0) {
   InitWithParentSpanId(span_name, parent->trace_span_->span_id());
 }
 
@@ -169,12 +195,6 @@ CloudTraceSpan::~CloudTraceSpan() {
     return;
   }
   GetNow(trace_span_->mutable_end_time());
-  for (unsigned int i = 0; i < messages_.size(); ++i) {
-    std::stringstream stream;
-    stream << std::setfill('0') << std::setw(3) << i;
-    std::string sequence = stream.str();
-    trace_span_->mutable_labels()->insert({sequence, messages_[i]});
-  }
 }
 
 void CloudTraceSpan::Write(const std::string &msg) {
@@ -182,55 +202,61 @@ void CloudTraceSpan::Write(const std::string &msg) {
     // Trace is disabled.
     return;
   }
-  messages_.push_back(msg);
+  // Messages are labeled by their zero padded sequence number, and written
+  // right away to the span in the trace arena.
+  char sequence[16];
+  snprintf(sequence, sizeof(sequence), "%03d", message_count_++);
+  (*trace_span_->mutable_labels())[sequence] = msg;
 }
 
 CloudTrace *CreateCloudTrace(const std::string &trace_context,
                              const std::string &root_span_name,
                              HeaderType header_type, Sampler *sampler) {
-  Trace *trace = nullptr;
+  std::string trace_id;
+  uint64_t parent_span_id = 0;
   std::string options;
+  bool enabled = false;
   switch (header_type) {
     case HeaderType::CLOUD_TRACE_CONTEXT:
-      GetTraceFromCloudTraceContextHeader(trace_context, root_span_name, &trace,
-                                          &options);
+      enabled = ParseCloudTraceContextHeader(trace_context, &trace_id,
+                                             &parent_span_id, &options);
       break;
     case HeaderType::GRPC_TRACE_CONTEXT:
-      GetTraceFromGRpcTraceContextHeader(trace_context, root_span_name, &trace,
-                                         &options);
+      enabled = ParseGRpcTraceContextHeader(trace_context, &trace_id,
+                                            &parent_span_id, &options);
       break;
   }
-  if (trace) {
+  if (enabled) {
     // When trace is triggered by the context header, refresh the previous
     // timestamp in sampler.
     if (sampler) {
       sampler->Refresh();
     }
-    return new CloudTrace(trace, options, header_type);
+    return new CloudTrace(trace_id, root_span_name, parent_span_id, options,
+                          header_type);
   } else if (sampler && sampler->On()) {
     // Trace is turned on by sampler.
-    GetNewTrace(RandomUInt128HexString(), root_span_name, &trace);
-    return new CloudTrace(trace, kDefaultTraceOptions, header_type);
+    return new CloudTrace(RandomUInt128HexString(), root_span_name, 0,
+                          kDefaultTraceOptions, header_type);
   } else {
     return nullptr;
   }
 }
 
-CloudTraceSpan *CreateSpan(CloudTrace *cloud_trace, const std::string &name) {
-  if (cloud_trace != nullptr) {
-    return new CloudTraceSpan(cloud_trace, name);
-  } else {
-    return nullptr;
-  }
-}
-
-CloudTraceSpan *CreateChildSpan(CloudTraceSpan *parent,
-                                const std::string &name) {
-  if (parent != nullptr) {
-    return new CloudTraceSpan(parent, name);
-  } else {
-    return nullptr;
-  }
+CloudTrace *CreateTailCloudTrace(
+    const std::string &root_span_name,
+    std::chrono::system_clock::time_point start_time) {
+  CloudTrace *cloud_trace =
+      new CloudTrace(RandomUInt128HexString(), root_span_name, 0,
+                     kDefaultTraceOptions, HeaderType::CLOUD_TRACE_CONTEXT);
+  TraceSpan *root_span = cloud_trace->root_span();
+  long long nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        start_time.time_since_epoch())
+                        .count();
+  root_span->mutable_start_time()->set_seconds(nanos / 1000000000);
+  root_span->mutable_start_time()->set_nanos(nanos % 1000000000);
+  root_span->mutable_labels()->insert({kTailSampledKey, "true"});
+  return cloud_trace;
 }
 
 TraceStream::~TraceStream() { trace_span_->Write(info_.str()); }
@@ -270,46 +296,32 @@ void GetNow(Timestamp *ts) {
   ts->set_nanos(nanos % 1000000000);
 }
 
-void GetNewTrace(std::string trace_id_str, const std::string &root_span_name,
-                 Trace **trace) {
-  *trace = new Trace;
-  (*trace)->set_trace_id(trace_id_str);
-  TraceSpan *root_span = (*trace)->add_spans();
-  root_span->set_kind(TraceSpan_SpanKind::TraceSpan_SpanKind_RPC_SERVER);
-  root_span->set_span_id(RandomUInt64());
-  root_span->set_name(root_span_name);
-  // Agent label is defined as "<agent>/<version>".
-  root_span->mutable_labels()->insert(
-      {kCloudTraceAgentKey,
-       kServiceAgentPrefix + utils::Version::instance().get()});
-  GetNow(root_span->mutable_start_time());
-}
-
-void GetTraceFromGRpcTraceContextHeader(const std::string &raw_trace_context,
-                                        const std::string &root_span_name,
-                                        Trace **trace, std::string *options) {
+bool ParseGRpcTraceContextHeader(const std::string &raw_trace_context,
+                                 std::string *trace_id,
+                                 uint64_t *parent_span_id,
+                                 std::string *options) {
   std::string trace_context;
   // Grpc binary headers are base64 encoded, decode the header before parsing
   // it.
   if (!absl::Base64Unescape(raw_trace_context, &trace_context)) {
     // Not a valid base64 encoded string.
-    return;
+    return false;
   }
   if (trace_context.length() != kGrpcTraceBinLen || trace_context[0] != 0) {
     // Size or version unknown.
-    return;
+    return false;
   }
 
   if (trace_context[kTraceIdFieldIdPos] != 0 ||
       trace_context[kSpanIdFieldIdPos] != 1 ||
       trace_context[kTraceOptionsFieldIdPos] != 2) {
     // Field ids are not in the right positions.
-    return;
+    return false;
   }
 
   if (!(trace_context[kTraceOptionsFieldIdPos + 1] & 1)) {
     // Trace is not enabled
-    return;
+    return false;
   }
 
   *options = kDefaultTraceOptions;
@@ -326,30 +338,28 @@ void GetTraceFromGRpcTraceContextHeader(const std::string &raw_trace_context,
   }
   if (!valid_trace_id) {
     // Invalid trace id
-    return;
+    return false;
   }
 
   uint64_t span_id =
       absl::big_endian::Load64(trace_context.data() + kSpanIdFieldIdPos + 1);
 
   // At this point, trace is enabled and trace id is successfully parsed.
-  GetNewTrace(absl::BytesToHexString(trace_id_str), root_span_name, trace);
-  TraceSpan *root_span = (*trace)->mutable_spans(0);
-  // Set parent of root span to the given one if provided.
-  if (span_id != 0) {
-    root_span->set_parent_span_id(span_id);
-  }
+  *trace_id = absl::BytesToHexString(trace_id_str);
+  *parent_span_id = span_id;
+  return true;
 }
 
-void GetTraceFromCloudTraceContextHeader(const std::string &trace_context,
-                                         const std::string &root_span_name,
-                                         Trace **trace, std::string *options) {
+bool ParseCloudTraceContextHeader(const std::string &trace_context,
+                                  std::string *trace_id,
+                                  uint64_t *parent_span_id,
+                                  std::string *options) {
   std::stringstream header_stream(trace_context);
 
   std::string trace_and_span_id;
   if (!getline(header_stream, trace_and_span_id, ';')) {
     // When trace_context is empty;
-    return;
+    return false;
   }
 
   bool trace_enabled = false;
@@ -359,16 +369,16 @@ void GetTraceFromCloudTraceContextHeader(const std::string &trace_context,
       int value;
       std::stringstream option_stream(item.substr(2));
       if ((option_stream >> value).fail() || !option_stream.eof()) {
-        return;
+        return false;
       }
       if (value < 0 || value > 0b11) {
         // invalid option value.
-        return;
+        return false;
       }
       *options = trace_context.substr(trace_context.find_first_of(';') + 1);
       // First bit indicates whether trace is enabled.
       if (!(value & 1)) {
-        return;
+        return false;
       }
       // Trace is enabled, we can stop parsing the header.
       trace_enabled = true;
@@ -376,7 +386,7 @@ void GetTraceFromCloudTraceContextHeader(const std::string &trace_context,
     }
   }
   if (!trace_enabled) {
-    return;
+    return false;
   }
 
   // Parse trace_id/span_id
@@ -391,11 +401,11 @@ void GetTraceFromCloudTraceContextHeader(const std::string &trace_context,
 
   // Trace id should be a 128-bit hex number (32 hex digits).
   if (trace_id_str.size() != 32) {
-    return;
+    return false;
   }
   for (size_t i = 0; i < trace_id_str.size(); ++i) {
     if (!isxdigit(trace_id_str[i])) {
-      return;
+      return false;
     }
   }
 
@@ -404,17 +414,14 @@ void GetTraceFromCloudTraceContextHeader(const std::string &trace_context,
   if (!span_id_str.empty()) {
     std::stringstream span_id_stream(span_id_str);
     if ((span_id_stream >> span_id).fail() || !span_id_stream.eof()) {
-      return;
+      return false;
     }
   }
 
   // At this point, trace is enabled and trace id is successfully parsed.
-  GetNewTrace(trace_id_str, root_span_name, trace);
-  TraceSpan *root_span = (*trace)->mutable_spans(0);
-  // Set parent of root span to the given one if provided.
-  if (span_id != 0) {
-    root_span->set_parent_span_id(span_id);
-  }
+  *trace_id = trace_id_str;
+  *parent_span_id = span_id;
+  return true;
 }
 
 }  // namespace
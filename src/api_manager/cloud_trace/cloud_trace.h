@@ -16,10 +16,13 @@
 #ifndef API_MANAGER_CLOUD_TRACE_CLOUD_TRACE_H_
 #define API_MANAGER_CLOUD_TRACE_CLOUD_TRACE_H_
 
+#include <chrono>
+#include <memory>
 #include <sstream>
 #include <vector>
 
 #include "google/devtools/cloudtrace/v1/trace.pb.h"
+#include "google/protobuf/arena.h"
 #include "google/protobuf/map.h"
 #include "src/api_manager/cloud_trace/aggregator.h"
 #include "src/api_manager/cloud_trace/sampler.h"
@@ -39,12 +42,16 @@ enum HeaderType {
 // ESP_ROOT that will be a parent span of all other trace spans. Start time
 // of this root span is recorded in constructor and end time is recorded when
 // EndRootSpan is called.
-class CloudTrace final {
+// The Trace proto, its spans and labels are allocated in a per request arena
+// whose first block is part of this object. The object must be owned by a
+// shared_ptr: the spans and the aggregator share it to keep the arena alive.
+class CloudTrace final : public std::enable_shared_from_this<CloudTrace> {
  public:
-  // Construct with give Trace proto object. This constructor must only be
-  // called with non-null pointer.
-  CloudTrace(google::devtools::cloudtrace::v1::Trace *trace,
-             const std::string &options, HeaderType header);
+  // Constructs with a new Trace proto with the trace id. The root span is a
+  // child of parent_span_id if it is not 0.
+  CloudTrace(const std::string &trace_id, const std::string &root_span_name,
+             uint64_t parent_span_id, const std::string &options,
+             HeaderType header);
 
   void SetProjectId(const std::string &project_id);
 
@@ -54,11 +61,12 @@ class CloudTrace final {
     return root_span_;
   }
 
-  google::devtools::cloudtrace::v1::Trace *trace() { return trace_.get(); }
+  google::devtools::cloudtrace::v1::Trace *trace() { return trace_; }
 
-  // Releases ownership of all traces and returns it.
-  google::devtools::cloudtrace::v1::Trace *ReleaseTrace() {
-    return trace_.release();
+  // Returns the trace, sharing the ownership of this object.
+  std::shared_ptr<google::devtools::cloudtrace::v1::Trace> shared_trace() {
+    return std::shared_ptr<google::devtools::cloudtrace::v1::Trace>(
+        shared_from_this(), trace_);
   }
 
   const std::string &options() const { return options_; }
@@ -68,7 +76,10 @@ class CloudTrace final {
   std::string ToTraceContextHeader(uint64_t span_id) const;
 
  private:
-  std::unique_ptr<google::devtools::cloudtrace::v1::Trace> trace_;
+  // Most traces fit in the first arena block.
+  char initial_block_[2048];
+  google::protobuf::Arena arena_;
+  google::devtools::cloudtrace::v1::Trace *trace_;
   google::devtools::cloudtrace::v1::TraceSpan *root_span_;
   std::string options_;
   std::string original_trace_context_;
@@ -79,15 +90,16 @@ class CloudTrace final {
 // multiple trace spans for one request. Typically an instance of this class is
 // initialized at the beginning of a function that needs to be traced.
 //
-// When an instance of CloudTraceSpan is destructed, its messages are written
-// to the corresponding CloudTrace.
+// Messages are written right away to the span in the CloudTrace arena. A
+// span shares the ownership of its CloudTrace, as it may be captured by
+// callbacks that run after the request is done.
 //
 // Start time and end time of the trace span is recorded in constructor and
 // destructor.
 //
 // Example of initializing a trace span:
-// std::shared_ptr<CloudTraceSpan> trace_span(GetTraceSpan(cloud_trace,
-//                                                         "MyFunc"));
+// std::shared_ptr<CloudTraceSpan> trace_span =
+//     CreateSpan(cloud_trace, "MyFunc");
 //
 class CloudTraceSpan {
  public:
@@ -108,9 +120,9 @@ class CloudTraceSpan {
   void Write(const std::string &msg);
   void InitWithParentSpanId(const std::string &span_name,
                             protobuf::uint64 parent_span_id);
-  CloudTrace *cloud_trace_;
+  std::shared_ptr<CloudTrace> cloud_trace_;
   google::devtools::cloudtrace::v1::TraceSpan *trace_span_;
-  std::vector<std::string> messages_;
+  int message_count_;
 };
 
 // Parses the trace_context and determines if cloud trace should
@@ -122,20 +134,44 @@ CloudTrace *CreateCloudTrace(const std::string &trace_context,
                              HeaderType header_type,
                              Sampler *sampler = nullptr);
 
+// Creates an initialized CloudTrace object for a request which is done,
+// after the sampler decided to trace it by its tail rules. The root span
+// starts at the request start time.
+CloudTrace *CreateTailCloudTrace(
+    const std::string &root_span_name,
+    std::chrono::system_clock::time_point start_time);
+
 // Creates trace span if trace is enabled.
-// Returns nullptr when cloud_trace is nullptr.
-CloudTraceSpan *CreateSpan(CloudTrace *cloud_trace, const std::string &name);
+// Returns an empty pointer when cloud_trace is nullptr, which neither
+// allocates nor builds the name.
+inline std::shared_ptr<CloudTraceSpan> CreateSpan(CloudTrace *cloud_trace,
+                                                  const char *name) {
+  if (cloud_trace == nullptr) {
+    return std::shared_ptr<CloudTraceSpan>();
+  }
+  return std::make_shared<CloudTraceSpan>(cloud_trace, name);
+}
+
+inline std::shared_ptr<CloudTraceSpan> CreateSpan(CloudTrace *cloud_trace,
+                                                  const std::string &name) {
+  return CreateSpan(cloud_trace, name.c_str());
+}
 
 // Creates a child trace span with the given parent span.
-// Returns nullptr if parent is nullptr.
-CloudTraceSpan *CreateChildSpan(CloudTraceSpan *parent,
-                                const std::string &name);
+// Returns an empty pointer if parent is nullptr.
+inline std::shared_ptr<CloudTraceSpan> CreateChildSpan(CloudTraceSpan *parent,
+                                                       const char *name) {
+  if (parent == nullptr) {
+    return std::shared_ptr<CloudTraceSpan>();
+  }
+  return std::make_shared<CloudTraceSpan>(parent, name);
+}
 
 // A helper class to create a stream-like write traces interface.
 //
 class TraceStream {
  public:
-  TraceStream(std::shared_ptr<CloudTraceSpan> trace_span)
+  TraceStream(const std::shared_ptr<CloudTraceSpan> &trace_span)
       : trace_span_(trace_span.get()){};
 
   ~TraceStream();
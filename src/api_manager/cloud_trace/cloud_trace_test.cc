@@ -21,6 +21,7 @@
 #include "gtest/gtest.h"
 #include "src/api_manager/mock_api_manager_environment.h"
 
+using google::devtools::cloudtrace::v1::Trace;
 using google::devtools::cloudtrace::v1::TraceSpan;
 
 namespace google {
@@ -47,7 +48,7 @@ class CloudTraceTest : public ::testing::Test {
 };
 
 TEST_F(CloudTraceTest, TestCloudTraceWithCloudHeader) {
-  std::unique_ptr<CloudTrace> cloud_trace(
+  std::shared_ptr<CloudTrace> cloud_trace(
       CreateCloudTrace("e133eacd437d8a12068fd902af3962d8;o=1", "root-span",
                        HeaderType::CLOUD_TRACE_CONTEXT));
   ASSERT_TRUE(cloud_trace);
@@ -81,6 +82,25 @@ TEST_F(CloudTraceTest, TestCloudTraceWithCloudHeader) {
   ASSERT_NE(cloud_trace->trace()->spans(0).end_time().DebugString(), "");
 }
 
+TEST_F(CloudTraceTest, TestCloudTraceSpanOutlivesRequest) {
+  std::shared_ptr<CloudTrace> cloud_trace(
+      CreateCloudTrace("e133eacd437d8a12068fd902af3962d8;o=1", "root-span",
+                       HeaderType::CLOUD_TRACE_CONTEXT));
+  ASSERT_TRUE(cloud_trace);
+  std::shared_ptr<CloudTraceSpan> cloud_trace_span(
+      CreateSpan(cloud_trace.get(), "Span"));
+  std::shared_ptr<Trace> trace = cloud_trace->shared_trace();
+
+  // The request is done, a callback still holds the span.
+  cloud_trace.reset();
+  TRACE(cloud_trace_span) << "Message";
+  cloud_trace_span.reset();
+
+  ASSERT_EQ(trace->spans_size(), 2);
+  ASSERT_EQ(trace->spans(1).labels().find("000")->second, "Message");
+  ASSERT_NE(trace->spans(1).end_time().DebugString(), "");
+}
+
 TEST_F(CloudTraceTest, TestCloudTraceSpanDisabled) {
   std::shared_ptr<CloudTraceSpan> cloud_trace_span(CreateSpan(nullptr, "Span"));
   // Ensure no core dump calling TRACE when cloud_trace_span is nullptr.
@@ -88,6 +108,23 @@ TEST_F(CloudTraceTest, TestCloudTraceSpanDisabled) {
   ASSERT_FALSE(cloud_trace_span);
 }
 
+TEST_F(CloudTraceTest, TestTailCloudTrace) {
+  auto start_time = std::chrono::system_clock::now() - std::chrono::seconds(2);
+  std::shared_ptr<CloudTrace> cloud_trace(
+      CreateTailCloudTrace("root-span", start_time));
+  ASSERT_TRUE(cloud_trace);
+
+  ASSERT_EQ(cloud_trace->trace()->spans_size(), 1);
+  const TraceSpan &root_span = cloud_trace->trace()->spans(0);
+  ASSERT_EQ(root_span.name(), "root-span");
+  ASSERT_EQ(root_span.start_time().seconds(),
+            std::chrono::duration_cast<std::chrono::seconds>(
+                start_time.time_since_epoch())
+                .count());
+  ASSERT_EQ(root_span.labels().find("esp/tail_sampled")->second, "true");
+  ASSERT_EQ(cloud_trace->options(), "o=1");
+}
+
 TEST_F(CloudTraceTest, TestParseCloudTraceContextHeader) {
   // Disabled if empty.
   ASSERT_EQ(nullptr, CreateCloudTrace("", "", HeaderType::CLOUD_TRACE_CONTEXT));
@@ -168,7 +205,7 @@ TEST_F(CloudTraceTest, TestParseCloudTraceContextHeader) {
                 "e133eacd437d8a12068fd902af3962d8/18446744073709551616;o=1", "",
                 HeaderType::CLOUD_TRACE_CONTEXT));
 
-  std::unique_ptr<CloudTrace> cloud_trace;
+  std::shared_ptr<CloudTrace> cloud_trace;
 
   // parent trace id should be 0(default) if span id is not provided.
   cloud_trace.reset(CreateCloudTrace("e133eacd437d8a12068fd902af3962d8;o=1", "",
@@ -232,7 +269,7 @@ TEST_F(CloudTraceTest, TestParseCloudTraceContextHeader) {
 }
 
 TEST_F(CloudTraceTest, TestFormatCloudTraceContextHeader) {
-  std::unique_ptr<CloudTrace> cloud_trace(
+  std::shared_ptr<CloudTrace> cloud_trace(
       CreateCloudTrace("e133eacd437d8a12068fd902af3962d8/12345;o=1", "",
                        HeaderType::CLOUD_TRACE_CONTEXT));
   ASSERT_EQ(cloud_trace->ToTraceContextHeader(12345),
@@ -244,7 +281,7 @@ TEST_F(CloudTraceTest, TestFormatCloudTraceContextHeader) {
 }
 
 TEST_F(CloudTraceTest, TestParseGrpcTraceContextHeader) {
-  std::unique_ptr<CloudTrace> cloud_trace;
+  std::shared_ptr<CloudTrace> cloud_trace;
   {
     // Trace options missing.
     constexpr char header[] = {
@@ -409,7 +446,7 @@ TEST_F(CloudTraceTest, TestFormatGrpcTraceContextHeader) {
       2,                                               // trace_options field
       1,                                               // options: enabled
   };
-  std::unique_ptr<CloudTrace> cloud_trace(
+  std::shared_ptr<CloudTrace> cloud_trace(
       CreateCloudTrace(Base64Escape(absl::string_view(header, sizeof(header))),
                        "root-span", HeaderType::GRPC_TRACE_CONTEXT));
   ASSERT_TRUE(cloud_trace);
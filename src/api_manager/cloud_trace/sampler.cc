@@ -16,11 +16,18 @@
 //
 #include "src/api_manager/cloud_trace/sampler.h"
 
+#include <algorithm>
+
 namespace google {
 namespace api_manager {
 namespace cloud_trace {
 
-Sampler::Sampler(double qps) {
+Sampler::Sampler(double qps)
+    : adaptive_(false),
+      has_tail_rules_(false),
+      rate_threshold_(0),
+      head_bucket_(0),
+      tail_bucket_(0) {
   if (qps == 0.0) {
     is_disabled_ = true;
   } else {
@@ -29,10 +36,33 @@ Sampler::Sampler(double qps) {
   }
 }
 
+Sampler::Sampler(const SamplingOptions &options)
+    : is_disabled_(false),
+      duration_(0),
+      adaptive_(true),
+      options_(options),
+      random_(std::random_device()()),
+      head_bucket_(options.max_qps),
+      tail_bucket_(options.tail_max_qps) {
+  has_tail_rules_ = options_.backend_latency_threshold_ms > 0 ||
+                    options_.overhead_latency_threshold_ms > 0 ||
+                    options_.sample_errors;
+
+  double rate = std::max(0.0, std::min(1.0, options_.rate));
+  rate_threshold_ = static_cast<uint64_t>(
+      rate * (static_cast<uint64_t>(random_.max() - random_.min()) + 1));
+}
+
 bool Sampler::On() {
   if (is_disabled_) {
     return false;
   }
+  if (adaptive_) {
+    // The clock is only read by the token bucket of sampled requests.
+    return static_cast<uint64_t>(random_() - random_.min()) <
+               rate_threshold_ &&
+           head_bucket_.Take();
+  }
   auto now = std::chrono::system_clock::now();
   std::chrono::duration<double> diff = now - previous_;
   if (diff.count() > duration_) {
@@ -44,12 +74,46 @@ bool Sampler::On() {
 };
 
 void Sampler::Refresh() {
-  if (is_disabled_) {
+  if (is_disabled_ || adaptive_) {
     return;
   }
   previous_ = std::chrono::system_clock::now();
 }
 
+bool Sampler::OnTail(int64_t backend_latency_ms, int64_t overhead_latency_ms,
+                     int response_code) {
+  if (!has_tail_rules_) {
+    return false;
+  }
+  bool matched =
+      (options_.backend_latency_threshold_ms > 0 &&
+       backend_latency_ms >= options_.backend_latency_threshold_ms) ||
+      (options_.overhead_latency_threshold_ms > 0 &&
+       overhead_latency_ms >= options_.overhead_latency_threshold_ms) ||
+      (options_.sample_errors && response_code >= 500);
+  return matched && tail_bucket_.Take();
+}
+
+Sampler::TokenBucket::TokenBucket(double rate)
+    : rate_(rate),
+      tokens_(std::max(1.0, rate)),
+      last_(std::chrono::steady_clock::now()) {}
+
+bool Sampler::TokenBucket::Take() {
+  if (rate_ <= 0) {
+    return true;
+  }
+  auto now = std::chrono::steady_clock::now();
+  std::chrono::duration<double> elapsed = now - last_;
+  last_ = now;
+  tokens_ = std::min(std::max(1.0, rate_), tokens_ + elapsed.count() * rate_);
+  if (tokens_ < 1.0) {
+    return false;
+  }
+  tokens_ -= 1.0;
+  return true;
+}
+
 }  // namespace cloud_trace
 }  // namespace api_manager
 }  // namespace google
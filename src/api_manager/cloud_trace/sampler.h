@@ -17,30 +17,100 @@
 #define API_MANAGER_CLOUD_TRACE_SAMPLER_H_
 
 #include <chrono>
+#include <cstdint>
+#include <random>
 
 namespace google {
 namespace api_manager {
 namespace cloud_trace {
 
+// Options of the adaptive sampling mode.
+struct SamplingOptions {
+  // The fraction of requests traced from their start, in [0, 1].
+  double rate = 0;
+
+  // The maximum number of requests per second traced by rate.
+  // If 0, there is no limit.
+  double max_qps = 0;
+
+  // Requests not traced from their start are traced when they are done if
+  // their backend or ESP overhead latency is at least the threshold.
+  // If 0, the rule is disabled.
+  int backend_latency_threshold_ms = 0;
+  int overhead_latency_threshold_ms = 0;
+
+  // Requests not traced from their start are traced when they are done if
+  // they fail with a 5xx response code.
+  bool sample_errors = false;
+
+  // The maximum number of requests per second traced by the above rules.
+  // If 0, there is no limit.
+  double tail_max_qps = 0;
+};
+
 // A helper class to determine if trace should be enabled for a request.
 // A Sampler instance is put into the Aggregator class.
-// Trace is triggered if the time interval between the request time and the
-// previous trace enabled request is bigger than a threshold.
-// The threshold is calculated from the qps.
+//
+// In the default time gap mode, trace is triggered if the time interval
+// between the request time and the previous trace enabled request is bigger
+// than a threshold. The threshold is calculated from the qps.
+//
+// In the adaptive mode, trace is triggered for a random fraction of requests
+// limited by a token bucket. Requests which are not traced from their start
+// can still be traced when they are done if they are slow or failed, in
+// which case their trace only has the root span.
 class Sampler {
  public:
+  // Creates a sampler in the time gap mode.
   Sampler(double qps);
 
+  // Creates a sampler in the adaptive mode.
+  Sampler(const SamplingOptions &options);
+
   // Returns whether trace should be turned on for this request.
   bool On();
 
   // Refresh the previous timestamp to the current time.
   void Refresh();
 
+  // Returns true if done requests may be traced by OnTail.
+  bool has_tail_rules() const { return has_tail_rules_; }
+
+  // Returns whether trace should be turned on for a done request which was
+  // not traced. Latencies are -1 if not available.
+  bool OnTail(int64_t backend_latency_ms, int64_t overhead_latency_ms,
+              int response_code);
+
  private:
+  // A token bucket refilled at a rate per second, holding up to one second
+  // of tokens. A rate of 0 means no limit.
+  class TokenBucket {
+   public:
+    TokenBucket(double rate);
+
+    // Takes a token if there is one.
+    bool Take();
+
+   private:
+    double rate_;
+    double tokens_;
+    std::chrono::steady_clock::time_point last_;
+  };
+
   bool is_disabled_;
   std::chrono::time_point<std::chrono::system_clock> previous_;
   double duration_;
+
+  bool adaptive_;
+  bool has_tail_rules_;
+  SamplingOptions options_;
+  // Cheap random numbers for the sampling rate. Samplers are per worker, the
+  // generator does not need to be thread safe.
+  std::minstd_rand random_;
+  // A request is sampled if random_() - random_.min() is below it.
+  uint64_t rate_threshold_;
+  TokenBucket head_bucket_;
+  TokenBucket tail_bucket_;
 };
 
 }  // namespace cloud_trace
@@ -62,6 +62,66 @@ TEST_F(SamplerTest, TestDisabled) {
   ASSERT_FALSE(sampler.On());
 }
 
+TEST_F(SamplerTest, TestAdaptiveRate) {
+  SamplingOptions options;
+  options.rate = 0.25;
+  Sampler sampler(options);
+
+  int sampled = 0;
+  for (int i = 0; i < 10000; ++i) {
+    if (sampler.On()) {
+      ++sampled;
+    }
+  }
+  ASSERT_GT(sampled, 2000);
+  ASSERT_LT(sampled, 3000);
+  ASSERT_FALSE(sampler.has_tail_rules());
+  ASSERT_FALSE(sampler.OnTail(10000, 10000, 500));
+}
+
+TEST_F(SamplerTest, TestAdaptiveMaxQps) {
+  SamplingOptions options;
+  options.rate = 1.0;
+  options.max_qps = 2.0;
+  Sampler sampler(options);
+
+  // The bucket starts with one second of tokens.
+  ASSERT_TRUE(sampler.On());
+  ASSERT_TRUE(sampler.On());
+  ASSERT_FALSE(sampler.On());
+  std::this_thread::sleep_for(std::chrono::milliseconds(600));
+  ASSERT_TRUE(sampler.On());
+  ASSERT_FALSE(sampler.On());
+}
+
+TEST_F(SamplerTest, TestAdaptiveTailRules) {
+  SamplingOptions options;
+  options.backend_latency_threshold_ms = 100;
+  options.overhead_latency_threshold_ms = 10;
+  options.sample_errors = true;
+  Sampler sampler(options);
+
+  // Rate is 0, no request is traced from its start.
+  ASSERT_FALSE(sampler.On());
+  ASSERT_TRUE(sampler.has_tail_rules());
+
+  ASSERT_FALSE(sampler.OnTail(99, 9, 200));
+  ASSERT_FALSE(sampler.OnTail(-1, -1, 404));
+  ASSERT_TRUE(sampler.OnTail(100, 0, 200));
+  ASSERT_TRUE(sampler.OnTail(0, 10, 200));
+  ASSERT_TRUE(sampler.OnTail(-1, -1, 503));
+}
+
+TEST_F(SamplerTest, TestAdaptiveTailMaxQps) {
+  SamplingOptions options;
+  options.sample_errors = true;
+  options.tail_max_qps = 1.0;
+  Sampler sampler(options);
+
+  ASSERT_TRUE(sampler.OnTail(-1, -1, 500));
+  ASSERT_FALSE(sampler.OnTail(-1, -1, 500));
+}
+
 }  // namespace
 
 }  // namespace cloud_trace
@@ -24,9 +24,11 @@
 #include <sstream>
 #include <string>
 
+#include "google/protobuf/io/coded_stream.h"
 #include "google/protobuf/io/tokenizer.h"
 #include "google/protobuf/io/zero_copy_stream_impl_lite.h"
 #include "google/protobuf/text_format.h"
+#include "utils/md5.h"
 
 using std::map;
 using std::string;
@@ -81,7 +83,42 @@ bool ReadConfigFromString(const std::string &service_config,
 
 }  // namespace
 
-Config::Config() {}
+std::shared_ptr<RoutingTable> RoutingTableCache::Find(const std::string &key) {
+  auto it = map_.find(key);
+  if (it == map_.end()) {
+    return nullptr;
+  }
+  auto table = it->second.lock();
+  if (!table) {
+    map_.erase(it);
+  }
+  return table;
+}
+
+void RoutingTableCache::Add(const std::string &key,
+                            std::shared_ptr<RoutingTable> table) {
+  // Drops the entries whose routing tables have been freed.
+  for (auto it = map_.begin(); it != map_.end();) {
+    if (it->second.expired()) {
+      it = map_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  map_[key] = table;
+}
+
+size_t RoutingTableCache::size() const {
+  size_t count = 0;
+  for (const auto &it : map_) {
+    if (!it.second.expired()) {
+      ++count;
+    }
+  }
+  return count;
+}
+
+Config::Config() : routing_table_(std::make_shared<RoutingTable>()) {}
 
 MethodInfoImpl *Config::GetOrCreateMethodInfoImpl(const string &name,
                                                   const string &api_name,
@@ -104,20 +141,21 @@ MethodInfoImpl *Config::GetOrCreateMethodInfoImpl(const string &name,
     path = path_builder.str();
   }
 
-  auto i = method_map_.find(selector);
-  if (i == std::end(method_map_)) {
+  auto i = routing_table_->method_map.find(selector);
+  if (i == std::end(routing_table_->method_map)) {
     auto info =
         MethodInfoImplPtr(new MethodInfoImpl(name, api_name, api_version));
     info->set_selector(selector);
     info->set_rpc_method_full_name(path);
-    i = method_map_.emplace(selector, std::move(info)).first;
+    i = routing_table_->method_map.emplace(selector, std::move(info)).first;
   }
   return i->second.get();
 }
 
 bool Config::LoadQuotaRule(ApiManagerEnvInterface *env) {
   for (const auto &rule : service_.quota().metric_rules()) {
-    auto method = utils::FindOrNull(method_map_, rule.selector());
+    auto method =
+        utils::FindOrNull(routing_table_->method_map, rule.selector());
     if (method) {
       for (auto &metric_cost : rule.metric_costs()) {
         (*method)->add_metric_cost(metric_cost.first, metric_cost.second);
@@ -235,7 +273,8 @@ bool Config::AddOptionsMethodForAllUrls(ApiManagerEnvInterface *env,
   string cors_selector_base = "CORS";
   string cors_selector = cors_selector_base;
   int n = 0;
-  while (method_map_.find(cors_selector) != method_map_.end()) {
+  while (routing_table_->method_map.find(cors_selector) !=
+         routing_table_->method_map.end()) {
     std::ostringstream suffix;
     suffix << ++n;
     cors_selector = cors_selector_base + "." + suffix.str();
@@ -285,11 +324,11 @@ bool Config::LoadRpcMethods(ApiManagerEnvInterface *env,
   return true;
 }
 
-bool Config::LoadAuthentication(ApiManagerEnvInterface *env) {
-  // Parsing auth config.
-  const ::google::api::Authentication &auth = service_.authentication();
-  map<string, const ::google::api::AuthProvider *> provider_id_provider_map;
-  for (const auto &provider : auth.providers()) {
+void Config::LoadAuthProviders(
+    ApiManagerEnvInterface *env,
+    map<string, const ::google::api::AuthProvider *>
+        *provider_id_provider_map) {
+  for (const auto &provider : service_.authentication().providers()) {
     if (provider.id().empty()) {
       env->LogError("Missing id field in AuthProvider.");
       continue;
@@ -304,11 +343,21 @@ bool Config::LoadAuthentication(ApiManagerEnvInterface *env) {
     } else {
       SetJwksUri(provider.issuer(), string(), true);
     }
-    provider_id_provider_map[provider.id()] = &provider;
+    if (provider_id_provider_map) {
+      (*provider_id_provider_map)[provider.id()] = &provider;
+    }
   }
+}
+
+bool Config::LoadAuthentication(ApiManagerEnvInterface *env) {
+  // Parsing auth config.
+  const ::google::api::Authentication &auth = service_.authentication();
+  map<string, const ::google::api::AuthProvider *> provider_id_provider_map;
+  LoadAuthProviders(env, &provider_id_provider_map);
 
   for (const auto &rule : auth.rules()) {
-    auto method = utils::FindOrNull(method_map_, rule.selector());
+    auto method =
+        utils::FindOrNull(routing_table_->method_map, rule.selector());
     if (method == nullptr) {
       std::string error = "Not HTTP rule defined for: " + rule.selector();
       env->LogError(error.c_str());
@@ -345,7 +394,8 @@ bool Config::LoadAuthentication(ApiManagerEnvInterface *env) {
 
 bool Config::LoadUsage(ApiManagerEnvInterface *env) {
   for (const auto &rule : service_.usage().rules()) {
-    auto method = utils::FindOrNull(method_map_, rule.selector());
+    auto method =
+        utils::FindOrNull(routing_table_->method_map, rule.selector());
     if (method) {
       (*method)->set_allow_unregistered_calls(rule.allow_unregistered_calls());
       (*method)->set_skip_service_control(rule.skip_service_control());
@@ -359,7 +409,8 @@ bool Config::LoadUsage(ApiManagerEnvInterface *env) {
 
 bool Config::LoadSystemParameters(ApiManagerEnvInterface *env) {
   for (auto &rule : service_.system_parameters().rules()) {
-    auto method = utils::FindOrNull(method_map_, rule.selector());
+    auto method =
+        utils::FindOrNull(routing_table_->method_map, rule.selector());
     if (method) {
       for (auto parameter : rule.parameters()) {
         if (parameter.name().empty()) {
@@ -385,7 +436,7 @@ bool Config::LoadSystemParameters(ApiManagerEnvInterface *env) {
   // For each method compile a set of system query parameter names.
   // PathMatcher uses this set to ignore system query parameters when building
   // variable bindings.
-  for (auto &m : method_map_) {
+  for (auto &m : routing_table_->method_map) {
     m.second->ProcessSystemQueryParameterNames();
   }
   return true;
@@ -393,12 +444,13 @@ bool Config::LoadSystemParameters(ApiManagerEnvInterface *env) {
 
 bool Config::LoadBackends(ApiManagerEnvInterface *env) {
   for (auto &rule : service_.backend().rules()) {
-    if (rule.address().empty()) {
+    if (rule.address().empty() && rule.deadline() <= 0) {
       continue;
     }
-    auto method = utils::FindOrNull(method_map_, rule.selector());
+    auto method =
+        utils::FindOrNull(routing_table_->method_map, rule.selector());
     if (method) {
-      if (!(*method)->backend_address().empty()) {
+      if (!rule.address().empty() && !(*method)->backend_address().empty()) {
         std::string error =
             "Duplicate a backend address for selector: " + rule.selector();
         env->LogError(error.c_str());
@@ -418,7 +470,8 @@ void Config::LoadTypes(ApiManagerEnvInterface *env) {
   for (const auto &type : service_.types()) {
     for (const auto &field : type.fields()) {
       if (field.name().find("_") != std::string::npos) {
-        snake_path_to_json_map_.emplace(field.name(), field.json_name());
+        routing_table_->snake_path_to_json_map.emplace(field.name(),
+                                                       field.json_name());
       }
     }
   }
@@ -471,53 +524,126 @@ std::unique_ptr<Config> Config::Create(ApiManagerEnvInterface *env,
 
 std::unique_ptr<Config> Config::Create(ApiManagerEnvInterface *env,
                                        const std::string &service_config) {
+  return Create(env, service_config, nullptr);
+}
+
+std::unique_ptr<Config> Config::Create(ApiManagerEnvInterface *env,
+                                       const std::string &service_config,
+                                       RoutingTableCache *cache) {
   std::unique_ptr<Config> config(new Config);
   if (!config->LoadService(env, service_config)) {
     return nullptr;
   }
+
+  std::string key;
+  if (cache) {
+    key = config->RoutingTableKey();
+    auto table = cache->Find(key);
+    if (table) {
+      env->LogDebug("Reuse the routing table of an identical service config");
+      config->routing_table_ = table;
+      // Issuer jwksUri map is not part of the routing table, it can be
+      // updated by OpenID discovery.
+      config->LoadAuthProviders(env, nullptr);
+      return config;
+    }
+  }
+
+  if (!config->LoadRoutingTable(env)) {
+    return nullptr;
+  }
+  if (cache) {
+    cache->Add(key, config->routing_table_);
+  }
+  return config;
+}
+
+bool Config::LoadRoutingTable(ApiManagerEnvInterface *env) {
   PathMatcherBuilder<MethodInfo *> pmb;
   // Load apis before http rules to store API versions
-  if (!config->LoadRpcMethods(env, &pmb)) {
-    return nullptr;
+  if (!LoadRpcMethods(env, &pmb)) {
+    return false;
   }
-  if (!config->LoadHttpMethods(env, &pmb)) {
-    return nullptr;
+  if (!LoadHttpMethods(env, &pmb)) {
+    return false;
   }
-  config->path_matcher_ = pmb.Build();
-  if (!config->LoadAuthentication(env)) {
-    return nullptr;
+  routing_table_->path_matcher = pmb.Build();
+  if (!LoadAuthentication(env)) {
+    return false;
   }
-  if (!config->LoadUsage(env)) {
-    return nullptr;
+  if (!LoadUsage(env)) {
+    return false;
   }
-  if (!config->LoadSystemParameters(env)) {
-    return nullptr;
+  if (!LoadSystemParameters(env)) {
+    return false;
   }
-  if (!config->LoadBackends(env)) {
-    return nullptr;
+  if (!LoadBackends(env)) {
+    return false;
   }
-  if (!config->LoadQuotaRule(env)) {
-    return nullptr;
+  if (!LoadQuotaRule(env)) {
+    return false;
   }
 
-  config->LoadTypes(env);
-  return config;
+  LoadTypes(env);
+  return true;
+}
+
+std::string Config::RoutingTableKey() const {
+  // Only the fields read by LoadRoutingTable().
+  ::google::api::Service routing;
+  routing.set_name(service_.name());
+  *routing.mutable_apis() = service_.apis();
+  *routing.mutable_types() = service_.types();
+  *routing.mutable_endpoints() = service_.endpoints();
+  if (service_.has_http()) {
+    *routing.mutable_http() = service_.http();
+  }
+  if (service_.has_authentication()) {
+    *routing.mutable_authentication() = service_.authentication();
+  }
+  if (service_.has_usage()) {
+    *routing.mutable_usage() = service_.usage();
+  }
+  if (service_.has_system_parameters()) {
+    *routing.mutable_system_parameters() = service_.system_parameters();
+  }
+  if (service_.has_backend()) {
+    *routing.mutable_backend() = service_.backend();
+  }
+  if (service_.has_quota()) {
+    *routing.mutable_quota() = service_.quota();
+  }
+
+  // Map fields, such as quota metric costs, need deterministic
+  // serialization to produce a stable key.
+  std::string serialized;
+  {
+    ::google::protobuf::io::StringOutputStream output(&serialized);
+    ::google::protobuf::io::CodedOutputStream coded(&output);
+    coded.SetSerializationDeterministic(true);
+    routing.SerializeToCodedStream(&coded);
+  }
+
+  google::service_control_client::MD5 hasher;
+  hasher.Update(serialized);
+  return hasher.Digest() + std::to_string(serialized.size());
 }
 
 const MethodInfo *Config::GetMethodInfo(const string &http_method,
                                         const string &url) const {
-  return path_matcher_ == nullptr ? nullptr
-                                  : path_matcher_->Lookup(http_method, url);
+  return routing_table_->path_matcher == nullptr
+             ? nullptr
+             : routing_table_->path_matcher->Lookup(http_method, url);
 }
 
 MethodCallInfo Config::GetMethodCallInfo(
     const std::string &http_method, const std::string &url,
     const std::string &query_params) const {
   MethodCallInfo call_info;
-  if (path_matcher_ == nullptr) {
+  if (routing_table_->path_matcher == nullptr) {
     call_info.method_info = nullptr;
   } else {
-    call_info.method_info = path_matcher_->Lookup(
+    call_info.method_info = routing_table_->path_matcher->Lookup(
         http_method, url, query_params, &call_info.variable_bindings,
         &call_info.body_field_path);
   }
@@ -589,8 +715,8 @@ std::string Config::GetFirebaseAudience() {
 
 bool Config::GetJsonName(const std::string &snake_name,
                          std::string *json_name) const {
-  auto it = snake_path_to_json_map_.find(snake_name);
-  if (it == snake_path_to_json_map_.end()) {
+  auto it = routing_table_->snake_path_to_json_map.find(snake_name);
+  if (it == routing_table_->snake_path_to_json_map.end()) {
     return false;
   }
   *json_name = it->second;
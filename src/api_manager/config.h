@@ -31,6 +31,36 @@
 namespace google {
 namespace api_manager {
 
+// The routing state built from a service config: the path matcher, the
+// method infos and the JSON name map. It is not changed once built, and it
+// is shared by all Config objects with the same routing related content.
+struct RoutingTable {
+  PathMatcherPtr<MethodInfo *> path_matcher;
+  std::map<std::string, MethodInfoImplPtr> method_map;
+  // snake case path to JSON name map.
+  // This is specifically for backend routing, where the path can be snake
+  // case, needs to translate to JSON name in order for redirecting.
+  std::map<std::string, std::string> snake_path_to_json_map;
+};
+
+// A cache of routing tables keyed by the hash of the routing related
+// content of a service config. Entries are held weakly, a routing table is
+// freed as soon as no Config uses it.
+class RoutingTableCache {
+ public:
+  // Returns the routing table for the key, nullptr if not found.
+  std::shared_ptr<RoutingTable> Find(const std::string &key);
+
+  // Adds a routing table for the key.
+  void Add(const std::string &key, std::shared_ptr<RoutingTable> table);
+
+  // Returns the number of cached routing tables still in use.
+  size_t size() const;
+
+ private:
+  std::map<std::string, std::weak_ptr<RoutingTable>> map_;
+};
+
 class Config {
  public:
   // Creates a configuration object from service config
@@ -41,6 +71,12 @@ class Config {
   // not server_config.
   static std::unique_ptr<Config> Create(ApiManagerEnvInterface *env,
                                         const std::string &service_config);
+  // Same as above, but reuses the routing table from the cache if another
+  // config with the same routing related content was loaded before.
+  // New routing tables are added to the cache.
+  static std::unique_ptr<Config> Create(ApiManagerEnvInterface *env,
+                                        const std::string &service_config,
+                                        RoutingTableCache *cache);
   // For unit test only
   static std::unique_ptr<Config> Create(ApiManagerEnvInterface *env,
                                         const std::string &service_config,
@@ -125,6 +161,19 @@ class Config {
   bool LoadRpcMethods(ApiManagerEnvInterface *env,
                       PathMatcherBuilder<MethodInfo *> *pmb);
 
+  // Builds the routing table from the service config.
+  bool LoadRoutingTable(ApiManagerEnvInterface *env);
+
+  // Returns the key of the routing table in RoutingTableCache: the hash of
+  // all service config fields used to build the routing table.
+  std::string RoutingTableKey() const;
+
+  // Load AuthProviders, sets jwksUri for their issuers.
+  void LoadAuthProviders(
+      ApiManagerEnvInterface *env,
+      std::map<std::string, const ::google::api::AuthProvider *>
+          *provider_id_provider_map);
+
   // Load Authentication info to MethodInfo.
   bool LoadAuthentication(ApiManagerEnvInterface *env);
 
@@ -149,19 +198,14 @@ class Config {
 
   ::google::api::Service service_;
   std::shared_ptr<proto::ServerConfig> server_config_;
-  PathMatcherPtr<MethodInfo *> path_matcher_;
-  std::map<std::string, MethodInfoImplPtr> method_map_;
+  // The routing table, may be shared with other Config objects.
+  std::shared_ptr<RoutingTable> routing_table_;
   // Maps issuer to {jwksUri, openIdValid} pair.
   // jwksUri is populated either from service config, or by openId discovery.
   // openIdValid means whether or not we need to try openId discovery to fetch
   // jwksUri for the issuer. It is set to true if jwksUri is not provided in
   // service config and we have not tried openId discovery to fetch jwksUri.
   std::map<std::string, std::pair<std::string, bool>> issuer_jwks_uri_map_;
-
-  // snake case path to JSON name map.
-  // This is specifically for backend routing, where the path can be snake case,
-  // needs to translate to JSON name in order for redirecting.
-  std::map<std::string, std::string> snake_path_to_json_map_;
 };
 
 }  // namespace api_manager
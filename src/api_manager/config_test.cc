@@ -555,6 +555,59 @@ TEST(Config, LoadEmptyBackends) {
   EXPECT_EQ(0, method_with_backend->backend_path_translation());
 }
 
+static const char backends_deadline_config[] =
+    "name: \"backends-deadline-config\"\n"
+    "backend {\n"
+    "  rules {\n"
+    "    selector: \"test.api.MethodWithDeadline\"\n"
+    "    deadline: 2.5\n"
+    "  }\n"
+    "  rules {\n"
+    "    selector: \"test.api.MethodWithBackendAndDeadline\"\n"
+    "    address: \"TestBackend:TestPort\"\n"
+    "    deadline: 10\n"
+    "  }\n"
+    "}\n"
+    "apis {\n"
+    "  name: \"test.api\"\n"
+    "  methods {\n"
+    "    name: \"MethodWithDeadline\"\n"
+    "  }\n"
+    "  methods {\n"
+    "    name: \"MethodWithBackendAndDeadline\"\n"
+    "  }\n"
+    "  methods {\n"
+    "    name: \"MethodWithoutBackend\"\n"
+    "  }\n"
+    "}\n";
+
+TEST(Config, LoadBackendDeadlines) {
+  MockApiManagerEnvironmentWithLog env;
+
+  std::unique_ptr<Config> config =
+      Config::Create(&env, backends_deadline_config, "");
+  ASSERT_TRUE(config);
+
+  // A rule without an address only sets the deadline.
+  const MethodInfo *method =
+      config->GetMethodInfo("POST", "/test.api/MethodWithDeadline");
+  ASSERT_NE(nullptr, method);
+  EXPECT_TRUE(method->backend_address().empty());
+  EXPECT_EQ(0, method->backend_path_translation());
+  EXPECT_EQ(2.5, method->backend_deadline());
+
+  method =
+      config->GetMethodInfo("POST", "/test.api/MethodWithBackendAndDeadline");
+  ASSERT_NE(nullptr, method);
+  EXPECT_EQ("TestBackend:TestPort", method->backend_address());
+  EXPECT_EQ(10, method->backend_deadline());
+
+  method = config->GetMethodInfo("POST", "/test.api/MethodWithoutBackend");
+  ASSERT_NE(nullptr, method);
+  EXPECT_TRUE(method->backend_address().empty());
+  EXPECT_EQ(0, method->backend_deadline());
+}
+
 static const char types_config[] =
     "name: \"types-config\"\n"
     "types {\n"
@@ -1233,6 +1286,49 @@ quota {
   ASSERT_EQ(200, metric_cost_vector[0].second);
 }
 
+TEST(Config, RoutingTableCache) {
+  ::testing::NiceMock<MockApiManagerEnvironment> env;
+  ::google::api::Service service;
+  service.set_name("service-name");
+  service.set_id("2017-05-01r0");
+  ::google::api::HttpRule *rule = service.mutable_http()->add_rules();
+  rule->set_get("/shelves");
+  rule->set_selector("ListShelves");
+
+  RoutingTableCache cache;
+  std::unique_ptr<Config> config1 =
+      Config::Create(&env, service.SerializeAsString(), &cache);
+  ASSERT_TRUE(config1);
+  EXPECT_EQ(1, cache.size());
+
+  // Only the config id is changed, the routing table is reused.
+  service.set_id("2017-05-01r1");
+  std::unique_ptr<Config> config2 =
+      Config::Create(&env, service.SerializeAsString(), &cache);
+  ASSERT_TRUE(config2);
+  EXPECT_EQ(1, cache.size());
+  EXPECT_EQ("2017-05-01r1", config2->service().id());
+  const MethodInfo *method1 = config1->GetMethodInfo("GET", "/shelves");
+  ASSERT_NE(nullptr, method1);
+  EXPECT_EQ(method1, config2->GetMethodInfo("GET", "/shelves"));
+
+  // A http rule is changed, a new routing table is built.
+  rule->set_get("/shelves/{shelf}");
+  std::unique_ptr<Config> config3 =
+      Config::Create(&env, service.SerializeAsString(), &cache);
+  ASSERT_TRUE(config3);
+  EXPECT_EQ(2, cache.size());
+  EXPECT_EQ(nullptr, config3->GetMethodInfo("GET", "/shelves"));
+  const MethodInfo *method3 = config3->GetMethodInfo("GET", "/shelves/1");
+  ASSERT_NE(nullptr, method3);
+  EXPECT_NE(method1, method3);
+
+  // Routing tables are freed with their last Config.
+  config1.reset();
+  config2.reset();
+  EXPECT_EQ(1, cache.size());
+}
+
 }  // namespace
 
 }  // namespace api_manager
@@ -139,6 +139,9 @@ GlobalContext::CreateCloudTraceAggregator() {
   int aggregate_time_millisec = kDefaultAggregateTimeMillisec;
   int cache_max_size = kDefaultTraceCacheMaxSize;
   double minimum_qps = kDefaultTraceSampleQps;
+  cloud_trace::ExportOptions export_options;
+  bool adaptive_sampling = false;
+  cloud_trace::SamplingOptions sampling_options;
   if (server_config_ && server_config_->has_cloud_tracing_config()) {
     // If url_override is set in server config, use it to query Cloud Trace.
     const auto& tracing_config = server_config_->cloud_tracing_config();
@@ -151,17 +154,41 @@ GlobalContext::CreateCloudTraceAggregator() {
       aggregate_time_millisec =
           tracing_config.aggregation_config().time_millisec();
       cache_max_size = tracing_config.aggregation_config().cache_max_size();
+      export_options.binary =
+          tracing_config.aggregation_config().binary_export();
+      export_options.gzip = tracing_config.aggregation_config().gzip();
+      export_options.max_batch_bytes =
+          tracing_config.aggregation_config().max_batch_bytes();
     }
 
     // If sampling config is set, take the values from it.
     if (tracing_config.has_samling_config()) {
-      minimum_qps = tracing_config.samling_config().minimum_qps();
+      const auto& sampling_config = tracing_config.samling_config();
+      minimum_qps = sampling_config.minimum_qps();
+      sampling_options.rate = sampling_config.rate();
+      sampling_options.max_qps = sampling_config.max_qps();
+      sampling_options.backend_latency_threshold_ms =
+          sampling_config.backend_latency_threshold_ms();
+      sampling_options.overhead_latency_threshold_ms =
+          sampling_config.overhead_latency_threshold_ms();
+      sampling_options.sample_errors = sampling_config.sample_errors();
+      sampling_options.tail_max_qps = sampling_config.tail_max_qps();
+      adaptive_sampling = sampling_options.rate > 0 ||
+                          sampling_options.backend_latency_threshold_ms > 0 ||
+                          sampling_options.overhead_latency_threshold_ms > 0 ||
+                          sampling_options.sample_errors;
     }
   }
 
-  return std::unique_ptr<cloud_trace::Aggregator>(new cloud_trace::Aggregator(
-      &service_account_token_, url, aggregate_time_millisec, cache_max_size,
-      minimum_qps, env_.get()));
+  std::unique_ptr<cloud_trace::Aggregator> aggregator(
+      new cloud_trace::Aggregator(&service_account_token_, url,
+                                  aggregate_time_millisec, cache_max_size,
+                                  minimum_qps, env_.get()));
+  aggregator->SetExportOptions(export_options);
+  if (adaptive_sampling) {
+    aggregator->SetSamplingOptions(sampling_options);
+  }
+  return aggregator;
 }
 
 auth::ServiceAccountToken* GlobalContext::GetInstanceIdentityToken(
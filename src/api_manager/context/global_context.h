@@ -21,6 +21,7 @@
 #include "src/api_manager/auth/service_account_token.h"
 #include "src/api_manager/cloud_trace/cloud_trace.h"
 #include "src/api_manager/compute_platform.h"
+#include "src/api_manager/config.h"
 #include "src/api_manager/proto/server_config.pb.h"
 
 namespace google {
@@ -102,6 +103,9 @@ class GlobalContext {
     return redirect_authorization_url_;
   }
 
+  // The routing tables shared by the service configs of the rollouts.
+  RoutingTableCache *routing_table_cache() { return &routing_table_cache_; }
+
   void set_rollout_id_func(SetRolloutIdFunc rollout_id_func) {
     rollout_id_func_ = rollout_id_func;
   }
@@ -160,6 +164,9 @@ class GlobalContext {
 
   // The function to set rollout id fetched from Check and Report response.
   SetRolloutIdFunc rollout_id_func_;
+
+  // Service configs with the same routing content share one routing table.
+  RoutingTableCache routing_table_cache_;
 };
 
 }  // namespace context
@@ -145,18 +145,41 @@ RequestContext::RequestContext(std::shared_ptr<ServiceContext> service_context,
       request_->FindHeader(kCloudTraceContextHeader, &trace_context_header);
     }
 
-    std::string method_name = kUnrecognizedOperation;
-    if (method_call_.method_info) {
-      method_name = method_call_.method_info->selector();
-    }
-    // qualify with the service name
-    method_name = service_context_->service_name() + "/" + method_name;
     cloud_trace_.reset(cloud_trace::CreateCloudTrace(
-        trace_context_header, method_name, header_type,
+        trace_context_header, GetTraceRootSpanName(), header_type,
         &service_context_->cloud_trace_aggregator()->sampler()));
   }
 }
 
+std::string RequestContext::GetTraceRootSpanName() {
+  std::string method_name = kUnrecognizedOperation;
+  if (method_call_.method_info) {
+    method_name = method_call_.method_info->selector();
+  }
+  // qualify with the service name
+  return service_context_->service_name() + "/" + method_name;
+}
+
+void RequestContext::MaybeStartTailCloudTrace(Response *response) {
+  auto aggregator = service_context_->cloud_trace_aggregator();
+  if (cloud_trace_ || !aggregator || !aggregator->sampler().has_tail_rules()) {
+    return;
+  }
+
+  // Latencies are not meaningful for streaming calls.
+  service_control::LatencyInfo latency;
+  if (!method() ||
+      (!method()->request_streaming() && !method()->response_streaming())) {
+    response->GetLatencyInfo(&latency);
+  }
+  if (aggregator->sampler().OnTail(latency.backend_time_ms,
+                                   latency.overhead_time_ms,
+                                   response->GetResponseStatus().HttpCode())) {
+    cloud_trace_.reset(
+        cloud_trace::CreateTailCloudTrace(GetTraceRootSpanName(), start_time_));
+  }
+}
+
 std::string RequestContext::GetRequestHTTPMethodWithOverride() {
   std::string method;
 
@@ -423,7 +446,7 @@ const std::string RequestContext::FindClientIPAddress() {
 }
 
 void RequestContext::StartBackendSpanAndSetTraceContext() {
-  backend_span_.reset(CreateSpan(cloud_trace_.get(), "Backend"));
+  backend_span_ = CreateSpan(cloud_trace_.get(), "Backend");
 
   // TODO: A better logic would be to send for GRPC backends the grpc-trace-bin
   // header, and for http/https backends the X-Cloud-Trace-Context header.
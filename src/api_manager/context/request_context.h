@@ -106,6 +106,10 @@ class RequestContext {
   // Marks the end of backend trace span.
   void EndBackendSpan() { backend_span_.reset(); }
 
+  // If the request is not traced, asks the sampler whether to trace it by
+  // its response and creates a CloudTrace with only the root span if so.
+  void MaybeStartTailCloudTrace(Response *response);
+
   // To indicate if the next report is the first_report or not.
   bool is_first_report() const { return is_first_report_; }
   void set_first_report(bool is_first_report) {
@@ -178,6 +182,10 @@ class RequestContext {
   // Extracts api-key
   void ExtractApiKey();
 
+  // Returns the trace root span name, the method selector qualified with the
+  // service name.
+  std::string GetTraceRootSpanName();
+
   // Find client IP address based on the
   // ServerConfig.client_ip_extraction_config. If it is not configured or
   // doesn't match, returns request_->GetClientIP()
@@ -222,7 +230,7 @@ class RequestContext {
   std::string auth_claims_;
 
   // Used by cloud tracing.
-  std::unique_ptr<cloud_trace::CloudTrace> cloud_trace_;
+  std::shared_ptr<cloud_trace::CloudTrace> cloud_trace_;
 
   // Backend trace span.
   std::shared_ptr<cloud_trace::CloudTraceSpan> backend_span_;
@@ -16,6 +16,7 @@
 //
 #include "src/api_manager/context/service_context.h"
 #include "src/api_manager/service_control/aggregated.h"
+#include "src/api_manager/utils/url_util.h"
 
 namespace google {
 namespace api_manager {
@@ -25,12 +26,27 @@ namespace {
 
 const char kHTTPHeadMethod[] = "HEAD";
 const char kHTTPGetMethod[] = "GET";
+
+// Returns the map of issuer to jwks_uri from the authentication providers.
+// Issuers are normalized the same way as in Config.
+std::map<std::string, std::string> GetIssuerJwksUriMap(
+    const ::google::api::Service& service) {
+  std::map<std::string, std::string> issuers;
+  for (const auto& provider : service.authentication().providers()) {
+    issuers[utils::GetUrlContent(provider.issuer())] = provider.jwks_uri();
+  }
+  return issuers;
+}
+
 }  // namespace
 
 ServiceContext::ServiceContext(std::shared_ptr<GlobalContext> global_context,
                                std::unique_ptr<Config> config)
     : global_context_(global_context),
       config_(std::move(config)),
+      certs_(std::make_shared<auth::Certs>()),
+      jwt_cache_(std::make_shared<auth::JwtCache>()),
+      authz_cache_(std::make_shared<auth::AuthzCache>()),
       service_control_(CreateInterface()) {
   config_->set_server_config(global_context_->server_config());
 }
@@ -67,6 +83,58 @@ const std::string& ServiceContext::project_id() const {
   }
 }
 
+void ServiceContext::InheritCaches(std::shared_ptr<ServiceContext> previous) {
+  if (previous == nullptr || previous.get() == this ||
+      previous->service_name() != service_name()) {
+    return;
+  }
+
+  // An issuer is unchanged if it has the same jwks_uri in both configs.
+  // Issuers removed from the new config are rejected by the method
+  // config before their cached entries are used.
+  auto old_issuers = GetIssuerJwksUriMap(previous->service());
+  auto new_issuers = GetIssuerJwksUriMap(service());
+  std::set<std::string> unchanged_issuers;
+  bool issuer_changed = false;
+  for (const auto& it : new_issuers) {
+    auto old_it = old_issuers.find(it.first);
+    if (old_it == old_issuers.end()) {
+      continue;
+    }
+    if (old_it->second != it.second) {
+      issuer_changed = true;
+      continue;
+    }
+    unchanged_issuers.insert(it.first);
+    // Carries over the jwks_uri found by OpenID discovery.
+    std::string jwks_uri;
+    if (it.second.empty() &&
+        !previous->config_->GetJwksUri(it.first, &jwks_uri) &&
+        !jwks_uri.empty()) {
+      config_->SetJwksUri(it.first, jwks_uri, false);
+    }
+  }
+
+  if (!issuer_changed) {
+    certs_ = previous->certs_;
+    jwt_cache_ = previous->jwt_cache_;
+  } else {
+    certs_->CopyFrom(*previous->certs_,
+                     [&unchanged_issuers](const std::string& issuer) {
+                       return unchanged_issuers.find(utils::GetUrlContent(
+                                  issuer)) != unchanged_issuers.end();
+                     });
+  }
+
+  // Authorization results only depend on the security rules server, which
+  // comes from the server config shared by all service configs.
+  authz_cache_ = previous->authz_cache_;
+
+  if (service_control_ && previous->service_control_) {
+    service_control_->InheritCacheFrom(previous->service_control_);
+  }
+}
+
 std::unique_ptr<service_control::Interface> ServiceContext::CreateInterface() {
   return std::unique_ptr<service_control::Interface>(
       service_control::Aggregated::Create(
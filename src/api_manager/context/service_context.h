@@ -67,10 +67,22 @@ class ServiceContext {
            !config_->GetFirebaseServer().empty();
   }
 
-  auth::Certs &certs() { return certs_; }
-  auth::JwtCache &jwt_cache() { return jwt_cache_; }
-
-  auth::AuthzCache &authz_cache() { return authz_cache_; }
+  auth::Certs &certs() { return *certs_; }
+  auth::JwtCache &jwt_cache() { return *jwt_cache_; }
+
+  auth::AuthzCache &authz_cache() { return *authz_cache_; }
+
+  // Inherits the cache state of the ServiceContext serving a previous config
+  // of the same service, so a new rollout starts with warm caches.
+  // Caches whose entries depend on changed config are not inherited:
+  // * certs are kept only for the issuers whose jwks_uri is unchanged,
+  // * jwt_cache is shared only if no issuer changed its jwks_uri,
+  // * service control check cache is used as the second level cache
+  //   only if the service control server and the config its check
+  //   responses depend on are unchanged.
+  // Only the previous service control object is kept for that, not the
+  // previous ServiceContext.
+  void InheritCaches(std::shared_ptr<ServiceContext> previous);
 
   bool GetJwksUri(const std::string &issuer, std::string *url) {
     return config_->GetJwksUri(issuer, url);
@@ -104,13 +116,16 @@ class ServiceContext {
   // The service config object.
   std::unique_ptr<Config> config_;
 
-  auth::Certs certs_;
-  auth::JwtCache jwt_cache_;
+  // The caches are shared with the ServiceContext of the next config
+  // if they are still valid for it.
+  std::shared_ptr<auth::Certs> certs_;
+  std::shared_ptr<auth::JwtCache> jwt_cache_;
 
-  auth::AuthzCache authz_cache_;
+  std::shared_ptr<auth::AuthzCache> authz_cache_;
 
-  // The service control object.
-  std::unique_ptr<service_control::Interface> service_control_;
+  // The service control object. It is shared with the service control
+  // object of the next config if that inherits its check cache.
+  std::shared_ptr<service_control::Interface> service_control_;
 };
 
 }  // namespace context
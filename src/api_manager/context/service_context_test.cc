@@ -0,0 +1,158 @@
+// Copyright (C) Extensible Service Proxy Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "src/api_manager/context/service_context.h"
+#include "src/api_manager/mock_api_manager_environment.h"
+
+namespace google {
+namespace api_manager {
+namespace context {
+namespace {
+
+const char kServiceConfig[] = R"(
+name: "bookstore.test.appspot.com"
+authentication {
+  providers {
+    id: "issuer1"
+    issuer: "https://issuer1.com"
+    jwks_uri: "https://issuer1.com/pubkey"
+  }
+  providers {
+    id: "issuer2"
+    issuer: "https://issuer2.com"
+    jwks_uri: "https://issuer2.com/pubkey"
+  }
+}
+)";
+
+// issuer1 has a new jwks_uri.
+const char kServiceConfigWithChangedIssuer[] = R"(
+name: "bookstore.test.appspot.com"
+authentication {
+  providers {
+    id: "issuer1"
+    issuer: "https://issuer1.com"
+    jwks_uri: "https://issuer1.com/newkey"
+  }
+  providers {
+    id: "issuer2"
+    issuer: "https://issuer2.com"
+    jwks_uri: "https://issuer2.com/pubkey"
+  }
+}
+)";
+
+const char kOtherServiceConfig[] = R"(
+name: "other.test.appspot.com"
+authentication {
+  providers {
+    id: "issuer1"
+    issuer: "https://issuer1.com"
+    jwks_uri: "https://issuer1.com/pubkey"
+  }
+}
+)";
+
+class ServiceContextTest : public ::testing::Test {
+ public:
+  void SetUp() {
+    std::unique_ptr<ApiManagerEnvInterface> env(
+        new ::testing::NiceMock<MockApiManagerEnvironment>());
+    global_context_ = std::make_shared<GlobalContext>(std::move(env), "");
+  }
+
+  std::shared_ptr<ServiceContext> Create(const char *service_config) {
+    std::unique_ptr<Config> config =
+        Config::Create(global_context_->env(), service_config);
+    EXPECT_NE(nullptr, config);
+    return std::make_shared<ServiceContext>(global_context_,
+                                            std::move(config));
+  }
+
+  // Caches a cert for both issuers.
+  static void UpdateCerts(ServiceContext *service_context) {
+    auto expiration =
+        std::chrono::system_clock::now() + std::chrono::minutes(5);
+    service_context->certs().Update("https://issuer1.com", "key1", expiration);
+    service_context->certs().Update("https://issuer2.com", "key2", expiration);
+  }
+
+  std::shared_ptr<GlobalContext> global_context_;
+};
+
+TEST_F(ServiceContextTest, SharesCachesOfUnchangedConfig) {
+  auto previous = Create(kServiceConfig);
+  UpdateCerts(previous.get());
+
+  auto service_context = Create(kServiceConfig);
+  service_context->InheritCaches(previous);
+  EXPECT_EQ(&previous->certs(), &service_context->certs());
+  EXPECT_EQ(&previous->jwt_cache(), &service_context->jwt_cache());
+  EXPECT_EQ(&previous->authz_cache(), &service_context->authz_cache());
+}
+
+TEST_F(ServiceContextTest, ChangedIssuerIsNotInherited) {
+  auto previous = Create(kServiceConfig);
+  UpdateCerts(previous.get());
+
+  auto service_context = Create(kServiceConfigWithChangedIssuer);
+  service_context->InheritCaches(previous);
+  EXPECT_NE(&previous->certs(), &service_context->certs());
+  EXPECT_NE(&previous->jwt_cache(), &service_context->jwt_cache());
+
+  // Only the cert of the unchanged issuer is copied.
+  EXPECT_EQ(nullptr, service_context->certs().GetCert("https://issuer1.com"));
+  ASSERT_NE(nullptr, service_context->certs().GetCert("https://issuer2.com"));
+  EXPECT_EQ("key2",
+            service_context->certs().GetCert("https://issuer2.com")->first);
+}
+
+TEST_F(ServiceContextTest, OtherServiceIsNotInherited) {
+  auto previous = Create(kServiceConfig);
+  UpdateCerts(previous.get());
+
+  auto service_context = Create(kOtherServiceConfig);
+  service_context->InheritCaches(previous);
+  EXPECT_NE(&previous->certs(), &service_context->certs());
+  EXPECT_NE(&previous->jwt_cache(), &service_context->jwt_cache());
+  EXPECT_NE(&previous->authz_cache(), &service_context->authz_cache());
+  EXPECT_EQ(nullptr, service_context->certs().GetCert("https://issuer1.com"));
+}
+
+TEST_F(ServiceContextTest, RepeatedRolloutsDontKeepPreviousContexts) {
+  auto first = Create(kServiceConfig);
+  auto second = Create(kServiceConfig);
+  second->InheritCaches(first);
+
+  std::weak_ptr<ServiceContext> weak_first = first;
+  first.reset();
+  EXPECT_TRUE(weak_first.expired());
+
+  auto third = Create(kServiceConfig);
+  third->InheritCaches(second);
+  std::weak_ptr<ServiceContext> weak_second = second;
+  second.reset();
+  EXPECT_TRUE(weak_second.expired());
+}
+
+}  // namespace
+}  // namespace context
+}  // namespace api_manager
+}  // namespace google
@@ -43,6 +43,7 @@ MethodInfoImpl::MethodInfoImpl(const string &name, const string &api_name,
       backend_path_translation_(
           ::google::api::
               BackendRule_PathTranslation_PATH_TRANSLATION_UNSPECIFIED),
+      backend_deadline_(0),
       request_streaming_(false),
       response_streaming_(false) {}
 
@@ -113,6 +114,13 @@ const std::string &MethodInfoImpl::first_authorization_url() const {
 
 void MethodInfoImpl::process_backend_rule(
     const ::google::api::BackendRule &rule) {
+  backend_deadline_ = rule.deadline() > 0 ? rule.deadline() : 0;
+  if (rule.address().empty()) {
+    // Only sets the deadline of calls to the backend nginx is configured
+    // with.
+    return;
+  }
+
   backend_address_ = rule.address();
   backend_path_translation_ = rule.path_translation();
   backend_jwt_audience_ = rule.jwt_audience();
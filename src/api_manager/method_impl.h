@@ -81,6 +81,8 @@ class MethodInfoImpl : public MethodInfo {
     return backend_jwt_audience_;
   }
 
+  double backend_deadline() const { return backend_deadline_; }
+
   const std::vector<std::pair<std::string, int>> &metric_cost_vector() const {
     return metric_cost_vector_;
   }
@@ -199,12 +201,13 @@ class MethodInfoImpl : public MethodInfo {
 
   const std::vector<std::string> *api_key_url_query_parameters_;
 
-  // The backend address, backend path, path_translation and jwt audience for
-  // this method.
+  // The backend address, backend path, path_translation, jwt audience and
+  // deadline for this method.
   std::string backend_address_;
   std::string backend_path_;
   ::google::api::BackendRule_PathTranslation backend_path_translation_;
   std::string backend_jwt_audience_;
+  double backend_deadline_;
 
   // Method selector
   std::string selector_;
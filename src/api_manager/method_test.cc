@@ -197,6 +197,28 @@ TEST(MethodInfo, PreservesBackendAddress_Append2) {
   ASSERT_EQ(method_info->backend_path(), "");
 }
 
+TEST(MethodInfo, PreservesBackendDeadline) {
+  MethodInfoImplPtr method_info(new MethodInfoImpl(kMethodName, "", ""));
+  ASSERT_EQ(method_info->backend_deadline(), 0);
+
+  ::google::api::BackendRule rule;
+  rule.set_address("backend");
+  rule.set_deadline(2.5);
+  method_info->process_backend_rule(rule);
+  ASSERT_EQ(method_info->backend_address(), "backend");
+  ASSERT_EQ(method_info->backend_deadline(), 2.5);
+}
+
+TEST(MethodInfo, BackendDeadlineWithoutAddress) {
+  MethodInfoImplPtr method_info(new MethodInfoImpl(kMethodName, "", ""));
+  ::google::api::BackendRule rule;
+  rule.set_deadline(10);
+  method_info->process_backend_rule(rule);
+  ASSERT_EQ(method_info->backend_address(), "");
+  ASSERT_EQ(method_info->backend_path(), "");
+  ASSERT_EQ(method_info->backend_deadline(), 10);
+}
+
 }  // namespace
 
 }  // namespace api_manager
@@ -41,6 +41,7 @@ class MockMethodInfo : public MethodInfo {
   MOCK_CONST_METHOD0(api_key_url_query_parameters,
                      const std::vector<std::string>*());
   MOCK_CONST_METHOD0(backend_address, const std::string&());
+  MOCK_CONST_METHOD0(backend_deadline, double());
   MOCK_CONST_METHOD0(rpc_method_full_name, const std::string&());
   MOCK_CONST_METHOD0(request_type_url, const std::string&());
   MOCK_CONST_METHOD0(request_streaming, bool());
@@ -124,6 +124,9 @@ void RequestHandler::Report(std::unique_ptr<Response> response,
     }
   }
 
+  // Tail sampling decisions are final once the response is known.
+  context_->MaybeStartTailCloudTrace(response.get());
+
   if (context_->cloud_trace()) {
     context_->cloud_trace()->EndRootSpan();
     // Always set the project_id to the latest one.
@@ -137,7 +140,7 @@ void RequestHandler::Report(std::unique_ptr<Response> response,
     context_->service_context()->cloud_trace_aggregator()->SetProjectId(
         context_->service_context()->project_id());
     context_->service_context()->cloud_trace_aggregator()->AppendTrace(
-        context_->cloud_trace()->ReleaseTrace());
+        context_->cloud_trace()->shared_trace());
   }
 
   continuation();
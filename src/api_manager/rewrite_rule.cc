@@ -16,6 +16,9 @@
 //
 #include "rewrite_rule.h"
 
+#include <algorithm>
+#include <cstring>
+
 namespace google {
 namespace api_manager {
 
@@ -57,6 +60,64 @@ class PcreMemoryFunctionOverride {
   void (*origin_pcre_free_)(void *);
 };
 
+// Returns true if the pattern has an alternative at the top level, e.g.
+// "^/a|/b", which is not anchored by the leading "^".  Conservative: also
+// returns true for quoted "\Q...\E" sequences, which aren't parsed.
+bool HasTopLevelAlternative(const std::string &pattern) {
+  int depth = 0;
+  bool in_class = false;
+  for (size_t i = 0; i < pattern.size(); ++i) {
+    char c = pattern[i];
+    if (c == '\\') {
+      if (i + 1 < pattern.size() && pattern[i + 1] == 'Q') {
+        return true;
+      }
+      ++i;
+    } else if (in_class) {
+      in_class = c != ']';
+    } else if (c == '[') {
+      in_class = true;
+      // A ']' right after "[" or "[^" is a literal.
+      if (i + 1 < pattern.size() && pattern[i + 1] == '^') {
+        ++i;
+      }
+      if (i + 1 < pattern.size() && pattern[i + 1] == ']') {
+        ++i;
+      }
+    } else if (c == '(') {
+      ++depth;
+    } else if (c == ')') {
+      --depth;
+    } else if (c == '|' && depth <= 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Returns the literal prefix every uri matched by the pattern starts with.
+// Conservative: returns an empty string if not sure.
+std::string GetLiteralPrefix(const std::string &pattern) {
+  if (pattern.empty() || pattern[0] != '^' ||
+      HasTopLevelAlternative(pattern)) {
+    return "";
+  }
+
+  std::string prefix;
+  for (size_t i = 1; i < pattern.size(); ++i) {
+    char c = pattern[i];
+    if (c == '\0' || strchr("\\.[]()*+?{}^$#|", c) != nullptr) {
+      // These quantifiers make the previous literal optional.
+      if ((c == '*' || c == '?' || c == '{') && !prefix.empty()) {
+        prefix.pop_back();
+      }
+      break;
+    }
+    prefix.push_back(c);
+  }
+  return prefix;
+}
+
 }  // namespace
 
 bool RewriteRule::ValidateRewriteRule(const std::string &rule,
@@ -139,15 +200,24 @@ RewriteRule::RewriteRule(std::string regex, std::string replacement,
     return;
   }
 
-  regex_extra_ = pcre_study(regex_compiled_, 0, &pcre_error_str);
+  int study_options = 0;
+#ifdef PCRE_STUDY_JIT_COMPILE
+  // JIT compiles the pattern if pcre is built with JIT support,
+  // otherwise it is ignored.
+  study_options |= PCRE_STUDY_JIT_COMPILE;
+#endif
+  regex_extra_ = pcre_study(regex_compiled_, study_options, &pcre_error_str);
   if (pcre_error_str != NULL) {
     env_->LogError("Invalid rewrite rule: \"" + regex_pattern_ +
                    "\", error: " + std::string(pcre_error_str));
 
     pcre_free(regex_compiled_);
+    regex_compiled_ = NULL;
     return;
   }
 
+  literal_prefix_ = GetLiteralPrefix(regex_pattern_);
+
   std::string segment;
   ReplacementPartType status = ReplacementPartType::TEXT;
 
@@ -311,20 +381,22 @@ bool RewriteRule::Check(const char *uri, size_t uri_len,
                 << std::endl;
   }
 
-  std::stringstream ss;
+  // Appends the matched substrings directly from the uri, unset
+  // substrings have negative offsets.
+  destination->clear();
   for (auto it = replacement_parts_.begin(); it != replacement_parts_.end();
        ++it) {
     switch (it->type) {
       case ReplacementPartType::TEXT:
-        ss << it->text;
+        destination->append(it->text);
         break;
       case ReplacementPartType::REPLACEMENT:
-        const char *psub_str_match_str;
         if (it->index >= 0 && it->index < pcre_exec_ret) {
-          pcre_get_substring(uri, sub_str_vec, pcre_exec_ret, it->index,
-                             &(psub_str_match_str));
-          ss << psub_str_match_str;
-          pcre_free_substring(psub_str_match_str);
+          int start = sub_str_vec[2 * it->index];
+          int end = sub_str_vec[2 * it->index + 1];
+          if (start >= 0 && end > start) {
+            destination->append(uri + start, end - start);
+          }
         }
         break;
       default:
@@ -334,8 +406,6 @@ bool RewriteRule::Check(const char *uri, size_t uri_len,
     }
   }
 
-  destination->assign(ss.str());
-
   if (debug_mode) {
     rewrite_log << kEspRewriteTitle << ": destination uri: " << *destination;
     env_->LogInfo(rewrite_log.str());
@@ -344,5 +414,57 @@ bool RewriteRule::Check(const char *uri, size_t uri_len,
   return true;
 }
 
+RewriteRuleSet::RewriteRuleSet() : nodes_(1) {}
+
+void RewriteRuleSet::Add(std::unique_ptr<RewriteRule> rule) {
+  size_t node = 0;
+  for (char c : rule->literal_prefix()) {
+    auto it = nodes_[node].children.find(c);
+    if (it != nodes_[node].children.end()) {
+      node = it->second;
+    } else {
+      nodes_[node].children[c] = nodes_.size();
+      node = nodes_.size();
+      nodes_.emplace_back();
+    }
+  }
+  nodes_[node].rules.push_back(rules_.size());
+  rules_.push_back(std::move(rule));
+}
+
+bool RewriteRuleSet::Rewrite(const char *uri, size_t uri_len,
+                             std::string *destination, bool debug_mode) {
+  if (debug_mode) {
+    for (auto &rule : rules_) {
+      if (rule->Check(uri, uri_len, destination, debug_mode)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Collect the rules whose literal prefix the uri starts with, on the
+  // path from the root to the longest such prefix.
+  std::vector<int> candidates(nodes_[0].rules);
+  size_t node = 0;
+  for (size_t i = 0; i < uri_len; ++i) {
+    auto it = nodes_[node].children.find(uri[i]);
+    if (it == nodes_[node].children.end()) {
+      break;
+    }
+    node = it->second;
+    candidates.insert(candidates.end(), nodes_[node].rules.begin(),
+                      nodes_[node].rules.end());
+  }
+  std::sort(candidates.begin(), candidates.end());
+
+  for (int index : candidates) {
+    if (rules_[index]->Check(uri, uri_len, destination, debug_mode)) {
+      return true;
+    }
+  }
+  return false;
+}
+
 }  // namespace api_manager
 }  // namespace google
@@ -19,6 +19,8 @@
 
 #include <cctype>
 #include <iostream>
+#include <map>
+#include <memory>
 #include <sstream>
 #include <vector>
 
@@ -53,6 +55,11 @@ class RewriteRule {
   static bool ValidateRewriteRule(const std::string &rule,
                                   std::string *error_msg);
 
+  // Returns the literal prefix of all uris matched by the pattern.
+  // It is empty if the pattern is not anchored by "^", has an alternative
+  // outside of groups or starts with a special character.
+  const std::string &literal_prefix() const { return literal_prefix_; }
+
  private:
   // Parts matched to "(\$[0-9]+)" are REPLACEMENT, others are TEXT
   enum ReplacementPartType { TEXT, REPLACEMENT };
@@ -79,6 +86,9 @@ class RewriteRule {
   pcre *regex_compiled_;
   pcre_extra *regex_extra_;
 
+  // literal prefix of the pattern
+  std::string literal_prefix_;
+
   // original replacement string
   std::string replacement_;
   // parsed replacement string
@@ -88,6 +98,39 @@ class RewriteRule {
   ApiManagerEnvInterface *env_;
 };
 
+// An ordered set of rewrite rules, the first matched rule is applied.
+// Rules are indexed by their literal prefix in a trie, so only the rules
+// which can match a request uri execute their regular expressions.
+class RewriteRuleSet {
+ public:
+  RewriteRuleSet();
+
+  // Adds a rule at the end of the set.
+  void Add(std::unique_ptr<RewriteRule> rule);
+
+  // Returns true if a rule matched the request uri, destination will have
+  // the replaced uri. Otherwise returns false.
+  // In debug mode all rules are tried in order to log every mismatch.
+  bool Rewrite(const char *uri, size_t uri_len, std::string *destination,
+               bool debug_mode);
+
+  size_t size() const { return rules_.size(); }
+
+ private:
+  // Rules in the order they were added.
+  std::vector<std::unique_ptr<RewriteRule>> rules_;
+
+  // A trie node of the literal prefixes; nodes_[0] is the root, for the
+  // empty prefix.
+  struct Node {
+    // Child nodes by the next byte of the prefix.
+    std::map<char, size_t> children;
+    // Indexes of the rules with this prefix, in rule order.
+    std::vector<int> rules;
+  };
+  std::vector<Node> nodes_;
+};
+
 }  // namespace api_manager
 }  // namespace google
 
@@ -206,6 +206,79 @@ TEST_F(RewriteRuleTest, CheckWithDebugInformation) {
   EXPECT_EQ(env.getLogMessage()[0], kExpectedRewriteLog);
 }
 
+TEST_F(RewriteRuleTest, LiteralPrefix) {
+  MockTimerApiManagerEnvironment env;
+
+  struct testData {
+    std::string pattern;
+    std::string prefix;
+  } test_cases[] = {
+      {"^/api/(.*)$", "/api/"},
+      {"^/apis/shelves\\?id=(.*)", "/apis/shelves"},
+      {"^/api/v(1|2)/(.*)", "/api/v"},
+      {"^/api/v[|]/(.*)", "/api/v"},
+      {"^/api/v1|/api/v2", ""},
+      {"^/api/(v1)|(v2)", ""},
+      {"^/api/v1\\|/api/v2", "/api/v1"},
+      {"^/api/vs?/(.*)", "/api/v"},
+      {"^/api/v{1,2}/(.*)", "/api/"},
+      {"^/api/v*/(.*)", "/api/"},
+      {"^/api/v+/(.*)", "/api/v"},
+      {"/api/(.*)", ""},
+      {"^(.*)$", ""},
+  };
+
+  for (auto tc : test_cases) {
+    RewriteRule rr(tc.pattern, "/$1", &env);
+    EXPECT_EQ(tc.prefix, rr.literal_prefix()) << tc.pattern;
+  }
+}
+
+TEST_F(RewriteRuleTest, RewriteRuleSetKeepsRuleOrder) {
+  MockTimerApiManagerEnvironment env;
+
+  RewriteRuleSet rules;
+  rules.Add(std::unique_ptr<RewriteRule>(
+      new RewriteRule("^/api/v1/(.*)$", "/v1/$1", &env)));
+  rules.Add(std::unique_ptr<RewriteRule>(
+      new RewriteRule("^/(shelves|books)/(.*)$", "/$1s/$2", &env)));
+  rules.Add(std::unique_ptr<RewriteRule>(
+      new RewriteRule("^/api/(.*)$", "/$1", &env)));
+  rules.Add(std::unique_ptr<RewriteRule>(
+      new RewriteRule("/static/(.*)$", "/assets/$1", &env)));
+  rules.Add(std::unique_ptr<RewriteRule>(
+      new RewriteRule("^/www/(.*)$", "/$1", &env)));
+  rules.Add(std::unique_ptr<RewriteRule>(
+      new RewriteRule("^/api/v1/books/(.*)$", "/books/$1", &env)));
+  EXPECT_EQ(6, rules.size());
+
+  struct testData {
+    std::string uri;
+    bool matched;
+    std::string destination;
+  } test_cases[] = {
+      {"/api/v1/shelves", true, "/v1/shelves"},
+      {"/api/v2/shelves", true, "/v2/shelves"},
+      {"/shelves/1", true, "/shelvess/1"},
+      {"/api/static/index.html", true, "/static/index.html"},
+      {"/www/static/index.html", true, "/assets/index.html"},
+      {"/www/index.html", true, "/index.html"},
+      {"/api/v1/books/1", true, "/v1/books/1"},
+      {"/index.html", false, ""},
+      {"", false, ""},
+  };
+
+  for (auto tc : test_cases) {
+    for (bool debug_mode : {false, true}) {
+      std::string destination;
+      EXPECT_EQ(tc.matched, rules.Rewrite(tc.uri.c_str(), tc.uri.length(),
+                                          &destination, debug_mode))
+          << tc.uri;
+      EXPECT_EQ(tc.destination, destination) << tc.uri;
+    }
+  }
+}
+
 }  // namespace
 
 }  // namespace api_manager
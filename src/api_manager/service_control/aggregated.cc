@@ -16,8 +16,11 @@
 //
 #include "src/api_manager/service_control/aggregated.h"
 
+#include <functional>
 #include <sstream>
 #include <typeinfo>
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
 #include "src/api_manager/service_control/logs_metrics_loader.h"
 
 using ::google::api::servicecontrol::v1::AllocateQuotaRequest;
@@ -93,6 +96,10 @@ const char servicecontrol_service[] =
 const char quotacontrol_service[] =
     "/google.api.servicecontrol.v1.QuotaController";
 
+// The gRPC service names, without the leading slash.
+const char* const servicecontrol_grpc_service = servicecontrol_service + 1;
+const char* const quotacontrol_grpc_service = quotacontrol_service + 1;
+
 // Http status code is converted to Status::code as:
 // https://github.com/cloudendpoints/esp/blob/master/src/api_manager/utils/status.cc#L364
 // which is called by Status.ToProto() at Aggregated::Call() on_done function.
@@ -154,6 +161,29 @@ const std::string& GetEmptyString() {
   return *kEmptyString;
 }
 
+// Returns a fingerprint of the parts of a service config which check
+// requests and their responses depend on: the methods, usage rules, quota
+// and metrics, the control settings and the system parameters.
+size_t CheckConfigFingerprint(const ::google::api::Service& service) {
+  ::google::api::Service rules;
+  *rules.mutable_apis() = service.apis();
+  *rules.mutable_usage() = service.usage();
+  *rules.mutable_quota() = service.quota();
+  *rules.mutable_metrics() = service.metrics();
+  *rules.mutable_control() = service.control();
+  *rules.mutable_system_parameters() = service.system_parameters();
+
+  std::string data;
+  {
+    ::google::protobuf::io::StringOutputStream output(&data);
+    ::google::protobuf::io::CodedOutputStream coded_output(&output);
+    // Map fields, e.g. of quota limits, are serialized in a fixed order.
+    coded_output.SetSerializationDeterministic(true);
+    rules.SerializeToCodedStream(&coded_output);
+  }
+  return std::hash<std::string>()(data);
+}
+
 }  // namespace
 
 template <class Type>
@@ -192,7 +222,8 @@ Aggregated::Aggregated(
       mismatched_check_config_id_(service.id()),
       mismatched_report_config_id_(service.id()),
       max_report_size_(0),
-      set_rollout_id_func_(set_rollout_id_func) {
+      set_rollout_id_func_(set_rollout_id_func),
+      check_config_fingerprint_(CheckConfigFingerprint(service)) {
   if (sa_token_) {
     sa_token_->SetAudience(
         auth::ServiceAccountToken::JWT_TOKEN_FOR_SERVICE_CONTROL,
@@ -248,6 +279,7 @@ void Aggregated::InitHttpRequestTimeoutRetries() {
       quota_retries_ = config.quota_retries();
     }
     network_fail_open_ = config.network_fail_open();
+    grpc_transport_ = config.transport() == proto::ServiceControlConfig::GRPC;
   }
 }
 
@@ -417,13 +449,50 @@ void Aggregated::Check(
       *request, response, check_on_done,
       [trace_span, this](const CheckRequest& request, CheckResponse* response,
                          TransportDoneFunc on_done) {
-        Call(request, response, on_done, trace_span.get());
+        CallCheck(request, response, on_done, trace_span.get());
       });
   // There is no reference to request anymore at this point and it is safe to
   // free request now.
   check_pool_.Free(std::move(request));
 }
 
+void Aggregated::CallCheck(const CheckRequest& request,
+                           CheckResponse* response, TransportDoneFunc on_done,
+                           cloud_trace::CloudTraceSpan* parent_span) {
+  std::shared_ptr<Aggregated> previous = check_predecessor_;
+  if (previous == nullptr || !previous->client_) {
+    Call(request, response, on_done, parent_span);
+    return;
+  }
+
+  // The previous client calls the server on its own cache miss, and
+  // this client caches the response either way.
+  previous->client_->Check(
+      request, response, on_done,
+      [previous, parent_span](const CheckRequest& request,
+                              CheckResponse* response,
+                              TransportDoneFunc on_done) {
+        previous->Call(request, response, on_done, parent_span);
+      });
+}
+
+bool Aggregated::InheritCacheFrom(std::shared_ptr<Interface> previous) {
+  std::shared_ptr<Aggregated> other =
+      std::dynamic_pointer_cast<Aggregated>(previous);
+  if (other == nullptr || other.get() == this || service_ == nullptr ||
+      other->service_ == nullptr ||
+      other->service_->name() != service_->name() ||
+      other->url_.check_url() != url_.check_url() ||
+      other->check_config_fingerprint_ != check_config_fingerprint_) {
+    return false;
+  }
+  // Keeps the chain one level deep, so rollouts don't keep every older
+  // object alive.
+  other->check_predecessor_.reset();
+  check_predecessor_ = std::move(other);
+  return true;
+}
+
 void Aggregated::Quota(const QuotaRequestInfo& info,
                        cloud_trace::CloudTraceSpan* parent_span,
                        std::function<void(utils::Status)> on_done) {
@@ -512,6 +581,25 @@ const std::string& Aggregated::GetApiRequestUrl<AllocateQuotaRequest>() {
   return url_.quota_url();
 }
 
+template <>
+void Aggregated::GetGrpcMethod<CheckRequest>(const char** service,
+                                             const char** method) {
+  *service = servicecontrol_grpc_service;
+  *method = "Check";
+}
+template <>
+void Aggregated::GetGrpcMethod<ReportRequest>(const char** service,
+                                              const char** method) {
+  *service = servicecontrol_grpc_service;
+  *method = "Report";
+}
+template <>
+void Aggregated::GetGrpcMethod<AllocateQuotaRequest>(const char** service,
+                                                     const char** method) {
+  *service = quotacontrol_grpc_service;
+  *method = "AllocateQuota";
+}
+
 template <>
 int Aggregated::GetHttpRequestTimeout<CheckRequest>() {
   return check_timeout_ms_;
@@ -538,6 +626,20 @@ int Aggregated::GetHttpRequestRetries<AllocateQuotaRequest>() {
   return quota_retries_;
 }
 
+template <>
+HTTPRequest::Priority Aggregated::GetHttpRequestPriority<CheckRequest>() {
+  return HTTPRequest::CHECK;
+}
+template <>
+HTTPRequest::Priority Aggregated::GetHttpRequestPriority<ReportRequest>() {
+  return HTTPRequest::REPORT;
+}
+template <>
+HTTPRequest::Priority
+Aggregated::GetHttpRequestPriority<AllocateQuotaRequest>() {
+  return HTTPRequest::QUOTA;
+}
+
 template <>
 const std::string& Aggregated::GetAuthToken<CheckRequest>() {
   if (sa_token_) {
@@ -614,6 +716,21 @@ void Aggregated::Call(const RequestType& request, ResponseType* response,
   std::shared_ptr<cloud_trace::CloudTraceSpan> trace_span(
       CreateChildSpan(parent_span, "Call ServiceControl server"));
 
+  std::string request_body;
+  request.SerializeToString(&request_body);
+
+  // Collect statistics on the maximum report body size.
+  if ((typeid(RequestType) == typeid(ReportRequest)) &&
+      (request_body.size() > max_report_size_)) {
+    max_report_size_ = request_body.size();
+  }
+
+  if (grpc_transport_) {
+    CallGrpc<RequestType>(std::move(request_body), response, on_done,
+                          trace_span);
+    return;
+  }
+
   const std::string& url = GetApiRequestUrl<RequestType>();
   TRACE(trace_span) << "Http request URL: " << url;
 
@@ -653,15 +770,6 @@ void Aggregated::Call(const RequestType& request, ResponseType* response,
         on_done(status.ToProto());
       }));
 
-  std::string request_body;
-  request.SerializeToString(&request_body);
-
-  // Collect statistics on the maximum report body size.
-  if ((typeid(RequestType) == typeid(ReportRequest)) &&
-      (request_body.size() > max_report_size_)) {
-    max_report_size_ = request_body.size();
-  }
-
   http_request->set_url(url)
       .set_method("POST")
       .set_auth_token(GetAuthToken<RequestType>())
@@ -670,10 +778,50 @@ void Aggregated::Call(const RequestType& request, ResponseType* response,
 
   http_request->set_timeout_ms(GetHttpRequestTimeout<RequestType>());
   http_request->set_max_retries(GetHttpRequestRetries<RequestType>());
+  http_request->set_priority(GetHttpRequestPriority<RequestType>());
 
   env_->RunHTTPRequest(std::move(http_request));
 }
 
+template <class RequestType, class ResponseType>
+void Aggregated::CallGrpc(
+    std::string&& request_body, ResponseType* response,
+    TransportDoneFunc on_done,
+    std::shared_ptr<cloud_trace::CloudTraceSpan> trace_span) {
+  const char* service;
+  const char* method;
+  GetGrpcMethod<RequestType>(&service, &method);
+  TRACE(trace_span) << "gRPC request method: " << service << "/" << method;
+
+  std::unique_ptr<GRPCRequest> grpc_request(new GRPCRequest(
+      [service, method, response, on_done, trace_span, this](
+          Status status, std::string&& body) {
+        TRACE(trace_span) << "gRPC response status: " << status.ToString();
+        if (status.ok()) {
+          if (!response->ParseFromString(body)) {
+            status =
+                Status(Code::INVALID_ARGUMENT, std::string("Invalid response"));
+          }
+          HandleResponse(*response);
+        } else {
+          env_->LogError(std::string("Failed to call ") + service + "/" +
+                         method + ", Error: " + status.ToString());
+        }
+        on_done(status.ToProto());
+      }));
+
+  grpc_request->set_server(url_.service_control())
+      .set_service(service)
+      .set_method(method)
+      .set_auth_token(GetAuthToken<RequestType>())
+      .set_body(std::move(request_body));
+
+  grpc_request->set_timeout_ms(GetHttpRequestTimeout<RequestType>());
+  grpc_request->set_max_retries(GetHttpRequestRetries<RequestType>());
+
+  env_->RunGRPCRequest(std::move(grpc_request));
+}
+
 Interface* Aggregated::Create(const ::google::api::Service& service,
                               const ServerConfig* server_config,
                               ApiManagerEnvInterface* env,
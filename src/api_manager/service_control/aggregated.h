@@ -66,6 +66,14 @@ class Aggregated : public Interface {
 
   virtual utils::Status GetStatistics(Statistics* stat) const;
 
+  // Check cache misses are looked up in the check cache of the previous
+  // object before calling the service control server. Only check responses
+  // are inherited; quota and report aggregation are tied to their own
+  // service config id. The previous object must call the same server, and
+  // its config must have the same methods, usage, quota, metrics, control
+  // and system parameters, otherwise its responses may no longer apply.
+  bool InheritCacheFrom(std::shared_ptr<Interface> previous) override;
+
  private:
   // A timer object to wrap PeriodicTimer
   class ApiManagerPeriodicTimer
@@ -139,6 +147,20 @@ class Aggregated : public Interface {
   template <class RequestType>
   int GetHttpRequestRetries();
 
+  // Returns the gRPC service and method based on RequestType
+  template <class RequestType>
+  void GetGrpcMethod(const char** service, const char** method);
+
+  // Calls to service control server over the gRPC transport.
+  template <class RequestType, class ResponseType>
+  void CallGrpc(std::string&& request_body, ResponseType* response,
+                ::google::service_control_client::TransportDoneFunc on_done,
+                std::shared_ptr<cloud_trace::CloudTraceSpan> trace_span);
+
+  // Returns the outbound scheduling class based on RequestType
+  template <class RequestType>
+  HTTPRequest::Priority GetHttpRequestPriority();
+
   // Returns API request auth token based on RequestType
   template <class RequestType>
   const std::string& GetAuthToken();
@@ -146,6 +168,14 @@ class Aggregated : public Interface {
   template <class ResponseType>
   void HandleResponse(const ResponseType& response);
 
+  // The transport for check cache misses. It looks up the check cache of
+  // check_predecessor_ if available, otherwise calls the server.
+  void CallCheck(
+      const ::google::api::servicecontrol::v1::CheckRequest& request,
+      ::google::api::servicecontrol::v1::CheckResponse* response,
+      ::google::service_control_client::TransportDoneFunc on_done,
+      cloud_trace::CloudTraceSpan* parent_span);
+
   // the service config.
   const ::google::api::Service* service_;
   // the server config.
@@ -198,9 +228,19 @@ class Aggregated : public Interface {
   // network fail policy, default to false
   bool network_fail_open_{};
 
+  // Whether calls use the gRPC transport instead of HTTP.
+  bool grpc_transport_{};
+
   // The callback function to set the latest rollout id
   // from Check and Report response
   SetRolloutIdFunc set_rollout_id_func_;
+
+  // A fingerprint of the service config parts check responses depend on.
+  size_t check_config_fingerprint_{};
+
+  // The object serving the previous config. Its check cache is used as the
+  // second level cache. It doesn't keep a predecessor of its own.
+  std::shared_ptr<Aggregated> check_predecessor_;
 };
 
 }  // namespace service_control
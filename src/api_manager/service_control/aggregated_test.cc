@@ -219,6 +219,7 @@ class AggregatedTestWithRealClient : public ::testing::Test {
   }
 
   void DoRunHTTPRequest(HTTPRequest* request) {
+    EXPECT_EQ(request->priority(), HTTPRequest::CHECK);
     std::map<std::string, std::string> headers;
     CheckResponse response;
     response.set_service_rollout_id("test_rollout_id");
@@ -253,6 +254,73 @@ TEST_F(AggregatedTestWithRealClient, CheckOKTest) {
   EXPECT_EQ(stat.send_report_operations, 0);
 }
 
+class AggregatedGrpcTransportTest : public ::testing::Test {
+ public:
+  void SetUp() {
+    service_.set_name("test_service");
+    service_.mutable_control()->set_environment(
+        "servicecontrol.googleapis.com");
+    server_config_.mutable_service_control_config()->set_transport(
+        proto::ServiceControlConfig::GRPC);
+    env_.reset(new ::testing::NiceMock<MockApiManagerEnvironment>);
+    sc_lib_.reset(Aggregated::Create(service_, &server_config_, env_.get(),
+                                     nullptr, nullptr));
+    ASSERT_TRUE((bool)(sc_lib_));
+    sc_lib_->Init();
+  }
+
+  void DoRunGRPCRequest(GRPCRequest* request) {
+    EXPECT_EQ(request->server(), "https://servicecontrol.googleapis.com");
+    EXPECT_EQ(request->service(),
+              "google.api.servicecontrol.v1.ServiceController");
+    EXPECT_EQ(request->method(), "Check");
+    EXPECT_EQ(request->max_retries(), 3);
+    CheckRequest check_request;
+    ASSERT_TRUE(check_request.ParseFromString(request->body()));
+    EXPECT_EQ(check_request.service_name(), "test_service");
+
+    CheckResponse response;
+    std::string body = response.SerializeAsString();
+    request->OnComplete(Status::OK, std::move(body));
+  }
+
+  ::google::api::Service service_;
+  proto::ServerConfig server_config_;
+  std::unique_ptr<MockApiManagerEnvironment> env_;
+  std::unique_ptr<Interface> sc_lib_;
+};
+
+TEST_F(AggregatedGrpcTransportTest, CheckOKTest) {
+  EXPECT_CALL(*env_, DoRunHTTPRequest(_)).Times(0);
+  EXPECT_CALL(*env_, DoRunGRPCRequest(_))
+      .WillOnce(Invoke(this, &AggregatedGrpcTransportTest::DoRunGRPCRequest));
+
+  CheckRequestInfo info;
+  FillOperationInfo(&info);
+  bool done = false;
+  sc_lib_->Check(info, nullptr,
+                 [&done](Status status, const CheckResponseInfo& info) {
+                   EXPECT_TRUE(status.ok());
+                   done = true;
+                 });
+  EXPECT_TRUE(done);
+}
+
+TEST_F(AggregatedGrpcTransportTest, CheckUnavailableTest) {
+  EXPECT_CALL(*env_, DoRunGRPCRequest(_))
+      .WillOnce(Invoke([](GRPCRequest* request) {
+        request->OnComplete(Status(Code::UNAVAILABLE, "connect failed"),
+                            std::string());
+      }));
+
+  CheckRequestInfo info;
+  FillOperationInfo(&info);
+  sc_lib_->Check(info, nullptr,
+                 [](Status status, const CheckResponseInfo& info) {
+                   EXPECT_EQ(status.code(), Code::UNAVAILABLE);
+                 });
+}
+
 class QuotaAllocationTestWithRealClient : public ::testing::Test {
  public:
   void SetUp() {
@@ -276,6 +344,7 @@ class QuotaAllocationTestWithRealClient : public ::testing::Test {
   }
 
   void DoRunHTTPRequest(HTTPRequest* request) {
+    EXPECT_EQ(request->priority(), HTTPRequest::QUOTA);
     std::map<std::string, std::string> headers;
 
     AllocateQuotaRequest quota_request;
@@ -346,6 +415,88 @@ TEST_F(QuotaAllocationTestWithRealClient, AllocateQuotaFailedTest) {
   });
 }
 
+class AggregatedInheritCacheTest : public ::testing::Test {
+ public:
+  void SetUp() {
+    service_.set_name("test_service");
+    service_.mutable_control()->set_environment(
+        "servicecontrol.googleapis.com");
+    changed_service_ = service_;
+    auto* rule = changed_service_.mutable_usage()->add_rules();
+    rule->set_selector("operation_name");
+    rule->set_allow_unregistered_calls(true);
+    env_.reset(new ::testing::NiceMock<MockApiManagerEnvironment>);
+  }
+
+  std::shared_ptr<Interface> Create(const ::google::api::Service& service) {
+    std::shared_ptr<Interface> sc_lib(
+        Aggregated::Create(service, nullptr, env_.get(), nullptr, nullptr));
+    EXPECT_TRUE((bool)(sc_lib));
+    sc_lib->Init();
+    return sc_lib;
+  }
+
+  static void DoRunHTTPRequest(HTTPRequest* request) {
+    CheckResponse response;
+    request->OnComplete(Status::OK, {}, response.SerializeAsString());
+  }
+
+  static void Check(Interface* sc_lib) {
+    CheckRequestInfo info;
+    FillOperationInfo(&info);
+    sc_lib->Check(info, nullptr,
+                  [](Status status, const CheckResponseInfo& info) {
+                    ASSERT_TRUE(status.ok());
+                  });
+  }
+
+  ::google::api::Service service_;
+  ::google::api::Service changed_service_;
+  std::unique_ptr<MockApiManagerEnvironment> env_;
+};
+
+TEST_F(AggregatedInheritCacheTest, InheritsCheckCacheOfSameConfig) {
+  EXPECT_CALL(*env_, DoRunHTTPRequest(_))
+      .WillOnce(Invoke(&AggregatedInheritCacheTest::DoRunHTTPRequest));
+
+  auto previous = Create(service_);
+  Check(previous.get());
+
+  // The check response cached by the previous object is used.
+  auto sc_lib = Create(service_);
+  EXPECT_TRUE(sc_lib->InheritCacheFrom(previous));
+  Check(sc_lib.get());
+}
+
+TEST_F(AggregatedInheritCacheTest, ChangedConfigIsNotInherited) {
+  EXPECT_CALL(*env_, DoRunHTTPRequest(_))
+      .Times(2)
+      .WillRepeatedly(Invoke(&AggregatedInheritCacheTest::DoRunHTTPRequest));
+
+  auto previous = Create(service_);
+  Check(previous.get());
+
+  // The usage rules changed, the cached check response may not apply.
+  auto sc_lib = Create(changed_service_);
+  EXPECT_FALSE(sc_lib->InheritCacheFrom(previous));
+  Check(sc_lib.get());
+}
+
+TEST_F(AggregatedInheritCacheTest, RepeatedRolloutsDontChain) {
+  auto first = Create(service_);
+  auto second = Create(service_);
+  auto third = Create(service_);
+
+  EXPECT_TRUE(second->InheritCacheFrom(first));
+  std::weak_ptr<Interface> weak_first = first;
+  first.reset();
+  EXPECT_FALSE(weak_first.expired());
+
+  // Only the direct predecessor is kept.
+  EXPECT_TRUE(third->InheritCacheFrom(second));
+  EXPECT_TRUE(weak_first.expired());
+}
+
 TEST(AggregatedServiceControlTest, Create) {
   // Verify that invalid service config yields nullptr.
   ::google::api::Service
@@ -15,6 +15,8 @@
 #ifndef API_MANAGER_SERVICE_CONTROL_INTERFACE_H_
 #define API_MANAGER_SERVICE_CONTROL_INTERFACE_H_
 
+#include <memory>
+
 #include "include/api_manager/service_control.h"
 #include "include/api_manager/utils/status.h"
 #include "src/api_manager/cloud_trace/cloud_trace.h"
@@ -86,6 +88,13 @@ class Interface {
 
   // Get statistics of ServiceControl library.
   virtual utils::Status GetStatistics(Statistics* stat) const = 0;
+
+  // Uses the cache of the object serving a previous config of the same
+  // service to warm up this object after a config rollout.
+  // Returns false if the previous object is not compatible.
+  virtual bool InheritCacheFrom(std::shared_ptr<Interface> previous) {
+    return false;
+  }
 };
 
 }  // namespace service_control
@@ -0,0 +1,104 @@
+// Copyright (C) Extensible Service Proxy Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "src/api_manager/utils/compression.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace google {
+namespace api_manager {
+namespace utils {
+
+namespace {
+
+// The size of a chunk appended to the output while decompressing.
+const size_t kDecompressChunkSize = 16 * 1024;
+
+voidpf ZAlloc(voidpf opaque, uInt items, uInt size) {
+  return calloc(items, size);
+}
+
+void ZFree(voidpf opaque, voidpf address) { free(address); }
+
+void InitStream(z_stream *stream, const std::string &input) {
+  InitZStream(stream);
+  stream->next_in =
+      reinterpret_cast<Bytef *>(const_cast<char *>(input.data()));
+  stream->avail_in = input.size();
+}
+
+}  // namespace
+
+void InitZStream(z_stream *stream) {
+  memset(stream, 0, sizeof(*stream));
+  stream->zalloc = ZAlloc;
+  stream->zfree = ZFree;
+}
+
+bool GzipCompress(const std::string &input, std::string *output) {
+  z_stream stream;
+  InitStream(&stream, input);
+  if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                   kGzipWindowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+    output->clear();
+    return false;
+  }
+
+  // deflateBound covers the gzip header, one deflate call is enough.
+  output->resize(deflateBound(&stream, input.size()));
+  stream.next_out = reinterpret_cast<Bytef *>(&(*output)[0]);
+  stream.avail_out = output->size();
+
+  int ret = deflate(&stream, Z_FINISH);
+  deflateEnd(&stream);
+  if (ret != Z_STREAM_END) {
+    output->clear();
+    return false;
+  }
+  output->resize(stream.total_out);
+  return true;
+}
+
+bool GzipDecompress(const std::string &input, std::string *output) {
+  z_stream stream;
+  InitStream(&stream, input);
+  output->clear();
+  if (inflateInit2(&stream, kAutoDetectWindowBits) != Z_OK) {
+    return false;
+  }
+
+  int ret = Z_OK;
+  while (ret == Z_OK) {
+    size_t size = output->size();
+    output->resize(size + kDecompressChunkSize);
+    stream.next_out = reinterpret_cast<Bytef *>(&(*output)[size]);
+    stream.avail_out = kDecompressChunkSize;
+    ret = inflate(&stream, Z_NO_FLUSH);
+    output->resize(size + kDecompressChunkSize - stream.avail_out);
+  }
+  inflateEnd(&stream);
+
+  if (ret != Z_STREAM_END) {
+    output->clear();
+    return false;
+  }
+  return true;
+}
+
+}  // namespace utils
+}  // namespace api_manager
+}  // namespace google
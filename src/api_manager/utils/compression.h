@@ -0,0 +1,49 @@
+/* Copyright (C) Extensible Service Proxy Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef API_MANAGER_UTILS_COMPRESSION_H_
+#define API_MANAGER_UTILS_COMPRESSION_H_
+
+#include <string>
+
+#include "zlib.h"
+
+namespace google {
+namespace api_manager {
+namespace utils {
+
+// Adding 16 to the window bits makes zlib write a gzip header and trailer.
+const int kGzipWindowBits = 16 + MAX_WBITS;
+
+// Adding 32 to the window bits makes zlib detect gzip or zlib header.
+const int kAutoDetectWindowBits = 32 + MAX_WBITS;
+
+// Clears a zlib stream and sets its allocation functions, as zlib is built
+// with Z_SOLO, which has none.  The memory comes from the heap, so the
+// stream may belong to an object that outlives an nginx request.
+void InitZStream(z_stream *stream);
+
+// Compresses input into output in gzip format.
+// Returns false if zlib fails, output is cleared then.
+bool GzipCompress(const std::string &input, std::string *output);
+
+// Decompresses gzip or zlib formatted input into output.
+// Returns false if input is not fully decompressed, output is cleared then.
+bool GzipDecompress(const std::string &input, std::string *output);
+
+}  // namespace utils
+}  // namespace api_manager
+}  // namespace google
+
+#endif  // API_MANAGER_UTILS_COMPRESSION_H_
@@ -0,0 +1,68 @@
+// Copyright (C) Extensible Service Proxy Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "src/api_manager/utils/compression.h"
+
+#include "gtest/gtest.h"
+
+namespace google {
+namespace api_manager {
+namespace utils {
+
+TEST(Compression, RoundTrip) {
+  std::string input;
+  for (int i = 0; i < 10000; ++i) {
+    input += "trace span " + std::to_string(i % 10) + "\n";
+  }
+
+  std::string compressed;
+  ASSERT_TRUE(GzipCompress(input, &compressed));
+  EXPECT_LT(compressed.size(), input.size());
+  // gzip magic bytes
+  ASSERT_GE(compressed.size(), 2);
+  EXPECT_EQ('\x1f', compressed[0]);
+  EXPECT_EQ('\x8b', compressed[1]);
+
+  std::string output;
+  ASSERT_TRUE(GzipDecompress(compressed, &output));
+  EXPECT_EQ(input, output);
+}
+
+TEST(Compression, Empty) {
+  std::string compressed;
+  ASSERT_TRUE(GzipCompress("", &compressed));
+  EXPECT_FALSE(compressed.empty());
+
+  std::string output = "not empty";
+  ASSERT_TRUE(GzipDecompress(compressed, &output));
+  EXPECT_EQ("", output);
+}
+
+TEST(Compression, Invalid) {
+  std::string compressed;
+  ASSERT_TRUE(GzipCompress("some data", &compressed));
+
+  std::string output;
+  EXPECT_FALSE(GzipDecompress("not gzip data", &output));
+  EXPECT_EQ("", output);
+  EXPECT_FALSE(
+      GzipDecompress(compressed.substr(0, compressed.size() - 4), &output));
+  EXPECT_EQ("", output);
+}
+
+}  // namespace utils
+}  // namespace api_manager
+}  // namespace google
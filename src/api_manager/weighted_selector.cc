@@ -16,18 +16,77 @@
 // includes should be ordered. This seems like a bug in clang-format?
 #include "src/api_manager/weighted_selector.h"
 
+#include <cstdint>
+
 namespace google {
 namespace api_manager {
 
+namespace {
+
+int Gcd(int a, int b) {
+  while (b != 0) {
+    int t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+// 64-bit FNV-1a, stable across processes and restarts.
+uint64_t HashKey(const std::string& key) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (unsigned char c : key) {
+    hash ^= c;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+}  // namespace
+
 WeightedSelector::WeightedSelector(
-    std::vector<std::pair<std::string, int>>&& list) {
+    std::vector<std::pair<std::string, int>>&& list)
+    : next_(0) {
   list_.swap(list);
-  counts_.resize(list_.size());
-  std::fill(counts_.begin(), counts_.end(), 0);
-}
 
-float WeightedSelector::score(int index) {
-  return float(counts_[index]) / list_[index].second;
+  // Entries with zero weight are never selected, unless all weights are
+  // zero, then the first entry is always selected.
+  std::vector<int> weights;
+  int gcd = 0;
+  for (const auto& it : list_) {
+    int weight = it.second > 0 ? it.second : 0;
+    weights.push_back(weight);
+    gcd = Gcd(gcd, weight);
+  }
+  if (gcd == 0) {
+    schedule_.push_back(0);
+    key_slots_.push_back(0);
+    return;
+  }
+
+  int total = 0;
+  for (unsigned int i = 0; i < weights.size(); ++i) {
+    weights[i] /= gcd;
+    total += weights[i];
+    key_slots_.insert(key_slots_.end(), weights[i], i);
+  }
+
+  // Smooth weighted round-robin, as in nginx upstream: every step adds the
+  // weights to the current scores, selects the highest score and lowers it
+  // by the total weight. A cycle of total steps follows the weights exactly.
+  std::vector<int> current(weights.size(), 0);
+  schedule_.reserve(total);
+  for (int step = 0; step < total; ++step) {
+    int best = 0;
+    for (unsigned int i = 0; i < weights.size(); ++i) {
+      current[i] += weights[i];
+      if (current[i] > current[best]) {
+        best = i;
+      }
+    }
+    current[best] -= total;
+    schedule_.push_back(best);
+  }
 }
 
 const std::string& WeightedSelector::Select() {
@@ -35,24 +94,19 @@ const std::string& WeightedSelector::Select() {
     static std::string empty;
     return empty;
   }
+  return list_[SelectIndex()].first;
+}
 
-  // An optimization for size=1, the most popular case.
-  if (list_.size() == 1) {
-    return list_[0].first;
-  }
-
-  auto min_score = score(0);
-  int min_idx = 0;
-  for (unsigned int i = 1; i < list_.size(); ++i) {
-    auto s = score(i);
-    if (s < min_score) {
-      min_score = s;
-      min_idx = i;
-    }
+int WeightedSelector::SelectIndex() {
+  int index = schedule_[next_];
+  if (++next_ == schedule_.size()) {
+    next_ = 0;
   }
+  return index;
+}
 
-  counts_[min_idx] += 1;
-  return list_[min_idx].first;
+int WeightedSelector::SelectIndexByKey(const std::string& key) const {
+  return key_slots_[HashKey(key) % key_slots_.size()];
 }
 
 }  // namespace api_manager
@@ -15,6 +15,7 @@
 #ifndef API_MANAGER_WEIGHTED_SELECTOR_H_
 #define API_MANAGER_WEIGHTED_SELECTOR_H_
 
+#include <cstddef>
 #include <string>
 #include <utility>
 #include <vector>
@@ -25,6 +26,7 @@ namespace api_manager {
 // A class to select one entry from a list.
 // Each element in the list is a pair of (name, weight).
 // The selection is based on the weight.
+// Selections are precomputed at construction, so Select() is O(1).
 class WeightedSelector {
  public:
   // Input is a list of <name, weight>.
@@ -33,17 +35,32 @@ class WeightedSelector {
   // Make a selection.
   const std::string& Select();
 
-  const std::vector<std::pair<std::string, int>>& list() { return list_; }
+  // Returns the list index of the next selection. The selections follow
+  // a deterministic smooth weighted round-robin order, so any window of
+  // selections is close to the weights. The list must not be empty.
+  int SelectIndex();
 
- private:
-  // Calculates score = "count / weight" for an element.
-  float score(int index);
+  // Returns the list index for a key, such as an api key. The same key is
+  // always mapped to the same entry for the same list and weights. The list
+  // must not be empty.
+  int SelectIndexByKey(const std::string& key) const;
+
+  const std::vector<std::pair<std::string, int>>& list() const {
+    return list_;
+  }
 
+ private:
   // The list of <name, weight>
   std::vector<std::pair<std::string, int>> list_;
 
-  // The used counts.
-  std::vector<uint64_t> counts_;
+  // One smooth weighted round-robin cycle of list indexes.
+  std::vector<int> schedule_;
+  // The position of the next selection in schedule_.
+  size_t next_;
+
+  // Maps a key hash modulo its size to a list index. Each entry owns
+  // a contiguous range of slots proportional to its weight.
+  std::vector<int> key_slots_;
 };
 
 }  // namespace api_manager
@@ -41,6 +41,45 @@ TEST(TestWeightedSelector, Multiple) {
   ASSERT_EQ(rets["name3"], 50);
 }
 
+TEST(TestWeightedSelector, SmoothOrder) {
+  WeightedSelector s({{"name1", 60}, {"name2", 20}, {"name3", 20}});
+
+  // Every cycle of 5 selections follows the weights.
+  for (int cycle = 0; cycle < 10; cycle++) {
+    std::map<std::string, int> rets;
+    for (int i = 0; i < 5; i++) {
+      ++rets[s.Select()];
+    }
+    ASSERT_EQ(rets["name1"], 3);
+    ASSERT_EQ(rets["name2"], 1);
+    ASSERT_EQ(rets["name3"], 1);
+  }
+}
+
+TEST(TestWeightedSelector, ZeroWeight) {
+  WeightedSelector s({{"name1", 0}, {"name2", 100}});
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ("name2", s.Select());
+  }
+}
+
+TEST(TestWeightedSelector, ByKey) {
+  WeightedSelector s({{"name1", 80}, {"name2", 20}});
+
+  std::map<int, int> rets;
+  for (int i = 0; i < 1000; i++) {
+    std::string key = "key" + std::to_string(i);
+    int index = s.SelectIndexByKey(key);
+    // Always the same index for a key.
+    ASSERT_EQ(index, s.SelectIndexByKey(key));
+    ++rets[index];
+  }
+
+  // Roughly follows the weights.
+  ASSERT_GT(rets[0], 700);
+  ASSERT_GT(rets[1], 100);
+}
+
 }  // namespace
 }  // namespace api_manager
 }  // namespace google
@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) Extensible Service Proxy Authors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#ifndef GRPC_GRPC_BYTE_BUFFER_PEER_H_
+#define GRPC_GRPC_BYTE_BUFFER_PEER_H_
+
+#include "grpc++/support/byte_buffer.h"
+
+namespace grpc {
+namespace internal {
+
+// Gives access to the grpc_byte_buffer of a ::grpc::ByteBuffer, which
+// tells among other things whether the message it holds is still
+// compressed.  ByteBuffer declares this class as a friend for that.
+class GrpcByteBufferPeer {
+ public:
+  explicit GrpcByteBufferPeer(ByteBuffer *buffer) : buffer_(buffer) {}
+
+  grpc_byte_buffer *c_buffer() { return buffer_->c_buffer(); }
+  grpc_byte_buffer **c_buffer_ptr() { return buffer_->c_buffer_ptr(); }
+
+ private:
+  ByteBuffer *buffer_;
+};
+
+}  // namespace internal
+}  // namespace grpc
+
+#endif  // GRPC_GRPC_BYTE_BUFFER_PEER_H_
@@ -0,0 +1,81 @@
+// Copyright (C) Extensible Service Proxy Authors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "src/grpc/message_compression.h"
+
+#include <vector>
+
+#include "src/grpc/grpc_byte_buffer_peer.h"
+
+namespace google {
+namespace api_manager {
+namespace grpc {
+
+MessageCompression::MessageCompression(size_t min_size)
+    : min_size_(min_size), stats_() {}
+
+void MessageCompression::PrepareWrite(const ::grpc::ByteBuffer &message,
+                                      ::grpc::WriteOptions *options) {
+  size_t length = message.Length();
+  if (length < min_size_) {
+    options->set_no_compression();
+    return;
+  }
+  ++stats_.compressed_requests;
+  stats_.compressed_request_bytes += length;
+}
+
+bool MessageCompression::Decompress(::grpc::ByteBuffer *message) {
+  // The library hands compressed messages over as they came off the
+  // wire, and decompresses them as they are read.
+  grpc_byte_buffer *buffer =
+      ::grpc::internal::GrpcByteBufferPeer(message).c_buffer();
+  if (buffer == nullptr || buffer->type != GRPC_BB_RAW ||
+      buffer->data.raw.compression == GRPC_COMPRESS_NONE) {
+    return true;
+  }
+
+  size_t length = message->Length();
+  std::vector<::grpc::Slice> slices;
+  if (!message->Dump(&slices).ok()) {
+    return false;
+  }
+
+  size_t decompressed_length = 0;
+  for (const auto &slice : slices) {
+    decompressed_length += slice.size();
+  }
+  ++stats_.compressed_responses;
+  if (decompressed_length > length) {
+    stats_.response_bytes_saved += decompressed_length - length;
+  }
+  *message = ::grpc::ByteBuffer(slices.data(), slices.size());
+  return true;
+}
+
+}  // namespace grpc
+}  // namespace api_manager
+}  // namespace google
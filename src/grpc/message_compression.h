@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) Extensible Service Proxy Authors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#ifndef GRPC_MESSAGE_COMPRESSION_H_
+#define GRPC_MESSAGE_COMPRESSION_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "grpc++/generic/generic_stub.h"
+#include "grpc++/support/byte_buffer.h"
+
+namespace google {
+namespace api_manager {
+namespace grpc {
+
+// Gzip compression of the messages proxied to one gRPC backend, with
+// counters of what it covers.
+//
+// The gRPC library does the compression on calls asking for it; this
+// picks the messages big enough to be worth it.  The library hands the
+// compressed messages it receives over as they came off the wire, which
+// is where the bytes saved on responses are counted.  Not thread-safe:
+// the calls to a backend must all use it from the same thread.
+class MessageCompression {
+ public:
+  struct Stats {
+    // Number of messages handed to the library to be sent compressed.
+    // Those which don't shrink are sent as is.
+    uint64_t compressed_requests;
+    // The size of those messages before compression.
+    uint64_t compressed_request_bytes;
+    // Number of compressed messages received from the backend.
+    uint64_t compressed_responses;
+    // Bytes those messages grew by when decompressed.
+    uint64_t response_bytes_saved;
+  };
+
+  // Messages smaller than min_size bytes are sent uncompressed.
+  explicit MessageCompression(size_t min_size);
+
+  // Sets up options for writing message on a call using gzip
+  // compression: messages smaller than the minimum size are marked to be
+  // sent uncompressed.
+  void PrepareWrite(const ::grpc::ByteBuffer &message,
+                    ::grpc::WriteOptions *options);
+
+  // Replaces a message read from the backend with its decompressed form,
+  // if the backend compressed it.  Returns false if the message can't be
+  // decompressed.
+  bool Decompress(::grpc::ByteBuffer *message);
+
+  const Stats &stats() const { return stats_; }
+
+ private:
+  size_t min_size_;
+  Stats stats_;
+};
+
+}  // namespace grpc
+}  // namespace api_manager
+}  // namespace google
+
+#endif  // GRPC_MESSAGE_COMPRESSION_H_
@@ -0,0 +1,203 @@
+// Copyright (C) Extensible Service Proxy Authors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "src/grpc/message_compression.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "grpc/byte_buffer.h"
+#include "gtest/gtest.h"
+#include "src/grpc/grpc_byte_buffer_peer.h"
+#include "zlib.h"
+
+namespace google {
+namespace api_manager {
+namespace grpc {
+namespace testing {
+namespace {
+
+const size_t kMinSize = 1024;
+
+::grpc::ByteBuffer CreateByteBuffer(const std::string &data) {
+  ::grpc::Slice slice(data);
+  return ::grpc::ByteBuffer(&slice, 1);
+}
+
+std::string ToString(const ::grpc::ByteBuffer &message) {
+  std::vector<::grpc::Slice> slices;
+  EXPECT_TRUE(message.Dump(&slices).ok());
+  std::string data;
+  for (const auto &slice : slices) {
+    data.append(reinterpret_cast<const char *>(slice.begin()), slice.size());
+  }
+  return data;
+}
+
+std::string Gzip(const std::string &data) {
+  z_stream stream = {};
+  EXPECT_EQ(Z_OK, deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED,
+                               MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY));
+  std::string compressed(deflateBound(&stream, data.size()), '\0');
+  stream.next_in =
+      reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+  stream.avail_in = data.size();
+  stream.next_out = reinterpret_cast<Bytef *>(&compressed[0]);
+  stream.avail_out = compressed.size();
+  EXPECT_EQ(Z_STREAM_END, deflate(&stream, Z_FINISH));
+  compressed.resize(stream.total_out);
+  deflateEnd(&stream);
+  return compressed;
+}
+
+// Returns a message as the library hands over one it received gzip
+// compressed.
+::grpc::ByteBuffer CreateCompressedByteBuffer(const std::string &data) {
+  std::string compressed = Gzip(data);
+  grpc_slice slice =
+      grpc_slice_from_copied_buffer(compressed.data(), compressed.size());
+  ::grpc::ByteBuffer message;
+  *::grpc::internal::GrpcByteBufferPeer(&message).c_buffer_ptr() =
+      grpc_raw_compressed_byte_buffer_create(&slice, 1, GRPC_COMPRESS_GZIP);
+  grpc_slice_unref(slice);
+  return message;
+}
+
+// Returns data which is as long as its gzip compressed form: a run of
+// repeated bytes, which compresses well, followed by noise, which grows.
+std::string CreateSameSizeData() {
+  std::string noise;
+  uint32_t state = 1;
+  for (int i = 0; i < 256; ++i) {
+    state = state * 1103515245 + 12345;
+    noise.push_back(static_cast<char>(state >> 16));
+  }
+  for (size_t run = 0; run < 1024; ++run) {
+    std::string data = std::string(run, 'a') + noise;
+    if (Gzip(data).size() == data.size()) {
+      return data;
+    }
+  }
+  return "";
+}
+
+TEST(MessageCompressionTest, CompressesLargeMessages) {
+  MessageCompression compression(kMinSize);
+  ::grpc::ByteBuffer message = CreateByteBuffer(std::string(kMinSize, 'a'));
+  ::grpc::WriteOptions options;
+
+  compression.PrepareWrite(message, &options);
+
+  EXPECT_FALSE(options.get_no_compression());
+  EXPECT_EQ(1u, compression.stats().compressed_requests);
+  EXPECT_EQ(kMinSize, compression.stats().compressed_request_bytes);
+
+  ::grpc::WriteOptions last_options;
+  last_options.set_last_message();
+  compression.PrepareWrite(message, &last_options);
+
+  EXPECT_FALSE(last_options.get_no_compression());
+  EXPECT_TRUE(last_options.is_last_message());
+  EXPECT_EQ(2u, compression.stats().compressed_requests);
+  EXPECT_EQ(2 * kMinSize, compression.stats().compressed_request_bytes);
+}
+
+TEST(MessageCompressionTest, SendsSmallMessagesAsIs) {
+  MessageCompression compression(kMinSize);
+  ::grpc::ByteBuffer message =
+      CreateByteBuffer(std::string(kMinSize - 1, 'a'));
+  ::grpc::WriteOptions options;
+
+  compression.PrepareWrite(message, &options);
+
+  EXPECT_TRUE(options.get_no_compression());
+  EXPECT_EQ(0u, compression.stats().compressed_requests);
+  EXPECT_EQ(0u, compression.stats().compressed_request_bytes);
+}
+
+TEST(MessageCompressionTest, LeavesUncompressedResponses) {
+  MessageCompression compression(kMinSize);
+  std::string data(4 * kMinSize, 'a');
+  ::grpc::ByteBuffer message = CreateByteBuffer(data);
+
+  EXPECT_TRUE(compression.Decompress(&message));
+
+  EXPECT_EQ(data, ToString(message));
+  EXPECT_EQ(0u, compression.stats().compressed_responses);
+  EXPECT_EQ(0u, compression.stats().response_bytes_saved);
+}
+
+TEST(MessageCompressionTest, DecompressesCompressedResponses) {
+  MessageCompression compression(kMinSize);
+  std::string data(4 * kMinSize, 'a');
+  ::grpc::ByteBuffer message = CreateCompressedByteBuffer(data);
+  size_t compressed_length = message.Length();
+  ASSERT_LT(compressed_length, data.size());
+
+  EXPECT_TRUE(compression.Decompress(&message));
+
+  EXPECT_EQ(data, ToString(message));
+  EXPECT_EQ(data.size(), message.Length());
+  EXPECT_EQ(1u, compression.stats().compressed_responses);
+  EXPECT_EQ(data.size() - compressed_length,
+            compression.stats().response_bytes_saved);
+}
+
+TEST(MessageCompressionTest, DecompressesResponsesKeepingTheirSize) {
+  MessageCompression compression(kMinSize);
+  std::string data = CreateSameSizeData();
+  ASSERT_FALSE(data.empty());
+  ::grpc::ByteBuffer message = CreateCompressedByteBuffer(data);
+  ASSERT_EQ(data.size(), message.Length());
+
+  EXPECT_TRUE(compression.Decompress(&message));
+
+  // The message must not be forwarded compressed.
+  grpc_byte_buffer *buffer =
+      ::grpc::internal::GrpcByteBufferPeer(&message).c_buffer();
+  ASSERT_NE(nullptr, buffer);
+  EXPECT_EQ(GRPC_COMPRESS_NONE, buffer->data.raw.compression);
+  EXPECT_EQ(data, ToString(message));
+  EXPECT_EQ(1u, compression.stats().compressed_responses);
+  EXPECT_EQ(0u, compression.stats().response_bytes_saved);
+}
+
+TEST(MessageCompressionTest, RejectsCorruptCompressedResponses) {
+  MessageCompression compression(kMinSize);
+  grpc_slice slice = grpc_slice_from_static_string("not gzip data");
+  ::grpc::ByteBuffer message;
+  *::grpc::internal::GrpcByteBufferPeer(&message).c_buffer_ptr() =
+      grpc_raw_compressed_byte_buffer_create(&slice, 1, GRPC_COMPRESS_GZIP);
+
+  EXPECT_FALSE(compression.Decompress(&message));
+}
+
+}  // namespace
+}  // namespace testing
+}  // namespace grpc
+}  // namespace api_manager
+}  // namespace google
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) Extensible Service Proxy Authors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#ifndef GRPC_MESSAGE_PIPE_H_
+#define GRPC_MESSAGE_PIPE_H_
+
+#include <cstddef>
+#include <vector>
+
+#include "grpc++/support/byte_buffer.h"
+
+namespace google {
+namespace api_manager {
+namespace grpc {
+
+// The messages proxied in one direction.  Both gRPC and the
+// downstream ServerCall allow only one outstanding read and one
+// outstanding write, so a pipe keeps a ring of buffers: the message
+// at head is being written while the next ones, up to the ring
+// size, are read into the following slots.
+class MessagePipe {
+ public:
+  explicit MessagePipe(size_t depth)
+      : buffers_(depth > 0 ? depth : 1),
+        head_(0),
+        count_(0),
+        reading_(false),
+        writing_(false),
+        read_done_(false) {}
+
+  // Whether a read may be started: none is outstanding, the source
+  // hasn't ended, and there is a free buffer to read into.
+  bool CanRead() const {
+    return !reading_ && !read_done_ && count_ < buffers_.size();
+  }
+  // Marks a read as outstanding and returns the buffer to read into.
+  ::grpc::ByteBuffer *StartRead() {
+    reading_ = true;
+    return &buffers_[(head_ + count_) % buffers_.size()];
+  }
+  // Completes the outstanding read; has_message tells whether it
+  // produced a message, otherwise the source has ended.
+  void FinishRead(bool has_message) {
+    reading_ = false;
+    if (has_message) {
+      ++count_;
+    } else {
+      read_done_ = true;
+    }
+  }
+  // Stops reading; no more messages will be added.
+  void SetReadDone() { read_done_ = true; }
+  bool read_done() const { return read_done_; }
+
+  // Whether a write may be started.
+  bool CanWrite() const { return !writing_ && count_ > 0; }
+  // Marks a write as outstanding and returns the message to write.
+  ::grpc::ByteBuffer *StartWrite() {
+    writing_ = true;
+    return &buffers_[head_];
+  }
+  // Completes the outstanding write, freeing its buffer.
+  void FinishWrite() {
+    writing_ = false;
+    buffers_[head_].Clear();
+    head_ = (head_ + 1) % buffers_.size();
+    --count_;
+  }
+  // Whether the message at head is the last one this pipe carries.
+  bool IsLastMessage() const { return read_done_ && count_ == 1; }
+
+  // Drops the buffered messages which aren't being written.
+  void DropPending() {
+    size_t keep = writing_ ? 1 : 0;
+    while (count_ > keep) {
+      buffers_[(head_ + --count_) % buffers_.size()].Clear();
+    }
+  }
+
+  // Whether the source has ended and everything read was written.
+  bool Drained() const {
+    return read_done_ && !reading_ && !writing_ && count_ == 0;
+  }
+
+ private:
+  std::vector<::grpc::ByteBuffer> buffers_;
+  size_t head_;
+  size_t count_;
+  bool reading_;
+  bool writing_;
+  bool read_done_;
+};
+
+}  // namespace grpc
+}  // namespace api_manager
+}  // namespace google
+
+#endif  // GRPC_MESSAGE_PIPE_H_
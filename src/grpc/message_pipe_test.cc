@@ -0,0 +1,194 @@
+// Copyright (C) Extensible Service Proxy Authors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "src/grpc/message_pipe.h"
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace google {
+namespace api_manager {
+namespace grpc {
+namespace testing {
+namespace {
+
+::grpc::ByteBuffer CreateByteBuffer(const std::string &data) {
+  ::grpc::Slice slice(data);
+  return ::grpc::ByteBuffer(&slice, 1);
+}
+
+std::string ToString(const ::grpc::ByteBuffer &message) {
+  std::vector<::grpc::Slice> slices;
+  EXPECT_TRUE(message.Dump(&slices).ok());
+  std::string data;
+  for (const auto &slice : slices) {
+    data.append(reinterpret_cast<const char *>(slice.begin()), slice.size());
+  }
+  return data;
+}
+
+// Reads data into the pipe as the next message.
+void Read(MessagePipe *pipe, const std::string &data) {
+  ASSERT_TRUE(pipe->CanRead());
+  *pipe->StartRead() = CreateByteBuffer(data);
+  pipe->FinishRead(true);
+}
+
+// Writes the message at head of the pipe and returns it.
+std::string Write(MessagePipe *pipe) {
+  EXPECT_TRUE(pipe->CanWrite());
+  std::string data = ToString(*pipe->StartWrite());
+  pipe->FinishWrite();
+  return data;
+}
+
+TEST(MessagePipeTest, DepthZeroBuffersOneMessage) {
+  MessagePipe pipe(0);
+  Read(&pipe, "a");
+  EXPECT_FALSE(pipe.CanRead());
+  EXPECT_EQ("a", Write(&pipe));
+  EXPECT_TRUE(pipe.CanRead());
+}
+
+TEST(MessagePipeTest, WrapsAroundTheRing) {
+  MessagePipe pipe(3);
+  int next_read = 0;
+  int next_write = 0;
+  // Fill the ring, then keep it full while the head moves around it
+  // several times.
+  for (; next_read < 3; ++next_read) {
+    Read(&pipe, std::to_string(next_read));
+  }
+  EXPECT_FALSE(pipe.CanRead());
+  for (; next_read < 10; ++next_read) {
+    EXPECT_EQ(std::to_string(next_write++), Write(&pipe));
+    Read(&pipe, std::to_string(next_read));
+    EXPECT_FALSE(pipe.CanRead());
+  }
+  while (pipe.CanWrite()) {
+    EXPECT_EQ(std::to_string(next_write++), Write(&pipe));
+  }
+  EXPECT_EQ(10, next_write);
+}
+
+TEST(MessagePipeTest, ReadsIntoFreeSlotsWhileWriting) {
+  MessagePipe pipe(2);
+  Read(&pipe, "a");
+  ::grpc::ByteBuffer *writing = pipe.StartWrite();
+  EXPECT_FALSE(pipe.CanWrite());
+
+  Read(&pipe, "b");
+  EXPECT_FALSE(pipe.CanRead());
+  EXPECT_EQ("a", ToString(*writing));
+
+  pipe.FinishWrite();
+  EXPECT_TRUE(pipe.CanRead());
+  EXPECT_EQ("b", Write(&pipe));
+}
+
+TEST(MessagePipeTest, DropPendingDropsAllIdleMessages) {
+  MessagePipe pipe(4);
+  Read(&pipe, "a");
+  Read(&pipe, "b");
+  pipe.SetReadDone();
+  pipe.DropPending();
+  EXPECT_FALSE(pipe.CanWrite());
+  EXPECT_TRUE(pipe.Drained());
+}
+
+TEST(MessagePipeTest, DropPendingKeepsTheMessageBeingWritten) {
+  MessagePipe pipe(4);
+  Read(&pipe, "a");
+  Read(&pipe, "b");
+  Read(&pipe, "c");
+  ::grpc::ByteBuffer *writing = pipe.StartWrite();
+
+  pipe.SetReadDone();
+  pipe.DropPending();
+  EXPECT_EQ("a", ToString(*writing));
+  EXPECT_FALSE(pipe.Drained());
+
+  pipe.FinishWrite();
+  EXPECT_FALSE(pipe.CanWrite());
+  EXPECT_TRUE(pipe.Drained());
+}
+
+TEST(MessagePipeTest, IsLastMessageOnlyForTheFinalMessage) {
+  MessagePipe pipe(4);
+  Read(&pipe, "a");
+  Read(&pipe, "b");
+  Read(&pipe, "c");
+  // More messages may still be read.
+  EXPECT_FALSE(pipe.IsLastMessage());
+
+  pipe.SetReadDone();
+  EXPECT_FALSE(pipe.IsLastMessage());
+  EXPECT_EQ("a", Write(&pipe));
+  EXPECT_FALSE(pipe.IsLastMessage());
+  EXPECT_EQ("b", Write(&pipe));
+  EXPECT_TRUE(pipe.IsLastMessage());
+  EXPECT_EQ("c", Write(&pipe));
+  EXPECT_FALSE(pipe.IsLastMessage());
+}
+
+// WritesDone and Finish are started once the pipe is drained, so it must
+// not be before the source has ended and every message was written.
+TEST(MessagePipeTest, DrainedAfterTheLastWrite) {
+  MessagePipe pipe(4);
+  EXPECT_FALSE(pipe.Drained());
+
+  Read(&pipe, "a");
+  Read(&pipe, "b");
+  pipe.StartRead();
+  pipe.FinishRead(false);
+  EXPECT_TRUE(pipe.read_done());
+  EXPECT_FALSE(pipe.CanRead());
+  EXPECT_FALSE(pipe.Drained());
+
+  EXPECT_EQ("a", Write(&pipe));
+  EXPECT_FALSE(pipe.Drained());
+  pipe.StartWrite();
+  EXPECT_FALSE(pipe.Drained());
+  pipe.FinishWrite();
+  EXPECT_TRUE(pipe.Drained());
+}
+
+TEST(MessagePipeTest, NotDrainedWhileReading) {
+  MessagePipe pipe(2);
+  pipe.StartRead();
+  pipe.SetReadDone();
+  EXPECT_FALSE(pipe.Drained());
+  pipe.FinishRead(false);
+  EXPECT_TRUE(pipe.Drained());
+}
+
+}  // namespace
+}  // namespace testing
+}  // namespace grpc
+}  // namespace api_manager
+}  // namespace google
@@ -0,0 +1,124 @@
+// Copyright (C) Extensible Service Proxy Authors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "src/grpc/mpsc_ring.h"
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace google {
+namespace api_manager {
+namespace grpc {
+namespace testing {
+namespace {
+
+TEST(MpscRingTest, FullAndEmpty) {
+  MpscRing<int> ring(4);
+  int value = 0;
+  EXPECT_FALSE(ring.TryPop(&value));
+
+  // Fill and drain the ring many times over, so that the positions wrap
+  // around it.
+  int next_push = 0;
+  int next_pop = 0;
+  for (int round = 0; round < 100; ++round) {
+    while (ring.TryPush(next_push)) {
+      ++next_push;
+    }
+    EXPECT_EQ(4, next_push - next_pop);
+
+    // Taking one value makes room for exactly one more.
+    ASSERT_TRUE(ring.TryPop(&value));
+    EXPECT_EQ(next_pop++, value);
+    EXPECT_TRUE(ring.TryPush(next_push++));
+    EXPECT_FALSE(ring.TryPush(next_push));
+
+    while (ring.TryPop(&value)) {
+      EXPECT_EQ(next_pop++, value);
+    }
+    EXPECT_EQ(next_push, next_pop);
+  }
+}
+
+TEST(MpscRingTest, ManyProducers) {
+  const int kProducers = 4;
+  const uint64_t kItemsPerProducer = 200000;
+
+  // A small ring, so that the producers keep finding it full and the
+  // positions wrap around it many times.
+  MpscRing<uint64_t> ring(64);
+  std::atomic<uint64_t> full(0);
+
+  std::vector<std::thread> producers;
+  for (int p = 0; p < kProducers; ++p) {
+    producers.emplace_back([&ring, &full, p]() {
+      for (uint64_t i = 0; i < kItemsPerProducer; ++i) {
+        // The producer id in the high bits, its sequence in the low bits.
+        uint64_t value = (static_cast<uint64_t>(p) << 32) | i;
+        while (!ring.TryPush(value)) {
+          full.fetch_add(1, std::memory_order_relaxed);
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+
+  // Each producer's values must come out in the order it pushed them,
+  // none lost and none twice.
+  std::vector<uint64_t> next(kProducers, 0);
+  uint64_t received = 0;
+  uint64_t value = 0;
+  while (received < kProducers * kItemsPerProducer) {
+    if (!ring.TryPop(&value)) {
+      std::this_thread::yield();
+      continue;
+    }
+    uint64_t p = value >> 32;
+    ASSERT_LT(p, static_cast<uint64_t>(kProducers));
+    ASSERT_EQ(next[p], value & 0xffffffff) << "producer " << p;
+    ++next[p];
+    ++received;
+  }
+
+  for (auto &producer : producers) {
+    producer.join();
+  }
+  EXPECT_FALSE(ring.TryPop(&value));
+  for (int p = 0; p < kProducers; ++p) {
+    EXPECT_EQ(kItemsPerProducer, next[p]);
+  }
+  EXPECT_GT(full.load(), 0u);
+}
+
+}  // namespace
+}  // namespace testing
+}  // namespace grpc
+}  // namespace api_manager
+}  // namespace google
@@ -30,8 +30,10 @@
 #include "grpc/support/alloc.h"
 #include "include/api_manager/utils/status.h"
 #include "src/core/lib/slice/b64.h"
+#include "src/grpc/request_headers.h"
 
 using ::google::api_manager::utils::Status;
+using ::google::protobuf::util::error::INTERNAL;
 using ::google::protobuf::util::error::UNAVAILABLE;
 using ::google::protobuf::util::error::UNKNOWN;
 using std::chrono::system_clock;
@@ -122,62 +124,82 @@ namespace grpc {
 //
 // All transitions labeled [success] also define an implicit
 // transition to "DownstreamFinish" in case of error.
+//
+// With a pipeline depth above one, the Read -> Write -> Read loops
+// above don't wait for a write to complete before reading the next
+// message: each direction keeps reading into free buffers of its
+// MessagePipe while the oldest buffered message is being written, and
+// a completed write restarts a read that stalled on a full pipe.  The
+// end of a direction (UpstreamWritesDone, UpstreamFinish) is only
+// started once its buffered messages have been written.
 
 namespace {
 
-const std::unordered_set<std::string> kHeadersToSkip = {
-    // gRPC requests (HTTP2) with a host header will lead some gRPC servers to
-    // reject it, so the host header is skipped here.
-    "host",
-
-    // HTTP/2 prohibits connection-specific header fields.
-    // The following header fields must not appear
-    "connection",
-    "proxy-connection",
-    "transfer-encoding",
-    "upgrade",
-
-    // GRPC lib will add following headers, so removing them.
-    "grpc-encoding",
-    "grpc-accept-encoding",
-};
-
-// The headers to prefix with "x-forwarded-"
-// grpc client addes these headers, it will override the original
-// headers. The original headers should be prefixed with "x-forwarded-".
-const std::unordered_set<std::string> kHeadersToAddPrefix = {
-    "user-agent",
-};
-
-Status ProcessDownstreamHeaders(
-    const std::multimap<std::string, std::string> &headers,
-    ::grpc::ClientContext *context) {
+// Timeouts longer than this are as good as none.
+const std::chrono::hours kMaxGrpcTimeout(24 * 365);
+
+// Parses a grpc-timeout header value: an integer of at most 8 digits
+// followed by a unit, one of H, M, S, m, u and n.  A zero timeout is
+// valid, it means the call's deadline has passed already.
+bool ParseGrpcTimeout(::grpc::string_ref value,
+                      std::chrono::microseconds *timeout) {
+  if (value.size() < 2 || value.size() > 9) {
+    return false;
+  }
+  const char *data = value.data();
+  int64_t amount = 0;
+  for (size_t i = 0; i + 1 < value.size(); ++i) {
+    if (data[i] < '0' || data[i] > '9') {
+      return false;
+    }
+    amount = amount * 10 + (data[i] - '0');
+  }
+  switch (data[value.size() - 1]) {
+    case 'H':
+      *timeout = std::chrono::hours(amount);
+      return true;
+    case 'M':
+      *timeout = std::chrono::minutes(amount);
+      return true;
+    case 'S':
+      *timeout = std::chrono::seconds(amount);
+      return true;
+    case 'm':
+      *timeout = std::chrono::milliseconds(amount);
+      return true;
+    case 'u':
+      *timeout = std::chrono::microseconds(amount);
+      return true;
+    case 'n':
+      // Rounded up, so that a non-zero timeout stays one.
+      *timeout = std::chrono::microseconds((amount + 999) / 1000);
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Gets the timeout a gRPC client set for the call with a grpc-timeout
+// header.  Returns false if it didn't set a usable one.
+bool GetGrpcTimeout(const std::vector<ProxyFlow::Header> &headers,
+                    std::chrono::microseconds *timeout) {
   for (const auto &it : headers) {
-    if (kHeadersToSkip.find(it.first) != kHeadersToSkip.end()) {
-      continue;
+    if (it.first == "grpc-timeout") {
+      return ParseGrpcTimeout(it.second, timeout) &&
+             *timeout <= kMaxGrpcTimeout;
     }
-    // GRPC runtime libraries use "-bin" suffix to detect binary headers and
-    // properly apply base64 encoding & decoding as headers are sent and
-    // received. So we decode here before passing it to GRPC runtime.
-    if (grpc_is_binary_header(::grpc::SliceReferencingString(it.first))) {
-      // Workaround for https://github.com/grpc/grpc/issues/8624
-      if (it.second.length() == 0) {
-        continue;
-      }
-      ::grpc::Slice value_slice(
-          grpc_base64_decode_with_len(it.second.c_str(), it.second.length(),
-                                      false),
-          ::grpc::Slice::STEAL_REF);
-      std::string binary_value(
-          reinterpret_cast<const char *>(value_slice.begin()),
-          value_slice.size());
-      context->AddMetadata(it.first, std::move(binary_value));
-    } else {
-      if (kHeadersToAddPrefix.find(it.first) != kHeadersToSkip.end()) {
-        context->AddMetadata("x-forwarded-" + it.first, it.second);
-      } else {
-        context->AddMetadata(it.first, it.second);
-      }
+  }
+  return false;
+}
+
+Status ProcessDownstreamHeaders(const std::vector<ProxyFlow::Header> &headers,
+                                ::grpc::ClientContext *context) {
+  // The context keeps its own copy of the metadata; these are only reused
+  // to pass each header to it.
+  std::string key, value;
+  for (const auto &it : headers) {
+    if (ForwardRequestHeader(it.first, it.second, &key, &value)) {
+      context->AddMetadata(key, value);
     }
   }
   return Status::OK;
@@ -219,9 +241,30 @@ void ProxyFlow::Start(AsyncGrpcQueue *async_grpc_queue,
                       std::shared_ptr<ServerCall> server_call,
                       std::shared_ptr<::grpc::GenericStub> upstream_stub,
                       const std::string &method,
-                      const std::multimap<std::string, std::string> &headers) {
+                      const std::vector<Header> &headers,
+                      size_t pipeline_depth,
+                      std::shared_ptr<MessageCompression> compression,
+                      std::chrono::milliseconds timeout) {
   auto flow = std::make_shared<ProxyFlow>(
-      async_grpc_queue, std::move(server_call), upstream_stub);
+      async_grpc_queue, std::move(server_call), upstream_stub, pipeline_depth,
+      std::move(compression));
+  // The shorter of the client's timeout and the configured one applies.
+  std::chrono::microseconds upstream_timeout;
+  bool has_timeout = GetGrpcTimeout(headers, &upstream_timeout);
+  if (timeout > std::chrono::milliseconds::zero() &&
+      (!has_timeout || timeout < upstream_timeout)) {
+    upstream_timeout = timeout;
+    has_timeout = true;
+  }
+  if (has_timeout) {
+    flow->upstream_context_.set_deadline(system_clock::now() +
+                                         upstream_timeout);
+  }
+  if (flow->compression_) {
+    // Messages too small to be worth compressing are sent as is; see
+    // StartUpstreamWriteMessage.
+    flow->upstream_context_.set_compression_algorithm(GRPC_COMPRESS_GZIP);
+  }
   Status status = ProcessDownstreamHeaders(headers, &flow->upstream_context_);
   if (status.ok()) {
     ProxyFlow::StartUpstreamCall(flow, method);
@@ -232,14 +275,22 @@ void ProxyFlow::Start(AsyncGrpcQueue *async_grpc_queue,
 
 ProxyFlow::ProxyFlow(AsyncGrpcQueue *async_grpc_queue,
                      std::shared_ptr<ServerCall> server_call,
-                     std::shared_ptr<::grpc::GenericStub> upstream_stub)
+                     std::shared_ptr<::grpc::GenericStub> upstream_stub,
+                     size_t pipeline_depth,
+                     std::shared_ptr<MessageCompression> compression)
     : sent_upstream_writes_done_(false),
       started_upstream_finish_(false),
       sent_downstream_finish_(false),
+      cancelled_upstream_(false),
       async_grpc_queue_(async_grpc_queue),
       server_call_(std::move(server_call)),
       upstream_stub_(std::move(upstream_stub)),
-      status_from_esp_(Status::OK) {}
+      compression_(std::move(compression)),
+      status_from_esp_(Status::OK),
+      downstream_to_upstream_(pipeline_depth),
+      upstream_to_downstream_(pipeline_depth),
+      downstream_last_message_(false),
+      downstream_read_status_(Status::OK) {}
 
 Status ProxyFlow::StatusFromGRPCStatus(const ::grpc::Status &status) {
   // The GRPC error code space happens to match the protocol buffer
@@ -269,24 +320,45 @@ void ProxyFlow::StartUpstreamCall(std::shared_ptr<ProxyFlow> flow,
         StartUpstreamReadInitialMetadata(flow);
         StartDownstreamReadMessage(flow);
       }));
+  RegisterGrpcUpstreamCancel(flow);
 }
 
 void ProxyFlow::StartDownstreamReadMessage(std::shared_ptr<ProxyFlow> flow) {
+  ::grpc::ByteBuffer *buffer;
   {
     std::lock_guard<std::mutex> lock(flow->mu_);
-    if (flow->sent_downstream_finish_) {
+    if (flow->sent_downstream_finish_ ||
+        !flow->downstream_to_upstream_.CanRead()) {
       return;
     }
+    buffer = flow->downstream_to_upstream_.StartRead();
   }
-  flow->server_call_->Read(&flow->downstream_to_upstream_buffer_,
-                           [flow](bool proceed, utils::Status status) {
-                             if (proceed) {
-                               StartUpstreamWriteMessage(
-                                   flow, status == Status::DONE);
-                             } else {
-                               StartUpstreamWritesDone(flow, status);
-                             }
-                           });
+  flow->server_call_->Read(buffer, [flow](bool proceed, utils::Status status) {
+    bool writes_done = false;
+    {
+      std::lock_guard<std::mutex> lock(flow->mu_);
+      flow->downstream_to_upstream_.FinishRead(proceed);
+      if (proceed) {
+        if (status == Status::DONE) {
+          flow->downstream_last_message_ = true;
+          flow->downstream_to_upstream_.SetReadDone();
+        }
+      } else {
+        flow->downstream_read_status_ = status;
+        if (!status.ok()) {
+          flow->downstream_to_upstream_.DropPending();
+        }
+        // Messages still buffered are written before WritesDone.
+        writes_done = flow->downstream_to_upstream_.Drained();
+      }
+    }
+    if (writes_done) {
+      StartUpstreamWritesDone(flow, status);
+      return;
+    }
+    StartUpstreamWriteMessage(flow);
+    StartDownstreamReadMessage(flow);
+  });
 }
 
 void ProxyFlow::StartUpstreamWritesDone(std::shared_ptr<ProxyFlow> flow,
@@ -297,7 +369,6 @@ void ProxyFlow::StartUpstreamWritesDone(std::shared_ptr<ProxyFlow> flow,
       return;
     }
     flow->sent_upstream_writes_done_ = true;
-    RegisterGrpcUpstreamCancel(flow);
   }
   flow->upstream_reader_writer_->WritesDone(
       flow->async_grpc_queue_->MakeTag([flow, status](bool ok) {
@@ -308,38 +379,61 @@ void ProxyFlow::StartUpstreamWritesDone(std::shared_ptr<ProxyFlow> flow,
           return;
         }
         if (!status.ok()) {
+          // The downstream failed; the backend's response is of no use.
+          StartUpstreamCancel(flow);
           StartDownstreamFinish(flow, status);
           return;
         }
       }));
 }
 
-void ProxyFlow::StartUpstreamWriteMessage(std::shared_ptr<ProxyFlow> flow,
-                                          bool last) {
+void ProxyFlow::StartUpstreamWriteMessage(std::shared_ptr<ProxyFlow> flow) {
   ::grpc::WriteOptions options;
-  if (last) {
-    options.set_last_message();
+  ::grpc::ByteBuffer *buffer;
+  {
     std::lock_guard<std::mutex> lock(flow->mu_);
-    if (flow->sent_upstream_writes_done_) {
+    if (!flow->downstream_to_upstream_.CanWrite()) {
       return;
     }
-    flow->sent_upstream_writes_done_ = true;
-    RegisterGrpcUpstreamCancel(flow);
+    if (flow->downstream_last_message_ &&
+        flow->downstream_to_upstream_.IsLastMessage()) {
+      if (flow->sent_upstream_writes_done_) {
+        return;
+      }
+      options.set_last_message();
+      flow->sent_upstream_writes_done_ = true;
+    }
+    buffer = flow->downstream_to_upstream_.StartWrite();
   }
   flow->server_call_->UpdateRequestMessageStat(
-      static_cast<int64_t>(flow->downstream_to_upstream_buffer_.Length()));
+      static_cast<int64_t>(buffer->Length()));
+  if (flow->compression_) {
+    flow->compression_->PrepareWrite(*buffer, &options);
+  }
   flow->upstream_reader_writer_->Write(
-      flow->downstream_to_upstream_buffer_, options,
-      flow->async_grpc_queue_->MakeTag([flow](bool ok) {
-        flow->downstream_to_upstream_buffer_.Clear();
+      *buffer, options, flow->async_grpc_queue_->MakeTag([flow](bool ok) {
+        bool writes_done;
+        Status status = Status::OK;
+        {
+          std::lock_guard<std::mutex> lock(flow->mu_);
+          flow->downstream_to_upstream_.FinishWrite();
+          writes_done = flow->downstream_to_upstream_.Drained();
+          status = flow->downstream_read_status_;
+        }
         if (!ok) {
           // Upstream is not writable, call finish to get status and
           // and finish the call
           StartUpstreamFinish(flow);
           return;
         }
-        // Now that the write has completed, it's safe to start the
-        // next read.
+        if (writes_done) {
+          // The downstream ended while this write was in flight.
+          StartUpstreamWritesDone(flow, status);
+          return;
+        }
+        // A buffer is free again: keep writing what has been read
+        // already, and read more.
+        StartUpstreamWriteMessage(flow);
         StartDownstreamReadMessage(flow);
       }));
 }
@@ -379,6 +473,7 @@ void ProxyFlow::StartDownstreamWriteInitialMetadata(
   }
   flow->server_call_->SendInitialMetadata(initial_metadata, [flow](bool ok) {
     if (!ok) {
+      StartUpstreamCancel(flow);
       StartDownstreamFinish(
           flow,
           Status(UNKNOWN, std::string("failed to send initial metadata")));
@@ -387,44 +482,83 @@ void ProxyFlow::StartDownstreamWriteInitialMetadata(
 }
 
 void ProxyFlow::StartUpstreamReadMessage(std::shared_ptr<ProxyFlow> flow) {
+  ::grpc::ByteBuffer *buffer;
   {
     std::lock_guard<std::mutex> lock(flow->mu_);
-    if (flow->sent_downstream_finish_) {
+    if (flow->sent_downstream_finish_ ||
+        !flow->upstream_to_downstream_.CanRead()) {
       return;
     }
+    buffer = flow->upstream_to_downstream_.StartRead();
   }
   flow->upstream_reader_writer_->Read(
-      &flow->upstream_to_downstream_buffer_,
-      flow->async_grpc_queue_->MakeTag([flow](bool ok) {
-        if (!ok) {
+      buffer, flow->async_grpc_queue_->MakeTag([flow, buffer](bool ok) {
+        if (ok && flow->compression_ &&
+            !flow->compression_->Decompress(buffer)) {
+          {
+            std::lock_guard<std::mutex> lock(flow->mu_);
+            flow->upstream_to_downstream_.FinishRead(false);
+          }
+          StartUpstreamCancel(flow);
+          StartDownstreamFinish(
+              flow,
+              Status(INTERNAL,
+                     std::string("failed to decompress a message from the "
+                                 "upstream backend")));
+          return;
+        }
+        bool finish;
+        {
+          std::lock_guard<std::mutex> lock(flow->mu_);
+          flow->upstream_to_downstream_.FinishRead(ok);
+          // Messages still buffered are written before finishing.
+          finish = flow->upstream_to_downstream_.Drained();
+        }
+        if (finish) {
           StartUpstreamFinish(flow);
           return;
         }
         StartDownstreamWriteMessage(flow);
+        StartUpstreamReadMessage(flow);
       }));
 }
 
 void ProxyFlow::StartDownstreamWriteMessage(std::shared_ptr<ProxyFlow> flow) {
+  ::grpc::ByteBuffer *buffer;
   {
     std::lock_guard<std::mutex> lock(flow->mu_);
-    if (flow->sent_downstream_finish_) {
+    if (flow->sent_downstream_finish_ ||
+        !flow->upstream_to_downstream_.CanWrite()) {
       return;
     }
+    buffer = flow->upstream_to_downstream_.StartWrite();
   }
   flow->server_call_->UpdateResponseMessageStat(
-      static_cast<int64_t>(flow->upstream_to_downstream_buffer_.Length()));
-  flow->server_call_->Write(
-      flow->upstream_to_downstream_buffer_, [flow](bool ok) {
-        if (!ok) {
-          StartDownstreamFinish(
-              flow,
-              Status(UNKNOWN,
-                     std::string(
-                         "failed to send a message to the downstream client")));
-          return;
-        }
-        StartUpstreamReadMessage(flow);
-      });
+      static_cast<int64_t>(buffer->Length()));
+  flow->server_call_->Write(*buffer, [flow](bool ok) {
+    bool finish;
+    {
+      std::lock_guard<std::mutex> lock(flow->mu_);
+      flow->upstream_to_downstream_.FinishWrite();
+      finish = flow->upstream_to_downstream_.Drained();
+    }
+    if (!ok) {
+      StartUpstreamCancel(flow);
+      StartDownstreamFinish(
+          flow,
+          Status(UNKNOWN,
+                 std::string("failed to send a message to the downstream "
+                             "client")));
+      return;
+    }
+    if (finish) {
+      // The upstream ended while this write was in flight.
+      StartUpstreamFinish(flow);
+      return;
+    }
+    StartDownstreamWriteMessage(flow);
+    StartUpstreamReadMessage(flow);
+  });
 }
 
 void ProxyFlow::StartUpstreamFinish(std::shared_ptr<ProxyFlow> flow) {
@@ -467,14 +601,36 @@ void ProxyFlow::StartDownstreamFinish(std::shared_ptr<ProxyFlow> flow,
                              system_clock::now() - flow->start_time_)
                              .count();
   flow->server_call_->RecordBackendTime(backend_time);
+  bool cancelled;
+  {
+    std::lock_guard<std::mutex> lock(flow->mu_);
+    cancelled = flow->cancelled_upstream_;
+  }
+  flow->server_call_->RecordUpstreamStatus(status, cancelled);
   flow->server_call_->Finish(status, std::move(response_trailers));
 }
 
-void ProxyFlow::RegisterGrpcUpstreamCancel(std::shared_ptr<ProxyFlow> flow) {
-  flow->server_call_->SetGrpcUpstreamCancel([flow]() {
-    flow->upstream_context_.TryCancel();
+void ProxyFlow::StartUpstreamCancel(std::shared_ptr<ProxyFlow> flow) {
+  bool finish;
+  {
+    std::lock_guard<std::mutex> lock(flow->mu_);
+    if (flow->sent_downstream_finish_ || flow->started_upstream_finish_ ||
+        flow->cancelled_upstream_) {
+      return;
+    }
+    flow->cancelled_upstream_ = true;
+    // Until then, a pending upstream write fails and finishes the call.
+    finish = flow->sent_upstream_writes_done_;
+  }
+  flow->upstream_context_.TryCancel();
+  if (finish) {
     StartUpstreamFinish(flow);
-  });
+  }
+}
+
+void ProxyFlow::RegisterGrpcUpstreamCancel(std::shared_ptr<ProxyFlow> flow) {
+  flow->server_call_->SetGrpcUpstreamCancel(
+      [flow]() { StartUpstreamCancel(flow); });
 }
 
 }  // namespace grpc
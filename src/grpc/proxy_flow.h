@@ -26,13 +26,18 @@
 #ifndef GRPC_PROXY_FLOW_H_
 #define GRPC_PROXY_FLOW_H_
 
+#include <chrono>
 #include <memory>
 #include <mutex>
+#include <utility>
+#include <vector>
 
 #include "grpc++/generic/async_generic_service.h"
 #include "grpc++/generic/generic_stub.h"
 #include "include/api_manager/utils/status.h"
 #include "src/grpc/async_grpc_queue.h"
+#include "src/grpc/message_compression.h"
+#include "src/grpc/message_pipe.h"
 #include "src/grpc/server_call.h"
 
 namespace google {
@@ -41,18 +46,40 @@ namespace grpc {
 
 class ProxyFlow {
  public:
+  // A downstream request header as a (lowercase key, value) pair.  The
+  // strings are referenced, not owned, and only need to stay valid for
+  // the duration of the Start() call.
+  typedef std::pair<::grpc::string_ref, ::grpc::string_ref> Header;
+
   // Invoked when a call is accepted by the server.  This call
   // instantiates an asynchronous ProxyFlow object which handles
   // proxying the GRPC call to an upstream backend server.
+  //
+  // pipeline_depth is the number of messages per direction that may
+  // be buffered between reading them from one side and writing them
+  // to the other.  With a depth of 1 each message is fully written
+  // before the next one is read.
+  //
+  // If compression is set, the messages sent upstream are gzip
+  // compressed and the compressed ones received are decompressed by it.
+  //
+  // The upstream call's deadline is set from the timeout a gRPC client
+  // sends in the grpc-timeout header, bounded by timeout unless that's
+  // zero.
   static void Start(AsyncGrpcQueue *async_grpc_queue,
                     std::shared_ptr<ServerCall> server_call,
                     std::shared_ptr<::grpc::GenericStub> upstream_stub,
                     const std::string &method,
-                    const std::multimap<std::string, std::string> &headers);
+                    const std::vector<Header> &headers,
+                    size_t pipeline_depth,
+                    std::shared_ptr<MessageCompression> compression,
+                    std::chrono::milliseconds timeout);
 
   ProxyFlow(AsyncGrpcQueue *async_grpc_queue,
             std::shared_ptr<ServerCall> server_call,
-            std::shared_ptr<::grpc::GenericStub> upstream_stub);
+            std::shared_ptr<::grpc::GenericStub> upstream_stub,
+            size_t pipeline_depth,
+            std::shared_ptr<MessageCompression> compression);
   ~ProxyFlow() {}
 
  private:
@@ -69,8 +96,7 @@ class ProxyFlow {
   static void StartDownstreamReadMessage(std::shared_ptr<ProxyFlow> flow);
   static void StartUpstreamWritesDone(std::shared_ptr<ProxyFlow> flow,
                                       utils::Status status);
-  static void StartUpstreamWriteMessage(std::shared_ptr<ProxyFlow> flow,
-                                        bool last);
+  static void StartUpstreamWriteMessage(std::shared_ptr<ProxyFlow> flow);
 
   // The upstream->downstream functions:
   static void StartUpstreamReadInitialMetadata(std::shared_ptr<ProxyFlow> flow);
@@ -82,13 +108,15 @@ class ProxyFlow {
   static void StartDownstreamFinish(std::shared_ptr<ProxyFlow> flow,
                                     utils::Status status);
 
-  // NOTE: For gRPC steaming, at this point client-side streaming is done, but
-  // server-side streaming is not. There needs to be an additional mechanism
-  // to detect RST_STREAM and finish upstream properly. This problem can arise
-  // for server-side streaming when ESP is connected with connection pooling
-  // and multiple requests share a single HTTP connection.
-  // This function must be called when `sent_upstream_writes_done_` is set to
-  // true.
+  // Cancels the upstream call, unless it has ended already, because the
+  // downstream call is ending first.
+  static void StartUpstreamCancel(std::shared_ptr<ProxyFlow> flow);
+
+  // NOTE: The downstream call may go away without ESP reading or writing
+  // anything on it, e.g. while a server-side streaming call waits for the
+  // backend's next message.  This registers StartUpstreamCancel to run
+  // when nginx sees the client disconnect or frees the request; it is
+  // called when the upstream call is started.
   static void RegisterGrpcUpstreamCancel(std::shared_ptr<ProxyFlow> flow);
 
   std::mutex mu_;
@@ -103,16 +131,27 @@ class ProxyFlow {
   // If true, we've sent a final status to the downstream client.
   bool sent_downstream_finish_;
 
+  // If true, ESP cancelled the upstream call.
+  bool cancelled_upstream_;
+
   AsyncGrpcQueue *async_grpc_queue_;
   std::shared_ptr<ServerCall> server_call_;
   std::shared_ptr<::grpc::GenericStub> upstream_stub_;
+  std::shared_ptr<MessageCompression> compression_;
   ::grpc::ClientContext upstream_context_;
   std::unique_ptr<::grpc::GenericClientAsyncReaderWriter>
       upstream_reader_writer_;
   utils::Status status_from_esp_;
   ::grpc::Status status_from_upstream_;
-  ::grpc::ByteBuffer downstream_to_upstream_buffer_;
-  ::grpc::ByteBuffer upstream_to_downstream_buffer_;
+  MessagePipe downstream_to_upstream_;
+  MessagePipe upstream_to_downstream_;
+
+  // If true, the last downstream message has been read and must be
+  // written upstream with the last message flag.
+  bool downstream_last_message_;
+
+  // How the downstream stopped sending messages.
+  utils::Status downstream_read_status_;
 
   // The backend request start time.
   std::chrono::system_clock::time_point start_time_;
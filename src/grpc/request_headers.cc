@@ -0,0 +1,134 @@
+// Copyright (C) Extensible Service Proxy Authors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+//
+#include "src/grpc/request_headers.h"
+
+#include "grpc/slice.h"
+#include "src/core/lib/slice/b64.h"
+
+namespace google {
+namespace api_manager {
+namespace grpc {
+
+namespace {
+
+// What to do with a downstream request header.
+enum class HeaderDisposition {
+  // Forward the header as is.
+  FORWARD,
+  // Drop the header.
+  SKIP,
+  // Forward the header under an "x-forwarded-" prefix.
+  ADD_PREFIX,
+};
+
+struct HeaderRule {
+  ::grpc::string_ref key;
+  HeaderDisposition disposition;
+};
+
+const HeaderRule kHeaderRules[] = {
+    // gRPC requests (HTTP2) with a host header will lead some gRPC servers to
+    // reject it, so the host header is skipped here.
+    {"host", HeaderDisposition::SKIP},
+
+    // HTTP/2 prohibits connection-specific header fields.
+    // The following header fields must not appear
+    {"connection", HeaderDisposition::SKIP},
+    {"keep-alive", HeaderDisposition::SKIP},
+    {"proxy-connection", HeaderDisposition::SKIP},
+    {"te", HeaderDisposition::SKIP},
+    {"transfer-encoding", HeaderDisposition::SKIP},
+    {"upgrade", HeaderDisposition::SKIP},
+
+    // GRPC lib will add following headers, so removing them.
+    {"grpc-encoding", HeaderDisposition::SKIP},
+    {"grpc-accept-encoding", HeaderDisposition::SKIP},
+    // Sent by the library from the upstream call's deadline, which is set
+    // from this; see GetGrpcTimeout() in proxy_flow.cc.
+    {"grpc-timeout", HeaderDisposition::SKIP},
+
+    // ESP's internal debugging header, read by the URL rewrite.
+    {"x-endpoints-debug-url-rewrite", HeaderDisposition::SKIP},
+
+    // grpc client addes these headers, it will override the original
+    // headers. The original headers should be prefixed with "x-forwarded-".
+    {"user-agent", HeaderDisposition::ADD_PREFIX},
+};
+
+const char kForwardedPrefix[] = "x-forwarded-";
+
+// Keys are expected to be lowercase already, so this is a plain compare
+// against the handful of special headers.
+HeaderDisposition GetHeaderDisposition(::grpc::string_ref key) {
+  for (const auto &rule : kHeaderRules) {
+    if (key.size() == rule.key.size() && key == rule.key) {
+      return rule.disposition;
+    }
+  }
+  return HeaderDisposition::FORWARD;
+}
+
+// GRPC runtime libraries use "-bin" suffix to detect binary headers.
+bool IsBinaryHeader(::grpc::string_ref key) { return key.ends_with("-bin"); }
+
+}  // namespace
+
+bool ForwardRequestHeader(::grpc::string_ref header_key,
+                          ::grpc::string_ref header_value, std::string *key,
+                          std::string *value) {
+  HeaderDisposition disposition = GetHeaderDisposition(header_key);
+  if (disposition == HeaderDisposition::SKIP) {
+    return false;
+  }
+
+  // GRPC runtime libraries apply base64 encoding & decoding to binary
+  // headers as they are sent and received. So we decode here before
+  // passing it to GRPC runtime.
+  if (IsBinaryHeader(header_key)) {
+    // Workaround for https://github.com/grpc/grpc/issues/8624
+    if (header_value.length() == 0) {
+      return false;
+    }
+    grpc_slice decoded = grpc_base64_decode_with_len(
+        header_value.data(), header_value.length(), false);
+    value->assign(reinterpret_cast<const char *>(GRPC_SLICE_START_PTR(decoded)),
+                  GRPC_SLICE_LENGTH(decoded));
+    grpc_slice_unref(decoded);
+  } else {
+    value->assign(header_value.data(), header_value.size());
+  }
+
+  if (disposition == HeaderDisposition::ADD_PREFIX) {
+    key->assign(kForwardedPrefix);
+    key->append(header_key.data(), header_key.size());
+  } else {
+    key->assign(header_key.data(), header_key.size());
+  }
+  return true;
+}
+
+}  // namespace grpc
+}  // namespace api_manager
+}  // namespace google
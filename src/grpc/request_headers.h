@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) Extensible Service Proxy Authors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#ifndef GRPC_REQUEST_HEADERS_H_
+#define GRPC_REQUEST_HEADERS_H_
+
+#include <string>
+
+#include "grpc++/support/string_ref.h"
+
+namespace google {
+namespace api_manager {
+namespace grpc {
+
+// Maps a downstream request header to the metadata sent upstream with a
+// proxied gRPC call.  The key must be lowercase.
+//
+// Returns false if the header isn't forwarded: hop-by-hop headers, the
+// ones the gRPC library sends itself and ESP-internal ones.  Otherwise
+// the metadata key and value are stored in *key and *value, which are
+// overwritten rather than reallocated, so that a caller reusing them for
+// every header of a call doesn't allocate per header.
+bool ForwardRequestHeader(::grpc::string_ref header_key,
+                          ::grpc::string_ref header_value, std::string *key,
+                          std::string *value);
+
+}  // namespace grpc
+}  // namespace api_manager
+}  // namespace google
+
+#endif  // GRPC_REQUEST_HEADERS_H_
@@ -0,0 +1,124 @@
+// Copyright (C) Extensible Service Proxy Authors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "src/grpc/request_headers.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace google {
+namespace api_manager {
+namespace grpc {
+namespace testing {
+namespace {
+
+TEST(RequestHeadersTest, ForwardsOrdinaryHeaders) {
+  std::string key, value;
+  ASSERT_TRUE(ForwardRequestHeader("x-custom", "custom value", &key, &value));
+  EXPECT_EQ("x-custom", key);
+  EXPECT_EQ("custom value", value);
+
+  ASSERT_TRUE(ForwardRequestHeader("authorization", "Bearer token", &key,
+                                   &value));
+  EXPECT_EQ("authorization", key);
+  EXPECT_EQ("Bearer token", value);
+}
+
+TEST(RequestHeadersTest, SkipsHopByHopHeaders) {
+  std::string key = "unchanged", value = "unchanged";
+  for (const char *header :
+       {"host", "connection", "keep-alive", "proxy-connection", "te",
+        "transfer-encoding", "upgrade"}) {
+    EXPECT_FALSE(ForwardRequestHeader(header, "value", &key, &value))
+        << header;
+  }
+  EXPECT_EQ("unchanged", key);
+  EXPECT_EQ("unchanged", value);
+}
+
+TEST(RequestHeadersTest, SkipsHeadersTheLibrarySends) {
+  std::string key, value;
+  EXPECT_FALSE(ForwardRequestHeader("grpc-encoding", "gzip", &key, &value));
+  EXPECT_FALSE(
+      ForwardRequestHeader("grpc-accept-encoding", "gzip", &key, &value));
+  EXPECT_FALSE(ForwardRequestHeader("grpc-timeout", "10S", &key, &value));
+}
+
+TEST(RequestHeadersTest, SkipsInternalHeaders) {
+  std::string key, value;
+  EXPECT_FALSE(ForwardRequestHeader("x-endpoints-debug-url-rewrite", "true",
+                                    &key, &value));
+}
+
+TEST(RequestHeadersTest, MatchesWholeKeys) {
+  std::string key, value;
+  EXPECT_TRUE(ForwardRequestHeader("hostname", "value", &key, &value));
+  EXPECT_EQ("hostname", key);
+  EXPECT_TRUE(ForwardRequestHeader("t", "value", &key, &value));
+  EXPECT_EQ("t", key);
+}
+
+TEST(RequestHeadersTest, PrefixesUserAgent) {
+  std::string key, value;
+  ASSERT_TRUE(ForwardRequestHeader("user-agent", "grpc-go/1.0", &key, &value));
+  EXPECT_EQ("x-forwarded-user-agent", key);
+  EXPECT_EQ("grpc-go/1.0", value);
+}
+
+TEST(RequestHeadersTest, DecodesBinaryHeaders) {
+  std::string key, value;
+  // "AAEC/w" is the unpadded base64 encoding of 00 01 02 ff.
+  ASSERT_TRUE(ForwardRequestHeader("x-data-bin", "AAEC/w", &key, &value));
+  EXPECT_EQ("x-data-bin", key);
+  EXPECT_EQ(std::string("\x00\x01\x02\xff", 4), value);
+
+  ASSERT_TRUE(ForwardRequestHeader("x-data-bin", "AAEC/w==", &key, &value));
+  EXPECT_EQ(std::string("\x00\x01\x02\xff", 4), value);
+}
+
+TEST(RequestHeadersTest, SkipsEmptyBinaryHeaders) {
+  std::string key, value;
+  EXPECT_FALSE(ForwardRequestHeader("x-data-bin", "", &key, &value));
+}
+
+TEST(RequestHeadersTest, OverwritesBuffers) {
+  std::string key, value;
+  ASSERT_TRUE(ForwardRequestHeader("x-long-header-name",
+                                   std::string(1024, 'v'), &key, &value));
+  const char *value_data = value.data();
+  ASSERT_TRUE(ForwardRequestHeader("x-short", "v", &key, &value));
+  EXPECT_EQ("x-short", key);
+  EXPECT_EQ("v", value);
+  // A shorter value reuses the storage of the longer one.
+  EXPECT_EQ(value_data, value.data());
+}
+
+}  // namespace
+}  // namespace testing
+}  // namespace grpc
+}  // namespace api_manager
+}  // namespace google
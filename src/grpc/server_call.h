@@ -58,6 +58,10 @@ class ServerCall {
       const utils::Status &status,
       std::multimap<std::string, std::string> response_trailers) = 0;
   virtual void RecordBackendTime(int64_t backend_time) = 0;
+  // Records the final status of the upstream call; cancelled is true if
+  // ESP cancelled it because the downstream call ended first.
+  virtual void RecordUpstreamStatus(const utils::Status &status,
+                                    bool cancelled) = 0;
 
   virtual void UpdateRequestMessageStat(int64_t size) = 0;
   virtual void UpdateResponseMessageStat(int64_t size) = 0;
@@ -24,6 +24,7 @@
 #include "google/protobuf/io/zero_copy_stream.h"
 #include "google/protobuf/stubs/common.h"
 #include "google/protobuf/stubs/status.h"
+#include "google/protobuf/stubs/strutil.h"
 #include "google/protobuf/util/json_util.h"
 #include "grpc_transcoding/json_request_translator.h"
 #include "grpc_transcoding/message_stream.h"
@@ -81,52 +82,51 @@ class TranscoderImpl : public Transcoder {
   std::unique_ptr<TranscoderInputStream> response_stream_;
 };
 
-// Converts MethodCallInfo into a RequestInfo structure needed by the
-// JsonRequestTranslator.
-pbutil::Status MethodCallInfoToRequestInfo(TypeHelper* type_helper,
-                                           const MethodCallInfo& call_info,
-                                           RequestInfo* request_info) {
-  // Try to resolve the request type
-  const auto& request_type_url = call_info.method_info->request_type_url();
-  request_info->message_type =
-      type_helper->Info()->GetTypeByTypeUrl(request_type_url);
-  if (nullptr == request_info->message_type) {
-    return pbutil::Status(pberr::NOT_FOUND,
-                          "Could not resolve the type \"" + request_type_url +
-                              "\". Invalid service configuration.");
-  }
-
-  // Copy the body field path
-  request_info->body_field_path = call_info.body_field_path;
-
-  // Resolve the field paths of the bindings and add to the request_info
-  for (const auto& unresolved_binding : call_info.variable_bindings) {
-    RequestWeaver::BindingInfo resolved_binding;
-
-    // Verify that the value is valid UTF8 before continuing
-    if (!pb::internal::IsStructurallyValidUTF8(
-            unresolved_binding.value.c_str(),
-            unresolved_binding.value.size())) {
-      return pbutil::Status(pberr::INVALID_ARGUMENT,
-                            "Encountered non UTF-8 code points.");
+// Appends the field paths of the variables in an HTTP path template, e.g.
+// {"shelf"} and {"book", "name"} for "/shelves/{shelf}/{book.name=*}".
+void AddTemplateVariables(const std::string& path_template,
+                          std::vector<std::vector<std::string>>* variables) {
+  size_t start = path_template.find('{');
+  while (start != std::string::npos) {
+    size_t end = path_template.find_first_of("=}", start + 1);
+    if (end == std::string::npos) {
+      return;
     }
-
-    resolved_binding.value = unresolved_binding.value;
-
-    // Try to resolve the field path
-    auto status = type_helper->ResolveFieldPath(*request_info->message_type,
-                                                unresolved_binding.field_path,
-                                                &resolved_binding.field_path);
-    if (!status.ok()) {
-      // Field path could not be resolved (usually a config error) - return
-      // the error.
-      return status;
-    }
-
-    request_info->variable_bindings.emplace_back(std::move(resolved_binding));
+    variables->emplace_back(
+        pb::Split(path_template.substr(start + 1, end - start - 1), ".",
+                  /*skip_empty*/ true));
+    start = path_template.find('{', end);
   }
+}
 
-  return pbutil::Status::OK;
+// Collects the variables of an HTTP rule and its additional bindings.
+void AddRuleVariables(const ::google::api::HttpRule& rule,
+                      std::vector<std::vector<std::string>>* variables) {
+  switch (rule.pattern_case()) {
+    case ::google::api::HttpRule::kGet:
+      AddTemplateVariables(rule.get(), variables);
+      break;
+    case ::google::api::HttpRule::kPut:
+      AddTemplateVariables(rule.put(), variables);
+      break;
+    case ::google::api::HttpRule::kPost:
+      AddTemplateVariables(rule.post(), variables);
+      break;
+    case ::google::api::HttpRule::kDelete:
+      AddTemplateVariables(rule.delete_(), variables);
+      break;
+    case ::google::api::HttpRule::kPatch:
+      AddTemplateVariables(rule.patch(), variables);
+      break;
+    case ::google::api::HttpRule::kCustom:
+      AddTemplateVariables(rule.custom().path(), variables);
+      break;
+    default:
+      break;
+  }
+  for (const auto& binding : rule.additional_bindings()) {
+    AddRuleVariables(binding, variables);
+  }
 }
 
 // This class combines two resolvers: if the first one could not find it,
@@ -168,7 +168,121 @@ TranscoderFactory::TranscoderFactory(
     : type_helper_(service.types(), service.enums()),
       json_print_options_(json_print_options),
       status_resolver_(new TwoTypeResolvers(type_helper_.Resolver(),
-                                            utils::GetTypeResolver())) {}
+                                            utils::GetTypeResolver())) {
+  BuildRequestPlans(service);
+}
+
+void TranscoderFactory::BuildRequestPlans(
+    const ::google::api::Service& service) {
+  std::unordered_map<std::string, const std::string*> request_type_urls;
+  for (const auto& api : service.apis()) {
+    for (const auto& method : api.methods()) {
+      const std::string& type_url = method.request_type_url();
+      request_type_urls[api.name() + "." + method.name()] = &type_url;
+      if (plans_.find(type_url) != plans_.end()) {
+        continue;
+      }
+      const pb::Type* type = type_helper_.Info()->GetTypeByTypeUrl(type_url);
+      if (type != nullptr) {
+        plans_[type_url].message_type = type;
+      }
+    }
+  }
+
+  for (const auto& rule : service.http().rules()) {
+    auto type_url = request_type_urls.find(rule.selector());
+    if (type_url == request_type_urls.end()) {
+      continue;
+    }
+    auto plan = plans_.find(*type_url->second);
+    if (plan == plans_.end()) {
+      continue;
+    }
+
+    std::vector<std::vector<std::string>> variables;
+    AddRuleVariables(rule, &variables);
+    for (auto& variable : variables) {
+      if (plan->second.field_paths.count(variable) > 0) {
+        continue;
+      }
+      std::vector<const pb::Field*> field_path;
+      // Unresolvable paths are left to fail per request as before.
+      if (type_helper_
+              .ResolveFieldPath(*plan->second.message_type, variable,
+                                &field_path)
+              .ok()) {
+        plan->second.field_paths.emplace(std::move(variable),
+                                         std::move(field_path));
+      }
+    }
+  }
+}
+
+pbutil::Status TranscoderFactory::MethodCallInfoToRequestInfo(
+    const MethodCallInfo& call_info, RequestInfo* request_info) {
+  // Use the request plan if there is one, otherwise resolve the request
+  // type.
+  const auto& request_type_url = call_info.method_info->request_type_url();
+  const RequestPlan* plan = nullptr;
+  auto plan_it = plans_.find(request_type_url);
+  if (plan_it != plans_.end()) {
+    plan = &plan_it->second;
+    request_info->message_type = plan->message_type;
+  } else {
+    request_info->message_type =
+        type_helper_.Info()->GetTypeByTypeUrl(request_type_url);
+  }
+  if (nullptr == request_info->message_type) {
+    return pbutil::Status(pberr::NOT_FOUND,
+                          "Could not resolve the type \"" + request_type_url +
+                              "\". Invalid service configuration.");
+  }
+
+  // Copy the body field path
+  request_info->body_field_path = call_info.body_field_path;
+
+  // Resolve the field paths of the bindings and add to the request_info
+  request_info->variable_bindings.reserve(call_info.variable_bindings.size());
+  for (const auto& unresolved_binding : call_info.variable_bindings) {
+    RequestWeaver::BindingInfo resolved_binding;
+
+    // Verify that the value is valid UTF8 before continuing
+    if (!pb::internal::IsStructurallyValidUTF8(
+            unresolved_binding.value.c_str(),
+            unresolved_binding.value.size())) {
+      return pbutil::Status(pberr::INVALID_ARGUMENT,
+                            "Encountered non UTF-8 code points.");
+    }
+
+    resolved_binding.value = unresolved_binding.value;
+
+    const std::vector<const pb::Field*>* field_path = nullptr;
+    if (plan != nullptr) {
+      auto it = plan->field_paths.find(unresolved_binding.field_path);
+      if (it != plan->field_paths.end()) {
+        field_path = &it->second;
+      }
+    }
+
+    if (field_path != nullptr) {
+      resolved_binding.field_path = *field_path;
+    } else {
+      // Try to resolve the field path
+      auto status = type_helper_.ResolveFieldPath(
+          *request_info->message_type, unresolved_binding.field_path,
+          &resolved_binding.field_path);
+      if (!status.ok()) {
+        // Field path could not be resolved (usually a config error) - return
+        // the error.
+        return status;
+      }
+    }
+
+    request_info->variable_bindings.emplace_back(std::move(resolved_binding));
+  }
+
+  return pbutil::Status::OK;
+}
 
 pbutil::Status TranscoderFactory::Create(
     const MethodCallInfo& call_info, pbio::ZeroCopyInputStream* request_input,
@@ -176,8 +290,7 @@ pbutil::Status TranscoderFactory::Create(
     std::unique_ptr<Transcoder>* transcoder) {
   // Convert MethodCallInfo into RequestInfo
   RequestInfo request_info;
-  auto status =
-      MethodCallInfoToRequestInfo(&type_helper_, call_info, &request_info);
+  auto status = MethodCallInfoToRequestInfo(call_info, &request_info);
   if (!status.ok()) {
     return status;
   }
@@ -15,12 +15,17 @@
 #ifndef GRPC_TRANSCODING_TRANSODER_FACTORY_H_
 #define GRPC_TRANSCODING_TRANSODER_FACTORY_H_
 
+#include <map>
 #include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "google/api/service.pb.h"
 #include "google/protobuf/io/zero_copy_stream.h"
 #include "google/protobuf/stubs/status.h"
 #include "google/protobuf/util/json_util.h"
+#include "grpc_transcoding/request_message_translator.h"
 #include "grpc_transcoding/transcoder.h"
 #include "grpc_transcoding/transcoder_input_stream.h"
 #include "grpc_transcoding/type_helper.h"
@@ -58,6 +63,11 @@ namespace transcoding {
 //                           response_upstream,
 //                           &transcoder);
 //
+// The request message types of the service's methods, and the field paths
+// of the variables in their HTTP rules, are resolved once when the factory
+// is created.  Only bindings outside of those (e.g. query parameters) are
+// resolved per request.
+//
 class TranscoderFactory {
  public:
   // service - The service config for which the factory is created
@@ -85,9 +95,29 @@ class TranscoderFactory {
   }
 
  private:
+  // The resolved request message type of a method, and the resolved field
+  // paths of its HTTP rule variables keyed by their dotted parts.
+  struct RequestPlan {
+    const ::google::protobuf::Type* message_type;
+    std::map<std::vector<std::string>,
+             std::vector<const ::google::protobuf::Field*>>
+        field_paths;
+  };
+
+  // Fills plans_ from the service's APIs and HTTP rules.
+  void BuildRequestPlans(const ::google::api::Service& service_config);
+
+  // Converts MethodCallInfo into the RequestInfo needed by the
+  // JsonRequestTranslator.
+  ::google::protobuf::util::Status MethodCallInfoToRequestInfo(
+      const MethodCallInfo& call_info,
+      ::google::grpc::transcoding::RequestInfo* request_info);
+
   ::google::grpc::transcoding::TypeHelper type_helper_;
   ::google::protobuf::util::JsonPrintOptions json_print_options_;
   std::unique_ptr<::google::protobuf::util::TypeResolver> status_resolver_;
+  // Keyed by request type URL.
+  std::unordered_map<std::string, RequestPlan> plans_;
 };
 
 }  // namespace transcoding
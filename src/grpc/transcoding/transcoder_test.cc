@@ -102,6 +102,7 @@ class TestMethodInfo : public MethodInfo {
         BackendRule_PathTranslation_PATH_TRANSLATION_UNSPECIFIED;
   }
   const std::string &backend_jwt_audience() const { return empty_; }
+  double backend_deadline() const { return 0; }
 
   const std::string &rpc_method_full_name() const { return empty_; }
   const std::set<std::string> &system_query_parameter_names() const {
@@ -487,6 +488,44 @@ TEST_F(TranscoderTest, StreamingRequestAndResponse) {
       << std::endl;
 }
 
+TEST_F(TranscoderTest, RequestBindingsReusedAcrossRequests) {
+  ASSERT_TRUE(LoadService("bookstore_service.pb.txt"));
+
+  // The factory resolves the field paths once; make sure every request still
+  // gets its own values, including for bindings resolved per request.
+  for (const std::string &shelf : {"1", "2", "3"}) {
+    SetMethodInfo(/*request_type_url*/ "type.googleapis.com/CreateBookRequest",
+                  /*response_type_url*/ "type.googleapis.com/Book",
+                  /*request_streaming*/ false,
+                  /*response_streaming*/ false,
+                  /*body_field_path*/ "book");
+    AddVariableBinding("shelf", shelf);
+    AddVariableBinding("book.authorInfo.lastName", "Author " + shelf);
+
+    CreateBookRequest expected;
+    ASSERT_TRUE(pb::TextFormat::ParseFromString(
+        "shelf : " + shelf + " book { title : \"Book\" author_info { " +
+            "last_name : \"Author " + shelf + "\" } }",
+        &expected));
+
+    std::unique_ptr<Transcoder> t;
+    TestZeroCopyInputStream request_in, response_in;
+    auto status = Build(&request_in, &response_in, &t);
+    ASSERT_TRUE(status.ok()) << "Error building Transcoder - "
+                             << status.error_message() << std::endl;
+
+    request_in.AddChunk(R"({"title" : "Book"})");
+
+    MessageReader reader(t->RequestOutput());
+    auto actual_proto = reader.NextMessage();
+    ASSERT_NE(nullptr, actual_proto.get());
+
+    CreateBookRequest actual;
+    ASSERT_TRUE(actual.ParseFromZeroCopyStream(actual_proto.get()));
+    EXPECT_TRUE(pbutil::MessageDifferencer::Equivalent(expected, actual));
+  }
+}
+
 TEST_F(TranscoderTest, ErrorResolvingVariableBinding) {
   ASSERT_TRUE(LoadService("bookstore_service.pb.txt"));
   SetMethodInfo(/*request_type_url*/ "type.googleapis.com/Shelf",
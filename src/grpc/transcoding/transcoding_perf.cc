@@ -0,0 +1,572 @@
+// Copyright (C) Extensible Service Proxy Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+// Measures JSON -> proto and proto -> JSON throughput of the transcoders
+// created by TranscoderFactory, in unary and streaming modes.
+//
+// The payloads are google.api.Service messages: the test/data/8k.json and
+// test/data/35k.json service configs, plus synthetic deep (nested HTTP rule
+// bindings) and wide (many HTTP rules) configs. For each case it reports
+// MB/s, C++ heap allocations per request and latency percentiles.
+//
+//   bazel run -c opt //src/grpc/transcoding:transcoding_perf
+//
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "google/api/service.pb.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
+#include "google/protobuf/struct.pb.h"
+#include "google/protobuf/util/json_util.h"
+#include "google/protobuf/util/type_resolver_util.h"
+#include "grpc++/support/byte_buffer.h"
+#include "include/api_manager/method.h"
+#include "include/api_manager/method_call_info.h"
+#include "src/grpc/transcoding/transcoder_factory.h"
+#include "src/grpc/zero_copy_stream.h"
+
+namespace {
+
+// Number of C++ heap allocations made so far, see operator new below.
+size_t allocation_count = 0;
+
+}  // namespace
+
+void *operator new(size_t size) {
+  ++allocation_count;
+  void *p = std::malloc(size == 0 ? 1 : size);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+namespace pb = ::google::protobuf;
+namespace pbio = ::google::protobuf::io;
+namespace pbutil = ::google::protobuf::util;
+
+using ::google::api_manager::MethodCallInfo;
+using ::google::api_manager::MethodInfo;
+using ::google::api_manager::grpc::GrpcZeroCopyInputStream;
+using ::google::api_manager::transcoding::TranscoderFactory;
+using ::google::grpc::transcoding::Transcoder;
+
+namespace {
+
+const char kTypeUrlPrefix[] = "type.googleapis.com";
+const char kServiceType[] = "type.googleapis.com/google.api.Service";
+
+// Requests per case, after kWarmupRequests that are not measured.
+const int kRequests = 1000;
+const int kWarmupRequests = 20;
+
+// Messages in a streaming request or response.
+const int kStreamMessages = 8;
+
+// nginx hands the request body to the transcoder in buffers of this size.
+const int kRequestChunkSize = 16 * 1024;
+
+// Shape of the synthetic configs.
+const int kDeepLevels = 24;
+const int kWideRules = 1000;
+
+// MethodInfo of the transcoded method. Only implements the methods that the
+// TranscoderFactory needs.
+class PerfMethodInfo : public MethodInfo {
+ public:
+  explicit PerfMethodInfo(bool streaming) : streaming_(streaming) {}
+
+  // Methods that the Transcoder doesn't use
+  const std::string &name() const { return empty_; }
+  const std::string &api_name() const { return empty_; }
+  const std::string &api_version() const { return empty_; }
+  const std::string &selector() const { return empty_; }
+  bool auth() const { return false; }
+  bool allow_unregistered_calls() const { return false; }
+  bool skip_service_control() const { return false; }
+  bool isIssuerAllowed(const std::string &issuer) const { return false; }
+  bool isAudienceAllowed(const std::string &issuer,
+                         const std::set<std::string> &jwt_audiences) const {
+    return false;
+  }
+  const std::vector<std::string> *http_header_parameters(
+      const std::string &name) const {
+    return nullptr;
+  }
+  const std::vector<std::string> *url_query_parameters(
+      const std::string &name) const {
+    return nullptr;
+  }
+  const std::vector<std::string> *api_key_http_headers() const {
+    return nullptr;
+  }
+  const std::vector<std::string> *api_key_url_query_parameters() const {
+    return nullptr;
+  }
+  const std::string &backend_address() const { return empty_; }
+  const std::string &backend_path() const { return empty_; }
+  const ::google::api::BackendRule_PathTranslation backend_path_translation()
+      const {
+    return ::google::api::
+        BackendRule_PathTranslation_PATH_TRANSLATION_UNSPECIFIED;
+  }
+  const std::string &backend_jwt_audience() const { return empty_; }
+  double backend_deadline() const { return 0; }
+  const std::string &rpc_method_full_name() const { return empty_; }
+  const std::set<std::string> &system_query_parameter_names() const {
+    return empty_names_;
+  };
+  bool keep_binding_escaped() const { return false; }
+  const std::vector<std::pair<std::string, int>> &metric_cost_vector() const {
+    return metric_cost_vector_;
+  }
+  const std::string &authorization_url_by_issuer(
+      const std::string &issuer) const {
+    return empty_;
+  }
+  const std::string &first_authorization_url() const { return empty_; }
+
+  // Methods that the Transcoder does use
+  const std::string &request_type_url() const { return type_url_; }
+  bool request_streaming() const { return streaming_; }
+  const std::string &response_type_url() const { return type_url_; }
+  bool response_streaming() const { return streaming_; }
+  const std::string &body_field_path() const { return empty_; }
+
+ private:
+  const std::string type_url_ = kServiceType;
+  bool streaming_;
+  std::string empty_;
+  std::set<std::string> empty_names_;
+  std::vector<std::pair<std::string, int>> metric_cost_vector_;
+};
+
+// Builds the service config the transcoders are created from: a single
+// method taking and returning google.api.Service, with all the types it
+// needs.
+::google::api::Service PerfService() {
+  ::google::api::Service service;
+  auto *api = service.add_apis();
+  api->set_name("perf.Perf");
+  auto *method = api->add_methods();
+  method->set_name("Transcode");
+  method->set_request_type_url(kServiceType);
+  method->set_response_type_url(kServiceType);
+  auto *rule = service.mutable_http()->add_rules();
+  rule->set_selector("perf.Perf.Transcode");
+  rule->set_post("/v1/{name}");
+  rule->set_body("*");
+
+  std::unique_ptr<pbutil::TypeResolver> resolver(
+      pbutil::NewTypeResolverForDescriptorPool(
+          kTypeUrlPrefix, pb::DescriptorPool::generated_pool()));
+  std::set<std::string> seen;
+  std::vector<const pb::Descriptor *> pending = {
+      ::google::api::Service::descriptor()};
+  while (!pending.empty()) {
+    const pb::Descriptor *message = pending.back();
+    pending.pop_back();
+    if (!seen.insert(message->full_name()).second) {
+      continue;
+    }
+    resolver->ResolveMessageType(
+        std::string(kTypeUrlPrefix) + "/" + message->full_name(),
+        service.add_types());
+    for (int i = 0; i < message->field_count(); ++i) {
+      const pb::FieldDescriptor *field = message->field(i);
+      if (field->message_type() != nullptr) {
+        pending.push_back(field->message_type());
+      } else if (field->enum_type() != nullptr &&
+                 seen.insert(field->enum_type()->full_name()).second) {
+        resolver->ResolveEnumType(
+            std::string(kTypeUrlPrefix) + "/" + field->enum_type()->full_name(),
+            service.add_enums());
+      }
+    }
+  }
+  return service;
+}
+
+// A transcoded payload: the JSON of its messages and their binary form.
+struct Payload {
+  std::string name;
+  std::vector<std::string> json_messages;
+  std::vector<std::string> proto_messages;
+};
+
+// Fills the binary form of the payload messages. Fields unknown to this
+// version of google.api.Service are dropped from the JSON so that the
+// transcoder accepts it. Returns false if the JSON is not a
+// google.api.Service.
+bool FillProtoMessages(Payload *payload) {
+  for (auto &json : payload->json_messages) {
+    ::google::api::Service message;
+    pbutil::JsonParseOptions options;
+    options.ignore_unknown_fields = true;
+    auto status = pbutil::JsonStringToMessage(json, &message, options);
+    if (!status.ok()) {
+      std::cerr << payload->name << ": " << status.ToString() << std::endl;
+      return false;
+    }
+    json.clear();
+    pbutil::MessageToJsonString(message, &json);
+    payload->proto_messages.emplace_back(message.SerializeAsString());
+  }
+  return true;
+}
+
+// Loads a payload file holding a service config or an array of them.
+bool LoadPayload(const std::string &file_name, Payload *payload) {
+  std::ifstream file(file_name);
+  if (!file) {
+    std::cerr << "Could not open " << file_name << std::endl;
+    return false;
+  }
+  std::stringstream content;
+  content << file.rdbuf();
+
+  pb::Value value;
+  auto status = pbutil::JsonStringToMessage(content.str(), &value);
+  if (!status.ok()) {
+    std::cerr << file_name << ": " << status.ToString() << std::endl;
+    return false;
+  }
+
+  payload->name = file_name;
+  if (value.has_list_value()) {
+    for (const auto &element : value.list_value().values()) {
+      std::string json;
+      pbutil::MessageToJsonString(element, &json);
+      payload->json_messages.emplace_back(std::move(json));
+    }
+  } else {
+    payload->json_messages.emplace_back(content.str());
+  }
+  return FillProtoMessages(payload);
+}
+
+Payload SyntheticPayload(const std::string &name,
+                         const ::google::api::Service &message) {
+  Payload payload;
+  payload.name = name;
+  std::string json;
+  pbutil::MessageToJsonString(message, &json);
+  payload.json_messages.emplace_back(std::move(json));
+  FillProtoMessages(&payload);
+  return payload;
+}
+
+// A config whose single HTTP rule nests kDeepLevels additional bindings.
+Payload DeepPayload() {
+  ::google::api::Service message;
+  message.set_name("deep.example.com");
+  auto *rule = message.mutable_http()->add_rules();
+  for (int i = 0; i < kDeepLevels; ++i) {
+    rule->set_selector("deep.Deep.Method" + std::to_string(i));
+    rule->set_get("/v1/level" + std::to_string(i) + "/{name}");
+    rule = rule->add_additional_bindings();
+  }
+  return SyntheticPayload("synthetic deep", message);
+}
+
+// A config with kWideRules HTTP rules.
+Payload WidePayload() {
+  ::google::api::Service message;
+  message.set_name("wide.example.com");
+  for (int i = 0; i < kWideRules; ++i) {
+    auto *rule = message.mutable_http()->add_rules();
+    rule->set_selector("wide.Wide.Method" + std::to_string(i));
+    rule->set_post("/v1/method" + std::to_string(i) + "/{name}");
+    rule->set_body("*");
+  }
+  return SyntheticPayload("synthetic wide", message);
+}
+
+// Measurements of the requests of one case.
+class Results {
+ public:
+  void Add(std::chrono::nanoseconds latency, size_t bytes,
+           size_t allocations) {
+    latencies_.push_back(latency);
+    total_ += latency;
+    bytes_ += bytes;
+    allocations_ += allocations;
+  }
+
+  void Print(const std::string &name) {
+    std::sort(latencies_.begin(), latencies_.end());
+    double seconds = std::chrono::duration<double>(total_).count();
+    std::printf("%-40s %9.1f MB/s %9.1f allocs %9.1f %9.1f %9.1f us\n",
+                name.c_str(), bytes_ / seconds / (1024 * 1024),
+                static_cast<double>(allocations_) / latencies_.size(),
+                Percentile(0.5), Percentile(0.9), Percentile(0.99));
+  }
+
+ private:
+  double Percentile(double p) const {
+    size_t i = static_cast<size_t>(p * (latencies_.size() - 1));
+    return std::chrono::duration<double, std::micro>(latencies_[i]).count();
+  }
+
+  std::vector<std::chrono::nanoseconds> latencies_;
+  std::chrono::nanoseconds total_{0};
+  size_t bytes_ = 0;
+  size_t allocations_ = 0;
+};
+
+// Reads the whole stream and returns the number of bytes read.
+size_t Drain(pbio::ZeroCopyInputStream *stream) {
+  size_t bytes = 0;
+  const void *data = nullptr;
+  int size = 0;
+  while (stream->Next(&data, &size) && size > 0) {
+    bytes += size;
+  }
+  return bytes;
+}
+
+// Returns the JSON messages a request or response of the mode carries, a
+// JSON array when streaming.
+std::string JsonBody(const Payload &payload, bool streaming) {
+  if (!streaming) {
+    return payload.json_messages.front();
+  }
+  std::string body = "[";
+  for (int i = 0; i < kStreamMessages; ++i) {
+    for (const auto &json : payload.json_messages) {
+      if (body.size() > 1) {
+        body += ",";
+      }
+      body += json;
+    }
+  }
+  return body + "]";
+}
+
+// Returns the binary messages a response of the mode carries.
+std::vector<const std::string *> ProtoMessages(const Payload &payload,
+                                               bool streaming) {
+  std::vector<const std::string *> messages;
+  if (!streaming) {
+    messages.push_back(&payload.proto_messages.front());
+    return messages;
+  }
+  for (int i = 0; i < kStreamMessages; ++i) {
+    for (const auto &proto : payload.proto_messages) {
+      messages.push_back(&proto);
+    }
+  }
+  return messages;
+}
+
+grpc_byte_buffer *ByteBuffer(const std::string &message) {
+  grpc_slice slice =
+      grpc_slice_from_copied_buffer(message.data(), message.size());
+  grpc_byte_buffer *buffer = grpc_raw_byte_buffer_create(&slice, 1);
+  grpc_slice_unref(slice);
+  return buffer;
+}
+
+// Copies the transcoded request into gRPC slices, as
+// NgxEspTranscodedGrpcServerCall::ConvertRequestBody does for the backend
+// call.
+void ReadSlices(pbio::ZeroCopyInputStream *stream,
+                std::vector<grpc_slice> *slices) {
+  const void *data = nullptr;
+  int size = 0;
+  while (stream->Next(&data, &size) && size > 0) {
+    slices->push_back(grpc_slice_from_copied_buffer(
+        reinterpret_cast<const char *>(data), size));
+  }
+}
+
+// Returns the number of gRPC messages framed in the slices, or -1 if the
+// last frame is incomplete.  Releases the slices.
+int CountMessages(std::vector<grpc_slice> *slices) {
+  std::string frames;
+  for (const auto &slice : *slices) {
+    frames.append(reinterpret_cast<const char *>(GRPC_SLICE_START_PTR(slice)),
+                  GRPC_SLICE_LENGTH(slice));
+    grpc_slice_unref(slice);
+  }
+  slices->clear();
+
+  int messages = 0;
+  size_t pos = 0;
+  while (pos + 5 <= frames.size()) {
+    const unsigned char *header =
+        reinterpret_cast<const unsigned char *>(frames.data() + pos);
+    size_t length = (size_t(header[1]) << 24) | (size_t(header[2]) << 16) |
+                    (size_t(header[3]) << 8) | size_t(header[4]);
+    pos += 5 + length;
+    ++messages;
+  }
+  return pos == frames.size() ? messages : -1;
+}
+
+// JSON -> proto: transcodes the request body, fed in nginx sized chunks, into
+// the gRPC slices sent to the backend.
+bool RunRequests(TranscoderFactory *factory, const Payload &payload,
+                 bool streaming) {
+  PerfMethodInfo method_info(streaming);
+  std::string body = JsonBody(payload, streaming);
+  int expected_messages = 1;
+  if (streaming) {
+    expected_messages =
+        kStreamMessages * static_cast<int>(payload.json_messages.size());
+  }
+  Results results;
+
+  for (int i = 0; i < kWarmupRequests + kRequests; ++i) {
+    size_t allocations = allocation_count;
+    auto start = std::chrono::steady_clock::now();
+
+    MethodCallInfo call_info;
+    call_info.method_info = &method_info;
+    call_info.body_field_path = method_info.body_field_path();
+    pbio::ArrayInputStream request_in(body.data(), body.size(),
+                                      kRequestChunkSize);
+    GrpcZeroCopyInputStream response_in;
+    std::unique_ptr<Transcoder> transcoder;
+    std::vector<grpc_slice> slices;
+    auto status =
+        factory->Create(call_info, &request_in, &response_in, &transcoder);
+    if (status.ok()) {
+      ReadSlices(transcoder->RequestOutput(), &slices);
+      status = transcoder->RequestStatus();
+    }
+    transcoder.reset();
+
+    auto end = std::chrono::steady_clock::now();
+    allocations = allocation_count - allocations;
+
+    int messages = CountMessages(&slices);
+    if (!status.ok()) {
+      std::cerr << payload.name << ": " << status.ToString() << std::endl;
+      return false;
+    }
+    if (messages != expected_messages) {
+      std::cerr << payload.name << ": " << messages << " gRPC messages, "
+                << expected_messages << " expected" << std::endl;
+      return false;
+    }
+    if (i >= kWarmupRequests) {
+      results.Add(end - start, body.size(), allocations);
+    }
+  }
+
+  results.Print(payload.name + (streaming ? " stream" : " unary") +
+                " request");
+  return true;
+}
+
+// proto -> JSON: transcodes the gRPC response messages.
+bool RunResponses(TranscoderFactory *factory, const Payload &payload,
+                  bool streaming) {
+  PerfMethodInfo method_info(streaming);
+  std::vector<const std::string *> messages =
+      ProtoMessages(payload, streaming);
+  Results results;
+
+  for (int i = 0; i < kWarmupRequests + kRequests; ++i) {
+    // The gRPC byte buffers come from the backend, don't count them.
+    std::vector<grpc_byte_buffer *> buffers;
+    for (const auto *message : messages) {
+      buffers.push_back(ByteBuffer(*message));
+    }
+
+    size_t allocations = allocation_count;
+    auto start = std::chrono::steady_clock::now();
+
+    MethodCallInfo call_info;
+    call_info.method_info = &method_info;
+    call_info.body_field_path = method_info.body_field_path();
+    pbio::ArrayInputStream request_in("", 0);
+    GrpcZeroCopyInputStream response_in;
+    for (auto *buffer : buffers) {
+      response_in.AddMessage(buffer, true);
+    }
+    response_in.Finish();
+    std::unique_ptr<Transcoder> transcoder;
+    size_t bytes = 0;
+    auto status =
+        factory->Create(call_info, &request_in, &response_in, &transcoder);
+    if (status.ok()) {
+      bytes = Drain(transcoder->ResponseOutput());
+      status = transcoder->ResponseStatus();
+    }
+    if (!status.ok()) {
+      std::cerr << payload.name << ": " << status.ToString() << std::endl;
+      return false;
+    }
+    transcoder.reset();
+
+    auto end = std::chrono::steady_clock::now();
+    if (i >= kWarmupRequests) {
+      results.Add(end - start, bytes, allocation_count - allocations);
+    }
+  }
+
+  results.Print(payload.name + (streaming ? " stream" : " unary") +
+                " response");
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  std::vector<std::string> files = {"test/data/8k.json", "test/data/35k.json"};
+  if (argc > 1) {
+    files.assign(argv + 1, argv + argc);
+  }
+
+  std::vector<Payload> payloads;
+  for (const auto &file : files) {
+    Payload payload;
+    if (!LoadPayload(file, &payload)) {
+      return 1;
+    }
+    payloads.emplace_back(std::move(payload));
+  }
+  payloads.emplace_back(DeepPayload());
+  payloads.emplace_back(WidePayload());
+
+  TranscoderFactory factory(PerfService());
+
+  std::printf("%-40s %14s %16s %9s %9s %9s\n", "case", "throughput",
+              "per request", "p50", "p90", "p99");
+  bool ok = true;
+  for (const auto &payload : payloads) {
+    for (bool streaming : {false, true}) {
+      ok = RunRequests(&factory, payload, streaming) && ok;
+      ok = RunResponses(&factory, payload, streaming) && ok;
+    }
+  }
+  return ok ? 0 : 1;
+}
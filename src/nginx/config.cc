@@ -43,6 +43,7 @@ namespace google {
 namespace api_manager {
 namespace nginx {
 
+using ::google::api_manager::proto::GrpcBackendChannelConfig;
 using ::google::api_manager::proto::GrpcSslCredentials;
 using ::google::api_manager::proto::ServerConfig;
 
@@ -673,6 +674,15 @@ ngx_int_t ngx_esp_build_server_config(ngx_conf_t *cf, ngx_esp_loc_conf_t *lc,
       cf, lc, config.grpc_backend_ssl_credentials());
   if (ret != NGX_OK) return ret;
 
+  if (config.has_grpc_backend_channel_config()) {
+    lc->grpc_channel_config = RegisterPoolCleanup(
+        cf->pool, new (cf->pool) GrpcBackendChannelConfig(
+                      config.grpc_backend_channel_config()));
+    if (lc->grpc_channel_config == nullptr) {
+      return NGX_ERROR;
+    }
+  }
+
   // Reserialize
   if (!config.SerializeToString(server_config)) {
     ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
@@ -29,35 +29,180 @@
 #include "src/nginx/http.h"
 #include "src/nginx/util.h"
 
+#include <chrono>
 #include <stdexcept>
+#include <vector>
 
 namespace google {
 namespace api_manager {
 namespace nginx {
 
-void NgxEspEnv::Log(LogLevel level, const char *message) {
-  ngx_uint_t ngx_level;
+namespace {
+
+ngx_uint_t NgxLogLevel(ApiManagerEnvInterface::LogLevel level) {
   switch (level) {
-    case DEBUG:
-      ngx_level = NGX_LOG_DEBUG;
-      break;
-    case INFO:
-      ngx_level = NGX_LOG_INFO;
-      break;
-    case WARNING:
-      ngx_level = NGX_LOG_WARN;
-      break;
-    case ERROR:
+    case ApiManagerEnvInterface::DEBUG:
+      return NGX_LOG_DEBUG;
+    case ApiManagerEnvInterface::INFO:
+      return NGX_LOG_INFO;
+    case ApiManagerEnvInterface::WARNING:
+      return NGX_LOG_WARN;
+    case ApiManagerEnvInterface::ERROR:
     default:
-      ngx_level = NGX_LOG_ERR;
-      break;
+      return NGX_LOG_ERR;
+  }
+}
+
+// Splits the server of a GRPCRequest into the channel target and
+// whether the channel uses TLS.
+std::pair<std::string, bool> GrpcTarget(const std::string &server) {
+  static const std::string kHttp = "http://";
+  static const std::string kHttps = "https://";
+  std::string target = server;
+  bool tls = true;
+  if (target.compare(0, kHttp.size(), kHttp) == 0) {
+    target.erase(0, kHttp.size());
+    tls = false;
+  } else if (target.compare(0, kHttps.size(), kHttps) == 0) {
+    target.erase(0, kHttps.size());
+  }
+  size_t slash = target.find('/');
+  if (slash != std::string::npos) {
+    target.erase(slash);
+  }
+  size_t bracket = target.rfind(']');
+  size_t colon = target.rfind(':');
+  if (colon == std::string::npos ||
+      (bracket != std::string::npos && colon < bracket)) {
+    target += tls ? ":443" : ":80";
+  }
+  return std::make_pair(target, tls);
+}
+
+// A unary call made on behalf of the API Manager.  The object owns
+// itself from Start() until the request's callback has run; all of
+// its completions are delivered on the main nginx thread.  The queue is
+// owned by the module's main conf, which outlives the call.
+class NgxEspGrpcCall {
+ public:
+  NgxEspGrpcCall(NgxEspGrpcQueue *queue,
+                 std::shared_ptr<::grpc::GenericStub> stub,
+                 std::unique_ptr<GRPCRequest> request)
+      : queue_(queue),
+        stub_(std::move(stub)),
+        request_(std::move(request)),
+        method_("/" + request_->service() + "/" + request_->method()),
+        has_response_(false),
+        retries_(0) {
+    ::grpc::Slice slice(request_->body());
+    request_body_ = ::grpc::ByteBuffer(&slice, 1);
+  }
+
+  void Start() {
+    context_.reset(new ::grpc::ClientContext());
+    if (request_->timeout_ms() > 0) {
+      context_->set_deadline(
+          std::chrono::system_clock::now() +
+          std::chrono::milliseconds(request_->timeout_ms()));
+    }
+    if (!request_->auth_token().empty()) {
+      context_->AddMetadata("authorization",
+                            "Bearer " + request_->auth_token());
+    }
+    stream_ = stub_->Call(context_.get(), method_, queue_->GetQueue(),
+                          NgxEspGrpcQueue::AllocTag([this](bool ok) {
+                            if (!ok) {
+                              Finish();
+                              return;
+                            }
+                            Write();
+                          }));
+  }
+
+ private:
+  void Write() {
+    stream_->Write(request_body_, ::grpc::WriteOptions().set_last_message(),
+                   NgxEspGrpcQueue::AllocTag([this](bool ok) {
+                     if (!ok) {
+                       Finish();
+                       return;
+                     }
+                     Read();
+                   }));
+  }
+
+  void Read() {
+    stream_->Read(&response_body_, NgxEspGrpcQueue::AllocTag([this](bool ok) {
+                    has_response_ = ok;
+                    Finish();
+                  }));
+  }
+
+  void Finish() {
+    stream_->Finish(&status_, NgxEspGrpcQueue::AllocTag(
+                                  [this](bool ok) { OnFinished(); }));
   }
 
+  void OnFinished() {
+    if (status_.error_code() == ::grpc::StatusCode::UNAVAILABLE &&
+        retries_ < request_->max_retries()) {
+      ++retries_;
+      stream_.reset();
+      response_body_.Clear();
+      has_response_ = false;
+      Start();
+      return;
+    }
+
+    std::string body;
+    if (status_.ok() && has_response_) {
+      std::vector<::grpc::Slice> slices;
+      response_body_.Dump(&slices);
+      for (const auto &slice : slices) {
+        body.append(reinterpret_cast<const char *>(slice.begin()),
+                    slice.size());
+      }
+    }
+
+    // The GRPC error code space matches the canonical code space used
+    // by ESP Status.
+    utils::Status status =
+        status_.ok() && !has_response_
+            ? utils::Status(::grpc::StatusCode::INTERNAL,
+                            "Missing response message")
+            : utils::Status(status_.error_code(), status_.error_message());
+    request_->OnComplete(status, std::move(body));
+    delete this;
+  }
+
+  NgxEspGrpcQueue *queue_;
+  std::shared_ptr<::grpc::GenericStub> stub_;
+  std::unique_ptr<GRPCRequest> request_;
+  const std::string method_;
+  // stream_ is declared after context_ so that it is destroyed first.
+  std::unique_ptr<::grpc::ClientContext> context_;
+  std::unique_ptr<::grpc::GenericClientAsyncReaderWriter> stream_;
+  ::grpc::ByteBuffer request_body_;
+  ::grpc::ByteBuffer response_body_;
+  ::grpc::Status status_;
+  bool has_response_;
+  int retries_;
+};
+
+}  // namespace
+
+void NgxEspEnv::Log(LogLevel level, const char *message) {
+  ngx_uint_t ngx_level = NgxLogLevel(level);
   ngx_str_t msg = {strlen(message),
                    reinterpret_cast<u_char *>(const_cast<char *>(message))};
   ngx_esp_log(log_, ngx_level, msg);
 }
 
+bool NgxEspEnv::IsLogLevelEnabled(LogLevel level) {
+  // The same check ngx_esp_log does before writing a message.
+  return log_ != nullptr && log_->log_level >= NgxLogLevel(level);
+}
+
 NgxEspTimer::NgxEspTimer(std::chrono::milliseconds interval,
                          std::function<void()> callback, ngx_log_t *log)
     : stopped_(false), interval_(interval), callback_(callback), log_(log) {
@@ -110,7 +255,41 @@ void NgxEspEnv::RunHTTPRequest(std::unique_ptr<HTTPRequest> request) {
   ngx_esp_send_http_request(std::move(request));
 }
 
-void NgxEspEnv::RunGRPCRequest(std::unique_ptr<GRPCRequest> request) {}
+void NgxEspEnv::RunGRPCRequest(std::unique_ptr<GRPCRequest> request) {
+  // The queue only exists if ngx_esp_init_process set it up, for a
+  // grpc_pass location or a gRPC service control transport.
+  std::shared_ptr<NgxEspGrpcQueue> queue = NgxEspGrpcQueue::TryInstance();
+  if (!queue) {
+    request->OnComplete(utils::Status(::grpc::StatusCode::UNAVAILABLE,
+                                      "gRPC support is not initialized"),
+                        std::string());
+    return;
+  }
+
+  auto it = grpc_channel_pools_.find(request->server());
+  if (it == grpc_channel_pools_.end()) {
+    auto target = GrpcTarget(request->server());
+    std::shared_ptr<::grpc::ChannelCredentials> credentials =
+        target.second
+            ? ::grpc::SslCredentials(::grpc::SslCredentialsOptions())
+            : ::grpc::InsecureChannelCredentials();
+    std::unique_ptr<NgxEspGrpcChannelPool> pool(new NgxEspGrpcChannelPool(
+        target.first, credentials, proto::GrpcChannelOptions()));
+    it = grpc_channel_pools_.emplace(request->server(), std::move(pool)).first;
+  }
+
+  std::shared_ptr<::grpc::GenericStub> stub = it->second->GetStub();
+  if (!stub) {
+    request->OnComplete(
+        utils::Status(::grpc::StatusCode::UNAVAILABLE,
+                      "Unable to create channel to " + request->server()),
+        std::string());
+    return;
+  }
+
+  (new NgxEspGrpcCall(queue.get(), std::move(stub), std::move(request)))
+      ->Start();
+}
 
 }  // namespace nginx
 }  // namespace api_manager
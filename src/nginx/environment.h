@@ -26,6 +26,10 @@
 #ifndef NGINX_NGX_ESP_ENV_H_
 #define NGINX_NGX_ESP_ENV_H_
 
+#include <map>
+#include <memory>
+#include <string>
+
 #include "include/api_manager/api_manager.h"
 
 extern "C" {
@@ -33,6 +37,7 @@ extern "C" {
 #include "src/http/ngx_http.h"
 }
 
+#include "src/nginx/grpc_channel_pool.h"
 #include "src/nginx/grpc_queue.h"
 
 namespace google {
@@ -48,6 +53,8 @@ class NgxEspEnv : public ApiManagerEnvInterface {
 
   virtual void Log(LogLevel level, const char *message);
 
+  virtual bool IsLogLevelEnabled(LogLevel level);
+
   virtual std::unique_ptr<PeriodicTimer> StartPeriodicTimer(
       std::chrono::milliseconds interval, std::function<void()> continuation);
 
@@ -57,6 +64,12 @@ class NgxEspEnv : public ApiManagerEnvInterface {
 
  private:
   ngx_log_t *log_;
+
+  // The channels used by RunGRPCRequest, keyed by the request's
+  // server.  Calls to the same server share the channel's HTTP/2
+  // connection.
+  std::map<std::string, std::unique_ptr<NgxEspGrpcChannelPool>>
+      grpc_channel_pools_;
 };
 
 // The nginx implementation of PeriodicTimer.
@@ -26,6 +26,9 @@
 //
 #include "src/nginx/grpc.h"
 
+#include <chrono>
+#include <cmath>
+
 #include "src/grpc/proxy_flow.h"
 #include "src/nginx/environment.h"
 #include "src/nginx/error.h"
@@ -112,9 +115,25 @@ std::shared_ptr<::grpc::ChannelCredentials> CreateChannelCredentials(
   return ::grpc::SslCredentials(ssl);
 }
 
+// Returns the deadline the backend rule sets for the request's method
+// (rounded up to milliseconds), or zero if it sets none.
+std::chrono::milliseconds GrpcGetBackendTimeout(ngx_esp_request_ctx_t *ctx) {
+  const MethodInfo *method =
+      ctx->request_handler ? ctx->request_handler->method() : nullptr;
+  if (method == nullptr || method->backend_deadline() <= 0) {
+    return std::chrono::milliseconds::zero();
+  }
+  return std::chrono::milliseconds(
+      static_cast<int64_t>(std::ceil(method->backend_deadline() * 1000)));
+}
+
+// Returns a stub for the request's backend, in pipeline_depth the number
+// of messages the call may buffer per direction, and in compression how
+// its messages are compressed.
 std::pair<Status, std::shared_ptr<::grpc::GenericStub>> GrpcGetStub(
     ngx_http_request_t *r, ngx_esp_loc_conf_t *espcf,
-    ngx_esp_request_ctx_t *ctx) {
+    ngx_esp_request_ctx_t *ctx, size_t *pipeline_depth,
+    std::shared_ptr<grpc::MessageCompression> *compression) {
   Status status = Status::OK;
   std::string address;
   std::tie(status, address) =
@@ -125,23 +144,28 @@ std::pair<Status, std::shared_ptr<::grpc::GenericStub>> GrpcGetStub(
   ngx_log_error(NGX_LOG_INFO, r->connection->log, 0,
                 "GrpcGetStub: connecting to backend=%s", address.c_str());
 
-  auto it = espcf->grpc_stubs.find(address);
-  if (it != espcf->grpc_stubs.end()) {
-    return std::make_pair(Status::OK, it->second);
+  auto it = espcf->grpc_channel_pools.find(address);
+  if (it == espcf->grpc_channel_pools.end()) {
+    ::google::api_manager::proto::GrpcChannelOptions options;
+    if (espcf->grpc_channel_config != nullptr) {
+      const auto &backend_options =
+          espcf->grpc_channel_config->backend_options();
+      auto options_it = backend_options.find(address);
+      options = options_it != backend_options.end()
+                    ? options_it->second
+                    : espcf->grpc_channel_config->default_options();
+    }
+    it = espcf->grpc_channel_pools
+             .emplace(address, std::make_shared<NgxEspGrpcChannelPool>(
+                                   address, CreateChannelCredentials(r, espcf),
+                                   options))
+             .first;
   }
 
-  ::grpc::ChannelArguments channel_arguments;
-
-  channel_arguments.SetMaxReceiveMessageSize(INT_MAX);
-  channel_arguments.SetMaxSendMessageSize(INT_MAX);
-  channel_arguments.SetInt(GRPC_ARG_MAX_METADATA_SIZE, INT_MAX);
-
-  auto result =
-      std::make_shared<::grpc::GenericStub>(::grpc::CreateCustomChannel(
-          address, CreateChannelCredentials(r, espcf), channel_arguments));
-
+  auto result = it->second->GetStub();
   if (result) {
-    espcf->grpc_stubs.emplace(address, result);
+    *pipeline_depth = it->second->pipeline_depth();
+    *compression = it->second->compression();
     return std::make_pair(Status::OK, result);
   }
 
@@ -150,12 +174,18 @@ std::pair<Status, std::shared_ptr<::grpc::GenericStub>> GrpcGetStub(
                         std::shared_ptr<::grpc::GenericStub>());
 }
 
-std::multimap<std::string, std::string> ExtractMetadata(ngx_http_request_t *r) {
-  std::multimap<std::string, std::string> metadata;
+// Collects references to the request headers, keyed by the lowercase
+// header names nginx computed while parsing them.  The references are
+// valid for the lifetime of the request.
+std::vector<grpc::ProxyFlow::Header> ExtractMetadata(ngx_http_request_t *r) {
+  std::vector<grpc::ProxyFlow::Header> metadata;
 
   for (auto &h : r->headers_in) {
-    metadata.emplace(ngx_str_to_std({h.key.len, h.lowcase_key}),
-                     ngx_str_to_std(h.value));
+    metadata.emplace_back(
+        ::grpc::string_ref(reinterpret_cast<const char *>(h.lowcase_key),
+                           h.key.len),
+        ::grpc::string_ref(reinterpret_cast<const char *>(h.value.data),
+                           h.value.len));
   }
 
   return metadata;
@@ -204,11 +234,14 @@ ngx_int_t GrpcBackendHandler(ngx_http_request_t *r) {
 
     ctx->grpc_backend = true;
     std::shared_ptr<::grpc::GenericStub> stub;
-    std::tie(status, stub) = GrpcGetStub(r, espcf, ctx);
+    size_t pipeline_depth = 1;
+    std::shared_ptr<grpc::MessageCompression> compression;
+    std::tie(status, stub) =
+        GrpcGetStub(r, espcf, ctx, &pipeline_depth, &compression);
 
     if (status.ok()) {
       // We have a stub for this backend; proxy the call via libgrpc.
-      const std::multimap<std::string, std::string> &headers =
+      const std::vector<grpc::ProxyFlow::Header> &headers =
           ExtractMetadata(r);
       std::shared_ptr<NgxEspGrpcPassThroughServerCall> server_call;
       status = NgxEspGrpcPassThroughServerCall::Create(r, &server_call);
@@ -221,7 +254,9 @@ ngx_int_t GrpcBackendHandler(ngx_http_request_t *r) {
                        method.c_str());
 
         grpc::ProxyFlow::Start(espmf->grpc_queue.get(), std::move(server_call),
-                               std::move(stub), method, headers);
+                               std::move(stub), method, headers,
+                               pipeline_depth, std::move(compression),
+                               GrpcGetBackendTimeout(ctx));
         return NGX_DONE;
       }
     }
@@ -229,11 +264,14 @@ ngx_int_t GrpcBackendHandler(ngx_http_request_t *r) {
     ctx->grpc_backend = true;
 
     std::shared_ptr<::grpc::GenericStub> stub;
-    std::tie(status, stub) = GrpcGetStub(r, espcf, ctx);
+    size_t pipeline_depth = 1;
+    std::shared_ptr<grpc::MessageCompression> compression;
+    std::tie(status, stub) =
+        GrpcGetStub(r, espcf, ctx, &pipeline_depth, &compression);
 
     if (status.ok()) {
       // We have a stub for this backend; proxy the call via libgrpc.
-      const std::multimap<std::string, std::string> &headers =
+      const std::vector<grpc::ProxyFlow::Header> &headers =
           ExtractMetadata(r);
       std::shared_ptr<NgxEspGrpcWebServerCall> server_call;
       status = NgxEspGrpcWebServerCall::Create(r, &server_call);
@@ -246,7 +284,9 @@ ngx_int_t GrpcBackendHandler(ngx_http_request_t *r) {
                        method.c_str());
 
         grpc::ProxyFlow::Start(espmf->grpc_queue.get(), std::move(server_call),
-                               std::move(stub), method, headers);
+                               std::move(stub), method, headers,
+                               pipeline_depth, std::move(compression),
+                               GrpcGetBackendTimeout(ctx));
         return NGX_DONE;
       }
     }
@@ -257,7 +297,10 @@ ngx_int_t GrpcBackendHandler(ngx_http_request_t *r) {
     ctx->request_handler->TryAddApiKeyHeaderFromQuery();
 
     std::shared_ptr<::grpc::GenericStub> stub;
-    std::tie(status, stub) = GrpcGetStub(r, espcf, ctx);
+    size_t pipeline_depth = 1;
+    std::shared_ptr<grpc::MessageCompression> compression;
+    std::tie(status, stub) =
+        GrpcGetStub(r, espcf, ctx, &pipeline_depth, &compression);
 
     if (status.ok()) {
       std::shared_ptr<NgxEspTranscodedGrpcServerCall> server_call;
@@ -269,10 +312,12 @@ ngx_int_t GrpcBackendHandler(ngx_http_request_t *r) {
                        "GrpcBackendHandler: transcoding - method %s",
                        method.c_str());
 
-        const std::multimap<std::string, std::string> &headers =
+        const std::vector<grpc::ProxyFlow::Header> &headers =
             ExtractMetadata(r);
         grpc::ProxyFlow::Start(espmf->grpc_queue.get(), std::move(server_call),
-                               std::move(stub), method, headers);
+                               std::move(stub), method, headers,
+                               pipeline_depth, std::move(compression),
+                               GrpcGetBackendTimeout(ctx));
         return NGX_DONE;
       }
     }
@@ -0,0 +1,161 @@
+// Copyright (C) Extensible Service Proxy Authors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "src/nginx/grpc_channel_pool.h"
+
+#include <climits>
+
+using ::google::api_manager::proto::GrpcChannelOptions;
+
+namespace google {
+namespace api_manager {
+namespace nginx {
+
+namespace {
+
+// Channels with identical arguments share their subchannels, and so
+// their connections.  Giving each channel of a pool a distinct value
+// for this argument gets each one its own connection.
+const char kChannelIndexArg[] = "grpc.esp.channel_index";
+
+// Messages smaller than this are sent uncompressed unless configured
+// otherwise.
+const size_t kDefaultCompressionMinSize = 1024;
+
+::grpc::ChannelArguments CreateChannelArguments(
+    const GrpcChannelOptions &options) {
+  ::grpc::ChannelArguments channel_arguments;
+
+  channel_arguments.SetMaxReceiveMessageSize(INT_MAX);
+  channel_arguments.SetMaxSendMessageSize(INT_MAX);
+  channel_arguments.SetInt(GRPC_ARG_MAX_METADATA_SIZE, INT_MAX);
+
+  if (options.keepalive_time_ms() > 0) {
+    channel_arguments.SetInt(GRPC_ARG_KEEPALIVE_TIME_MS,
+                             options.keepalive_time_ms());
+  }
+  if (options.keepalive_timeout_ms() > 0) {
+    channel_arguments.SetInt(GRPC_ARG_KEEPALIVE_TIMEOUT_MS,
+                             options.keepalive_timeout_ms());
+  }
+  if (options.initial_window_size() > 0) {
+    channel_arguments.SetInt(GRPC_ARG_HTTP2_STREAM_LOOKAHEAD_BYTES,
+                             options.initial_window_size());
+  }
+  return channel_arguments;
+}
+
+}  // namespace
+
+NgxEspGrpcChannelPool::NgxEspGrpcChannelPool(
+    const std::string &address,
+    std::shared_ptr<::grpc::ChannelCredentials> credentials,
+    const GrpcChannelOptions &options)
+    : address_(address),
+      selection_(options.selection()),
+      max_concurrent_streams_(options.max_concurrent_streams()),
+      pipeline_depth_(options.pipeline_depth() > 0 ? options.pipeline_depth()
+                                                    : 1),
+      next_(0) {
+  if (options.compression() == GrpcChannelOptions::GZIP) {
+    compression_ = std::make_shared<grpc::MessageCompression>(
+        options.compression_min_size() > 0 ? options.compression_min_size()
+                                           : kDefaultCompressionMinSize);
+  }
+
+  int pool_size = options.pool_size() > 0 ? options.pool_size() : 1;
+  for (int i = 0; i < pool_size; ++i) {
+    ::grpc::ChannelArguments channel_arguments =
+        CreateChannelArguments(options);
+    if (pool_size > 1) {
+      channel_arguments.SetInt(kChannelIndexArg, i);
+    }
+
+    std::shared_ptr<Channel> channel(new Channel);
+    channel->stub =
+        std::make_shared<::grpc::GenericStub>(::grpc::CreateCustomChannel(
+            address, credentials, channel_arguments));
+    channel->in_flight = 0;
+    channel->calls = 0;
+    channels_.push_back(std::move(channel));
+  }
+}
+
+std::shared_ptr<::grpc::GenericStub> NgxEspGrpcChannelPool::GetStub() {
+  std::shared_ptr<Channel> channel = channels_[Pick()];
+  channel->in_flight.fetch_add(1, std::memory_order_relaxed);
+  ++channel->calls;
+
+  // The returned pointer shares ownership with a lease on the channel,
+  // which ends the call's accounting once the caller lets go of it.
+  ::grpc::GenericStub *stub = channel->stub.get();
+  std::shared_ptr<Channel> lease(channel.get(), [channel](Channel *) {
+    channel->in_flight.fetch_sub(1, std::memory_order_relaxed);
+  });
+  return std::shared_ptr<::grpc::GenericStub>(lease, stub);
+}
+
+size_t NgxEspGrpcChannelPool::Pick() {
+  if (channels_.size() == 1) {
+    return 0;
+  }
+
+  if (selection_ == GrpcChannelOptions::LEAST_OUTSTANDING) {
+    return PickLeastOutstanding();
+  }
+
+  for (size_t tried = 0; tried < channels_.size(); ++tried) {
+    size_t index = next_;
+    if (++next_ == channels_.size()) {
+      next_ = 0;
+    }
+    if (max_concurrent_streams_ <= 0 ||
+        in_flight(index) < max_concurrent_streams_) {
+      return index;
+    }
+  }
+  // Every channel is at its stream limit; the least loaded one gets
+  // to queue the call.
+  return PickLeastOutstanding();
+}
+
+size_t NgxEspGrpcChannelPool::PickLeastOutstanding() {
+  size_t best = next_;
+  for (size_t i = 1; i < channels_.size(); ++i) {
+    size_t index = (next_ + i) % channels_.size();
+    if (in_flight(index) < in_flight(best)) {
+      best = index;
+    }
+  }
+  if (++next_ == channels_.size()) {
+    next_ = 0;
+  }
+  return best;
+}
+
+}  // namespace nginx
+}  // namespace api_manager
+}  // namespace google
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) Extensible Service Proxy Authors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#ifndef NGINX_NGX_ESP_GRPC_CHANNEL_POOL_H_
+#define NGINX_NGX_ESP_GRPC_CHANNEL_POOL_H_
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <grpc++/generic/generic_stub.h>
+#include <grpc++/grpc++.h>
+
+#include "src/api_manager/proto/server_config.pb.h"
+#include "src/grpc/message_compression.h"
+
+namespace google {
+namespace api_manager {
+namespace nginx {
+
+// A set of channels to one gRPC backend.  Spreading the calls over
+// several channels, each with its own HTTP/2 connection, avoids being
+// capped by the backend's MAX_CONCURRENT_STREAMS and by the throughput
+// of a single TCP connection.
+//
+// GetStub() must be called from the main nginx thread.
+class NgxEspGrpcChannelPool {
+ public:
+  NgxEspGrpcChannelPool(
+      const std::string &address,
+      std::shared_ptr<::grpc::ChannelCredentials> credentials,
+      const ::google::api_manager::proto::GrpcChannelOptions &options);
+
+  // Picks a channel for a new call and returns its stub.  The call is
+  // counted as in flight on that channel until the returned pointer
+  // and all of its copies are released.
+  std::shared_ptr<::grpc::GenericStub> GetStub();
+
+  const std::string &address() const { return address_; }
+
+  // The number of messages per direction buffered by calls to this
+  // backend; see ProxyFlow::Start.
+  size_t pipeline_depth() const { return pipeline_depth_; }
+
+  // The compression of the messages of calls to this backend, or null if
+  // they are sent uncompressed; see ProxyFlow::Start.
+  const std::shared_ptr<grpc::MessageCompression> &compression() const {
+    return compression_;
+  }
+
+  // The number of channels in the pool.
+  size_t size() const { return channels_.size(); }
+
+  // The number of calls in flight on the channel at index.
+  int in_flight(size_t index) const {
+    return channels_[index]->in_flight.load(std::memory_order_relaxed);
+  }
+
+  // The number of calls started on the channel at index.
+  uint64_t calls(size_t index) const { return channels_[index]->calls; }
+
+ private:
+  struct Channel {
+    std::shared_ptr<::grpc::GenericStub> stub;
+    // Decremented by whichever thread drops the last reference to a
+    // call's stub.
+    std::atomic<int> in_flight;
+    uint64_t calls;
+  };
+
+  // Returns the index of the channel to use for the next call.
+  size_t Pick();
+
+  // Returns the index of the channel with the fewest calls in flight,
+  // preferring the round-robin position on ties.
+  size_t PickLeastOutstanding();
+
+  std::string address_;
+  ::google::api_manager::proto::GrpcChannelOptions::Selection selection_;
+  int max_concurrent_streams_;
+  size_t pipeline_depth_;
+  std::shared_ptr<grpc::MessageCompression> compression_;
+  std::vector<std::shared_ptr<Channel>> channels_;
+  size_t next_;
+};
+
+}  // namespace nginx
+}  // namespace api_manager
+}  // namespace google
+
+#endif  // NGINX_NGX_ESP_GRPC_CHANNEL_POOL_H_
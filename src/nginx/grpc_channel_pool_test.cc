@@ -0,0 +1,150 @@
+// Copyright (C) Extensible Service Proxy Authors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "src/nginx/grpc_channel_pool.h"
+
+#include <memory>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+using ::google::api_manager::proto::GrpcChannelOptions;
+
+namespace google {
+namespace api_manager {
+namespace nginx {
+
+namespace {
+
+// Channels connect lazily, so nothing needs to listen here.
+const char kAddress[] = "127.0.0.1:1";
+
+std::unique_ptr<NgxEspGrpcChannelPool> CreatePool(
+    const GrpcChannelOptions &options) {
+  return std::unique_ptr<NgxEspGrpcChannelPool>(new NgxEspGrpcChannelPool(
+      kAddress, ::grpc::InsecureChannelCredentials(), options));
+}
+
+TEST(GrpcChannelPoolTest, Defaults) {
+  auto pool = CreatePool(GrpcChannelOptions());
+  ASSERT_EQ(1, pool->size());
+  EXPECT_EQ(kAddress, pool->address());
+  EXPECT_EQ(1, pool->pipeline_depth());
+  EXPECT_EQ(nullptr, pool->compression());
+
+  auto first = pool->GetStub();
+  auto second = pool->GetStub();
+  EXPECT_EQ(first.get(), second.get());
+  EXPECT_EQ(2, pool->in_flight(0));
+  EXPECT_EQ(2, pool->calls(0));
+}
+
+TEST(GrpcChannelPoolTest, Options) {
+  GrpcChannelOptions options;
+  options.set_pipeline_depth(4);
+  options.set_compression(GrpcChannelOptions::GZIP);
+  auto pool = CreatePool(options);
+  EXPECT_EQ(4, pool->pipeline_depth());
+  EXPECT_NE(nullptr, pool->compression());
+}
+
+TEST(GrpcChannelPoolTest, RoundRobin) {
+  GrpcChannelOptions options;
+  options.set_pool_size(3);
+  auto pool = CreatePool(options);
+  ASSERT_EQ(3, pool->size());
+
+  std::vector<std::shared_ptr<::grpc::GenericStub>> stubs;
+  for (int i = 0; i < 6; ++i) {
+    stubs.push_back(pool->GetStub());
+  }
+  EXPECT_NE(stubs[0].get(), stubs[1].get());
+  EXPECT_NE(stubs[1].get(), stubs[2].get());
+  EXPECT_NE(stubs[0].get(), stubs[2].get());
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_EQ(stubs[i].get(), stubs[i + 3].get());
+    EXPECT_EQ(2, pool->in_flight(i));
+    EXPECT_EQ(2, pool->calls(i));
+  }
+}
+
+TEST(GrpcChannelPoolTest, InFlightUntilLastCopyIsReleased) {
+  auto pool = CreatePool(GrpcChannelOptions());
+  auto stub = pool->GetStub();
+  auto copy = stub;
+  stub.reset();
+  EXPECT_EQ(1, pool->in_flight(0));
+  copy.reset();
+  EXPECT_EQ(0, pool->in_flight(0));
+  EXPECT_EQ(1, pool->calls(0));
+}
+
+TEST(GrpcChannelPoolTest, LeastOutstanding) {
+  GrpcChannelOptions options;
+  options.set_pool_size(3);
+  options.set_selection(GrpcChannelOptions::LEAST_OUTSTANDING);
+  auto pool = CreatePool(options);
+
+  auto first = pool->GetStub();
+  auto second = pool->GetStub();
+  auto third = pool->GetStub();
+  ::grpc::GenericStub *idle = second.get();
+  second.reset();
+
+  // Only the second channel has no call in flight.
+  auto next = pool->GetStub();
+  EXPECT_EQ(idle, next.get());
+  EXPECT_EQ(1, pool->in_flight(0));
+  EXPECT_EQ(1, pool->in_flight(1));
+  EXPECT_EQ(1, pool->in_flight(2));
+  EXPECT_EQ(2, pool->calls(1));
+}
+
+TEST(GrpcChannelPoolTest, RoundRobinSkipsFullChannels) {
+  GrpcChannelOptions options;
+  options.set_pool_size(2);
+  options.set_max_concurrent_streams(1);
+  auto pool = CreatePool(options);
+
+  auto first = pool->GetStub();
+  pool->GetStub().reset();
+  // The first channel is next in turn but at its limit.
+  auto second = pool->GetStub();
+  EXPECT_NE(first.get(), second.get());
+  EXPECT_EQ(1, pool->calls(0));
+  EXPECT_EQ(2, pool->calls(1));
+
+  // With both channels at their limit, the call still gets one.
+  auto third = pool->GetStub();
+  EXPECT_NE(nullptr, third);
+  EXPECT_EQ(3, pool->in_flight(0) + pool->in_flight(1));
+}
+
+}  // namespace
+
+}  // namespace nginx
+}  // namespace api_manager
+}  // namespace google
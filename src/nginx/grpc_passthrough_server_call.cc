@@ -46,6 +46,10 @@ namespace nginx {
 namespace {
 const ngx_str_t kContentTypeApplicationGrpc = ngx_string("application/grpc");
 
+// Response messages at least this large are sent from the grpc slices
+// without copying them into nginx buffers.
+const size_t kMinZeroCopyMessageSize = 8192;
+
 // Deletes GRPC objects.
 //
 // This is used (instead of specializing std::default_deleter<>) in
@@ -104,15 +108,26 @@ void NgxEspGrpcPassThroughServerCall::Finish(
 
 bool NgxEspGrpcPassThroughServerCall::ConvertRequestBody(
     std::vector<grpc_slice> *out) {
-  // Turn all incoming buffers into slices.
   ngx_http_request_body_t *body = r_->request_body;
+  size_t size = 0;
+  for (ngx_chain_t *cl = body->bufs; cl; cl = cl->next) {
+    size += ngx_buf_size(cl->buf);
+  }
+
+  // nginx reuses its buffer once the chain is consumed, so the data must be
+  // copied. The buffers read at once are copied into a single slice.
+  grpc_slice slice = grpc_slice_malloc(size);
+  u_char *p = GRPC_SLICE_START_PTR(slice);
   while (body->bufs) {
     ngx_chain_t *cl = body->bufs;
     body->bufs = cl->next;
-    out->push_back(GrpcSliceFromNginxBuffer(cl->buf));
+    p = CopyNginxBuffer(cl->buf, p);
     cl->next = body->free;
     body->free = cl;
   }
+  if (size > 0) {
+    out->push_back(slice);
+  }
   return true;
 }
 
@@ -124,15 +139,18 @@ bool NgxEspGrpcPassThroughServerCall::ConvertResponseMessage(
   }
   std::unique_ptr<grpc_byte_buffer, GrpcDeleter> msg_deleter(grpc_msg);
 
-  // Since there's no good way to reuse the underlying grpc_slice for
-  // the nginx buffer, we need to allocate an nginx buffer and copy
-  // the data into it.
   size_t buflen = 5;  // Compressed flag + four bytes of length.
 
   // Get the length of the actual message.  N.B. This is the
   // *compressed* length.
   size_t msglen = grpc_byte_buffer_length(grpc_msg);
-  buflen += msglen;
+
+  // Large messages are sent straight from the slices; for small ones,
+  // copying is cheaper than setting up a buf per slice.
+  bool zero_copy = msglen >= kMinZeroCopyMessageSize;
+  if (!zero_copy) {
+    buflen += msglen;
+  }
 
   // Allocate the chain link and buffer.
   ngx_chain_t *cl = AllocNgxBufChain(buflen);
@@ -144,50 +162,74 @@ bool NgxEspGrpcPassThroughServerCall::ConvertResponseMessage(
   }
   *out = cl;
   ngx_buf_t *buf = cl->buf;
-  buf->last_in_chain = 1;
-  buf->flush = 1;
 
   // Write the 'compressed' flag.
   *buf->last++ = (grpc_msg->data.raw.compression == GRPC_COMPRESS_NONE ? 0 : 1);
 
   // Write the message length: four bytes, big-endian.
   // TODO: We should fail if asked to forward a message with length > uint32_max
-  buf->last[3] = msglen & 0xFF;
-  msglen >>= 8;
-  buf->last[2] = msglen & 0xFF;
-  msglen >>= 8;
-  buf->last[1] = msglen & 0xFF;
-  msglen >>= 8;
-  buf->last[0] = msglen & 0xFF;
+  size_t len = msglen;
+  buf->last[3] = len & 0xFF;
+  len >>= 8;
+  buf->last[2] = len & 0xFF;
+  len >>= 8;
+  buf->last[1] = len & 0xFF;
+  len >>= 8;
+  buf->last[0] = len & 0xFF;
   buf->last += 4;
 
   // Fill in the message.
   for (size_t sln = 0; sln < grpc_msg->data.raw.slice_buffer.count; sln++) {
     grpc_slice *slice = grpc_msg->data.raw.slice_buffer.slices + sln;
-    ngx_memcpy(buf->last, GRPC_SLICE_START_PTR(*slice),
-               GRPC_SLICE_LENGTH(*slice));
-    buf->last += GRPC_SLICE_LENGTH(*slice);
+    if (!zero_copy) {
+      ngx_memcpy(buf->last, GRPC_SLICE_START_PTR(*slice),
+                 GRPC_SLICE_LENGTH(*slice));
+      buf->last += GRPC_SLICE_LENGTH(*slice);
+      continue;
+    }
+    if (GRPC_SLICE_LENGTH(*slice) == 0) {
+      continue;
+    }
+
+    // Inlined slices keep their bytes in the grpc_slice itself, which
+    // goes away with grpc_msg, so those few bytes are copied.
+    ngx_chain_t *next = slice->refcount
+                            ? AllocNgxSliceChain(*slice)
+                            : AllocNgxBufChain(GRPC_SLICE_LENGTH(*slice));
+    if (!next) {
+      ngx_log_error(NGX_LOG_ERR, r_->connection->log, 0,
+                    "Failed to allocate response buffer for GRPC response "
+                    "message.");
+      return false;
+    }
+    if (!slice->refcount) {
+      next->buf->last =
+          ngx_cpymem(next->buf->last, GRPC_SLICE_START_PTR(*slice),
+                     GRPC_SLICE_LENGTH(*slice));
+    }
+    cl->next = next;
+    cl = next;
   }
 
+  cl->buf->last_in_chain = 1;
+  cl->buf->flush = 1;
+
   return true;
 }
 
-grpc_slice NgxEspGrpcPassThroughServerCall::GrpcSliceFromNginxBuffer(
-    ngx_buf_t *buf) {
+u_char *NgxEspGrpcPassThroughServerCall::CopyNginxBuffer(ngx_buf_t *buf,
+                                                         u_char *dst) {
   if (!ngx_buf_in_memory(buf) && buf->file) {
     // If the buffer's not in memory, we need to read the contents.
-    grpc_slice result = grpc_slice_malloc(ngx_buf_size(buf));
-    ngx_read_file(buf->file, GRPC_SLICE_START_PTR(result), ngx_buf_size(buf),
-                  buf->file_pos);
-    return result;
+    off_t size = ngx_buf_size(buf);
+    ngx_read_file(buf->file, dst, size, buf->file_pos);
+    return dst + size;
   }
 
   // Otherwise, just copy the buffer's data.
-  grpc_slice result = grpc_slice_from_copied_buffer(
-      reinterpret_cast<char *>(buf->pos), buf->last - buf->pos);
-
-  buf->pos += GRPC_SLICE_LENGTH(result);
-  return result;
+  dst = ngx_cpymem(dst, buf->pos, buf->last - buf->pos);
+  buf->pos = buf->last;
+  return dst;
 }
 }  // namespace nginx
 }  // namespace api_manager
@@ -61,9 +61,9 @@ class NgxEspGrpcPassThroughServerCall : public NgxEspGrpcServerCall {
   // Constructor
   NgxEspGrpcPassThroughServerCall(ngx_http_request_t* r);
 
-  // Builds a grpc_slice containing the same data as is contained in the
-  // supplied nginx buffer.
-  grpc_slice GrpcSliceFromNginxBuffer(ngx_buf_t* buf);
+  // Copies the data of the supplied nginx buffer to dst, and returns the
+  // end of the copied data.
+  u_char* CopyNginxBuffer(ngx_buf_t* buf, u_char* dst);
 
   virtual const ngx_str_t& response_content_type() const;
 
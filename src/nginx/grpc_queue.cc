@@ -26,6 +26,8 @@
 //
 #include "src/nginx/grpc_queue.h"
 
+#include <chrono>
+
 extern "C" {
 #include "ngx_event.h"
 }
@@ -95,6 +97,22 @@ namespace nginx {
 // GRPC team to create an API for integrating libgrpc into arbitrary
 // event loops.
 
+namespace {
+
+// The capacity of the ring carrying events to the nginx thread.  When
+// the ring is full the worker threads wait for nginx to catch up.
+const size_t kPendingRingSize = 8192;
+
+// The maximum number of callbacks run by a single DrainPending call,
+// so that a burst of gRPC events doesn't starve other nginx events.
+const size_t kMaxEventsPerDrain = 1024;
+
+int64_t SteadyNow() {
+  return std::chrono::steady_clock::now().time_since_epoch().count();
+}
+
+}  // namespace
+
 std::weak_ptr<NgxEspGrpcQueue> NgxEspGrpcQueue::instance;
 
 std::shared_ptr<NgxEspGrpcQueue> NgxEspGrpcQueue::Instance() {
@@ -110,11 +128,28 @@ std::shared_ptr<NgxEspGrpcQueue> NgxEspGrpcQueue::TryInstance() {
   return instance.lock();
 }
 
-void NgxEspGrpcQueue::Init(ngx_cycle_t *cycle) {
+void NgxEspGrpcQueue::Init(ngx_cycle_t *cycle, ngx_uint_t queue_count) {
   ngx_notify_init(&notify_, NginxTagHandler, cycle);
+  if (queue_count < 1) {
+    queue_count = 1;
+  }
+  for (ngx_uint_t i = 0; i < queue_count; ++i) {
+    cqs_.emplace_back(new ::grpc::CompletionQueue());
+  }
+  for (auto &cq : cqs_) {
+    worker_threads_.emplace_back(&NgxEspGrpcQueue::WorkerThread, this,
+                                 cq.get());
+  }
+}
+
+::grpc::CompletionQueue *NgxEspGrpcQueue::GetQueue() {
+  ::grpc::CompletionQueue *cq = cqs_[next_cq_].get();
+  if (++next_cq_ == cqs_.size()) {
+    next_cq_ = 0;
+  }
+  return cq;
 }
 
-// Runs GRPC event callbacks on the main nginx thread.
 void NgxEspGrpcQueue::NginxTagHandler(ngx_event_t *) {
   std::shared_ptr<NgxEspGrpcQueue> queue = TryInstance();
   if (queue) {
@@ -122,34 +157,47 @@ void NgxEspGrpcQueue::NginxTagHandler(ngx_event_t *) {
   }
 }
 
-void NgxEspGrpcQueue::WorkerThread(NgxEspGrpcQueue *queue) {
+void NgxEspGrpcQueue::WorkerThread(NgxEspGrpcQueue *queue,
+                                   ::grpc::CompletionQueue *cq) {
   void *tag;
   bool ok;
-  while (queue->cq_->Next(&tag, &ok)) {
-    std::unique_ptr<Tag> cb(static_cast<Tag *>(tag));
-    if (cb) {
-      bool notify_nginx = false;
-      {
-        std::lock_guard<std::mutex> lock(queue->mu_);
-        queue->pending_.emplace_back(Finalizer{std::move(cb), ok});
-        if (!queue->notified_) {
-          notify_nginx = true;
-          queue->notified_ = true;
-        }
-      }
-      if (notify_nginx) {
-        ngx_notify(&queue->notify_);
-      }
+  while (cq->Next(&tag, &ok)) {
+    if (tag) {
+      queue->Enqueue(static_cast<Tag *>(tag), ok);
+    }
+  }
+}
+
+void NgxEspGrpcQueue::Enqueue(Tag *callback, bool success) {
+  while (!pending_.TryPush(Finalizer{callback, success})) {
+    if (shutting_down_.load(std::memory_order_acquire)) {
+      // Nobody is going to drain the ring anymore.
+      delete callback;
+      return;
     }
+    // The nginx thread is behind by a full ring; make sure it knows
+    // there is work and give it a chance to catch up.
+    if (!notified_.exchange(true)) {
+      notified_at_.store(SteadyNow(), std::memory_order_relaxed);
+      ngx_notify(&notify_);
+    }
+    std::this_thread::yield();
+  }
+  if (!notified_.exchange(true)) {
+    notified_at_.store(SteadyNow(), std::memory_order_relaxed);
+    ngx_notify(&notify_);
   }
 }
 
 void NgxEspGrpcQueue::Deleter(NgxEspGrpcQueue *lib) { delete lib; }
 
 NgxEspGrpcQueue::NgxEspGrpcQueue()
-    : cq_(new ::grpc::CompletionQueue()), notified_(false) {
-  worker_thread_ = std::thread(&NgxEspGrpcQueue::WorkerThread, this);
-}
+    : next_cq_(0),
+      pending_(kPendingRingSize),
+      notified_(false),
+      notified_at_(0),
+      shutting_down_(false),
+      stats_() {}
 
 NgxEspGrpcQueue::~NgxEspGrpcQueue() {
   // N.B. At this point, we expect that all components have
@@ -165,31 +213,65 @@ NgxEspGrpcQueue::~NgxEspGrpcQueue() {
   //
   // If this happens, this code handles them correctly, by:
   //
-  //   * Shutting down the queue
+  //   * Shutting down the queues
   //
-  //   * Waiting for the queue to drain (i.e. waiting for the event
-  //     worker thread to dequeue all pending tags and exit)
+  //   * Waiting for the queues to drain (i.e. waiting for the event
+  //     worker threads to dequeue all pending tags and exit)
   //
   //   * Ignoring the outstanding events as they may try to enqueue
-  //     new events, which is dangerous as the completion queue
-  //     has been shut down.
+  //     new events, which is dangerous as the completion queues
+  //     have been shut down.
+
+  shutting_down_.store(true, std::memory_order_release);
+  for (auto &cq : cqs_) {
+    cq->Shutdown();
+  }
 
-  cq_->Shutdown();
+  // N.B. Joining on the worker threads is essential, as those threads
+  // maintain a raw pointer to this datastructure.
+  for (auto &thread : worker_threads_) {
+    thread.join();
+  }
 
-  // N.B. Joining on the worker thread is essential, as that thread
-  // maintains a raw pointer to this datastructure.
-  worker_thread_.join();
+  Finalizer finalizer;
+  while (pending_.TryPop(&finalizer)) {
+    delete finalizer.callback;
+  }
 }
 
 void NgxEspGrpcQueue::DrainPending() {
-  std::deque<Finalizer> pending;
-  {
-    std::lock_guard<std::mutex> lock(mu_);
-    pending.swap(pending_);
-    notified_ = false;
-  }
-  for (auto &it : pending) {
-    (*it.callback)(it.success);
+  // Clear the flag before looking at the ring: an event pushed after
+  // this point either gets picked up below or sends a new notification.
+  notified_.exchange(false);
+  int64_t latency = SteadyNow() - notified_at_.load(std::memory_order_relaxed);
+
+  size_t count = 0;
+  Finalizer finalizer;
+  while (count < kMaxEventsPerDrain && pending_.TryPop(&finalizer)) {
+    std::unique_ptr<Tag> callback(finalizer.callback);
+    (*callback)(finalizer.success);
+    ++count;
+  }
+
+  if (count == kMaxEventsPerDrain && !notified_.exchange(true)) {
+    // More events may be waiting; come back for them after nginx has
+    // had a chance to process other events.
+    notified_at_.store(SteadyNow(), std::memory_order_relaxed);
+    ngx_notify(&notify_);
+  }
+
+  uint64_t latency_us =
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::duration(latency > 0 ? latency : 0))
+          .count();
+  ++stats_.drains;
+  stats_.events += count;
+  stats_.total_drain_latency_us += latency_us;
+  if (count > stats_.max_events_per_drain) {
+    stats_.max_events_per_drain = count;
+  }
+  if (latency_us > stats_.max_drain_latency_us) {
+    stats_.max_drain_latency_us = latency_us;
   }
 }
 
@@ -26,9 +26,10 @@
 #ifndef NGINX_NGX_ESP_GRPC_QUEUE_H_
 #define NGINX_NGX_ESP_GRPC_QUEUE_H_
 
-#include <deque>
+#include <atomic>
 #include <memory>
 #include <thread>
+#include <vector>
 
 #include <grpc++/grpc++.h>
 
@@ -38,6 +39,7 @@ extern "C" {
 }
 
 #include "src/grpc/async_grpc_queue.h"
+#include "src/grpc/mpsc_ring.h"
 
 namespace google {
 namespace api_manager {
@@ -70,11 +72,34 @@ class NgxEspGrpcQueue : public AsyncGrpcQueue {
     return AllocTag(std::move(callback));
   }
 
-  // The completion queue processed by the library.  Tags queued to
-  // this queue must be created by MakeTag or AllocTag.
-  virtual ::grpc::CompletionQueue *GetQueue() { return cq_.get(); }
+  // A completion queue processed by the library.  Tags queued to
+  // this queue must be created by MakeTag or AllocTag.  Successive
+  // calls hand out the configured completion queues round-robin, so
+  // that each call is pinned to a single poller thread.  This must
+  // be called from the main nginx thread.
+  virtual ::grpc::CompletionQueue *GetQueue();
+
+  // Creates queue_count completion queues, each polled by its own
+  // worker thread, and hooks the event delivery into the nginx
+  // notification mechanism of the cycle.
+  void Init(ngx_cycle_t *cycle, ngx_uint_t queue_count);
+
+  // Counters describing how events are delivered to the nginx thread.
+  // Only updated and read on the main nginx thread.
+  struct Stats {
+    // Number of times DrainPending ran.
+    uint64_t drains;
+    // Total number of events delivered to the nginx thread.
+    uint64_t events;
+    // The largest number of events delivered by a single drain.
+    uint64_t max_events_per_drain;
+    // Total and maximum time between a poller notifying nginx and
+    // nginx starting to drain the events (unit: microseconds).
+    uint64_t total_drain_latency_us;
+    uint64_t max_drain_latency_us;
+  };
 
-  void Init(ngx_cycle_t *cycle);
+  const Stats &stats() const { return stats_; }
 
  private:
   static std::weak_ptr<NgxEspGrpcQueue> instance;
@@ -100,11 +125,11 @@ class NgxEspGrpcQueue : public AsyncGrpcQueue {
     T t_;
   };
 
-  // The type stored in the pending event queue (pending_).  This
+  // The type stored in the pending event ring (pending_).  This
   // holds the callback function and the result to pass to that
   // function once the Nginx main thread picks up the pending event.
   struct Finalizer {
-    std::unique_ptr<Tag> callback;
+    Tag *callback;
     bool success;
   };
 
@@ -112,15 +137,20 @@ class NgxEspGrpcQueue : public AsyncGrpcQueue {
   static void NginxTagHandler(ngx_event_t *);
 
   // The GRPC worker thread main routine.  This shuttles events from
-  // the GRPC completion queue to the nginx event queue, getting them
-  // onto the main nginx thread.
+  // the GRPC completion queue cq to the nginx event queue, getting
+  // them onto the main nginx thread.
   //
   // Note that the worker thread's lifetime is strictly contained
   // within the lifetime of its associated NgxEspGrpcQueue (the
   // NgxEspGrpcQueue destructor joins on the thread).  This makes it
   // possible to pass the queue to the worker thread via a raw
   // pointer.
-  static void WorkerThread(NgxEspGrpcQueue *queue);
+  static void WorkerThread(NgxEspGrpcQueue *queue,
+                           ::grpc::CompletionQueue *cq);
+
+  // Hands an event over to the nginx thread, waking it up if it is
+  // not already due to drain the pending events.
+  void Enqueue(Tag *callback, bool success);
 
   // Deletes the NgxEspGrpcQueue.  (This lets us avoid making the
   // constructor and destructor public, which is a little overly
@@ -130,16 +160,26 @@ class NgxEspGrpcQueue : public AsyncGrpcQueue {
   NgxEspGrpcQueue();
   virtual ~NgxEspGrpcQueue();
 
-  // Drains the contents of the pending_ queue.
+  // Drains the contents of the pending_ ring.
   void DrainPending();
 
-  std::mutex mu_;
   ngx_event_t notify_;
-  std::unique_ptr<::grpc::CompletionQueue> cq_;
-  std::deque<Finalizer> pending_;
-  bool notified_;
-
-  std::thread worker_thread_;
+  std::vector<std::unique_ptr<::grpc::CompletionQueue>> cqs_;
+  size_t next_cq_;
+  // Pushed by the worker threads, popped by the nginx thread.
+  grpc::MpscRing<Finalizer> pending_;
+
+  // Set while an nginx notification is outstanding.
+  std::atomic<bool> notified_;
+  // When the outstanding notification was sent, as steady_clock ticks.
+  std::atomic<int64_t> notified_at_;
+  // Set once the destructor starts; workers stop waiting for room in
+  // the ring.
+  std::atomic<bool> shutting_down_;
+
+  Stats stats_;
+
+  std::vector<std::thread> worker_threads_;
 };
 
 }  // namespace nginx
@@ -155,9 +155,12 @@ grpc_message_compression_algorithm GetCompressionAlgorithm(
 NgxEspGrpcServerCall::NgxEspGrpcServerCall(ngx_http_request_t *r,
                                            bool delay_downstream_headers)
     : r_(r),
+      output_slices_(nullptr),
       buf_free_(nullptr),
       buf_busy_(nullptr),
       buf_tag_(ngx_buf_tag_t(&ConvertByteBuffer)),
+      write_buffer_size_(0),
+      write_stats_(nullptr),
       add_header_failed_(false),
       reading_(false),
       read_msg_(nullptr),
@@ -169,6 +172,14 @@ NgxEspGrpcServerCall::NgxEspGrpcServerCall(ngx_http_request_t *r,
   cln_.data = this;
   cln_.next = r->cleanup;
   r->cleanup = &cln_;
+
+  ngx_esp_loc_conf_t *lc = reinterpret_cast<ngx_esp_loc_conf_t *>(
+      ngx_http_get_module_loc_conf(r, ngx_esp_module));
+  write_buffer_size_ = lc->grpc_write_buffer_size;
+  ngx_esp_main_conf_t *mc = reinterpret_cast<ngx_esp_main_conf_t *>(
+      ngx_http_get_module_main_conf(r, ngx_esp_module));
+  write_stats_ = &mc->grpc_write_stats;
+  call_stats_ = &mc->grpc_call_stats;
 }
 
 utils::Status NgxEspGrpcServerCall::ProcessPrereadRequestBody() {
@@ -334,14 +345,23 @@ void NgxEspGrpcServerCall::OnDownstreamWriteable(ngx_http_request_t *r) {
   ngx_int_t rc = ngx_esp_write_output(
       r, nullptr, &NgxEspGrpcServerCall::OnDownstreamWriteable);
 
-  if (rc == NGX_AGAIN) {
-    ngx_log_debug0(
-        NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
-        "NgxEspGrpcServerCall::OnDownstreamWriteable: Flush blocked");
+  if (!server_call) {
     return;
   }
 
-  if (!server_call) {
+  ngx_chain_t *out = nullptr;
+  ngx_chain_update_chains(r->pool, &server_call->buf_free_,
+                          &server_call->buf_busy_, &out, server_call->buf_tag_);
+  if (server_call->output_slices_) {
+    server_call->output_slices_->ReleaseSent();
+  }
+
+  if (rc == NGX_AGAIN &&
+      (!server_call->write_continuation_ ||
+       server_call->BufferedOutputBytes() >= server_call->write_buffer_size_)) {
+    ngx_log_debug0(
+        NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+        "NgxEspGrpcServerCall::OnDownstreamWriteable: Flush blocked");
     return;
   }
 
@@ -349,7 +369,8 @@ void NgxEspGrpcServerCall::OnDownstreamWriteable(ngx_http_request_t *r) {
   std::swap(continuation, server_call->write_continuation_);
 
   if (continuation) {
-    bool ok = (rc == NGX_OK);
+    server_call->EndThrottle();
+    bool ok = (rc == NGX_OK || rc == NGX_AGAIN);
     ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
                    "NgxEspGrpcServerCall::OnDownstreamWriteable: Write %s",
                    ok ? "OK" : "NOT ok");
@@ -728,6 +749,55 @@ ngx_chain_t *NgxEspGrpcServerCall::AllocNgxBufChain(size_t buflen) {
   return cl;
 }
 
+ngx_chain_t *NgxEspGrpcServerCall::AllocNgxSliceChain(const grpc_slice &slice) {
+  if (!output_slices_) {
+    output_slices_ =
+        RegisterPoolCleanup(r_->pool, new (r_->pool) OutputSlices());
+    if (!output_slices_) {
+      return nullptr;
+    }
+  }
+
+  ngx_chain_t *cl = ngx_alloc_chain_link(r_->pool);
+  ngx_buf_t *buf = ngx_calloc_buf(r_->pool);
+  if (!cl || !buf) {
+    return nullptr;
+  }
+
+  // The buf is read-only and, unlike the ones from AllocNgxBufChain(),
+  // not tagged with buf_tag_: its memory belongs to the slice and must
+  // never make it to buf_free_.
+  buf->start = GRPC_SLICE_START_PTR(slice);
+  buf->end = buf->start + GRPC_SLICE_LENGTH(slice);
+  buf->pos = buf->start;
+  buf->last = buf->end;
+  buf->memory = 1;
+
+  cl->buf = buf;
+  cl->next = nullptr;
+
+  output_slices_->Add(buf, grpc_slice_ref(slice));
+  return cl;
+}
+
+NgxEspGrpcServerCall::OutputSlices::~OutputSlices() {
+  for (auto &it : slices_) {
+    grpc_slice_unref(it.second);
+  }
+}
+
+void NgxEspGrpcServerCall::OutputSlices::Add(ngx_buf_t *buf,
+                                             grpc_slice slice) {
+  slices_.emplace_back(buf, slice);
+}
+
+void NgxEspGrpcServerCall::OutputSlices::ReleaseSent() {
+  while (!slices_.empty() && ngx_buf_size(slices_.front().first) == 0) {
+    grpc_slice_unref(slices_.front().second);
+    slices_.pop_front();
+  }
+}
+
 void NgxEspGrpcServerCall::Write(const ::grpc::ByteBuffer &msg,
                                  std::function<void(bool)> continuation) {
   if (!cln_.data) {
@@ -735,20 +805,11 @@ void NgxEspGrpcServerCall::Write(const ::grpc::ByteBuffer &msg,
     return;
   }
 
-  // Make sure the headers have been sent
-  if (!r_->header_sent) {
-    auto status = WriteDownstreamHeaders();
-    if (!status.ok()) {
-      ngx_log_error(NGX_LOG_DEBUG, r_->connection->log, 0,
-                    "Faield to send the headers");
-      continuation(false);
-      return;
-    }
-  }
-
   ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r_->connection->log, 0,
                  "NgxEspGrpcServerCall::Write: Writing %z bytes", msg.Length());
 
+  // The message is converted before the headers are sent, so that a first
+  // message that fails to convert gets an error response.
   ngx_chain_t *out = nullptr;
   if (!ConvertResponseMessage(msg, &out)) {
     // Converting the response message failed. ConvertResponseMessage() has
@@ -760,12 +821,26 @@ void NgxEspGrpcServerCall::Write(const ::grpc::ByteBuffer &msg,
     return;
   }
 
+  // Make sure the headers have been sent
+  if (!r_->header_sent) {
+    auto status = WriteDownstreamHeaders();
+    if (!status.ok()) {
+      ngx_log_error(NGX_LOG_DEBUG, r_->connection->log, 0,
+                    "Faield to send the headers");
+      continuation(false);
+      return;
+    }
+  }
+
   ngx_int_t rc = ngx_esp_write_output(
       r_, out, &NgxEspGrpcServerCall::OnDownstreamWriteable);
   // Completely written buffers are added to the free list so they can be
   // re-used by AllocNgxBufChain(). They could be used by next respond
   // messages for passthrough grpc.
   ngx_chain_update_chains(r_->pool, &buf_free_, &buf_busy_, &out, buf_tag_);
+  if (output_slices_) {
+    output_slices_->ReleaseSent();
+  }
 
   if (rc == NGX_OK) {
     // We were immediately able to send the message downstream.
@@ -784,11 +859,47 @@ void NgxEspGrpcServerCall::Write(const ::grpc::ByteBuffer &msg,
   }
 
   // Otherwise: the message is in the outgoing queue.
+  if (BufferedOutputBytes() < write_buffer_size_) {
+    // There's room for more; nginx sends the rest as the client becomes
+    // writable.
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r_->connection->log, 0,
+                   "NgxEspGrpcServerCall::Write: buffered");
+    continuation(true);
+    return;
+  }
+
   write_continuation_ = continuation;
+  throttled_since_ = std::chrono::steady_clock::now();
   ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r_->connection->log, 0,
                  "NgxEspGrpcServerCall::Write: blocked");
 }
 
+size_t NgxEspGrpcServerCall::BufferedOutputBytes() const {
+  // ngx_chain_update_chains() keeps every buf from the first unsent one on
+  // in buf_busy_.
+  size_t size = 0;
+  for (ngx_chain_t *cl = buf_busy_; cl; cl = cl->next) {
+    size += ngx_buf_size(cl->buf);
+  }
+  return size;
+}
+
+void NgxEspGrpcServerCall::EndThrottle() {
+  if (throttled_since_ == std::chrono::steady_clock::time_point()) {
+    // Already accounted.
+    return;
+  }
+  uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - throttled_since_)
+                    .count();
+  write_stats_->throttled_writes++;
+  write_stats_->total_throttled_us += us;
+  if (us > write_stats_->max_throttled_us) {
+    write_stats_->max_throttled_us = us;
+  }
+  throttled_since_ = std::chrono::steady_clock::time_point();
+}
+
 void NgxEspGrpcServerCall::RecordBackendTime(int64_t backend_time) {
   if (!cln_.data) {
     return;
@@ -807,7 +918,38 @@ void NgxEspGrpcServerCall::Cleanup(void *server_call_ptr) {
   if (server_call->read_continuation_) {
     server_call->CompletePendingRead(false, utils::Status::OK);
   }
+  std::function<void(bool)> write_continuation;
+  if (server_call->write_continuation_) {
+    server_call->EndThrottle();
+    std::swap(write_continuation, server_call->write_continuation_);
+  }
+  // The upstream call is cancelled unless it has ended already, so that a
+  // backend doesn't keep working on a call nobody will read.
+  std::unique_ptr<std::function<void()>> cancel;
+  ngx_esp_request_ctx_t *ctx = ngx_http_esp_ensure_module_ctx(server_call->r_);
+  if (ctx != nullptr) {
+    std::swap(cancel, ctx->grpc_upstream_cancel);
+  }
   server_call->cln_.data = nullptr;
+
+  // These may release the last reference to server_call.
+  if (write_continuation) {
+    write_continuation(false);
+  }
+  if (cancel) {
+    (*cancel)();
+  }
+}
+
+void NgxEspGrpcServerCall::RecordUpstreamStatus(const utils::Status &status,
+                                                bool cancelled) {
+  // The counters outlive the request, so this doesn't check cln_.data.
+  if (cancelled) {
+    ++call_stats_->cancelled_calls;
+  } else if (status.code() ==
+             ::google::protobuf::util::error::DEADLINE_EXCEEDED) {
+    ++call_stats_->deadline_exceeded_calls;
+  }
 }
 
 grpc_byte_buffer *NgxEspGrpcServerCall::ConvertByteBuffer(
@@ -26,6 +26,9 @@
 #ifndef NGINX_NGX_ESP_GRPC_SERVER_CALL_H_
 #define NGINX_NGX_ESP_GRPC_SERVER_CALL_H_
 
+#include <chrono>
+#include <deque>
+
 extern "C" {
 #include "src/http/ngx_http.h"
 }
@@ -73,12 +76,33 @@ class NgxEspGrpcServerCall : public grpc::ServerCall {
   virtual void Write(const ::grpc::ByteBuffer& msg,
                      std::function<void(bool)> continuation);
   virtual void RecordBackendTime(int64_t backend_time);
+  virtual void RecordUpstreamStatus(const utils::Status& status,
+                                    bool cancelled);
 
   virtual void UpdateRequestMessageStat(int64_t size);
   virtual void UpdateResponseMessageStat(int64_t size);
   virtual void SetGrpcUpstreamCancel(
       std::function<void()> grpc_upstream_cancel);
 
+  // Statistics of writes held back because the client reads responses
+  // more slowly than the backend produces them.
+  struct WriteStats {
+    // Number of writes held until the buffered output drained below the
+    // high-water mark.
+    uint64_t throttled_writes;
+    // Total and maximum time writes were held (unit: microseconds).
+    uint64_t total_throttled_us;
+    uint64_t max_throttled_us;
+  };
+
+  // Statistics of how upstream calls ended early.
+  struct CallStats {
+    // Number of calls the backend didn't finish before their deadline.
+    uint64_t deadline_exceeded_calls;
+    // Number of calls cancelled because the client went away or failed.
+    uint64_t cancelled_calls;
+  };
+
  protected:
   // Converts the request body into gRPC messages and outputs the raw slices.
   // The output slices are appended to the specified out vector.
@@ -115,6 +139,11 @@ class NgxEspGrpcServerCall : public grpc::ServerCall {
   // Allocate a ngx buf chain and its buf from re-cycled free list.
   ngx_chain_t* AllocNgxBufChain(size_t buflen);
 
+  // Allocate a ngx buf chain whose buf points at the memory of the
+  // slice, so that the slice is sent without copying it.  The slice is
+  // referenced until the buf has been sent or the request is freed.
+  ngx_chain_t* AllocNgxSliceChain(const grpc_slice& slice);
+
  private:
   static void OnDownstreamPreread(ngx_http_request_t* r);
   static void OnDownstreamReadable(ngx_http_request_t* r);
@@ -127,6 +156,12 @@ class NgxEspGrpcServerCall : public grpc::ServerCall {
 
   void AddInitialMetadata(const std::string& key, const std::string& value);
 
+  // Returns the number of response bytes handed to nginx but not sent yet.
+  size_t BufferedOutputBytes() const;
+
+  // Accounts the time the pending write was held in write_stats_.
+  void EndThrottle();
+
   // Attempts to read a GRPC message from downstream into read_msg_;
   // calls CompletePendingRead and returns true if successful.
   bool TryReadDownstreamMessage();
@@ -136,11 +171,41 @@ class NgxEspGrpcServerCall : public grpc::ServerCall {
   // completed with 'false'.
   static void Cleanup(void* server_call_ptr);
 
+  // The slices referenced by response bufs, in output order.  This is
+  // owned by the request pool rather than the NgxEspGrpcServerCall,
+  // as nginx may still be sending the bufs after the call is gone.
+  class OutputSlices {
+   public:
+    ~OutputSlices();
+
+    void Add(ngx_buf_t* buf, grpc_slice slice);
+
+    // Unreferences the slices whose bufs have been fully sent.
+    void ReleaseSent();
+
+   private:
+    std::deque<std::pair<ngx_buf_t*, grpc_slice>> slices_;
+  };
+
+  // Created by the first AllocNgxSliceChain() call.
+  OutputSlices* output_slices_;
+
   // re cycled buffer chains
   ngx_chain_t* buf_free_;
   ngx_chain_t* buf_busy_;
   ngx_buf_tag_t buf_tag_;
 
+  // The high-water mark for buffered output.  Write() completes right
+  // away while less than this is waiting to be sent; otherwise it is held
+  // (and so is ProxyFlow's next upstream read) until the client catches up.
+  size_t write_buffer_size_;
+  // Where held writes are accounted; lives in the module's main conf.
+  WriteStats* write_stats_;
+  // Where the ends of upstream calls are accounted; also in the main conf.
+  CallStats* call_stats_;
+  // When the pending write started being held.
+  std::chrono::steady_clock::time_point throttled_since_;
+
   bool add_header_failed_;
   bool reading_;
   std::function<void(bool)> write_continuation_;
@@ -27,10 +27,16 @@
 #include "src/nginx/http.h"
 
 #include <core/ngx_string.h>
+#include <algorithm>
 #include <memory>
+#include <new>
+#include <string>
+#include <vector>
 
 #include "include/api_manager/http_request.h"
 #include "src/nginx/alloc.h"
+#include "src/nginx/http_connection_pool.h"
+#include "src/nginx/http_scheduler.h"
 #include "src/nginx/module.h"
 #include "src/nginx/util.h"
 
@@ -47,8 +53,16 @@ namespace nginx {
 
 namespace {
 
-// The pool size used for the outgoing HTTP request.
-const size_t kRequestPoolSize = 4096;
+// The number of response headers the request's header list is sized for
+// up front.
+const ngx_uint_t kResponseHeadersCount = 20;
+
+// Room in the request pool for the smaller allocations made by the
+// upstream module (chain links, cleanups, the resolver context).
+const size_t kRequestPoolSlack = 1024;
+
+// The most torn down HTTP connection objects kept for reuse per worker.
+const size_t kMaxFreeHttpConnections = 64;
 
 // Default HTTP timeout, in milliseconds.
 const int kDefaultTimeoutMilliseconds = 60000;
@@ -82,6 +96,40 @@ inline ngx_esp_http_connection *get_esp_connection(ngx_http_request_t *r) {
   }
 }
 
+// Returns the worker's pool of idle outbound HTTP connections, or nullptr.
+NgxEspHttpConnectionPool *get_connection_pool() {
+  auto http_cctx = reinterpret_cast<ngx_http_conf_ctx_t *>(
+      ngx_get_conf(ngx_cycle->conf_ctx, ngx_http_module));
+  if (http_cctx == nullptr) {
+    return nullptr;
+  }
+  auto mc = reinterpret_cast<ngx_esp_main_conf_t *>(
+      http_cctx->main_conf[ngx_esp_module.ctx_index]);
+  return mc ? mc->http_connection_pool.get() : nullptr;
+}
+
+// Returns the worker's outbound request scheduler, if any.
+NgxEspHttpScheduler *get_scheduler() {
+  auto http_cctx = reinterpret_cast<ngx_http_conf_ctx_t *>(
+      ngx_get_conf(ngx_cycle->conf_ctx, ngx_http_module));
+  if (http_cctx == nullptr) {
+    return nullptr;
+  }
+  auto mc = reinterpret_cast<ngx_esp_main_conf_t *>(
+      http_cctx->main_conf[ngx_esp_module.ctx_index]);
+  return mc ? mc->http_scheduler.get() : nullptr;
+}
+
+// Gives the request's scheduler slot back, once.
+void release_scheduler_slot(ngx_esp_http_connection *http_connection) {
+  std::string destination;
+  destination.swap(http_connection->scheduler_destination);
+  NgxEspHttpScheduler *scheduler = get_scheduler();
+  if (!destination.empty() && scheduler != nullptr) {
+    scheduler->Done(destination);
+  }
+}
+
 // Parses the request URL, identifies the URL scheme and default port,
 //
 Status ngx_esp_upstream_set_url(ngx_pool_t *pool, ngx_http_upstream_t *upstream,
@@ -243,17 +291,18 @@ ngx_int_t ngx_esp_upstream_create_request(ngx_http_request_t *r) {
 
   // <method> followed by a space.
   buffer_size += http_request->method().size() + sizeof(" ") - 1;
-  // <URL path> followed by 'HTTP/1.0' and a newline.
-  buffer_size += http_connection->url_path.len + sizeof(" HTTP/1.0" CRLF) - 1;
+  // <URL path> followed by 'HTTP/1.1' and a newline.
+  buffer_size += http_connection->url_path.len + sizeof(" HTTP/1.1" CRLF) - 1;
   // 'Host:' header, followed by a newline.
   buffer_size += sizeof("Host: ") - 1;
   buffer_size += http_connection->host_header.len;
   buffer_size += sizeof(CRLF) - 1;
-  // Right now all our subrequests close connection (both old and new
-  // implementation).
-  // TODO: investigate NGINX ability for connection reuse. This may especially
-  // benefit service control connections.
-  buffer_size += sizeof("Connection: close" CRLF) - 1;
+  // HTTP/1.1 connections persist unless either side asks to close them.
+  // Ask for that when the connection won't be pooled.
+  bool keepalive = !http_connection->pool_key.empty();
+  if (!keepalive) {
+    buffer_size += sizeof("Connection: close" CRLF) - 1;
+  }
 
   // Add sizes of all headers and their values.
   for (const auto &header : http_request->request_headers()) {
@@ -291,15 +340,15 @@ ngx_int_t ngx_esp_upstream_create_request(ngx_http_request_t *r) {
   append(buf, http_request->method());
   append(buf, " ");
   append(buf, http_connection->url_path);
-  // Must be HTTP/1.0 since this module doesn't support HTTP/1.1 features;
-  // such as trunked encoding.
-  append(buf, " HTTP/1.0" CRLF);
+  append(buf, " HTTP/1.1" CRLF);
 
   // Append the Host and Connection headers.
   append(buf, "Host: ");
   append(buf, http_connection->host_header);
   append(buf, CRLF);
-  append(buf, "Connection: close" CRLF);
+  if (!keepalive) {
+    append(buf, "Connection: close" CRLF);
+  }
 
   // Append the headers provided by the caller.
   for (const auto &header : http_request->request_headers()) {
@@ -409,6 +458,11 @@ ngx_int_t ngx_esp_upstream_process_status_line(ngx_http_request_t *r) {
   // continuation as a status).
   http_connection->response_status = status;
 
+  // HTTP/1.0 servers close the connection after the response.
+  if (status.http_version < NGX_HTTP_VERSION_11) {
+    r->upstream->headers_in.connection_close = 1;
+  }
+
   // Advance the state machine to parse individual headers next.
   r->upstream->process_header = ngx_esp_upstream_process_header;
   return ngx_esp_upstream_process_header(r);
@@ -454,6 +508,27 @@ ngx_int_t ngx_esp_upstream_process_header(ngx_http_request_t *r) {
         r->upstream->headers_in.content_length_n =
             ngx_atoof(value.data, value.len);
       }
+
+      // The body is either chunked, or delimited by Content-Length, or by
+      // the server closing the connection.
+      static ngx_str_t transfer_encoding = ngx_string("Transfer-Encoding");
+      static ngx_str_t chunked = ngx_string("chunked");
+      if (name.len == transfer_encoding.len &&
+          ngx_strncasecmp(name.data, transfer_encoding.data,
+                          transfer_encoding.len) == 0 &&
+          ngx_strlcasestrn(value.data, value.data + value.len, chunked.data,
+                           chunked.len - 1) != nullptr) {
+        r->upstream->headers_in.chunked = 1;
+      }
+
+      static ngx_str_t connection = ngx_string("Connection");
+      static ngx_str_t close_token = ngx_string("close");
+      if (name.len == connection.len &&
+          ngx_strncasecmp(name.data, connection.data, connection.len) == 0 &&
+          ngx_strlcasestrn(value.data, value.data + value.len,
+                           close_token.data, close_token.len - 1) != nullptr) {
+        r->upstream->headers_in.connection_close = 1;
+      }
     } else if (rc == NGX_HTTP_PARSE_HEADER_DONE) {
       return NGX_OK;
     } else if (rc == NGX_AGAIN) {
@@ -464,12 +539,121 @@ ngx_int_t ngx_esp_upstream_process_header(ngx_http_request_t *r) {
   }
 }
 
+//
+// Peer handlers for requests sent on a pooled connection.
+//
+// The upstream module normally connects to the resolved address itself.
+// When a pooled connection is available, the request is pointed at
+// http_connection->pooled_upstream instead, whose peer.init installs these
+// handlers; the upstream module then takes the connection from
+// ngx_esp_upstream_get_pooled_peer as if it had just connected.
+//
+ngx_int_t ngx_esp_upstream_get_pooled_peer(ngx_peer_connection_t *pc,
+                                           void *data) {
+  ngx_esp_http_connection *http_connection =
+      reinterpret_cast<ngx_esp_http_connection *>(data);
+  if (http_connection->pooled_connection == nullptr) {
+    return NGX_BUSY;
+  }
+
+  pc->sockaddr = &http_connection->pooled_sockaddr.sockaddr;
+  pc->socklen = http_connection->pooled_socklen;
+  pc->name = &http_connection->host_header;
+  pc->connection = http_connection->pooled_connection;
+  pc->cached = 1;
+  http_connection->pooled_sent = pc->connection->sent;
+  http_connection->pooled_connection = nullptr;
+
+  return NGX_DONE;
+}
+
+void ngx_esp_upstream_free_pooled_peer(ngx_peer_connection_t *pc, void *data,
+                                       ngx_uint_t state) {
+  // There is no other peer to try.
+  pc->tries = 0;
+}
+
+ngx_int_t ngx_esp_upstream_init_pooled_peer(ngx_http_request_t *r,
+                                            ngx_http_upstream_srv_conf_t *us) {
+  ngx_esp_http_connection *http_connection = get_esp_connection(r);
+  if (http_connection == nullptr) {
+    return NGX_ERROR;
+  }
+
+  r->upstream->peer.data = http_connection;
+  r->upstream->peer.get = ngx_esp_upstream_get_pooled_peer;
+  r->upstream->peer.free = ngx_esp_upstream_free_pooled_peer;
+  r->upstream->peer.tries = 1;
+  return NGX_OK;
+}
+
 // An abort handler -- apparently this is never called by NGINX so we only log.
 void ngx_esp_upstream_abort_request(ngx_http_request_t *r) {
   ngx_log_error(NGX_LOG_DEBUG, r->connection->log, 0,
                 "endpoints request aborted");
 }
 
+//
+// Free list of HTTP connection objects.
+//
+// Instead of destroying the pools of a finished request, the wakeup
+// handler resets them and keeps the ngx_esp_http_connection, still
+// allocated from its esp pool, for the next outbound request.  The
+// request pool keeps the blocks it grew to, so a recycled request
+// needs no allocations for the structures that fit there.  The list
+// is only used on the main nginx thread of a worker.
+//
+std::vector<ngx_esp_http_connection *> &free_http_connections() {
+  static auto *list = new std::vector<ngx_esp_http_connection *>();
+  return *list;
+}
+
+// Runs the cleanup handlers of a pool and then releases its memory for
+// reuse, as ngx_destroy_pool does short of freeing the pool blocks.
+void reset_pool(ngx_pool_t *pool) {
+  for (ngx_pool_cleanup_t *c = pool->cleanup; c; c = c->next) {
+    if (c->handler) {
+      c->handler(c->data);
+    }
+  }
+  pool->cleanup = nullptr;
+  ngx_reset_pool(pool);
+}
+
+// Resets a finished HTTP connection and puts it on the free list.
+// Returns false if the connection can't be reused and its pools must
+// be destroyed instead.
+bool recycle_http_connection(ngx_esp_http_connection *http_connection) {
+  ngx_pool_t *ep = http_connection->esp_pool;
+  ngx_pool_t *cp = http_connection->connection_pool_reset.pool;
+  ngx_pool_t *rp = http_connection->request_pool_reset.pool;
+
+  auto &free_list = free_http_connections();
+  if (cp == nullptr || rp == nullptr ||
+      free_list.size() >= kMaxFreeHttpConnections ||
+      http_connection->read_event.timer_set ||
+      http_connection->write_event.timer_set ||
+      http_connection->read_event.posted ||
+      http_connection->write_event.posted) {
+    return false;
+  }
+
+  reset_pool(rp);
+  reset_pool(cp);
+
+  // Rebuild the connection state in place.  The esp pool keeps the
+  // cleanup that eventually destroys it.
+  http_connection->~ngx_esp_http_connection();
+  ngx_memzero(http_connection, sizeof(ngx_esp_http_connection));
+  new (http_connection) ngx_esp_http_connection();
+  http_connection->esp_pool = ep;
+  http_connection->connection_pool_reset.pool = cp;
+  http_connection->request_pool_reset.pool = rp;
+
+  free_list.push_back(http_connection);
+  return true;
+}
+
 //
 // Wakeup handler.
 //
@@ -480,8 +664,8 @@ void ngx_esp_upstream_abort_request(ngx_http_request_t *r) {
 // the next iteration of NGINX main event loop.
 //
 // This is the function that we register NGINX to call.
-// It will destroy the pools we created to handle the request and, if parent
-// request was provided by the caller, wake it up.
+// It will recycle or destroy the pools we created to handle the request and,
+// if parent request was provided by the caller, wake it up.
 //
 void wakeup_event_handler(ngx_event_t *ev) {
   ngx_esp_http_connection *http_connection =
@@ -493,6 +677,18 @@ void wakeup_event_handler(ngx_event_t *ev) {
                  "wakeup_event_handler called: %V%V",
                  &http_connection->host_header, &http_connection->url_path);
 
+  // A pooled connection the upstream module never picked up.
+  if (http_connection->pooled_connection != nullptr) {
+    NgxEspHttpConnectionPool::Close(http_connection->pooled_connection);
+    http_connection->pooled_connection = nullptr;
+  }
+
+  // Note: ev is part of http_connection and must not be used once the
+  // connection is recycled.
+  if (recycle_http_connection(http_connection)) {
+    return;
+  }
+
   // Request and a connection pools.
   ngx_pool_t *ep = http_connection->esp_pool;
   ngx_pool_t *cp = http_connection->connection_pool_reset.pool;
@@ -510,6 +706,28 @@ void wakeup_event_handler(ngx_event_t *ev) {
   ngx_destroy_pool(ep);
 }
 
+// Returns true if a request that failed on a pooled connection may be
+// sent again on a new connection without spending a retry, i.e. the
+// server most likely closed the idle connection just as it was reused
+// and can't have acted on the request.  As with nginx's upstream
+// keepalive, a timeout or a response doesn't qualify, and neither does a
+// non-idempotent request (Check and Report are POSTs) once any of it was
+// written.
+bool can_resend_on_new_connection(ngx_esp_http_connection *http_connection,
+                                  ngx_http_upstream_t *u, ngx_int_t rc) {
+  if (!http_connection->reused_connection || rc == NGX_OK ||
+      rc == NGX_HTTP_GATEWAY_TIME_OUT ||
+      http_connection->response_status.code != 0) {
+    return false;
+  }
+  const std::string &method = http_connection->esp_request->method();
+  if (method != "POST" && method != "PATCH") {
+    return true;
+  }
+  return u->peer.connection != nullptr &&
+         u->peer.connection->sent == http_connection->pooled_sent;
+}
+
 // A finalize handler. Called by NGINX when request is complete (success)
 // or on error, for example connection error, timeout, etc.
 void ngx_esp_upstream_finalize_request(ngx_http_request_t *r, ngx_int_t rc) {
@@ -527,6 +745,24 @@ void ngx_esp_upstream_finalize_request(ngx_http_request_t *r, ngx_int_t rc) {
                  "ngx_esp_upstream_finalize_request called: %V%V",
                  &http_connection->host_header, &http_connection->url_path);
 
+  // Keep the connection for the next request to the same server if the
+  // response was read completely and neither side asked to close it.  The
+  // upstream module closes the connection right after this handler
+  // returns unless it is taken away here.
+  ngx_http_upstream_t *u = r->upstream;
+  NgxEspHttpConnectionPool *pool = get_connection_pool();
+  if (rc == NGX_OK && pool != nullptr && !http_connection->pool_key.empty() &&
+      u->peer.connection != nullptr && u->peer.sockaddr != nullptr &&
+      u->length == 0 && !u->headers_in.connection_close) {
+    if (pool->Put(http_connection->pool_key, u->peer.connection,
+                  u->peer.sockaddr, u->peer.socklen)) {
+      u->peer.connection = nullptr;
+    }
+  }
+
+  bool resend = http_connection->esp_request != nullptr && pool != nullptr &&
+                can_resend_on_new_connection(http_connection, u, rc);
+
   std::string message;
   if (rc == NGX_OK) {
     // If the overall transmission succeeded (rc == NGX_OK), use the HTTP
@@ -546,6 +782,10 @@ void ngx_esp_upstream_finalize_request(ngx_http_request_t *r, ngx_int_t rc) {
     message = "Failed to connect to server.";
   }
 
+  // Let the next queued request to this destination go before the
+  // continuation (or a retry) submits more.
+  release_scheduler_slot(http_connection);
+
   // Call the continuation.
   if (http_connection->esp_request) {
     // Swap the initial HTTP request out to make sure we don't
@@ -553,8 +793,17 @@ void ngx_esp_upstream_finalize_request(ngx_http_request_t *r, ngx_int_t rc) {
     std::unique_ptr<HTTPRequest> request;
     request.swap(http_connection->esp_request);
 
-    // Retry if an error and retry budget left
-    if (rc == NGX_ERROR && request->max_retries() > 0) {
+    if (resend) {
+      // The server closed the pooled connection without responding, most
+      // likely just as it was reused.  Its other idle connections are
+      // suspect too; send the request again on a new connection without
+      // spending a retry.
+      ngx_log_debug0(NGX_LOG_DEBUG_HTTP, &http_connection->log, 0,
+                     "Pooled connection failed, resending the request");
+      pool->CloseIdle(http_connection->pool_key);
+      ngx_esp_send_http_request(std::move(request));
+    } else if (rc == NGX_ERROR && request->max_retries() > 0) {
+      // Retry if an error and retry budget left
       // increase timeout
       request->set_max_retries(request->max_retries() - 1);
       request->set_timeout_ms(request->timeout_ms() *
@@ -640,9 +889,73 @@ ngx_int_t ngx_esp_upstream_input_filter_init(void *data) {
       esp_request != nullptr ? esp_request->url().c_str() : "<unknown URL>");
 #endif
 
+  // Work out where the body ends; the upstream module finishes the request
+  // once u->length drops to 0 (see ngx_esp_upstream_input_filter).
+  ngx_http_upstream_t *u = r->upstream;
+  ngx_uint_t code = http_connection->response_status.code;
+  if (code == NGX_HTTP_NO_CONTENT || code == NGX_HTTP_NOT_MODIFIED ||
+      (http_connection->esp_request &&
+       http_connection->esp_request->method() == "HEAD")) {
+    u->length = 0;
+  } else if (u->headers_in.chunked) {
+    // Not known until the last chunk has been decoded.
+    u->length = 1;
+  } else if (u->headers_in.content_length_n >= 0) {
+    u->length = u->headers_in.content_length_n;
+  } else {
+    // The body ends when the server closes the connection.
+    u->length = -1;
+    u->headers_in.connection_close = 1;
+  }
+
   return NGX_OK;
 }
 
+// Decodes the chunked response body data read into the upstream buffer,
+// accumulating the chunks' contents.
+ngx_int_t ngx_esp_upstream_decode_chunked(
+    ngx_http_request_t *r, ngx_esp_http_connection *http_connection,
+    ssize_t bytes) {
+  ngx_http_upstream_t *u = r->upstream;
+  ngx_buf_t buf;
+  ngx_memzero(&buf, sizeof(buf));
+  buf.pos = u->buffer.last;
+  buf.last = u->buffer.last + bytes;
+  buf.temporary = 1;
+
+  for (;;) {
+    ngx_int_t rc = ngx_http_parse_chunked(r, &buf, &http_connection->chunked);
+
+    if (rc == NGX_OK) {
+      // (A part of) a chunk's data.
+      off_t size = ngx_min(http_connection->chunked.size,
+                           static_cast<off_t>(buf.last - buf.pos));
+      http_connection->response_body.write(reinterpret_cast<char *>(buf.pos),
+                                           size);
+      buf.pos += size;
+      http_connection->chunked.size -= size;
+      continue;
+    }
+
+    if (rc == NGX_DONE) {
+      // The last chunk; anything after it is unexpected.
+      u->length = 0;
+      if (buf.pos != buf.last) {
+        u->headers_in.connection_close = 1;
+      }
+      return NGX_OK;
+    }
+
+    if (rc == NGX_AGAIN) {
+      return NGX_OK;
+    }
+
+    ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
+                  "upstream sent invalid chunked response");
+    return NGX_ERROR;
+  }
+}
+
 // An upstream input filter handler.
 //
 // After initialization, NGINX calls this filter handler whenever new data
@@ -666,8 +979,22 @@ ngx_int_t ngx_esp_upstream_input_filter(void *data, ssize_t bytes) {
                  "endpoints received %d bytes: %V", (int)bytes, &body);
 #endif
 
+  ngx_http_upstream_t *u = r->upstream;
+  if (u->headers_in.chunked) {
+    return ngx_esp_upstream_decode_chunked(r, http_connection, bytes);
+  }
+
+  if (u->length >= 0) {
+    if (bytes > u->length) {
+      // More data than announced; the connection can't be reused.
+      u->headers_in.connection_close = 1;
+      bytes = u->length;
+    }
+    u->length -= bytes;
+  }
+
   http_connection->response_body.write(
-      reinterpret_cast<char *>(r->upstream->buffer.last), bytes);
+      reinterpret_cast<char *>(u->buffer.last), bytes);
 
   return NGX_OK;
 }
@@ -743,6 +1070,49 @@ class ngx_pool_t_deleter {
 //
 // Comments on the individual phases are below.
 
+// Returns the size of the request pool for request: room for the
+// ngx_http_request_t and the upstream state allocated along with it, the
+// ESP module context, the per-request arrays, and the URL copies and
+// rendered request when they're small, so that the pool rarely has to
+// chain another block.  Allocations above NGX_MAX_ALLOC_FROM_POOL, such as
+// the rendered request of a large body and the response buffers, bypass
+// the pool blocks regardless; they aren't counted, and the strings add at
+// most NGX_MAX_ALLOC_FROM_POOL, so that a recycled pool stays small.
+size_t request_pool_size(const HTTPRequest *request) {
+  auto http_cmcf = reinterpret_cast<ngx_http_core_main_conf_t *>(
+      ngx_http_cycle_get_module_main_conf(ngx_cycle, ngx_http_core_module));
+
+  size_t size = sizeof(ngx_pool_t) + sizeof(ngx_http_request_t) +
+                kResponseHeadersCount * sizeof(ngx_table_elt_t) +
+                sizeof(ngx_buf_t) + sizeof(ngx_http_upstream_t) +
+                sizeof(ngx_http_upstream_resolved_t) +
+                sizeof(ngx_event_pipe_t) + sizeof(ngx_esp_request_ctx_t) +
+                2 * sizeof(ngx_pool_cleanup_t) +
+                ngx_http_max_module * sizeof(void *) + kRequestPoolSlack;
+  if (http_cmcf != nullptr) {
+    size += http_cmcf->variables.nelts * sizeof(ngx_http_variable_value_t);
+  }
+
+  // The URL is copied and its path split out (ngx_esp_upstream_set_url)
+  // before the request line, headers and body are rendered.
+  size_t strings = 0;
+  if (request->url().size() < NGX_MAX_ALLOC_FROM_POOL) {
+    strings += 3 * request->url().size();
+  }
+  size_t rendered = request->url().size() + request->method().size() +
+                    request->body().size() + NGX_OFF_T_LEN;
+  for (const auto &header : request->request_headers()) {
+    rendered += header.first.size() + header.second.size() +
+                sizeof(": " CRLF) - 1;
+  }
+  if (rendered < NGX_MAX_ALLOC_FROM_POOL) {
+    strings += rendered;
+  }
+  size += std::min(strings, static_cast<size_t>(NGX_MAX_ALLOC_FROM_POOL));
+
+  return ngx_align(size, NGX_POOL_ALIGNMENT);
+}
+
 // Allocates NGINX memory pools for data structures related to the connection
 // and the request.
 //
@@ -750,7 +1120,8 @@ class ngx_pool_t_deleter {
 // over them (the subrequest code has less control over pools than we have
 // here), a single pool could work as well.
 Status allocate_pools(
-    ngx_log_t *log, std::unique_ptr<ngx_pool_t, ngx_pool_t_deleter> &esp_pool,
+    ngx_log_t *log, const HTTPRequest *request,
+    std::unique_ptr<ngx_pool_t, ngx_pool_t_deleter> &esp_pool,
     std::unique_ptr<ngx_pool_t, ngx_pool_t_deleter> &connection_pool,
     std::unique_ptr<ngx_pool_t, ngx_pool_t_deleter> &request_pool) {
   // Only esp_http_connection will be allocated from the pool. No need to
@@ -771,7 +1142,7 @@ Status allocate_pools(
   }
 
   // Allocate the request pool.
-  request_pool.reset(ngx_create_pool(kRequestPoolSize, log));
+  request_pool.reset(ngx_create_pool(request_pool_size(request), log));
   if (request_pool == nullptr) {
     return Status(NGX_ERROR, "Out of memory");
   }
@@ -796,7 +1167,8 @@ ngx_http_request_t *allocate_ngx_http_request(ngx_pool_t *request_pool) {
   }
 
   // headers_out
-  if (ngx_list_init(&r->headers_out.headers, request_pool, 20,
+  if (ngx_list_init(&r->headers_out.headers, request_pool,
+                    kResponseHeadersCount,
                     sizeof(ngx_table_elt_t)) != NGX_OK) {
     return nullptr;
   }
@@ -1047,6 +1419,30 @@ Status initialize_upstream_request(ngx_log_t *log, HTTPRequest *request,
   http_connection->upstream_conf.pass_headers =
       reinterpret_cast<ngx_array_t *>(NGX_CONF_UNSET_PTR);
 
+  // Use a pooled connection to the same scheme, host and port if there is
+  // one.
+  NgxEspHttpConnectionPool *pool = get_connection_pool();
+  if (pool != nullptr && pool->enabled()) {
+    ngx_http_upstream_resolved_t *resolved = upstream->resolved;
+    http_connection->pool_key =
+        std::string(upstream->ssl ? "https://" : "http://") +
+        ngx_str_to_std(resolved->host) + ":" + std::to_string(resolved->port);
+
+    http_connection->pooled_connection =
+        pool->Take(http_connection->pool_key, log,
+                   &http_connection->pooled_sockaddr,
+                   &http_connection->pooled_socklen);
+    if (http_connection->pooled_connection != nullptr) {
+      http_connection->reused_connection = true;
+      ngx_http_upstream_srv_conf_t *uscf = &http_connection->pooled_upstream;
+      uscf->host = resolved->host;
+      uscf->port = resolved->port;
+      uscf->peer.init = ngx_esp_upstream_init_pooled_peer;
+      http_connection->upstream_conf.upstream = uscf;
+      upstream->resolved = nullptr;
+    }
+  }
+
 // Set up SSL if available and required.
 #if NGX_HTTP_SSL
   if (upstream->ssl) {
@@ -1101,25 +1497,41 @@ Status initialize_upstream_request(ngx_log_t *log, HTTPRequest *request,
 Status ngx_esp_create_http_request(
     ngx_log_t *log, HTTPRequest *request,
     ngx_esp_http_connection **out_http_connection) {
-  // Create the connection pool and request pools.
   std::unique_ptr<ngx_pool_t, ngx_pool_t_deleter> esp_pool;
   std::unique_ptr<ngx_pool_t, ngx_pool_t_deleter> connection_pool;
   std::unique_ptr<ngx_pool_t, ngx_pool_t_deleter> request_pool;
+  ngx_esp_http_connection *http_connection = nullptr;
+  Status status = Status::OK;
+
+  auto &free_list = free_http_connections();
+  if (!free_list.empty()) {
+    // Reuse the connection state and pools of a finished request.
+    http_connection = free_list.back();
+    free_list.pop_back();
+    http_connection->recycled = true;
+    esp_pool.reset(http_connection->esp_pool);
+    connection_pool.reset(http_connection->connection_pool_reset.pool);
+    request_pool.reset(http_connection->request_pool_reset.pool);
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, log, 0,
+                   "esp: reusing http_connection %p", http_connection);
+  } else {
+    // Create the connection pool and request pools.
+    status = allocate_pools(log, request, esp_pool, connection_pool,
+                            request_pool);
+    if (!status.ok()) {
+      return status;
+    }
 
-  Status status = allocate_pools(log, esp_pool, connection_pool, request_pool);
-  if (!status.ok()) {
-    return status;
-  }
-
-  // Allocate the HTTP connection state in one go.
-  // Because we custom-fit the pool size to match this one allocation, the
-  // alloction will not fail.
-  ngx_esp_http_connection *http_connection = RegisterPoolCleanup(
-      esp_pool.get(), new (esp_pool.get()) ngx_esp_http_connection());
-  ngx_log_debug1(NGX_LOG_DEBUG_HTTP, log, 0,
-                 "esp: allocated http_connection %p", http_connection);
-  if (http_connection == nullptr) {
-    return Status(NGX_ERROR, "Out of memory");
+    // Allocate the HTTP connection state in one go.
+    // Because we custom-fit the pool size to match this one allocation, the
+    // alloction will not fail.
+    http_connection = RegisterPoolCleanup(
+        esp_pool.get(), new (esp_pool.get()) ngx_esp_http_connection());
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, log, 0,
+                   "esp: allocated http_connection %p", http_connection);
+    if (http_connection == nullptr) {
+      return Status(NGX_ERROR, "Out of memory");
+    }
   }
 
   // Allocate and initialize an ngx_http_request_t.
@@ -1176,7 +1588,7 @@ Status ngx_esp_create_http_request(
   //     request pool: http_connection->request->pool
   //     connection pool: http_connection->connection.pool
   //
-  // They will be destroyed in wakeup_event_handler.
+  // They will be recycled or destroyed in wakeup_event_handler.
   esp_pool.release();
   connection_pool.release();
   request_pool.release();
@@ -1190,6 +1602,16 @@ Status ngx_esp_create_http_request(
 }  // namespace
 
 void ngx_esp_send_http_request(std::unique_ptr<HTTPRequest> request) {
+  NgxEspHttpScheduler *scheduler = get_scheduler();
+  if (scheduler != nullptr) {
+    scheduler->Submit(std::move(request));
+    return;
+  }
+  ngx_esp_start_http_request(std::move(request), std::string());
+}
+
+void ngx_esp_start_http_request(std::unique_ptr<HTTPRequest> request,
+                                const std::string &destination) {
   ngx_esp_http_connection *http_connection(nullptr);
 
   ngx_log_t *log = ngx_cycle->log;
@@ -1210,6 +1632,13 @@ void ngx_esp_send_http_request(std::unique_ptr<HTTPRequest> request) {
 
     // Store the caller's request for the continuation call.
     http_connection->esp_request = std::move(request);
+    http_connection->scheduler_destination = destination;
+
+    NgxEspHttpConnectionPool *pool = get_connection_pool();
+    if (pool != nullptr) {
+      pool->RecordRequest(http_connection->reused_connection,
+                          http_connection->recycled);
+    }
 
     // Initiate the upstream connection by calling NGINX upstream.
     ngx_http_upstream_init(http_connection->request);
@@ -1219,6 +1648,11 @@ void ngx_esp_send_http_request(std::unique_ptr<HTTPRequest> request) {
 
     // Call the request continuation with error.
     request->OnComplete(status, std::map<std::string, std::string>(), "");
+
+    NgxEspHttpScheduler *scheduler = get_scheduler();
+    if (!destination.empty() && scheduler != nullptr) {
+      scheduler->Done(destination);
+    }
   }
 }
 
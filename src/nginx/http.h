@@ -29,6 +29,7 @@
 
 #include <memory>
 #include <sstream>
+#include <string>
 
 #include "include/api_manager/http_request.h"
 #include "include/api_manager/utils/status.h"
@@ -97,6 +98,34 @@ struct ngx_esp_http_connection {
   ngx_str_t url_path;
   ngx_str_t host_header;
 
+  // The connection pool key (scheme, host and port) when the connection
+  // may be kept alive after the response; empty otherwise.
+  std::string pool_key;
+
+  // A connection taken from the pool for this request, until the
+  // upstream module picks it up (see ngx_esp_upstream_get_pooled_peer).
+  ngx_connection_t* pooled_connection;
+  ngx_sockaddr_t pooled_sockaddr;
+  socklen_t pooled_socklen;
+
+  // True if the request was sent on a pooled connection.
+  bool reused_connection;
+  // True if the connection state and pools are those of a finished
+  // request (see recycle_http_connection).
+  bool recycled;
+  // The bytes written on the pooled connection when the upstream module
+  // picked it up, to tell whether any of the request was written.
+  off_t pooled_sent;
+
+  // The destination whose outbound scheduler slot the request holds;
+  // empty if the request bypassed the scheduler.
+  std::string scheduler_destination;
+
+  // Stands in for an upstream{} block so that the upstream module asks
+  // for a peer (rather than connecting to the resolved address) when a
+  // pooled connection is used.
+  ngx_http_upstream_srv_conf_t pooled_upstream;
+
   // A unique pointer to the HTTP request object created by the caller
   // (contains headers, body, HTTP verb, URL, timeout, and completion
   // continuation).
@@ -107,6 +136,9 @@ struct ngx_esp_http_connection {
   // Parsed HTTP response status.
   ngx_http_status_t response_status;
 
+  // State of the chunked transfer coding decoder.
+  ngx_http_chunked_t chunked;
+
   // Stream in which we accumulate response body as it is streamed to us
   // by the NGINX upstream module.
   std::ostringstream response_body;
@@ -135,6 +167,12 @@ struct ngx_esp_http_connection {
 // an error, for example on connection failure, timeout etc.)
 void ngx_esp_send_http_request(std::unique_ptr<HTTPRequest> request);
 
+// Sends an HTTP request right away, bypassing the outbound scheduler.  A
+// non-empty destination is released with the scheduler once the request
+// has finished.
+void ngx_esp_start_http_request(std::unique_ptr<HTTPRequest> request,
+                                const std::string &destination);
+
 }  // namespace nginx
 }  // namespace api_manager
 }  // namespace google
@@ -0,0 +1,227 @@
+// Copyright (C) Extensible Service Proxy Authors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "src/nginx/http_connection_pool.h"
+
+namespace google {
+namespace api_manager {
+namespace nginx {
+
+NgxEspHttpConnectionPool::NgxEspHttpConnectionPool(const Options &options)
+    : options_(options), stats_() {}
+
+NgxEspHttpConnectionPool::~NgxEspHttpConnectionPool() {
+  // nginx closes idle connections itself when the worker shuts down
+  // (ngx_close_idle_connections); whatever is left goes with the process.
+  for (auto &it : idle_) {
+    for (Item *item : it.second) {
+      item->connection->data = nullptr;
+      delete item;
+    }
+  }
+}
+
+ngx_connection_t *NgxEspHttpConnectionPool::Take(const std::string &key,
+                                                 ngx_log_t *log,
+                                                 ngx_sockaddr_t *sockaddr,
+                                                 socklen_t *socklen) {
+  auto it = idle_.find(key);
+  if (it == idle_.end() || it->second.empty()) {
+    return nullptr;
+  }
+
+  Item *item = it->second.front();
+  ngx_connection_t *c = item->connection;
+  ngx_memcpy(sockaddr, &item->sockaddr, item->socklen);
+  *socklen = item->socklen;
+  Remove(item);
+
+  if (c->read->timer_set) {
+    c->read->delayed = 0;
+    ngx_del_timer(c->read);
+  }
+  if (c->write->timer_set) {
+    ngx_del_timer(c->write);
+  }
+
+  c->idle = 0;
+  c->sent = 0;
+  c->data = nullptr;
+  c->log = log;
+  c->read->log = log;
+  c->write->log = log;
+  c->pool->log = log;
+
+  ngx_log_debug2(NGX_LOG_DEBUG_HTTP, log, 0,
+                 "esp: reusing http connection %p for %s", c, key.c_str());
+  return c;
+}
+
+bool NgxEspHttpConnectionPool::Put(const std::string &key,
+                                   ngx_connection_t *c,
+                                   const struct sockaddr *sockaddr,
+                                   socklen_t socklen) {
+  if (!enabled() || ngx_terminate || ngx_exiting ||
+      c->requests >= options_.max_requests || c->read->eof ||
+      c->read->error || c->read->timedout || c->write->error ||
+      c->write->timedout || socklen > sizeof(ngx_sockaddr_t)) {
+    return false;
+  }
+
+  if (ngx_handle_read_event(c->read, 0) != NGX_OK) {
+    return false;
+  }
+
+  std::list<Item *> &idle = idle_[key];
+  if (idle.size() >= options_.max_idle) {
+    // Make room by closing the least recently used connection.
+    Item *oldest = idle.back();
+    ngx_connection_t *old = oldest->connection;
+    Remove(oldest);
+    Close(old);
+  }
+
+  Item *item = new Item;
+  item->pool = this;
+  item->key = key;
+  item->connection = c;
+  ngx_memcpy(&item->sockaddr, sockaddr, socklen);
+  item->socklen = socklen;
+  idle.push_front(item);
+  item->position = idle.begin();
+  stats_.idle++;
+
+  if (c->write->timer_set) {
+    ngx_del_timer(c->write);
+  }
+  c->read->delayed = 0;
+  ngx_add_timer(c->read, options_.idle_timeout);
+
+  c->read->handler = &NgxEspHttpConnectionPool::OnIdleRead;
+  c->write->handler = &NgxEspHttpConnectionPool::OnIdleWrite;
+  c->data = item;
+  c->idle = 1;
+  c->log = ngx_cycle->log;
+  c->read->log = ngx_cycle->log;
+  c->write->log = ngx_cycle->log;
+  c->pool->log = ngx_cycle->log;
+
+  ngx_log_debug2(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                 "esp: keeping http connection %p for %s", c, key.c_str());
+
+  if (c->read->ready) {
+    // The peer sent something (or closed) already.
+    OnIdleRead(c->read);
+  }
+  return true;
+}
+
+void NgxEspHttpConnectionPool::CloseIdle(const std::string &key) {
+  auto it = idle_.find(key);
+  if (it == idle_.end()) {
+    return;
+  }
+  while (!it->second.empty()) {
+    Item *item = it->second.front();
+    ngx_connection_t *c = item->connection;
+    Remove(item);
+    Close(c);
+    stats_.idle_closed++;
+  }
+}
+
+void NgxEspHttpConnectionPool::RecordRequest(bool reused, bool recycled) {
+  stats_.requests++;
+  if (reused) {
+    stats_.reused++;
+  }
+  if (recycled) {
+    stats_.recycled++;
+  }
+}
+
+void NgxEspHttpConnectionPool::OnIdleRead(ngx_event_t *ev) {
+  ngx_connection_t *c = reinterpret_cast<ngx_connection_t *>(ev->data);
+  Item *item = reinterpret_cast<Item *>(c->data);
+
+  if (!c->close && !ev->timedout) {
+    char buf[1];
+    ssize_t n = recv(c->fd, buf, 1, MSG_PEEK);
+    if (n == -1 && ngx_socket_errno == NGX_EAGAIN) {
+      ev->ready = 0;
+      if (ngx_handle_read_event(c->read, 0) == NGX_OK) {
+        return;
+      }
+    }
+  }
+
+  ngx_log_debug1(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                 "esp: closing idle http connection %p", c);
+
+  if (item) {
+    NgxEspHttpConnectionPool *pool = item->pool;
+    pool->Remove(item);
+    pool->stats_.idle_closed++;
+  }
+  Close(c);
+}
+
+void NgxEspHttpConnectionPool::OnIdleWrite(ngx_event_t *ev) {
+  ngx_connection_t *c = reinterpret_cast<ngx_connection_t *>(ev->data);
+  ngx_log_debug1(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                 "esp: idle http connection %p writable", c);
+}
+
+void NgxEspHttpConnectionPool::Close(ngx_connection_t *c) {
+#if (NGX_SSL)
+  if (c->ssl) {
+    c->ssl->no_wait_shutdown = 1;
+    c->ssl->no_send_shutdown = 1;
+    if (ngx_ssl_shutdown(c) == NGX_AGAIN) {
+      c->ssl->handler = &NgxEspHttpConnectionPool::Close;
+      return;
+    }
+  }
+#endif
+
+  ngx_destroy_pool(c->pool);
+  ngx_close_connection(c);
+}
+
+void NgxEspHttpConnectionPool::Remove(Item *item) {
+  auto it = idle_.find(item->key);
+  it->second.erase(item->position);
+  if (it->second.empty()) {
+    idle_.erase(it);
+  }
+  item->connection->data = nullptr;
+  stats_.idle--;
+  delete item;
+}
+
+}  // namespace nginx
+}  // namespace api_manager
+}  // namespace google
@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) Extensible Service Proxy Authors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#ifndef NGINX_NGX_ESP_HTTP_CONNECTION_POOL_H_
+#define NGINX_NGX_ESP_HTTP_CONNECTION_POOL_H_
+
+#include <cstdint>
+#include <list>
+#include <map>
+#include <string>
+
+extern "C" {
+#include "src/core/ngx_core.h"
+#include "src/event/ngx_event.h"
+}
+
+namespace google {
+namespace api_manager {
+namespace nginx {
+
+// The idle HTTP/1.1 connections of the outbound HTTP client (http.cc),
+// keyed by scheme, host and port, so that service control, JWKS, metadata
+// and tracing calls don't pay for a TCP connect and TLS handshake each.
+//
+// There is one pool per worker; it must only be used from the nginx
+// thread.
+class NgxEspHttpConnectionPool {
+ public:
+  struct Options {
+    // The maximum number of idle connections kept per key; 0 disables
+    // connection reuse.
+    ngx_uint_t max_idle;
+    // How long a connection may stay idle before it is closed.
+    ngx_msec_t idle_timeout;
+    // The maximum number of requests sent on one connection.
+    ngx_uint_t max_requests;
+  };
+
+  struct Stats {
+    // Number of requests sent.
+    uint64_t requests;
+    // Number of requests sent on a pooled connection.
+    uint64_t reused;
+    // Number of connections currently idle in the pool.
+    uint64_t idle;
+    // Number of idle connections closed by the timeout or by the peer.
+    uint64_t idle_closed;
+    // Number of requests that reused the state and pools of a finished
+    // request.
+    uint64_t recycled;
+  };
+
+  explicit NgxEspHttpConnectionPool(const Options &options);
+  ~NgxEspHttpConnectionPool();
+
+  bool enabled() const { return options_.max_idle > 0; }
+
+  // Removes the most recently used idle connection for key from the pool
+  // and returns it, or nullptr if there is none.  The connection's peer
+  // address is returned in sockaddr and socklen.
+  ngx_connection_t *Take(const std::string &key, ngx_log_t *log,
+                         ngx_sockaddr_t *sockaddr, socklen_t *socklen);
+
+  // Offers a connection whose response has been read completely.  Returns
+  // true if the pool took it over; otherwise the caller must close it.
+  bool Put(const std::string &key, ngx_connection_t *c,
+           const struct sockaddr *sockaddr, socklen_t socklen);
+
+  // Closes all idle connections for key.
+  void CloseIdle(const std::string &key);
+
+  // Counts a request sent, on a pooled connection or not, and with
+  // recycled request state or not.
+  void RecordRequest(bool reused, bool recycled);
+
+  const Stats &stats() const { return stats_; }
+
+  // Closes a connection taken from the pool (or refused by it).
+  static void Close(ngx_connection_t *c);
+
+ private:
+  struct Item {
+    NgxEspHttpConnectionPool *pool;
+    std::string key;
+    ngx_connection_t *connection;
+    ngx_sockaddr_t sockaddr;
+    socklen_t socklen;
+    std::list<Item *>::iterator position;
+  };
+
+  // Read handler of idle connections: any data, EOF or the idle timeout
+  // means the connection can't be reused.
+  static void OnIdleRead(ngx_event_t *ev);
+  static void OnIdleWrite(ngx_event_t *ev);
+
+  // Unlinks and deletes the item; doesn't touch the connection.
+  void Remove(Item *item);
+
+  Options options_;
+  Stats stats_;
+  // Per key, the idle connections, most recently used first.
+  std::map<std::string, std::list<Item *>> idle_;
+};
+
+}  // namespace nginx
+}  // namespace api_manager
+}  // namespace google
+
+#endif  // NGINX_NGX_ESP_HTTP_CONNECTION_POOL_H_
@@ -0,0 +1,195 @@
+// Copyright (C) Extensible Service Proxy Authors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "src/nginx/http_scheduler.h"
+
+#include <vector>
+
+using ::google::api_manager::utils::Status;
+using std::chrono::steady_clock;
+
+namespace google {
+namespace api_manager {
+namespace nginx {
+
+namespace {
+
+// How often queued requests are checked for expired deadlines.
+const std::chrono::milliseconds kSweepInterval(100);
+
+// The status code of requests that fail without a response, NGX_ERROR as
+// in http.cc.
+const int kRequestFailed = -1;
+
+uint64_t MicrosecondsSince(steady_clock::time_point start,
+                           steady_clock::time_point now) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(now - start)
+      .count();
+}
+
+}  // namespace
+
+NgxEspHttpScheduler::NgxEspHttpScheduler(const Options &options,
+                                         StartFunc start,
+                                         TimerFunc start_timer)
+    : options_(options),
+      start_(std::move(start)),
+      start_timer_(std::move(start_timer)),
+      stats_(),
+      queued_(0) {}
+
+NgxEspHttpScheduler::~NgxEspHttpScheduler() {}
+
+std::string NgxEspHttpScheduler::DestinationOf(const std::string &url) {
+  size_t start = url.find("://");
+  start = start == std::string::npos ? 0 : start + 3;
+  return url.substr(0, url.find_first_of("/?#", start));
+}
+
+void NgxEspHttpScheduler::Submit(std::unique_ptr<HTTPRequest> request) {
+  std::string key = DestinationOf(request->url());
+  Destination &destination = destinations_[key];
+
+  if (options_.max_concurrent == 0 ||
+      destination.in_flight < options_.max_concurrent) {
+    ++destination.in_flight;
+    start_(std::move(request), key);
+    return;
+  }
+
+  Entry entry;
+  entry.enqueued = steady_clock::now();
+  entry.deadline = request->timeout_ms() > 0
+                       ? entry.enqueued +
+                             std::chrono::milliseconds(request->timeout_ms())
+                       : steady_clock::time_point::max();
+  HTTPRequest::Priority priority = request->priority();
+  entry.request = std::move(request);
+  destination.queues[priority].push_back(std::move(entry));
+
+  ++stats_.classes[priority].queued;
+  ++queued_;
+  ScheduleSweep();
+}
+
+void NgxEspHttpScheduler::Done(const std::string &key) {
+  auto it = destinations_.find(key);
+  if (it == destinations_.end() || it->second.in_flight == 0) {
+    return;
+  }
+  --it->second.in_flight;
+  StartQueued(key, &it->second);
+}
+
+void NgxEspHttpScheduler::StartQueued(const std::string &key,
+                                      Destination *destination) {
+  steady_clock::time_point now = steady_clock::now();
+  for (int priority = 0; priority < HTTPRequest::NUM_PRIORITIES;
+       ++priority) {
+    auto &queue = destination->queues[priority];
+    ClassStats &stats = stats_.classes[priority];
+    while (!queue.empty()) {
+      if (options_.max_concurrent != 0 &&
+          destination->in_flight >= options_.max_concurrent) {
+        return;
+      }
+
+      Entry entry = std::move(queue.front());
+      queue.pop_front();
+      --stats.queued;
+      --queued_;
+      if (entry.deadline <= now) {
+        ++stats.expired;
+        entry.request->OnComplete(
+            Status(kRequestFailed, "Timed out waiting to send the request"),
+            std::map<std::string, std::string>(), std::string());
+        continue;
+      }
+
+      uint64_t wait_us = MicrosecondsSince(entry.enqueued, now);
+      ++stats.delayed;
+      stats.total_wait_us += wait_us;
+      if (wait_us > stats.max_wait_us) {
+        stats.max_wait_us = wait_us;
+      }
+
+      // Destinations are never erased, so destination stays valid even if
+      // start_ finishes the request right away and reenters Done().
+      ++destination->in_flight;
+      start_(std::move(entry.request), key);
+    }
+  }
+}
+
+void NgxEspHttpScheduler::ExpireQueued() {
+  steady_clock::time_point now = steady_clock::now();
+  std::vector<std::unique_ptr<HTTPRequest>> expired;
+  for (auto &it : destinations_) {
+    for (int priority = 0; priority < HTTPRequest::NUM_PRIORITIES;
+         ++priority) {
+      auto &queue = it.second.queues[priority];
+      ClassStats &stats = stats_.classes[priority];
+      for (auto entry = queue.begin(); entry != queue.end();) {
+        if (entry->deadline > now) {
+          ++entry;
+          continue;
+        }
+        expired.push_back(std::move(entry->request));
+        entry = queue.erase(entry);
+        --stats.queued;
+        ++stats.expired;
+        --queued_;
+      }
+    }
+  }
+
+  // The callbacks may submit new requests, so they run once the queues
+  // are no longer being walked.
+  for (auto &request : expired) {
+    request->OnComplete(
+        Status(kRequestFailed, "Timed out waiting to send the request"),
+        std::map<std::string, std::string>(), std::string());
+  }
+}
+
+void NgxEspHttpScheduler::OnSweep() {
+  ExpireQueued();
+  if (queued_ == 0) {
+    // The timer can't be deleted from its own callback; the next queued
+    // request replaces it.
+    sweep_->Stop();
+  }
+}
+
+void NgxEspHttpScheduler::ScheduleSweep() {
+  if (queued_ > 0 && (!sweep_ || sweep_->IsStopped())) {
+    sweep_ = start_timer_(kSweepInterval, [this]() { OnSweep(); });
+  }
+}
+
+}  // namespace nginx
+}  // namespace api_manager
+}  // namespace google
@@ -0,0 +1,151 @@
+// Copyright (C) Extensible Service Proxy Authors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#ifndef NGINX_NGX_ESP_HTTP_SCHEDULER_H_
+#define NGINX_NGX_ESP_HTTP_SCHEDULER_H_
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+
+#include "include/api_manager/http_request.h"
+#include "include/api_manager/periodic_timer.h"
+
+namespace google {
+namespace api_manager {
+namespace nginx {
+
+// Admission control for the outbound HTTP client (http.cc).  At most
+// max_concurrent requests per destination (scheme, host and port) are in
+// flight; the others wait in per-priority queues, so that a burst of
+// report or trace uploads can't hold up the checks sent to the same
+// server.  A request that is still queued when its timeout expires fails
+// without being sent.
+//
+// There is one scheduler per worker; it must only be used from the nginx
+// thread.  It doesn't call nginx itself: requests are sent and the expiry
+// timer is run by the functions it is given.
+class NgxEspHttpScheduler {
+ public:
+  struct Options {
+    // The maximum number of requests in flight per destination; 0 for no
+    // limit.
+    size_t max_concurrent;
+  };
+
+  // Counters per priority class.
+  struct ClassStats {
+    // Number of requests currently queued.
+    uint64_t queued;
+    // Number of requests that had to wait before being sent.
+    uint64_t delayed;
+    // Number of requests failed because their timeout expired in the
+    // queue.
+    uint64_t expired;
+    // Total and maximum time spent in the queue (unit: microseconds).
+    uint64_t total_wait_us;
+    uint64_t max_wait_us;
+  };
+
+  struct Stats {
+    ClassStats classes[HTTPRequest::NUM_PRIORITIES];
+  };
+
+  // Sends a request to the network.  The scheduler passes the request's
+  // destination along; it must be handed back to Done() when the request
+  // has finished.
+  typedef std::function<void(std::unique_ptr<HTTPRequest>,
+                             const std::string &destination)>
+      StartFunc;
+
+  // Starts a timer that runs the callback every interval, as
+  // ApiManagerEnvInterface::StartPeriodicTimer does.
+  typedef std::function<std::unique_ptr<PeriodicTimer>(
+      std::chrono::milliseconds interval, std::function<void()> callback)>
+      TimerFunc;
+
+  NgxEspHttpScheduler(const Options &options, StartFunc start,
+                      TimerFunc start_timer);
+  ~NgxEspHttpScheduler();
+
+  // Sends the request now if its destination is below the concurrency
+  // limit, or queues it.
+  void Submit(std::unique_ptr<HTTPRequest> request);
+
+  // Releases the slot held by a finished request and sends the next
+  // queued request to the same destination, if any.
+  void Done(const std::string &destination);
+
+  const Stats &stats() const { return stats_; }
+
+  // Returns the scheme, host and port part of url.
+  static std::string DestinationOf(const std::string &url);
+
+ private:
+  struct Entry {
+    std::unique_ptr<HTTPRequest> request;
+    std::chrono::steady_clock::time_point enqueued;
+    // steady_clock::time_point::max() for no deadline.
+    std::chrono::steady_clock::time_point deadline;
+  };
+
+  struct Destination {
+    size_t in_flight;
+    std::deque<Entry> queues[HTTPRequest::NUM_PRIORITIES];
+  };
+
+  // Sends the highest priority queued request for the destination that
+  // hasn't expired yet, while there is room.
+  void StartQueued(const std::string &key, Destination *destination);
+
+  // Fails the queued requests whose deadline has passed.
+  void ExpireQueued();
+
+  // The sweep timer callback: expires queued requests, and stops the
+  // timer once nothing is queued.
+  void OnSweep();
+
+  // Starts the sweep timer if any request is queued.
+  void ScheduleSweep();
+
+  Options options_;
+  StartFunc start_;
+  TimerFunc start_timer_;
+  Stats stats_;
+  uint64_t queued_;
+  std::map<std::string, Destination> destinations_;
+  std::unique_ptr<PeriodicTimer> sweep_;
+};
+
+}  // namespace nginx
+}  // namespace api_manager
+}  // namespace google
+
+#endif  // NGINX_NGX_ESP_HTTP_SCHEDULER_H_
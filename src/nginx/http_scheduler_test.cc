@@ -0,0 +1,272 @@
+// Copyright (C) Extensible Service Proxy Authors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "src/nginx/http_scheduler.h"
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+using ::google::api_manager::utils::Status;
+
+namespace google {
+namespace api_manager {
+namespace nginx {
+
+namespace {
+
+const char kServer[] = "http://server";
+const char kOtherServer[] = "https://other:8443";
+
+class FakeTimer : public PeriodicTimer {
+ public:
+  void Stop() override { stopped_ = true; }
+  bool IsStopped() const override { return stopped_; }
+
+ private:
+  bool stopped_ = false;
+};
+
+class HttpSchedulerTest : public ::testing::Test {
+ protected:
+  void CreateScheduler(size_t max_concurrent) {
+    NgxEspHttpScheduler::Options options;
+    options.max_concurrent = max_concurrent;
+    scheduler_.reset(new NgxEspHttpScheduler(
+        options,
+        [this](std::unique_ptr<HTTPRequest> request,
+               const std::string &destination) {
+          Start(std::move(request), destination);
+        },
+        [this](std::chrono::milliseconds interval,
+               std::function<void()> callback) {
+          sweep_ = callback;
+          timer_ = new FakeTimer();
+          ++timers_started_;
+          return std::unique_ptr<PeriodicTimer>(timer_);
+        }));
+  }
+
+  // Submits a request named by its body.
+  void Submit(const std::string &name, HTTPRequest::Priority priority,
+              const std::string &server = kServer, int timeout_ms = 0) {
+    std::unique_ptr<HTTPRequest> request(new HTTPRequest(
+        [this, name](Status status, std::map<std::string, std::string> &&,
+                     std::string &&) {
+          failed_.push_back(name);
+          EXPECT_EQ(-1, status.code());
+        }));
+    request->set_url(server + std::string("/v1/path?query"))
+        .set_body(name)
+        .set_priority(priority)
+        .set_timeout_ms(timeout_ms);
+    scheduler_->Submit(std::move(request));
+  }
+
+  void Start(std::unique_ptr<HTTPRequest> request,
+             const std::string &destination) {
+    started_.push_back(request->body());
+    destinations_.push_back(destination);
+    // A request that fails right away releases its slot from within the
+    // start function.
+    if (request->body().compare(0, 4, "fail") == 0) {
+      scheduler_->Done(destination);
+    }
+  }
+
+  const NgxEspHttpScheduler::ClassStats &Stats(HTTPRequest::Priority p) {
+    return scheduler_->stats().classes[p];
+  }
+
+  std::unique_ptr<NgxEspHttpScheduler> scheduler_;
+  std::vector<std::string> started_;
+  std::vector<std::string> destinations_;
+  std::vector<std::string> failed_;
+
+  std::function<void()> sweep_;
+  FakeTimer *timer_ = nullptr;
+  int timers_started_ = 0;
+};
+
+TEST(HttpScheduler, DestinationOf) {
+  EXPECT_EQ("http://server",
+            NgxEspHttpScheduler::DestinationOf("http://server/v1/check"));
+  EXPECT_EQ("https://server:8443",
+            NgxEspHttpScheduler::DestinationOf("https://server:8443?a=b"));
+  EXPECT_EQ("http://server",
+            NgxEspHttpScheduler::DestinationOf("http://server"));
+}
+
+TEST_F(HttpSchedulerTest, NoLimit) {
+  CreateScheduler(0);
+  for (int i = 0; i < 10; ++i) {
+    Submit("report" + std::to_string(i), HTTPRequest::REPORT);
+  }
+  EXPECT_EQ(10, started_.size());
+  EXPECT_EQ(0, Stats(HTTPRequest::REPORT).delayed);
+  EXPECT_EQ(0, timers_started_);
+}
+
+TEST_F(HttpSchedulerTest, ConcurrencyCapPerDestination) {
+  CreateScheduler(2);
+  Submit("a", HTTPRequest::OTHER);
+  Submit("b", HTTPRequest::OTHER);
+  Submit("c", HTTPRequest::OTHER);
+  Submit("d", HTTPRequest::OTHER);
+  // Another destination has slots of its own.
+  Submit("other", HTTPRequest::OTHER, kOtherServer);
+
+  EXPECT_EQ(std::vector<std::string>({"a", "b", "other"}), started_);
+  EXPECT_EQ(std::vector<std::string>({kServer, kServer, kOtherServer}),
+            destinations_);
+  EXPECT_EQ(2, Stats(HTTPRequest::OTHER).queued);
+
+  // Finishing a request to the other destination doesn't free a slot here.
+  scheduler_->Done(kOtherServer);
+  EXPECT_EQ(3, started_.size());
+
+  scheduler_->Done(kServer);
+  EXPECT_EQ(std::vector<std::string>({"a", "b", "other", "c"}), started_);
+  scheduler_->Done(kServer);
+  EXPECT_EQ(std::vector<std::string>({"a", "b", "other", "c", "d"}),
+            started_);
+  EXPECT_EQ(0, Stats(HTTPRequest::OTHER).queued);
+  EXPECT_EQ(2, Stats(HTTPRequest::OTHER).delayed);
+
+  // Nothing is queued; extra Done() calls are ignored.
+  scheduler_->Done(kServer);
+  scheduler_->Done(kServer);
+  scheduler_->Done(kServer);
+  Submit("e", HTTPRequest::OTHER);
+  Submit("f", HTTPRequest::OTHER);
+  Submit("g", HTTPRequest::OTHER);
+  EXPECT_EQ(7, started_.size());
+  EXPECT_EQ(1, Stats(HTTPRequest::OTHER).queued);
+}
+
+TEST_F(HttpSchedulerTest, PriorityOrder) {
+  CreateScheduler(1);
+  Submit("first", HTTPRequest::OTHER);
+  Submit("trace", HTTPRequest::TRACE);
+  Submit("report1", HTTPRequest::REPORT);
+  Submit("other", HTTPRequest::OTHER);
+  Submit("key_fetch", HTTPRequest::KEY_FETCH);
+  Submit("report2", HTTPRequest::REPORT);
+  Submit("quota", HTTPRequest::QUOTA);
+  Submit("check1", HTTPRequest::CHECK);
+  Submit("check2", HTTPRequest::CHECK);
+  EXPECT_EQ(1, started_.size());
+
+  for (int i = 0; i < 8; ++i) {
+    scheduler_->Done(kServer);
+  }
+  EXPECT_EQ(std::vector<std::string>({"first", "check1", "check2", "quota",
+                                      "key_fetch", "other", "report1",
+                                      "report2", "trace"}),
+            started_);
+  EXPECT_EQ(2, Stats(HTTPRequest::CHECK).delayed);
+  EXPECT_EQ(2, Stats(HTTPRequest::REPORT).delayed);
+  EXPECT_EQ(1, Stats(HTTPRequest::TRACE).delayed);
+  EXPECT_TRUE(failed_.empty());
+}
+
+TEST_F(HttpSchedulerTest, ExpiredBySweep) {
+  CreateScheduler(1);
+  Submit("first", HTTPRequest::OTHER);
+  Submit("expires", HTTPRequest::REPORT, kServer, 1);
+  Submit("no_deadline", HTTPRequest::REPORT);
+  ASSERT_EQ(1, timers_started_);
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  sweep_();
+  EXPECT_EQ(std::vector<std::string>({"expires"}), failed_);
+  EXPECT_EQ(1, Stats(HTTPRequest::REPORT).expired);
+  EXPECT_EQ(1, Stats(HTTPRequest::REPORT).queued);
+  // A request is still queued, so the sweep goes on.
+  EXPECT_FALSE(timer_->IsStopped());
+
+  scheduler_->Done(kServer);
+  EXPECT_EQ(std::vector<std::string>({"first", "no_deadline"}), started_);
+
+  // Nothing left to expire: the timer stops, and the next queued request
+  // starts a new one.
+  sweep_();
+  EXPECT_TRUE(timer_->IsStopped());
+  Submit("queued", HTTPRequest::REPORT);
+  EXPECT_EQ(2, timers_started_);
+  EXPECT_FALSE(timer_->IsStopped());
+}
+
+TEST_F(HttpSchedulerTest, ExpiredWhenSlotFrees) {
+  CreateScheduler(1);
+  Submit("first", HTTPRequest::OTHER);
+  Submit("expires", HTTPRequest::CHECK, kServer, 1);
+  Submit("next", HTTPRequest::REPORT, kServer, 60000);
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  // The expired request fails instead of taking the slot.
+  scheduler_->Done(kServer);
+  EXPECT_EQ(std::vector<std::string>({"expires"}), failed_);
+  EXPECT_EQ(std::vector<std::string>({"first", "next"}), started_);
+  EXPECT_EQ(1, Stats(HTTPRequest::CHECK).expired);
+  EXPECT_EQ(0, Stats(HTTPRequest::CHECK).delayed);
+  EXPECT_EQ(1, Stats(HTTPRequest::REPORT).delayed);
+}
+
+TEST_F(HttpSchedulerTest, ReentrantDone) {
+  CreateScheduler(1);
+  Submit("first", HTTPRequest::OTHER);
+  Submit("fail1", HTTPRequest::CHECK);
+  Submit("fail2", HTTPRequest::CHECK);
+  Submit("last", HTTPRequest::REPORT);
+  Submit("queued", HTTPRequest::TRACE);
+
+  // Each failing request releases its slot as it starts, which starts the
+  // next one; "last" then holds the only slot.
+  scheduler_->Done(kServer);
+  EXPECT_EQ(std::vector<std::string>({"first", "fail1", "fail2", "last"}),
+            started_);
+  EXPECT_EQ(1, Stats(HTTPRequest::TRACE).queued);
+
+  Submit("more", HTTPRequest::CHECK);
+  EXPECT_EQ(4, started_.size());
+
+  scheduler_->Done(kServer);
+  EXPECT_EQ(std::vector<std::string>(
+                {"first", "fail1", "fail2", "last", "more"}),
+            started_);
+  scheduler_->Done(kServer);
+  EXPECT_EQ("queued", started_.back());
+  EXPECT_EQ(0, Stats(HTTPRequest::TRACE).queued);
+}
+
+}  // namespace
+
+}  // namespace nginx
+}  // namespace api_manager
+}  // namespace google
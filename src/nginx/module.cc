@@ -202,6 +202,25 @@ namespace {
 // During process exiting.
 const int kWaitCloseTime = 3;
 
+// Default high-water mark for gRPC response data waiting to be sent.
+const size_t kDefaultGrpcWriteBufferSize = 64 * 1024;
+
+// Defaults for the outbound HTTP keep-alive pool.
+const ngx_int_t kDefaultHttpKeepaliveConnections = 8;
+const ngx_msec_t kDefaultHttpKeepaliveTimeout = 60000;
+const ngx_int_t kDefaultHttpKeepaliveRequests = 100;
+
+// Default limit on the outbound HTTP requests in flight per server: none,
+// so that requests are only queued where the limit is configured.
+const ngx_int_t kDefaultHttpMaxConcurrentRequests = 0;
+
+// Defaults for the gzip compression of transcoded responses.
+const size_t kDefaultTranscodingGzipMinLength = 1024;
+const ngx_int_t kDefaultTranscodingGzipCompLevel = 1;
+
+ngx_conf_num_bounds_t kTranscodingGzipCompLevelBounds = {
+    ngx_conf_check_num_bounds, 1, 9};
+
 // ********************************************************
 // * Extensible Service Proxy - Configuration declarations. *
 // ********************************************************
@@ -310,6 +329,140 @@ ngx_command_t ngx_esp_commands[] = {
         0,
         nullptr,
     },
+    {
+        ngx_string("endpoints_grpc_queues"),
+        NGX_HTTP_MAIN_CONF | NGX_CONF_TAKE1,
+        [](ngx_conf_t *cf, ngx_command_t *cmd, void *conf) -> char * {
+          return ngx_conf_set_num_slot(
+              cf, cmd,
+              &reinterpret_cast<ngx_esp_main_conf_t *>(conf)
+                   ->grpc_queue_count);
+        },
+        NGX_HTTP_MAIN_CONF_OFFSET,
+        0,
+        nullptr,
+    },
+    {
+        // Outbound HTTP requests (service control, JWKS, metadata, ...)
+        // keep up to this many idle connections per server; 0 disables
+        // connection reuse.
+        ngx_string("endpoints_http_keepalive"),
+        NGX_HTTP_MAIN_CONF | NGX_CONF_TAKE1,
+        [](ngx_conf_t *cf, ngx_command_t *cmd, void *conf) -> char * {
+          return ngx_conf_set_num_slot(
+              cf, cmd,
+              &reinterpret_cast<ngx_esp_main_conf_t *>(conf)
+                   ->http_keepalive_connections);
+        },
+        NGX_HTTP_MAIN_CONF_OFFSET,
+        0,
+        nullptr,
+    },
+    {
+        ngx_string("endpoints_http_keepalive_timeout"),
+        NGX_HTTP_MAIN_CONF | NGX_CONF_TAKE1,
+        [](ngx_conf_t *cf, ngx_command_t *cmd, void *conf) -> char * {
+          return ngx_conf_set_msec_slot(
+              cf, cmd,
+              &reinterpret_cast<ngx_esp_main_conf_t *>(conf)
+                   ->http_keepalive_timeout);
+        },
+        NGX_HTTP_MAIN_CONF_OFFSET,
+        0,
+        nullptr,
+    },
+    {
+        ngx_string("endpoints_http_keepalive_requests"),
+        NGX_HTTP_MAIN_CONF | NGX_CONF_TAKE1,
+        [](ngx_conf_t *cf, ngx_command_t *cmd, void *conf) -> char * {
+          return ngx_conf_set_num_slot(
+              cf, cmd,
+              &reinterpret_cast<ngx_esp_main_conf_t *>(conf)
+                   ->http_keepalive_requests);
+        },
+        NGX_HTTP_MAIN_CONF_OFFSET,
+        0,
+        nullptr,
+    },
+    {
+        // endpoints_http_max_concurrent_requests <number>;  (http block)
+        //
+        // Outbound HTTP requests beyond this many in flight to one server
+        // wait in priority order (check, quota, key fetch, other, report,
+        // trace), and fail if still queued when their timeout expires.
+        // The default, 0, sets no limit.  A worker sends at most about
+        // number / latency requests per second to one server, e.g. 640/s
+        // for 32 at 50ms, so the limit should leave room for peak load.
+        ngx_string("endpoints_http_max_concurrent_requests"),
+        NGX_HTTP_MAIN_CONF | NGX_CONF_TAKE1,
+        [](ngx_conf_t *cf, ngx_command_t *cmd, void *conf) -> char * {
+          return ngx_conf_set_num_slot(
+              cf, cmd,
+              &reinterpret_cast<ngx_esp_main_conf_t *>(conf)
+                   ->http_max_concurrent_requests);
+        },
+        NGX_HTTP_MAIN_CONF_OFFSET,
+        0,
+        nullptr,
+    },
+    {
+        ngx_string("endpoints_grpc_write_buffer_size"),
+        NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF |
+            NGX_CONF_TAKE1,
+        [](ngx_conf_t *cf, ngx_command_t *cmd, void *conf) -> char * {
+          return ngx_conf_set_size_slot(
+              cf, cmd,
+              &reinterpret_cast<ngx_esp_loc_conf_t *>(conf)
+                   ->grpc_write_buffer_size);
+        },
+        NGX_HTTP_LOC_CONF_OFFSET,
+        0,
+        nullptr,
+    },
+    {
+        // Gzip compresses transcoded JSON responses for clients that send
+        // "Accept-Encoding: gzip".
+        ngx_string("endpoints_transcoding_gzip"),
+        NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF |
+            NGX_CONF_FLAG,
+        [](ngx_conf_t *cf, ngx_command_t *cmd, void *conf) -> char * {
+          return ngx_conf_set_flag_slot(
+              cf, cmd,
+              &reinterpret_cast<ngx_esp_loc_conf_t *>(conf)->transcoding_gzip);
+        },
+        NGX_HTTP_LOC_CONF_OFFSET,
+        0,
+        nullptr,
+    },
+    {
+        // Responses whose first gRPC message is smaller are not compressed.
+        ngx_string("endpoints_transcoding_gzip_min_length"),
+        NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF |
+            NGX_CONF_TAKE1,
+        [](ngx_conf_t *cf, ngx_command_t *cmd, void *conf) -> char * {
+          return ngx_conf_set_size_slot(
+              cf, cmd,
+              &reinterpret_cast<ngx_esp_loc_conf_t *>(conf)
+                   ->transcoding_gzip_min_length);
+        },
+        NGX_HTTP_LOC_CONF_OFFSET,
+        0,
+        nullptr,
+    },
+    {
+        ngx_string("endpoints_transcoding_gzip_comp_level"),
+        NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF |
+            NGX_CONF_TAKE1,
+        [](ngx_conf_t *cf, ngx_command_t *cmd, void *conf) -> char * {
+          return ngx_conf_set_num_slot(
+              cf, cmd,
+              &reinterpret_cast<ngx_esp_loc_conf_t *>(conf)
+                   ->transcoding_gzip_comp_level);
+        },
+        NGX_HTTP_LOC_CONF_OFFSET,
+        0,
+        &kTranscodingGzipCompLevelBounds,
+    },
     ngx_null_command  // last entry
 };
 
@@ -404,12 +557,45 @@ void *ngx_esp_create_main_conf(ngx_conf_t *cf) {
     return nullptr;
   }
 
+  conf->grpc_queue_count = NGX_CONF_UNSET;
+  conf->http_keepalive_connections = NGX_CONF_UNSET;
+  conf->http_keepalive_timeout = NGX_CONF_UNSET_MSEC;
+  conf->http_keepalive_requests = NGX_CONF_UNSET;
+  conf->http_max_concurrent_requests = NGX_CONF_UNSET;
+
   return conf;
 }
 
 // Initialize module's main context configuration.
 char *ngx_esp_init_main_conf(ngx_conf_t *cf, void *conf) {
-  // noop
+  auto *mc = reinterpret_cast<ngx_esp_main_conf_t *>(conf);
+  ngx_conf_init_value(mc->grpc_queue_count, 1);
+  if (mc->grpc_queue_count < 1) {
+    ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                       "endpoints_grpc_queues must be at least 1");
+    return reinterpret_cast<char *>(NGX_CONF_ERROR);
+  }
+
+  ngx_conf_init_value(mc->http_keepalive_connections,
+                      kDefaultHttpKeepaliveConnections);
+  ngx_conf_init_msec_value(mc->http_keepalive_timeout,
+                           kDefaultHttpKeepaliveTimeout);
+  ngx_conf_init_value(mc->http_keepalive_requests,
+                      kDefaultHttpKeepaliveRequests);
+  if (mc->http_keepalive_connections < 0 || mc->http_keepalive_requests < 1) {
+    ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                       "invalid endpoints_http_keepalive settings");
+    return reinterpret_cast<char *>(NGX_CONF_ERROR);
+  }
+
+  ngx_conf_init_value(mc->http_max_concurrent_requests,
+                      kDefaultHttpMaxConcurrentRequests);
+  if (mc->http_max_concurrent_requests < 0) {
+    ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                       "endpoints_http_max_concurrent_requests must not be "
+                       "negative");
+    return reinterpret_cast<char *>(NGX_CONF_ERROR);
+  }
   return NGX_CONF_OK;
 }
 
@@ -433,6 +619,10 @@ void *ngx_esp_create_loc_conf(ngx_conf_t *cf) {
   lc->service_control = NGX_CONF_UNSET;
   lc->cloud_tracing = NGX_CONF_UNSET;
   lc->api_authentication = NGX_CONF_UNSET;
+  lc->grpc_write_buffer_size = NGX_CONF_UNSET_SIZE;
+  lc->transcoding_gzip = NGX_CONF_UNSET;
+  lc->transcoding_gzip_min_length = NGX_CONF_UNSET_SIZE;
+  lc->transcoding_gzip_comp_level = NGX_CONF_UNSET;
 
   return lc;
 }
@@ -494,6 +684,18 @@ char *ngx_esp_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child) {
   ngx_conf_merge_str_value(conf->grpc_backend_address_fallback,
                            prev->grpc_backend_address_fallback, nullptr);
 
+  ngx_conf_merge_size_value(conf->grpc_write_buffer_size,
+                            prev->grpc_write_buffer_size,
+                            kDefaultGrpcWriteBufferSize);
+
+  ngx_conf_merge_value(conf->transcoding_gzip, prev->transcoding_gzip, 0);
+  ngx_conf_merge_size_value(conf->transcoding_gzip_min_length,
+                            prev->transcoding_gzip_min_length,
+                            kDefaultTranscodingGzipMinLength);
+  ngx_conf_merge_value(conf->transcoding_gzip_comp_level,
+                       prev->transcoding_gzip_comp_level,
+                       kDefaultTranscodingGzipCompLevel);
+
   if (conf->metadata_server == NGX_CONF_UNSET) {
     conf->metadata_server = prev->metadata_server;
     conf->metadata_server_url = prev->metadata_server_url;
@@ -1201,6 +1403,24 @@ ngx_int_t ngx_esp_init_process(ngx_cycle_t *cycle) {
     // Handle the case where there is no http section at all.
     return NGX_OK;
   }
+
+  NgxEspHttpConnectionPool::Options http_pool_options;
+  http_pool_options.max_idle = mc->http_keepalive_connections;
+  http_pool_options.idle_timeout = mc->http_keepalive_timeout;
+  http_pool_options.max_requests = mc->http_keepalive_requests;
+  mc->http_connection_pool.reset(
+      new NgxEspHttpConnectionPool(http_pool_options));
+
+  NgxEspHttpScheduler::Options http_scheduler_options;
+  http_scheduler_options.max_concurrent = mc->http_max_concurrent_requests;
+  mc->http_scheduler.reset(new NgxEspHttpScheduler(
+      http_scheduler_options, ngx_esp_start_http_request,
+      [cycle](std::chrono::milliseconds interval,
+              std::function<void()> callback) {
+        return std::unique_ptr<PeriodicTimer>(
+            new NgxEspTimer(interval, callback, cycle->log));
+      }));
+
   bool has_esp = false;
   ngx_esp_loc_conf_t **endpoints =
       reinterpret_cast<ngx_esp_loc_conf_t **>(mc->endpoints.elts);
@@ -1211,9 +1431,13 @@ ngx_int_t ngx_esp_init_process(ngx_cycle_t *cycle) {
       lc->esp->Init();
       has_esp = true;
     }
-    if (lc->grpc_pass && !mc->grpc_queue) {
+    // The queue also delivers the completions of service control calls
+    // made over gRPC (NgxEspEnv::RunGRPCRequest).
+    bool grpc_service_control = lc->endpoints_api == 1 && lc->esp &&
+                                lc->esp->get_service_control_grpc_transport();
+    if ((lc->grpc_pass || grpc_service_control) && !mc->grpc_queue) {
       mc->grpc_queue = NgxEspGrpcQueue::Instance();
-      mc->grpc_queue->Init(cycle);
+      mc->grpc_queue->Init(cycle, mc->grpc_queue_count);
     }
   }
 
@@ -43,9 +43,12 @@ extern "C" {
 #include "src/grpc/transcoding/transcoder_factory.h"
 #include "src/nginx/alloc.h"
 #include "src/nginx/grpc.h"
+#include "src/nginx/grpc_channel_pool.h"
 #include "src/nginx/grpc_queue.h"
 #include "src/nginx/grpc_server_call.h"
 #include "src/nginx/http.h"
+#include "src/nginx/http_connection_pool.h"
+#include "src/nginx/http_scheduler.h"
 #include "src/nginx/request.h"
 
 namespace google {
@@ -73,6 +76,29 @@ typedef struct {
   // The module-level GRPC library interface.
   std::shared_ptr<NgxEspGrpcQueue> grpc_queue;
 
+  // Number of gRPC completion queues (and poller threads) per worker.
+  ngx_int_t grpc_queue_count;
+
+  // gRPC response writes held back by slow clients.
+  NgxEspGrpcServerCall::WriteStats grpc_write_stats;
+
+  // gRPC calls to backends that ran past their deadline or were cancelled.
+  NgxEspGrpcServerCall::CallStats grpc_call_stats;
+
+  // Idle connections of the outbound HTTP client (http.cc).
+  std::unique_ptr<NgxEspHttpConnectionPool> http_connection_pool;
+
+  // Outbound HTTP keep-alive: idle connections kept per server, how long
+  // they're kept, and how many requests one connection may carry.
+  ngx_int_t http_keepalive_connections;
+  ngx_msec_t http_keepalive_timeout;
+  ngx_int_t http_keepalive_requests;
+
+  // Admission control of the outbound HTTP client, and its limit on the
+  // requests in flight per server (0 for none).
+  std::unique_ptr<NgxEspHttpScheduler> http_scheduler;
+  ngx_int_t http_max_concurrent_requests;
+
   // Shared memory zone for stats per process
   ngx_shm_zone_t *stats_zone;
 
@@ -108,8 +134,8 @@ typedef struct {
 
 } ngx_esp_main_conf_t;
 
-typedef std::map<std::string, std::shared_ptr<::grpc::GenericStub>>
-    ngx_esp_grpc_stub_map_t;
+typedef std::map<std::string, std::shared_ptr<NgxEspGrpcChannelPool>>
+    ngx_esp_grpc_channel_pool_map_t;
 
 // similar to GrpcSslCredentials but using ngx_str_t
 struct ngx_esp_ssl_credentials {
@@ -165,9 +191,9 @@ typedef struct {
   // Server config
   ngx_str_t endpoints_server_config;
 
-  // The map of backends to GRPC stubs.  These are constructed
+  // The map of backends to GRPC channel pools.  These are constructed
   // on-demand.
-  ngx_esp_grpc_stub_map_t grpc_stubs;
+  ngx_esp_grpc_channel_pool_map_t grpc_channel_pools;
 
   // The GRPC backend address override.  If this is a non-zero-length
   // string, this is where all GRPC API traffic will be sent,
@@ -183,6 +209,21 @@ typedef struct {
 
   // Grpc backend ssl credentials  from server_config.
   ngx_esp_ssl_credentials *grpc_backend_ssl;
+
+  // Grpc backend channel settings from server_config.
+  ::google::api_manager::proto::GrpcBackendChannelConfig *grpc_channel_config;
+
+  // How many bytes of gRPC response data may wait to be sent to the client
+  // before further responses are held back.
+  size_t grpc_write_buffer_size;
+
+  // Whether transcoded JSON responses are gzip compressed for clients that
+  // accept it.  Only responses whose first gRPC message is at least
+  // transcoding_gzip_min_length bytes are compressed.  gzip_http_version,
+  // gzip_proxied and gzip_disable apply as for nginx's gzip filter.
+  ngx_flag_t transcoding_gzip;
+  size_t transcoding_gzip_min_length;
+  ngx_int_t transcoding_gzip_comp_level;
 } ngx_esp_loc_conf_t;
 
 // **************************************************
@@ -132,6 +132,67 @@ void fill_process_stats(const ngx_esp_process_stats_t &stat,
     esp_status_proto->mutable_service_config_rollouts()->ParseFromArray(
         stat.esp_stats[j].rollouts, stat.esp_stats[j].rollouts_length);
   }
+
+  auto *grpc_queue = process_status->mutable_grpc_queue();
+  grpc_queue->set_drains(stat.grpc_queue.drains);
+  grpc_queue->set_events(stat.grpc_queue.events);
+  grpc_queue->set_max_events_per_drain(stat.grpc_queue.max_events_per_drain);
+  grpc_queue->set_total_drain_latency_us(
+      stat.grpc_queue.total_drain_latency_us);
+  grpc_queue->set_max_drain_latency_us(stat.grpc_queue.max_drain_latency_us);
+
+  auto *grpc_writes = process_status->mutable_grpc_writes();
+  grpc_writes->set_throttled_writes(stat.grpc_writes.throttled_writes);
+  grpc_writes->set_total_throttled_us(stat.grpc_writes.total_throttled_us);
+  grpc_writes->set_max_throttled_us(stat.grpc_writes.max_throttled_us);
+
+  auto *grpc_calls = process_status->mutable_grpc_calls();
+  grpc_calls->set_deadline_exceeded_calls(
+      stat.grpc_calls.deadline_exceeded_calls);
+  grpc_calls->set_cancelled_calls(stat.grpc_calls.cancelled_calls);
+
+  auto *http_connections = process_status->mutable_http_connections();
+  http_connections->set_requests(stat.http_connections.requests);
+  http_connections->set_reused(stat.http_connections.reused);
+  http_connections->set_idle(stat.http_connections.idle);
+  http_connections->set_idle_closed(stat.http_connections.idle_closed);
+  http_connections->set_recycled(stat.http_connections.recycled);
+
+  static const char *kHttpPriorityNames[HTTPRequest::NUM_PRIORITIES] = {
+      "check", "quota", "key_fetch", "other", "report", "trace"};
+  for (int j = 0; j < HTTPRequest::NUM_PRIORITIES; ++j) {
+    const auto &stats = stat.http_scheduler.classes[j];
+    auto *class_status = process_status->add_http_scheduler();
+    class_status->set_priority(kHttpPriorityNames[j]);
+    class_status->set_queued(stats.queued);
+    class_status->set_delayed(stats.delayed);
+    class_status->set_expired(stats.expired);
+    class_status->set_total_wait_us(stats.total_wait_us);
+    class_status->set_max_wait_us(stats.max_wait_us);
+  }
+
+  for (int j = 0; j < stat.num_grpc_channels; ++j) {
+    const auto &channel = stat.grpc_channels[j];
+    auto *channel_status = process_status->add_grpc_channels();
+    channel_status->set_backend(channel.backend);
+    channel_status->set_channel(channel.channel);
+    channel_status->set_in_flight(channel.in_flight);
+    channel_status->set_calls(channel.calls);
+  }
+
+  for (int j = 0; j < stat.num_grpc_compression; ++j) {
+    const auto &compression = stat.grpc_compression[j];
+    auto *compression_status = process_status->add_grpc_compression();
+    compression_status->set_backend(compression.backend);
+    compression_status->set_compressed_requests(
+        compression.stats.compressed_requests);
+    compression_status->set_compressed_request_bytes(
+        compression.stats.compressed_request_bytes);
+    compression_status->set_compressed_responses(
+        compression.stats.compressed_responses);
+    compression_status->set_response_bytes_saved(
+        compression.stats.response_bytes_saved);
+  }
 }
 
 Status create_status_json(ngx_http_request_t *r, std::string *json) {
@@ -383,6 +444,45 @@ ngx_int_t ngx_esp_init_process_stats(ngx_cycle_t *cycle) {
         if (++esp_idx >= kMaxEspNum) break;
       }
     }
+
+    if (mc->grpc_queue) {
+      process_stat->grpc_queue = mc->grpc_queue->stats();
+    }
+    process_stat->grpc_writes = mc->grpc_write_stats;
+    process_stat->grpc_calls = mc->grpc_call_stats;
+    if (mc->http_connection_pool) {
+      process_stat->http_connections = mc->http_connection_pool->stats();
+    }
+    if (mc->http_scheduler) {
+      process_stat->http_scheduler = mc->http_scheduler->stats();
+    }
+
+    int channel_idx = 0;
+    int compression_idx = 0;
+    for (ngx_uint_t i = 0, napis = mc->endpoints.nelts; i < napis; i++) {
+      for (const auto &it : endpoints[i]->grpc_channel_pools) {
+        const NgxEspGrpcChannelPool &pool = *it.second;
+        if (pool.compression() && compression_idx < kMaxGrpcCompressionNum) {
+          auto &compression = process_stat->grpc_compression[compression_idx++];
+          strncpy(compression.backend, pool.address().c_str(),
+                  kMaxServiceNameSize - 1);
+          compression.backend[kMaxServiceNameSize - 1] = '\0';
+          compression.stats = pool.compression()->stats();
+        }
+        for (size_t j = 0;
+             j < pool.size() && channel_idx < kMaxGrpcChannelNum; ++j) {
+          auto &channel = process_stat->grpc_channels[channel_idx++];
+          strncpy(channel.backend, pool.address().c_str(),
+                  kMaxServiceNameSize - 1);
+          channel.backend[kMaxServiceNameSize - 1] = '\0';
+          channel.channel = j;
+          channel.in_flight = pool.in_flight(j);
+          channel.calls = pool.calls(j);
+        }
+      }
+    }
+    process_stat->num_grpc_channels = channel_idx;
+    process_stat->num_grpc_compression = compression_idx;
   };
 
   auto log_func = [cycle, process_stat]() {
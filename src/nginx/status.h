@@ -29,6 +29,11 @@
 #include <chrono>
 
 #include "include/api_manager/api_manager.h"
+#include "src/grpc/message_compression.h"
+#include "src/nginx/grpc_queue.h"
+#include "src/nginx/grpc_server_call.h"
+#include "src/nginx/http_connection_pool.h"
+#include "src/nginx/http_scheduler.h"
 
 extern "C" {
 #include "src/http/ngx_http.h"
@@ -42,6 +47,10 @@ namespace nginx {
 const int kMaxEspNum = 10;
 const int kMaxServiceNameSize = 256;
 const int kMaxServiceRolloutsInfoSize = 4096;
+// The maximum number of gRPC backend channels reported.
+const int kMaxGrpcChannelNum = 32;
+// The maximum number of gRPC backends reported with message compression.
+const int kMaxGrpcCompressionNum = 32;
 
 typedef struct {
   // process ID
@@ -77,6 +86,43 @@ typedef struct {
   };
   EspData esp_stats[kMaxEspNum];
 
+  // gRPC completion event delivery statistics
+  NgxEspGrpcQueue::Stats grpc_queue;
+
+  // gRPC response writes held back by slow clients
+  NgxEspGrpcServerCall::WriteStats grpc_writes;
+
+  // gRPC backend calls ended by a deadline or cancelled
+  NgxEspGrpcServerCall::CallStats grpc_calls;
+
+  // Outbound HTTP connection reuse
+  NgxEspHttpConnectionPool::Stats http_connections;
+
+  // Outbound HTTP request queueing
+  NgxEspHttpScheduler::Stats http_scheduler;
+
+  // Number of gRPC backend channels.
+  int num_grpc_channels;
+
+  // Struct to store the calls on a gRPC backend channel
+  struct GrpcChannelData {
+    char backend[kMaxServiceNameSize];
+    int channel;
+    int in_flight;
+    uint64_t calls;
+  };
+  GrpcChannelData grpc_channels[kMaxGrpcChannelNum];
+
+  // Number of gRPC backends with message compression.
+  int num_grpc_compression;
+
+  // Struct to store the message compression counters of a gRPC backend
+  struct GrpcCompressionData {
+    char backend[kMaxServiceNameSize];
+    grpc::MessageCompression::Stats stats;
+  };
+  GrpcCompressionData grpc_compression[kMaxGrpcCompressionNum];
+
 } ngx_esp_process_stats_t;
 
 // Adds shared memory for process stats
@@ -327,6 +327,12 @@ sub grpc_test_server {
   exec $server, @args;
 }
 
+sub grpc_service_control_server {
+  my ($t, $port, $file) = @_;
+  my $server = './test/grpc/grpc-service-control-server';
+  exec $server, "127.0.0.1:${port}", $t->testdir() . '/' . $file;
+}
+
 sub grpc_interop_server {
   my ($t, $port, @args) = @_;
   my $server = "./external/com_github_grpc_grpc/test/cpp/interop/interop_server";
@@ -47,6 +47,7 @@ sub new {
         _http => [],
         _http_cb => {},
         _ssl => $ssl,
+        _keep_alive => 0,
     };
 
     bless $self;
@@ -58,6 +59,14 @@ sub port {
     return $self->{_port};
 }
 
+# Keeps each client connection open for more requests after a response,
+# until the client or a handler closes it.  Responses must then carry a
+# Content-Length or a chunked body.
+sub keep_alive {
+    my ($self) = @_;
+    $self->{_keep_alive} = 1;
+}
+
 sub on {
     my ($self, $method, $url, $response) = @_;
     push @{$self->{_http}}, {
@@ -84,6 +93,9 @@ sub handle_client {
     last if (/^\x0d?\x0a?$/);
   }
 
+  # The client closed the connection.
+  return 0 if $request eq '';
+
   # Read the request.
   if ($request =~ /^(\S+)\s+(([^? ]+)(\?[^ ]+)?)\s+HTTP/i) {
     my $verb = $1;
@@ -136,6 +148,19 @@ EOF
       }
     }
   }
+  return 1;
+}
+
+# Handles a request on the client connection, then either waits for the
+# next one on it or closes it.
+sub serve_client {
+  my ($self, $client, $listeners, $rh) = @_;
+  if ($self->handle_client($client, $rh) && $self->{_keep_alive} &&
+      $client->opened) {
+    $listeners->add($client);
+  } else {
+    close $client;
+  }
 }
 
 sub run {
@@ -172,9 +197,16 @@ sub run {
   open my $rh, '>', $self->{_file} or die "cannot open > " . $self->{_file};
   select $rh; $| = 1; # Enable auto-flush.
 
+  my %servers = map { $_ => 1 } $listeners->handles;
   while (1) {
       my @ready = $listeners->can_read;
       foreach(@ready) {
+          if (!$servers{$_}) {
+              # A kept-alive client connection, readable again.
+              $listeners->remove($_);
+              $self->serve_client($_, $listeners, $rh);
+              next;
+          }
           next unless my $client = $_->accept();
           $client->blocking(1);
           $client->autoflush(1);
@@ -187,8 +219,7 @@ sub run {
                   SSL_key_file => "$dir/test.key",
               ) or die "failed to ssl handshake: $SSL_ERROR";
           }
-          $self->handle_client($client, $rh);
-          close $client;
+          $self->serve_client($client, $listeners, $rh);
       }
   }
   close $rh;
@@ -0,0 +1,264 @@
+# Copyright (C) Extensible Service Proxy Authors
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 1. Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+# OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+# HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+# SUCH DAMAGE.
+#
+################################################################################
+#
+use strict;
+use warnings;
+
+################################################################################
+
+use src::nginx::t::ApiManager;   # Must be first (sets up import path to the Nginx test module)
+use src::nginx::t::HttpServer;
+use Test::Nginx;  # Imports Nginx's test module
+use Test::More;   # And the test framework
+
+################################################################################
+
+# Port assignments
+my $Http2NginxPort = ApiManager::pick_port();
+my $HttpNginxPort = ApiManager::pick_port();
+my $ServiceControlPort = ApiManager::pick_port();
+my $GrpcBackendPort = ApiManager::pick_port();
+my $GrpcFallbackPort = ApiManager::pick_port();
+
+my $t = Test::Nginx->new()->has(qw/http proxy/)->plan(10);
+
+$t->write_file('service.pb.txt',
+        ApiManager::get_grpc_test_service_config($GrpcBackendPort) . <<"EOF");
+control {
+  environment: "http://127.0.0.1:${ServiceControlPort}"
+}
+EOF
+
+# A small body buffer makes nginx read the request bodies over many reads.
+ApiManager::write_file_expand($t, 'nginx.conf', <<"EOF");
+%%TEST_GLOBALS%%
+daemon off;
+events {
+  worker_connections 32;
+}
+http {
+  %%TEST_GLOBALS_HTTP%%
+  client_body_buffer_size 4k;
+  server {
+    listen 127.0.0.1:${Http2NginxPort} http2;
+    server_name localhost;
+    location / {
+      endpoints {
+        api service.pb.txt;
+        %%TEST_CONFIG%%
+        on;
+      }
+      grpc_pass 127.0.0.2:${GrpcFallbackPort};
+    }
+  }
+  server {
+    listen 127.0.0.1:${HttpNginxPort};
+    server_name localhost;
+    location / {
+      endpoints {
+        api service.pb.txt;
+        %%TEST_CONFIG%%
+        on;
+      }
+      grpc_pass 127.0.0.2:${GrpcFallbackPort};
+    }
+  }
+}
+EOF
+
+$t->run_daemon(\&service_control, $t, $ServiceControlPort, 'servicecontrol.log');
+$t->run_daemon(\&ApiManager::grpc_test_server, $t, "127.0.0.1:${GrpcBackendPort}");
+is($t->waitforsocket("127.0.0.1:${ServiceControlPort}"), 1, 'Service control socket ready.');
+is($t->waitforsocket("127.0.0.1:${GrpcBackendPort}"), 1, 'GRPC test server socket ready.');
+$t->run();
+is($t->waitforsocket("127.0.0.1:${Http2NginxPort}"), 1, 'Nginx HTTP/2 socket ready.');
+is($t->waitforsocket("127.0.0.1:${HttpNginxPort}"), 1, 'Nginx HTTP/1.1 socket ready.');
+
+################################################################################
+
+# 256 KB of text that differs all along, so that misplaced data shows.
+my $text = join('', map { sprintf('%08d', $_) } 0 .. 32767);
+my $medium_text = substr($text, 0, 20000);
+
+# A large unary request over HTTP/2.
+my $test_results = &ApiManager::run_grpc_test($t, <<"EOF");
+server_addr: "127.0.0.1:${Http2NginxPort}"
+plans {
+  echo {
+    call_config {
+      api_key: "this-is-an-api-key"
+    }
+    request {
+      text: "${text}"
+    }
+  }
+}
+EOF
+
+is($test_results, <<"EOF", 'Large HTTP/2 request is echoed.');
+results {
+  echo {
+    text: "${text}"
+  }
+}
+EOF
+
+# Streamed messages of different sizes, a message may span several reads
+# and a read may hold several messages.
+$test_results = &ApiManager::run_grpc_test($t, <<"EOF");
+server_addr: "127.0.0.1:${Http2NginxPort}"
+plans {
+  echo_stream {
+    call_config {
+      api_key: "this-is-an-api-key"
+    }
+    request {
+      text: "Hello, world!"
+    }
+    request {
+      text: "${medium_text}"
+    }
+    request {
+      text: "Hello again!"
+    }
+    count: 20
+    delay_ms: 10
+  }
+}
+EOF
+
+is($test_results, <<'EOF', 'HTTP/2 request stream is echoed.');
+results {
+  echo_stream {
+    count: 20
+  }
+}
+EOF
+
+# The same large request as gRPC-Web over HTTP/1.1, with the body sent in
+# two parts.
+my $frame = grpc_frame("\x0a" . varint(length($text)) . $text);
+my $frame_length = length($frame);
+my $half = int($frame_length / 2);
+
+my $response = ApiManager::http($HttpNginxPort, <<EOF . substr($frame, 0, $half),
+POST /test.grpc.Test/Echo HTTP/1.1
+Host: 127.0.0.1:${HttpNginxPort}
+Content-Type: application/grpc-web
+x-api-key: this-is-an-api-key
+Content-Length: ${frame_length}
+Connection: close
+
+EOF
+  sleep => 0.2, body => substr($frame, $half));
+
+my ($headers, $body) = split /\r\n\r\n/, $response, 2;
+like($headers, qr/HTTP\/1\.1 200 OK/, 'HTTP/1.1 request got a 200.');
+ok(index(dechunk($body), $text) >= 0, 'HTTP/1.1 request is echoed.');
+
+# Chunked, a chunk header is split across the two parts.
+my $chunked = '';
+for (my $pos = 0; $pos < length($frame); $pos += 3000) {
+  my $chunk = substr($frame, $pos, 3000);
+  $chunked .= sprintf("%x\r\n", length($chunk)) . $chunk . "\r\n";
+}
+$chunked .= "0\r\n\r\n";
+$half = index($chunked, "\r\nbb8\r\n", int(length($chunked) / 2)) + 3;
+
+$response = ApiManager::http($HttpNginxPort, <<EOF . substr($chunked, 0, $half),
+POST /test.grpc.Test/Echo HTTP/1.1
+Host: 127.0.0.1:${HttpNginxPort}
+Content-Type: application/grpc-web
+x-api-key: this-is-an-api-key
+Transfer-Encoding: chunked
+Connection: close
+
+EOF
+  sleep => 0.2, body => substr($chunked, $half));
+
+($headers, $body) = split /\r\n\r\n/, $response, 2;
+like($headers, qr/HTTP\/1\.1 200 OK/, 'Chunked HTTP/1.1 request got a 200.');
+ok(index(dechunk($body), $text) >= 0, 'Chunked HTTP/1.1 request is echoed.');
+
+$t->stop_daemons();
+
+################################################################################
+
+sub varint {
+  my ($value) = @_;
+  my $bytes = '';
+  while ($value >= 0x80) {
+    $bytes .= chr(($value & 0x7f) | 0x80);
+    $value >>= 7;
+  }
+  return $bytes . chr($value);
+}
+
+sub grpc_frame {
+  my ($message) = @_;
+  return pack('CN', 0, length($message)) . $message;
+}
+
+sub dechunk {
+  my ($body) = @_;
+  my $data = '';
+  while ($body =~ s/^([0-9a-fA-F]+)\r\n//) {
+    my $size = hex($1);
+    last if $size == 0;
+    $data .= substr($body, 0, $size);
+    $body = substr($body, $size + 2);
+  }
+  return $data;
+}
+
+sub service_control {
+  my ($t, $port, $file) = @_;
+  my $server = HttpServer->new($port, $t->testdir() . '/' . $file)
+    or die "Can't create test server socket: $!\n";
+  local $SIG{PIPE} = 'IGNORE';
+
+  $server->on_sub('POST', '/v1/services/endpoints-grpc-test.cloudendpointsapis.com:check', sub {
+    my ($headers, $body, $client) = @_;
+    print $client <<'EOF';
+HTTP/1.1 200 OK
+Connection: close
+
+EOF
+  });
+
+  $server->on_sub('POST', '/v1/services/endpoints-grpc-test.cloudendpointsapis.com:report', sub {
+    my ($headers, $body, $client) = @_;
+    print $client <<'EOF';
+HTTP/1.1 200 OK
+Connection: close
+
+EOF
+  });
+
+  $server->run();
+}
+
+################################################################################
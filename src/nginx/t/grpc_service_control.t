@@ -0,0 +1,162 @@
+# Copyright (C) Extensible Service Proxy Authors
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 1. Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+# OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+# HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+# SUCH DAMAGE.
+#
+################################################################################
+#
+use strict;
+use warnings;
+
+################################################################################
+
+use src::nginx::t::ApiManager;   # Must be first (sets up import path to the Nginx test module)
+use src::nginx::t::HttpServer;
+use Test::Nginx;  # Imports Nginx's test module
+use Test::More;   # And the test framework
+use JSON::PP;
+
+################################################################################
+
+# Port assignments
+my $NginxPort = ApiManager::pick_port();
+my $BackendPort = ApiManager::pick_port();
+my $ServiceControlPort = ApiManager::pick_port();
+
+my $t = Test::Nginx->new()->has(qw/http proxy/)->plan(11);
+
+my $check_method = '/google.api.servicecontrol.v1.ServiceController/Check';
+my $report_method = '/google.api.servicecontrol.v1.ServiceController/Report';
+
+# Service control calls go to a gRPC server at the control environment.
+$t->write_file('service.pb.txt', ApiManager::get_bookstore_service_config . <<"EOF");
+control {
+  environment: "http://127.0.0.1:${ServiceControlPort}"
+}
+EOF
+
+$t->write_file('server_config.pb.txt', <<"EOF");
+service_control_config {
+  transport: GRPC
+}
+EOF
+
+ApiManager::write_file_expand($t, 'nginx.conf', <<"EOF");
+%%TEST_GLOBALS%%
+daemon off;
+events {
+  worker_connections 32;
+}
+http {
+  %%TEST_GLOBALS_HTTP%%
+  server_tokens off;
+  server {
+    listen 127.0.0.1:${NginxPort};
+    server_name localhost;
+    location / {
+      endpoints {
+        api service.pb.txt;
+        server_config server_config.pb.txt;
+        %%TEST_CONFIG%%
+        on;
+      }
+      proxy_pass http://127.0.0.1:${BackendPort};
+    }
+  }
+}
+EOF
+
+$t->run_daemon(\&bookstore, $t, $BackendPort, 'bookstore.log');
+$t->run_daemon(\&ApiManager::grpc_service_control_server, $t,
+               $ServiceControlPort, 'servicecontrol.log');
+is($t->waitforsocket("127.0.0.1:${BackendPort}"), 1, 'Bookstore socket ready.');
+is($t->waitforsocket("127.0.0.1:${ServiceControlPort}"), 1,
+   'Service control socket ready.');
+$t->run();
+
+################################################################################
+
+my $response = ApiManager::http_get($NginxPort,'/shelves?key=this-is-an-api-key');
+
+# The report is sent once the aggregation interval expires.
+my @calls;
+for (my $i = 0; $i < 50; $i++) {
+  @calls = read_calls($t, 'servicecontrol.log');
+  last if grep { $_->{method} eq $report_method } @calls;
+  select undef, undef, undef, 0.1;
+}
+
+$t->stop_daemons();
+
+my ($response_headers, $response_body) = split /\r\n\r\n/, $response, 2;
+
+like($response_headers, qr/HTTP\/1\.1 200 OK/, 'Returned HTTP 200.');
+is($response_body, "Shelves data.\n", 'Shelves returned in the response body.');
+
+my @requests = ApiManager::read_http_stream($t, 'bookstore.log');
+is(scalar @requests, 1, 'Backend received one request');
+
+is(scalar @calls, 2, 'Service control received two calls');
+
+my $check = shift @calls;
+is($check->{method}, $check_method, 'Check was called over gRPC');
+is($check->{request}->{serviceName}, 'endpoints-test.cloudendpointsapis.com',
+   'Check has the service name');
+is($check->{request}->{operation}->{consumerId},
+   'api_key:this-is-an-api-key', 'Check has the api key');
+
+my $report = shift @calls;
+is($report->{method}, $report_method, 'Report was called over gRPC');
+is($report->{request}->{operations}->[0]->{operationName}, 'ListShelves',
+   'Report has the operation name');
+
+################################################################################
+
+# Reads the calls logged by the gRPC service control server, one per line.
+sub read_calls {
+  my ($t, $file) = @_;
+  my $path = $t->testdir() . '/' . $file;
+  return () unless -e $path;
+  my @calls;
+  foreach my $line (split /\n/, $t->read_file($file)) {
+    my ($method, $json) = split / /, $line, 2;
+    push @calls, { method => $method, request => decode_json($json) };
+  }
+  return @calls;
+}
+
+sub bookstore {
+  my ($t, $port, $file) = @_;
+  my $server = HttpServer->new($port, $t->testdir() . '/' . $file)
+    or die "Can't create test server socket: $!\n";
+  local $SIG{PIPE} = 'IGNORE';
+
+  $server->on('GET', '/shelves?key=this-is-an-api-key', <<'EOF');
+HTTP/1.1 200 OK
+Connection: close
+
+Shelves data.
+EOF
+  $server->run();
+}
+
+################################################################################
@@ -0,0 +1,170 @@
+# Copyright (C) Extensible Service Proxy Authors
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 1. Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+# OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+# HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+# SUCH DAMAGE.
+#
+################################################################################
+#
+use strict;
+use warnings;
+
+################################################################################
+
+use src::nginx::t::ApiManager;   # Must be first (sets up import path to the Nginx test module)
+use Test::Nginx;  # Imports Nginx's test module
+use Test::More;   # And the test framework
+use JSON::PP;
+
+################################################################################
+
+# Port assignments
+my $SmallBufferPort = ApiManager::pick_port();
+my $LargeBufferPort = ApiManager::pick_port();
+my $StatusPort = ApiManager::pick_port();
+my $GrpcBackendPort = ApiManager::pick_port();
+my $GrpcFallbackPort = ApiManager::pick_port();
+
+my $t = Test::Nginx->new()->has(qw/http proxy/)->plan(11);
+
+$t->write_file('service.pb.txt', ApiManager::get_grpc_test_service_config($GrpcBackendPort));
+
+# The client stops reading echoed messages, so ESP can only buffer them: with
+# a small endpoints_grpc_write_buffer_size it stops reading from the backend
+# early, and the backend pushes back on the client sooner.
+$t->write_file_expand('nginx.conf', <<"EOF");
+%%TEST_GLOBALS%%
+daemon off;
+events {
+  worker_connections 32;
+}
+http {
+  %%TEST_GLOBALS_HTTP%%
+  server {
+    listen 127.0.0.1:${SmallBufferPort} http2;
+    server_name localhost;
+    location / {
+      endpoints {
+        api service.pb.txt;
+        on;
+      }
+      endpoints_grpc_write_buffer_size 16k;
+      grpc_pass 127.0.0.2:${GrpcFallbackPort};
+    }
+  }
+  server {
+    listen 127.0.0.1:${LargeBufferPort} http2;
+    server_name localhost;
+    location / {
+      endpoints {
+        api service.pb.txt;
+        on;
+      }
+      endpoints_grpc_write_buffer_size 4m;
+      grpc_pass 127.0.0.2:${GrpcFallbackPort};
+    }
+  }
+  server {
+    listen 127.0.0.1:${StatusPort};
+    server_name localhost;
+    location /endpoints_status {
+      endpoints_status;
+    }
+  }
+}
+EOF
+
+$t->run_daemon(\&ApiManager::grpc_test_server, $t, "127.0.0.1:${GrpcBackendPort}");
+is($t->waitforsocket("127.0.0.1:${GrpcBackendPort}"), 1, 'GRPC test server socket ready.');
+$t->run();
+is($t->waitforsocket("127.0.0.1:${SmallBufferPort}"), 1, 'Nginx socket ready.');
+is($t->waitforsocket("127.0.0.1:${StatusPort}"), 1, 'Nginx status socket ready.');
+
+################################################################################
+
+my $before = write_stats();
+is($before->{throttledWrites}, 0, 'No writes were held before the test.');
+
+my $small_limit = probe_message_limit($SmallBufferPort);
+ok(defined $small_limit, 'Small buffer probe completed.');
+
+my $after = write_stats();
+cmp_ok($after->{throttledWrites}, '>', 0,
+       'Writes to the slow reader were held.');
+cmp_ok($after->{totalThrottledUs}, '>', 0, 'Held time was recorded.');
+cmp_ok($after->{maxThrottledUs}, '>', 0, 'Longest held time was recorded.');
+cmp_ok($after->{maxThrottledUs}, '<=', $after->{totalThrottledUs},
+       'Longest held time is part of the total.');
+
+my $large_limit = probe_message_limit($LargeBufferPort);
+ok(defined $large_limit, 'Large buffer probe completed.');
+
+$t->stop_daemons();
+
+# 4m of buffered 16k messages is about 250 messages more than 16k.
+cmp_ok($small_limit, '<', $large_limit - 100,
+       'Backend reads stop at the write buffer limit.');
+
+################################################################################
+
+sub probe_message_limit {
+  my ($port) = @_;
+  my $test_results = &ApiManager::run_grpc_test($t, <<"EOF");
+server_addr: "127.0.0.1:${port}"
+direct_addr: "127.0.0.1:${GrpcBackendPort}"
+plans {
+  probe_upstream_message_limit {
+    request {
+      space_payload_size: 16386
+    }
+    timeout_ms: 100
+  }
+}
+EOF
+  if ($test_results =~ /message_limit: (\d+)/) {
+    return $1;
+  }
+  return undef;
+}
+
+# Sums the gRPC write counters of all the worker processes.
+sub write_stats {
+  # The status is refreshed once a second.
+  sleep 2;
+  my $response = ApiManager::http_get($StatusPort, '/endpoints_status');
+  my ($headers, $body) = split /\r\n\r\n/, $response, 2;
+  my $status = decode_json($body);
+  my %totals = (throttledWrites => 0, totalThrottledUs => 0,
+                maxThrottledUs => 0);
+  foreach my $process (@{$status->{processes}}) {
+    foreach my $counter (keys %totals) {
+      my $value = $process->{grpcWrites}->{$counter};
+      if ($counter eq 'maxThrottledUs') {
+        $totals{$counter} = $value if $value > $totals{$counter};
+      } else {
+        $totals{$counter} += $value;
+      }
+    }
+  }
+  return \%totals;
+}
+
+################################################################################
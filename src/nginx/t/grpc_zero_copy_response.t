@@ -0,0 +1,235 @@
+# Copyright (C) Extensible Service Proxy Authors
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 1. Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+# OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+# HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+# SUCH DAMAGE.
+#
+################################################################################
+#
+use strict;
+use warnings;
+
+################################################################################
+
+use src::nginx::t::ApiManager;   # Must be first (sets up import path to the Nginx test module)
+use src::nginx::t::HttpServer;
+use Test::Nginx;  # Imports Nginx's test module
+use Test::More;   # And the test framework
+
+################################################################################
+
+# Response messages of 8192 bytes or more are sent from the grpc slices
+# without being copied; smaller ones are copied into one nginx buffer. This
+# sends messages on both sides of that size, over gRPC-Web (where the exact
+# bytes can be checked) and over HTTP/2.
+
+# Port assignments
+my $NginxPort = ApiManager::pick_port();
+my $Http2NginxPort = ApiManager::pick_port();
+my $ServiceControlPort = ApiManager::pick_port();
+my $InteropBackendPort = ApiManager::pick_port();
+my $GrpcBackendPort = ApiManager::pick_port();
+
+my $t = Test::Nginx->new()->has(qw/http proxy/)->plan(13);
+
+$t->write_file(
+    'interop.pb.txt',
+    ApiManager::get_grpc_interop_service_config . <<"EOF");
+control {
+  environment: "http://127.0.0.1:${ServiceControlPort}"
+}
+EOF
+
+$t->write_file('service.pb.txt', ApiManager::get_grpc_test_service_config($GrpcBackendPort) . <<"EOF");
+control {
+  environment: "http://127.0.0.1:${ServiceControlPort}"
+}
+EOF
+
+$t->write_file_expand('nginx.conf', <<"EOF");
+%%TEST_GLOBALS%%
+daemon off;
+events {
+  worker_connections 32;
+}
+http {
+  %%TEST_GLOBALS_HTTP%%
+  server {
+    listen 127.0.0.1:${NginxPort};
+    server_name localhost;
+    location / {
+      endpoints {
+        api interop.pb.txt;
+        on;
+      }
+      grpc_pass 127.0.0.1:${InteropBackendPort};
+    }
+  }
+  server {
+    listen 127.0.0.1:${Http2NginxPort} http2;
+    server_name localhost;
+    location / {
+      endpoints {
+        api service.pb.txt;
+        on;
+      }
+      grpc_pass 127.0.0.2:${GrpcBackendPort};
+    }
+  }
+}
+EOF
+
+$t->run_daemon(\&service_control, $t, $ServiceControlPort, 'servicecontrol.log');
+$t->run_daemon(\&ApiManager::grpc_interop_server, $t, "${InteropBackendPort}");
+$t->run_daemon(\&ApiManager::grpc_test_server, $t, "127.0.0.1:${GrpcBackendPort}");
+is($t->waitforsocket("127.0.0.1:${ServiceControlPort}"), 1, 'Service control socket ready.');
+is($t->waitforsocket("127.0.0.1:${InteropBackendPort}"), 1, 'GRPC interop server socket ready.');
+is($t->waitforsocket("127.0.0.1:${GrpcBackendPort}"), 1, 'GRPC test server socket ready.');
+$t->run();
+is($t->waitforsocket("127.0.0.1:${NginxPort}"), 1, 'Nginx socket ready.');
+is($t->waitforsocket("127.0.0.1:${Http2NginxPort}"), 1, 'Nginx HTTP/2 socket ready.');
+
+################################################################################
+#
+# Streams one gRPC-Web response message per payload size. A payload of N
+# zero bytes, for 128 <= N < 16384, makes a StreamingOutputCallResponse of
+# N + 6 bytes, so the first three messages are 8191, 8192 and 8193 bytes.
+#
+################################################################################
+
+my @payload_sizes = (8185, 8186, 8187, 100000);
+
+my $request = join('', map {
+  my $parameters = "\x08" . varint($_);
+  "\x12" . varint(length $parameters) . $parameters;
+} @payload_sizes);
+$request = "\x00" . pack('N', length $request) . $request;
+
+my $response = ApiManager::http($NginxPort, <<"EOF", body => $request);
+POST /grpc.testing.TestService/StreamingOutputCall HTTP/1.0
+Host: 127.0.0.1:${NginxPort}
+Content-Type: application/grpc-web
+x-api-key: api-key
+Content-Length: @{[length $request]}
+
+EOF
+
+like($response, qr/HTTP\/1\.1 200 OK/, 'StreamingOutputCall returned HTTP 200.');
+
+my @frames = grpc_web_frames(ApiManager::http_response_body($response));
+my @messages = map { $_->[1] } grep { $_->[0] == 0 } @frames;
+is(join(' ', map { length } @messages), '8191 8192 8193 100008',
+   'Messages on both sides of the zero-copy size were sent.');
+for my $i (0 .. $#payload_sizes) {
+  ok(defined $messages[$i] &&
+     $messages[$i] eq response_message($payload_sizes[$i]),
+     "Message of ${payload_sizes[$i]} payload bytes is intact.");
+}
+
+my $trailers = $frames[-1];
+ok($trailers->[0] == 0x80 && $trailers->[1] =~ /grpc-status:\s*0/,
+   'Trailers follow the messages.');
+
+################################################################################
+
+my $test_results = &ApiManager::run_grpc_test($t, <<"EOF");
+server_addr: "127.0.0.1:${Http2NginxPort}"
+plans {
+  echo {
+    call_config {
+      api_key: "this-is-an-api-key"
+    }
+    request {
+      space_payload_size: 4000
+    }
+  }
+}
+plans {
+  echo {
+    call_config {
+      api_key: "this-is-an-api-key"
+    }
+    request {
+      space_payload_size: 100000
+    }
+  }
+}
+EOF
+
+$t->stop_daemons();
+
+my @texts = $test_results =~ /text: "( *)"/g;
+is(join(' ', map { length } @texts), '4000 100000',
+   'HTTP/2 responses on both sides of the zero-copy size echoed the text.');
+
+################################################################################
+
+sub varint {
+  my ($n) = @_;
+  my $bytes = '';
+  while ($n >= 0x80) {
+    $bytes .= chr(($n & 0x7f) | 0x80);
+    $n >>= 7;
+  }
+  return $bytes . chr($n);
+}
+
+# The StreamingOutputCallResponse with a payload of zero bytes of the size.
+sub response_message {
+  my ($size) = @_;
+  my $payload = "\x12" . varint($size) . ("\x00" x $size);
+  return "\x0a" . varint(length $payload) . $payload;
+}
+
+# Splits a gRPC-Web body into [flags, data] frames.
+sub grpc_web_frames {
+  my ($body) = @_;
+  my @frames;
+  while (length($body) >= 5) {
+    my ($flags, $length) = unpack('C N', $body);
+    push @frames, [$flags, substr($body, 5, $length)];
+    substr($body, 0, 5 + $length) = '';
+  }
+  return @frames;
+}
+
+sub service_control {
+  my ($t, $port, $file) = @_;
+  my $server = HttpServer->new($port, $t->testdir() . '/' . $file)
+    or die "Can't create test server socket: $!\n";
+  local $SIG{PIPE} = 'IGNORE';
+
+  foreach my $service ('endpoints-grpc-interop.cloudendpointsapis.com',
+                       'endpoints-grpc-test.cloudendpointsapis.com') {
+    $server->on_sub('POST', "/v1/services/${service}:check", sub {
+      my ($headers, $body, $client) = @_;
+      print $client <<'EOF';
+HTTP/1.1 200 OK
+Connection: close
+
+EOF
+    });
+  }
+
+  $server->run();
+}
+
+################################################################################
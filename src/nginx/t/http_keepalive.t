@@ -0,0 +1,347 @@
+# Copyright (C) Extensible Service Proxy Authors
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 1. Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+# OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+# HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+# SUCH DAMAGE.
+#
+################################################################################
+#
+use strict;
+use strict;
+use warnings;
+
+################################################################################
+
+use src::nginx::t::ApiManager;   # Must be first (sets up import path to the Nginx test module)
+use src::nginx::t::Auth;
+use src::nginx::t::HttpServer;
+use src::nginx::t::ServiceControl;
+use JSON::PP;
+use Test::Nginx;  # Imports Nginx's test module
+use Test::More;   # And the test framework
+
+################################################################################
+
+# Keep-alive of the outbound HTTP connections.  The service control
+# server keeps its connections open, and also serves the JWKS of the
+# auth provider, so all calls share one connection pool key.  Each
+# request the server gets is logged with the client port of its
+# connection and whether it is the first request on that connection.
+
+# Port assignments
+my $NginxPort = ApiManager::pick_port();
+my $BackendPort = ApiManager::pick_port();
+my $ServiceControlPort = ApiManager::pick_port();
+
+my $t = Test::Nginx->new()->has(qw/http proxy/)->plan(22);
+
+my $config = ApiManager::get_bookstore_service_config . <<"EOF";
+authentication {
+  providers {
+    id: "test_auth"
+    issuer: "628645741881-noabiu23f5a8m8ovd8ucv698lj78vv0l\@developer.gserviceaccount.com"
+    jwks_uri: "http://127.0.0.1:${ServiceControlPort}/pubkey"
+  }
+  rules {
+    selector: "GetShelf"
+    requirements {
+      provider_id: "test_auth"
+    }
+  }
+}
+control {
+  environment: "http://127.0.0.1:${ServiceControlPort}"
+}
+EOF
+$t->write_file('service.pb.txt', $config);
+
+$t->write_file('server_config.pb.txt', ApiManager::disable_service_control_cache);
+
+ApiManager::write_file_expand($t, 'nginx.conf', <<"EOF");
+%%TEST_GLOBALS%%
+daemon off;
+events {
+  worker_connections 32;
+}
+http {
+  %%TEST_GLOBALS_HTTP%%
+  server_tokens off;
+  server {
+    listen 127.0.0.1:${NginxPort};
+    server_name localhost;
+    location /endpoints_status {
+      endpoints_status;
+    }
+    location / {
+      endpoints {
+        api service.pb.txt;
+        server_config server_config.pb.txt;
+        on;
+      }
+      proxy_pass http://127.0.0.1:${BackendPort};
+    }
+  }
+}
+EOF
+
+my $connections = $t->testdir() . '/connections.log';
+
+$t->run_daemon(\&bookstore, $t, $BackendPort, 'bookstore.log');
+$t->run_daemon(\&servicecontrol, $t, $ServiceControlPort, $connections,
+               'servicecontrol.log');
+
+is($t->waitforsocket("127.0.0.1:${BackendPort}"), 1, 'Bookstore socket ready.');
+is($t->waitforsocket("127.0.0.1:${ServiceControlPort}"), 1, 'Service control socket ready.');
+
+$t->run();
+
+################################################################################
+
+# Content-Length responses: the Check and Report calls of consecutive
+# requests all go over one connection.
+for my $i (1 .. 3) {
+  like(send_request("/shelves?key=reuse-${i}"), qr/HTTP\/1\.1 200 OK/,
+       "Request ${i} returned HTTP 200.");
+}
+
+# A chunked CheckResponse, with every chunk header split across two
+# reads.  Its API key error must come through, and the connection must be
+# reusable after the last chunk.
+my $response = send_request('/shelves?key=chunked');
+like($response, qr/HTTP\/1\.1 400 Bad Request/, 'Chunked check returned HTTP 400.');
+like($response, qr/API key not valid/, 'Chunked check error was decoded.');
+
+# The server closes the connection after the Report of this request, while
+# it is idle in the pool; the next request must use a new one.
+like(send_request('/shelves?key=close-after-report'), qr/HTTP\/1\.1 200 OK/,
+     'Request before the close returned HTTP 200.');
+like(send_request('/shelves?key=after-close'), qr/HTTP\/1\.1 200 OK/,
+     'Request after the close returned HTTP 200.');
+
+# The server reads every Check of this request and closes the connection
+# without a response.  The Check is a POST that was written to a reused
+# connection, so it isn't resent for free: it is sent once plus the three
+# default retries.
+like(send_request('/shelves?key=drop-check'),
+     qr/HTTP\/1\.1 503 Service Temporarily Unavailable/,
+     'Dropped check returned HTTP 503.');
+
+# The server reads the JWKS request on a reused connection and closes it
+# without a response.  The GET is sent again on a new connection.
+my $token = Auth::get_auth_token('./src/nginx/t/matching-client-secret.json');
+like(send_request('/shelves/1?key=jwks', "Authorization: Bearer ${token}"),
+     qr/HTTP\/1\.1 200 OK/, 'Resent JWKS request returned HTTP 200.');
+
+# The status is refreshed once a second.
+sleep 2;
+my $status = http_response_json(
+    ApiManager::http_get($NginxPort, '/endpoints_status'));
+
+$t->stop_daemons();
+
+my @calls = map { [split / /] } split /\n/, $t->read_file('connections.log');
+
+# The first three requests: one Check and one Report each.
+my @reuse = @calls[0 .. 5];
+is(scalar(grep { $_->[1] eq $reuse[0][1] } @reuse), 6,
+   'Checks and reports of the first requests shared one connection.');
+
+my ($chunked_check) = calls_for('check:chunked');
+my ($chunked_report) = calls_for('report:chunked');
+is($chunked_report->[1], $chunked_check->[1],
+   'Report after the chunked check reused its connection.');
+
+my ($closed_report) = calls_for('report:close-after-report');
+my ($after_close) = calls_for('check:after-close');
+isnt($after_close->[1], $closed_report->[1],
+     'Check after the close used a new connection.');
+is($after_close->[2], 'new', 'Closed connection was not reused.');
+
+my @drop_checks = calls_for('check:drop-check');
+is(scalar @drop_checks, 4, 'Dropped check was not resent, only retried.');
+is(join(' ', map { $_->[2] } @drop_checks), 'reused new new new',
+   'Only the first check went over a reused connection.');
+
+my @pubkeys = calls_for('pubkey');
+is(scalar @pubkeys, 2, 'Dropped JWKS request was resent.');
+is(join(' ', map { $_->[2] } @pubkeys), 'reused new',
+   'JWKS request was resent on a new connection.');
+
+my %totals = (requests => 0, reused => 0, idleClosed => 0);
+foreach my $process (@{$status->{processes}}) {
+  foreach my $counter (keys %totals) {
+    $totals{$counter} += $process->{httpConnections}->{$counter};
+  }
+}
+is($totals{requests}, scalar @calls, 'Status counts every request sent.');
+is($totals{reused}, scalar(grep { $_->[2] eq 'reused' } @calls),
+   'Status counts the requests on reused connections.');
+ok($totals{idleClosed} >= 1, 'Status counts the idle connection closed by the server.');
+
+################################################################################
+
+sub send_request {
+  my ($url, $header) = @_;
+  $header = $header ? "${header}\r\n" : '';
+  my $response = ApiManager::http($NginxPort, <<"EOF");
+GET ${url} HTTP/1.0
+Host: localhost
+${header}
+EOF
+  # Let the Report go out before the next request.
+  sleep 1;
+  return $response;
+}
+
+sub calls_for {
+  my ($name) = @_;
+  return grep { $_->[0] eq $name } @calls;
+}
+
+sub http_response_json {
+  my ($response) = @_;
+  my ($headers, $body) = split /\r\n\r\n/, $response, 2;
+  return decode_json($body);
+}
+
+################################################################################
+
+# Logs a request the server got as "<name> <client port> new|reused".
+sub log_call {
+  my ($file, $requests, $name, $client) = @_;
+  my $port = $client->peerport();
+  my $state = $requests->{$port}++ ? 'reused' : 'new';
+  open my $fh, '>>', $file or die "Can't open ${file}: $!";
+  print $fh "${name} ${port} ${state}\n";
+  close $fh;
+  return $state;
+}
+
+sub send_content_length {
+  my ($client, $body) = @_;
+  print $client "HTTP/1.1 200 OK\r\n" .
+      "Content-Length: " . length($body) . "\r\n\r\n" . $body;
+}
+
+sub send_chunked {
+  my ($client, $body) = @_;
+  print $client "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n";
+  foreach my $chunk (substr($body, 0, 16), substr($body, 16)) {
+    my $size = sprintf('%x', length $chunk);
+    print $client substr($size, 0, 1);
+    select undef, undef, undef, 0.2;
+    print $client substr($size, 1) . "\r\n" . $chunk . "\r\n";
+  }
+  print $client "0\r";
+  select undef, undef, undef, 0.2;
+  print $client "\n\r\n";
+}
+
+sub servicecontrol {
+  my ($t, $port, $connections, $file) = @_;
+  my $server = HttpServer->new($port, $t->testdir() . '/' . $file)
+    or die "Can't create test server socket: $!\n";
+  $server->keep_alive();
+  local $SIG{PIPE} = 'IGNORE';
+
+  my %requests;
+  my $key = '';
+  my $jwks_dropped = 0;
+
+  my $check_ok = ServiceControl::convert_proto(<<'EOF', 'check_response', 'binary');
+{
+  "operationId": "ListShelves:7b3f4c4f-f29c-4391-b35e-0a676427fec8"
+}
+EOF
+  my $check_error = ServiceControl::convert_proto(<<"EOF", 'check_response', 'binary');
+{
+  "operationId": "ListShelves:7b3f4c4f-f29c-4391-b35e-0a676427fec8",
+  "checkErrors": [
+    {
+      "code": "API_KEY_INVALID",
+      "detail": "@{['Invalid api key. ' x 16]}"
+    }
+  ]
+}
+EOF
+
+  $server->on_sub('POST', '/v1/services/endpoints-test.cloudendpointsapis.com:check', sub {
+    my ($headers, $body, $client) = @_;
+    ($key) = $body =~
+        /api_key:(reuse-\d|chunked|close-after-report|after-close|drop-check|jwks)/;
+    log_call($connections, \%requests, "check:${key}", $client);
+    if ($key eq 'drop-check') {
+      close $client;
+    } elsif ($key eq 'chunked') {
+      send_chunked($client, $check_error);
+    } else {
+      send_content_length($client, $check_ok);
+    }
+  });
+
+  $server->on_sub('POST', '/v1/services/endpoints-test.cloudendpointsapis.com:report', sub {
+    my ($headers, $body, $client) = @_;
+    log_call($connections, \%requests, "report:${key}", $client);
+    send_content_length($client, '');
+    if ($key eq 'close-after-report') {
+      # Close it once ESP has put it in the pool.
+      select undef, undef, undef, 0.5;
+      close $client;
+    }
+  });
+
+  $server->on_sub('GET', '/pubkey', sub {
+    my ($headers, $body, $client) = @_;
+    my $state = log_call($connections, \%requests, 'pubkey', $client);
+    if ($state eq 'reused' && !$jwks_dropped++) {
+      close $client;
+    } else {
+      send_content_length($client, Auth::get_public_key_jwk);
+    }
+  });
+
+  $server->run();
+}
+
+################################################################################
+
+sub bookstore {
+  my ($t, $port, $file) = @_;
+  my $server = HttpServer->new($port, $t->testdir() . '/' . $file)
+    or die "Can't create test server socket: $!\n";
+  local $SIG{PIPE} = 'IGNORE';
+
+  foreach my $path ('/shelves', '/shelves/1') {
+    $server->on_sub('GET', $path, sub {
+      my ($headers, $body, $client) = @_;
+      print $client <<'EOF';
+HTTP/1.1 200 OK
+Connection: close
+
+{ "get": "ok" }
+EOF
+    });
+  }
+
+  $server->run();
+}
+
+################################################################################
@@ -0,0 +1,201 @@
+# Copyright (C) Extensible Service Proxy Authors
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 1. Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+# OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+# HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+# SUCH DAMAGE.
+#
+################################################################################
+#
+use strict;
+use warnings;
+
+################################################################################
+
+use src::nginx::t::ApiManager;   # Must be first (sets up import path to the Nginx test module)
+use src::nginx::t::HttpServer;
+use Test::Nginx;  # Imports Nginx's test module
+use Test::More;   # And the test framework
+use JSON::PP;
+use Time::HiRes qw(gettimeofday tv_interval);
+
+################################################################################
+
+# A microbenchmark of the outbound HTTP client (ngx_esp_send_http_request).
+# With the service control caches disabled, every request sent to ESP
+# makes one Check and one Report call to a local stub server, which keeps
+# its connections alive.  The test reports the rate of outbound calls and
+# checks that none were lost, and that the calls reused both connections
+# and the request state of finished calls.
+
+my $RequestCount = 500;
+
+# Port assignments
+my $NginxPort = ApiManager::pick_port();
+my $BackendPort = ApiManager::pick_port();
+my $ServiceControlPort = ApiManager::pick_port();
+
+my $t = Test::Nginx->new()->has(qw/http proxy/)->plan(10);
+
+$t->write_file('service.pb.txt', ApiManager::get_bookstore_service_config . <<"EOF");
+control {
+  environment: "http://127.0.0.1:${ServiceControlPort}"
+}
+EOF
+
+$t->write_file('server_config.pb.txt', ApiManager::disable_service_control_cache);
+
+$t->write_file_expand('nginx.conf', <<"EOF");
+%%TEST_GLOBALS%%
+daemon off;
+events {
+  worker_connections 64;
+}
+http {
+  %%TEST_GLOBALS_HTTP%%
+  server_tokens off;
+  server {
+    listen 127.0.0.1:${NginxPort};
+    server_name localhost;
+    location /endpoints_status {
+      endpoints_status;
+    }
+    location / {
+      endpoints {
+        api service.pb.txt;
+        server_config server_config.pb.txt;
+        on;
+      }
+      proxy_pass http://127.0.0.1:${BackendPort};
+    }
+  }
+}
+EOF
+
+my $report_done = $t->{_testdir} . '/report_done.log';
+
+$t->run_daemon(\&bookstore, $t, $BackendPort, 'bookstore.log');
+$t->run_daemon(\&servicecontrol, $t, $ServiceControlPort, $report_done,
+               'servicecontrol.log');
+
+is($t->waitforsocket("127.0.0.1:${BackendPort}"), 1, 'Bookstore socket ready.');
+is($t->waitforsocket("127.0.0.1:${ServiceControlPort}"), 1, 'Service control socket ready.');
+
+$t->run();
+
+################################################################################
+
+my $ok = 0;
+my $start = [gettimeofday];
+for my $i (1 .. $RequestCount) {
+  my $response = ApiManager::http_get($NginxPort, "/shelves?key=key-${i}");
+  $ok++ if $response =~ /HTTP\/1\.1 200 OK/;
+}
+
+is($t->waitforfile($report_done), 1, 'Report body file ready.');
+my $elapsed = tv_interval($start);
+
+# The status is refreshed once a second.
+sleep 2;
+my $status_response = ApiManager::http_get($NginxPort, '/endpoints_status');
+$t->stop_daemons();
+
+is($ok, $RequestCount, "All ${RequestCount} requests succeeded.");
+
+my @sc_requests = ApiManager::read_http_stream($t, 'servicecontrol.log');
+is(scalar(grep { $_->{uri} =~ /:check$/ } @sc_requests), $RequestCount,
+   'Every request was checked.');
+is(scalar(grep { $_->{uri} =~ /:report$/ } @sc_requests), $RequestCount,
+   'Every request was reported.');
+
+# Only calls that overlap need another connection or another request
+# state; everything else is taken from the pools.
+my (undef, $status_body) = split /\r\n\r\n/, $status_response, 2;
+my %stats = (requests => 0, reused => 0, recycled => 0);
+foreach my $process (@{decode_json($status_body)->{processes}}) {
+  foreach my $counter (keys %stats) {
+    $stats{$counter} += $process->{httpConnections}->{$counter};
+  }
+}
+is($stats{requests}, 2 * $RequestCount, 'Status counts every outbound call.');
+ok($stats{requests} - $stats{reused} <= 8,
+   "Outbound calls reused their connections ($stats{reused} reused).");
+ok($stats{requests} - $stats{recycled} <= 8,
+   "Outbound calls recycled their request state ($stats{recycled} recycled).");
+
+my $connections = $t->read_file('connections.txt');
+ok($connections <= 8, "Stub server saw ${connections} connections.");
+
+diag(sprintf('%d outbound HTTP calls in %.3f s: %.0f calls/s',
+             2 * $RequestCount, $elapsed, 2 * $RequestCount / $elapsed));
+
+################################################################################
+
+sub servicecontrol {
+  my ($t, $port, $done, $file) = @_;
+  my $server = HttpServer->new($port, $t->testdir() . '/' . $file)
+    or die "Can't create test server socket: $!\n";
+  $server->keep_alive();
+  local $SIG{PIPE} = 'IGNORE';
+  my $report_count = 0;
+  my %connections;
+
+  $server->on_sub('POST', '/v1/services/endpoints-test.cloudendpointsapis.com:check', sub {
+    my ($headers, $body, $client) = @_;
+    $connections{$client->peerport()} = 1;
+    print $client "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
+  });
+
+  $server->on_sub('POST', '/v1/services/endpoints-test.cloudendpointsapis.com:report', sub {
+    my ($headers, $body, $client) = @_;
+    $connections{$client->peerport()} = 1;
+    print $client "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
+    $report_count++;
+    if ($report_count == $RequestCount) {
+      $t->write_file('connections.txt', scalar keys %connections);
+      ApiManager::write_binary_file($done, ':report done');
+    }
+  });
+
+  $server->run();
+}
+
+################################################################################
+
+sub bookstore {
+  my ($t, $port, $file) = @_;
+  my $server = HttpServer->new($port, $t->testdir() . '/' . $file)
+    or die "Can't create test server socket: $!\n";
+  local $SIG{PIPE} = 'IGNORE';
+
+  $server->on_sub('GET', '/shelves', sub {
+    my ($headers, $body, $client) = @_;
+    print $client <<'EOF';
+HTTP/1.1 200 OK
+Connection: close
+
+List of shelves.
+EOF
+  });
+
+  $server->run();
+}
+
+################################################################################
@@ -0,0 +1,272 @@
+# Copyright (C) Extensible Service Proxy Authors
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 1. Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+# OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+# HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+# SUCH DAMAGE.
+#
+################################################################################
+#
+use strict;
+use warnings;
+
+################################################################################
+
+use src::nginx::t::ApiManager;   # Must be first (sets up import path to the Nginx test module)
+use src::nginx::t::HttpServer;
+use src::nginx::t::ServiceControl;
+use Test::Nginx;  # Imports Nginx's test module
+use Test::More;   # And the test framework
+use JSON::PP;
+use IO::Compress::Deflate qw(deflate);
+use IO::Compress::Gzip qw(gzip);
+use IO::Uncompress::Gunzip qw(gunzip);
+use MIME::Base64;
+
+################################################################################
+
+# Port assignments
+my $NginxPort = ApiManager::pick_port();
+my $LimitedNginxPort = ApiManager::pick_port();
+my $GzipNginxPort = ApiManager::pick_port();
+my $ServiceControlPort = ApiManager::pick_port();
+my $GrpcServerPort = ApiManager::pick_port();
+
+my $t = Test::Nginx->new()->has(qw/http proxy/)->plan(28);
+
+$t->write_file('service.pb.txt',
+  ApiManager::get_grpc_echo_test_service_config(
+    'endpoints-transcoding-test.cloudendpointsapis.com',
+    "http://127.0.0.1:${ServiceControlPort}"));
+
+$t->write_file_expand('nginx.conf', <<EOF);
+%%TEST_GLOBALS%%
+daemon off;
+events {
+  worker_connections 32;
+}
+http {
+  %%TEST_GLOBALS_HTTP%%
+  server_tokens off;
+  server {
+    listen 127.0.0.1:${NginxPort};
+    server_name localhost;
+    location / {
+      endpoints {
+        api service.pb.txt;
+        on;
+      }
+      grpc_pass 127.0.0.1:${GrpcServerPort};
+    }
+  }
+  server {
+    listen 127.0.0.1:${LimitedNginxPort};
+    server_name localhost;
+    client_max_body_size 64k;
+    location / {
+      endpoints {
+        api service.pb.txt;
+        on;
+      }
+      grpc_pass 127.0.0.1:${GrpcServerPort};
+    }
+  }
+  server {
+    listen 127.0.0.1:${GzipNginxPort};
+    server_name localhost;
+    gzip_http_version 1.0;
+    endpoints_transcoding_gzip on;
+    endpoints_transcoding_gzip_min_length 1k;
+    location / {
+      endpoints {
+        api service.pb.txt;
+        on;
+      }
+      grpc_pass 127.0.0.1:${GrpcServerPort};
+    }
+  }
+}
+EOF
+
+$t->run_daemon(\&service_control, $t, $ServiceControlPort, 'servicecontrol.log');
+$t->run_daemon(\&ApiManager::grpc_test_server, $t, "127.0.0.1:${GrpcServerPort}");
+
+is($t->waitforsocket("127.0.0.1:${ServiceControlPort}"), 1, "Service control socket ready.");
+is($t->waitforsocket("127.0.0.1:${GrpcServerPort}"), 1, "GRPC test server socket ready.");
+$t->run();
+is($t->waitforsocket("127.0.0.1:${NginxPort}"), 1, "Nginx socket ready.");
+is($t->waitforsocket("127.0.0.1:${LimitedNginxPort}"), 1, "Limited Nginx socket ready.");
+is($t->waitforsocket("127.0.0.1:${GzipNginxPort}"), 1, "Gzip Nginx socket ready.");
+
+################################################################################
+
+# A body of more than 128 KB, it is inflated over several buffers.
+my $request = ApiManager::get_large_report_request($t, "131584");
+
+my $gzipped;
+gzip(\$request => \$gzipped) or die "gzip failed";
+my $deflated;
+deflate(\$request => \$deflated) or die "deflate failed";
+
+my $response = post_compressed($NginxPort, 'gzip', $gzipped);
+ok(ApiManager::verify_http_json_response($response, decode_json($request)),
+   "Gzip encoded request is inflated and echoed.");
+
+$response = post_compressed($NginxPort, 'deflate', $deflated);
+ok(ApiManager::verify_http_json_response($response, decode_json($request)),
+   "Deflate encoded request is inflated and echoed.");
+
+# Inflated bodies filling whole 16 KB output buffers, the last of which
+# leaves no input but may leave output in zlib.
+foreach my $inflated_size (16384, 65536) {
+  my $exact_request = '{"key":"' . ('a' x ($inflated_size - 10)) . '"}';
+  my $exact_gzipped;
+  gzip(\$exact_request => \$exact_gzipped) or die "gzip failed";
+  $response = post_compressed($NginxPort, 'gzip', $exact_gzipped,
+                              '/echostruct');
+  ok(ApiManager::verify_http_json_response($response,
+                                           decode_json($exact_request)),
+     "Gzip encoded request inflated to ${inflated_size} bytes is echoed.");
+}
+
+# The compressed stream ends early.
+$response = post_compressed($NginxPort, 'gzip',
+                            substr($gzipped, 0, length($gzipped) / 2));
+like($response, qr/HTTP\/1\.1 400 Bad Request/, 'Truncated body got a 400.');
+like($response, qr/compressed request body is truncated/i,
+     'Truncated body error message is correct.');
+
+# The compressed body is under client_max_body_size, the inflated one is not.
+$response = post_compressed($LimitedNginxPort, 'gzip', $gzipped);
+like($response, qr/HTTP\/1\.1 413 Request Entity Too Large/,
+     'Inflated body over client_max_body_size got a 413.');
+
+# Not a gzip stream at all.
+$response = post_compressed($NginxPort, 'gzip', $request);
+like($response, qr/HTTP\/1\.1 400 Bad Request/, 'Invalid gzip body got a 400.');
+
+# Transcoded responses are gzipped for clients that accept it.
+$response = post_json($GzipNginxPort, '/echoreport', $request,
+                      'Accept-Encoding: deflate, gzip');
+my ($headers, $body) = split /\r\n\r\n/, $response, 2;
+like($headers, qr/HTTP\/1\.1 200 OK/, 'Gzipped response got a 200.');
+like($headers, qr/Content-Encoding: gzip/i, 'Response is gzipped.');
+like($headers, qr/Vary: Accept-Encoding/i, 'Response varies on Accept-Encoding.');
+my $inflated;
+gunzip(\$body => \$inflated) or die "gunzip failed";
+ok(ApiManager::compare_json($inflated, decode_json($request)),
+   'Gzipped response is echoed.');
+
+$response = post_json($GzipNginxPort, '/echoreport', $request,
+                      'Accept-Encoding: gzip;q=0');
+unlike($response, qr/Content-Encoding/i, 'Refused gzip is not used.');
+ok(ApiManager::verify_http_json_response($response, decode_json($request)),
+   'Plain response is echoed.');
+
+$response = post_json($GzipNginxPort, '/echoreport', $request, undef);
+unlike($response, qr/Content-Encoding/i,
+       'Response without Accept-Encoding is not gzipped.');
+
+# Smaller than endpoints_transcoding_gzip_min_length.
+my $small_request = '{"key":"value"}';
+$response = post_json($GzipNginxPort, '/echostruct', $small_request,
+                      'Accept-Encoding: gzip');
+unlike($response, qr/Content-Encoding/i, 'Small response is not gzipped.');
+ok(ApiManager::verify_http_json_response($response,
+                                         decode_json($small_request)),
+   'Small response is echoed.');
+
+# Errors sent before the response is compressed are plain JSON.
+$response = post_json($GzipNginxPort, '/echo',
+  '{"return_status":{"code":16,"details":"Error propagation test"}}',
+  'Accept-Encoding: gzip');
+like($response, qr/HTTP\/1\.1 401 Unauthorized/, 'Error got a 401.');
+unlike($response, qr/Content-Encoding/i, 'Error response is not gzipped.');
+like($response, qr/"message": "Error propagation test",/,
+     'Error response is plain JSON.');
+
+# An error after a gzipped message can't be added to the compressed body,
+# the response is cut short instead.
+my $text = encode_base64('a' x 2048, '');
+$response = post_json($GzipNginxPort, '/echostream',
+  qq([{"text":"${text}"},) .
+  '{"return_status":{"code":16,"details":"Error propagation test"}}]',
+  'Accept-Encoding: gzip');
+($headers, $body) = split /\r\n\r\n/, $response, 2;
+like($headers, qr/HTTP\/1\.1 200 OK/, 'Streamed response got a 200.');
+like($headers, qr/Content-Encoding: gzip/i, 'Streamed response is gzipped.');
+unlike($body, qr/Error propagation test/,
+       'Plain error does not follow the gzipped messages.');
+
+$t->stop_daemons();
+
+################################################################################
+
+sub post_json {
+  my ($port, $path, $body, $header) = @_;
+  my $content_length = length($body);
+  my $extra_header = defined $header ? "${header}\n" : '';
+
+  return ApiManager::http($port,<<EOF . $body);
+POST ${path}?key=api-key HTTP/1.0
+Host: 127.0.0.1:${port}
+Content-Type: application/json
+${extra_header}Content-Length: $content_length
+
+EOF
+}
+
+sub post_compressed {
+  my ($port, $encoding, $body, $path) = @_;
+  my $content_length = length($body);
+  $path = '/echoreport' unless defined $path;
+
+  return ApiManager::http($port,<<EOF . $body);
+POST ${path}?key=api-key HTTP/1.0
+Host: 127.0.0.1:${port}
+Content-Type: application/json
+Content-Encoding: ${encoding}
+Content-Length: $content_length
+
+EOF
+}
+
+sub service_control {
+  my ($t, $port, $file) = @_;
+
+  my $server = HttpServer->new($port, $t->testdir() . '/' . $file)
+    or die "Can't create test server socket: $!\n";
+
+  local $SIG{PIPE} = 'IGNORE';
+
+  $server->on_sub('POST', '/v1/services/endpoints-transcoding-test.cloudendpointsapis.com:check', sub {
+    my ($headers, $body, $client) = @_;
+    print $client <<EOF;
+HTTP/1.1 200 OK
+Content-Type: application/json
+Connection: close
+
+EOF
+  });
+
+  $server->run();
+}
+
+################################################################################
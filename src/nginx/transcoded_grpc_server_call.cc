@@ -31,6 +31,7 @@
 #include <vector>
 
 #include "grpc++/support/byte_buffer.h"
+#include "src/api_manager/utils/compression.h"
 #include "src/core/lib/slice/b64.h"
 #include "src/nginx/error.h"
 #include "src/nginx/grpc.h"
@@ -49,17 +50,48 @@ namespace {
 const ngx_str_t kContentTypeApplicationJson = ngx_string("application/json");
 
 const std::string kGrpcStatusDetailsBin = "grpc-status-details-bin";
+
+const ngx_str_t kAcceptEncodingName = ngx_string("Accept-Encoding");
+const ngx_str_t kContentEncoding = ngx_string("Content-Encoding");
+const ngx_str_t kVary = ngx_string("Vary");
+const ngx_str_t kGzip = ngx_string("gzip");
+
+// The size of the buffers the response is compressed into.
+const size_t kGzipBufferSize = 8 * 1024;
+
+ngx_table_elt_t *AddResponseHeader(ngx_http_request_t *r, const ngx_str_t &key,
+                                   const ngx_str_t &value) {
+  auto *h = reinterpret_cast<ngx_table_elt_t *>(
+      ngx_list_push(&r->headers_out.headers));
+  if (h) {
+    h->hash = 1;
+    h->key = key;
+    h->value = value;
+  }
+  return h;
+}
 }  // namespace
 
 NgxEspTranscodedGrpcServerCall::NgxEspTranscodedGrpcServerCall(
     ngx_http_request_t *r,
     std::unique_ptr<NgxRequestZeroCopyInputStream> nginx_request_stream,
+    std::unique_ptr<NgxInflateZeroCopyInputStream> inflate_request_stream,
     std::unique_ptr<grpc::GrpcZeroCopyInputStream> grpc_response_stream,
     std::unique_ptr<::google::grpc::transcoding::Transcoder> transcoder)
     : NgxEspGrpcServerCall(r, true),
       nginx_request_stream_(std::move(nginx_request_stream)),
+      inflate_request_stream_(std::move(inflate_request_stream)),
       grpc_response_stream_(std::move(grpc_response_stream)),
-      transcoder_(std::move(transcoder)) {}
+      transcoder_(std::move(transcoder)),
+      gzip_(false) {
+  ngx_memzero(&gzip_stream_, sizeof(gzip_stream_));
+}
+
+NgxEspTranscodedGrpcServerCall::~NgxEspTranscodedGrpcServerCall() {
+  if (gzip_) {
+    deflateEnd(&gzip_stream_);
+  }
+}
 
 utils::Status NgxEspTranscodedGrpcServerCall::Create(
     ngx_http_request_t *r,
@@ -70,6 +102,22 @@ utils::Status NgxEspTranscodedGrpcServerCall::Create(
   std::unique_ptr<grpc::GrpcZeroCopyInputStream> grpc_response_stream(
       new grpc::GrpcZeroCopyInputStream());
 
+  // Inflate a gzip or deflate encoded request body as it arrives, limiting
+  // the inflated size the same way client_max_body_size limits the body.
+  std::unique_ptr<NgxInflateZeroCopyInputStream> inflate_request_stream;
+  ::google::protobuf::io::ZeroCopyInputStream *request_stream =
+      nginx_request_stream.get();
+  if (NgxInflateZeroCopyInputStream::IsSupportedEncoding(r)) {
+    auto clcf = reinterpret_cast<ngx_http_core_loc_conf_t *>(
+        ngx_http_get_module_loc_conf(r, ngx_http_core_module));
+    inflate_request_stream.reset(new NgxInflateZeroCopyInputStream(
+        r, nginx_request_stream.get(), clcf->client_max_body_size));
+    if (!inflate_request_stream->Status().ok()) {
+      return inflate_request_stream->Status();
+    }
+    request_stream = inflate_request_stream.get();
+  }
+
   // Make sure the ESP request context and the request handler exist
   ngx_esp_request_ctx_t *ctx = ngx_http_esp_ensure_module_ctx(r);
   if (!ctx || !ctx->request_handler) {
@@ -83,7 +131,7 @@ utils::Status NgxEspTranscodedGrpcServerCall::Create(
   // Create the Transcoder
   std::unique_ptr<::google::grpc::transcoding::Transcoder> transcoder;
   auto protoStatus = ctx->transcoder_factory->Create(
-      *ctx->request_handler->method_call(), nginx_request_stream.get(),
+      *ctx->request_handler->method_call(), request_stream,
       grpc_response_stream.get(), &transcoder);
   if (!protoStatus.ok()) {
     return utils::Status::FromProto(protoStatus);
@@ -91,9 +139,9 @@ utils::Status NgxEspTranscodedGrpcServerCall::Create(
 
   // Create the NgxEspTranscodedGrpcServerCall instance
   std::shared_ptr<NgxEspTranscodedGrpcServerCall> call(
-      new NgxEspTranscodedGrpcServerCall(r, std::move(nginx_request_stream),
-                                         std::move(grpc_response_stream),
-                                         std::move(transcoder)));
+      new NgxEspTranscodedGrpcServerCall(
+          r, std::move(nginx_request_stream), std::move(inflate_request_stream),
+          std::move(grpc_response_stream), std::move(transcoder)));
   auto status = call->ProcessPrereadRequestBody();
   if (!status.ok()) {
     return status;
@@ -147,12 +195,16 @@ void NgxEspTranscodedGrpcServerCall::Finish(
   // response output.
   grpc_response_stream_->Finish();
   ngx_chain_t *out = nullptr;
-  if (!ReadTranslatedResponse(&out)) {
+  if (!ReadTranslatedResponse(&out, true)) {
     return;
   }
   // Mark this as the last buffer in the request
   if (out) {
-    out->buf->last_buf = 1;
+    ngx_chain_t *cl = out;
+    while (cl->next) {
+      cl = cl->next;
+    }
+    cl->buf->last_buf = 1;
   }
 
   // Send the final buffer and finalize the request
@@ -181,13 +233,17 @@ bool NgxEspTranscodedGrpcServerCall::ConvertRequestBody(
     out->push_back(grpc_slice_from_copied_buffer(
         reinterpret_cast<const char *>(buffer), size));
   }
-  // Check the status
-  if (!transcoder_->RequestStatus().ok()) {
-    HandleError(utils::Status::FromProto(transcoder_->RequestStatus()));
+  // Check the status. A request stream error is reported first, as it also
+  // makes the transcoder fail on the truncated input.
+  auto stream_status = inflate_request_stream_
+                           ? inflate_request_stream_->Status()
+                           : nginx_request_stream_->Status();
+  if (!stream_status.ok()) {
+    HandleError(stream_status);
     return false;
   }
-  if (!nginx_request_stream_->Status().ok()) {
-    HandleError(nginx_request_stream_->Status());
+  if (!transcoder_->RequestStatus().ok()) {
+    HandleError(utils::Status::FromProto(transcoder_->RequestStatus()));
     return false;
   }
   return true;
@@ -207,10 +263,119 @@ bool NgxEspTranscodedGrpcServerCall::ConvertResponseMessage(
   // Add the response gRPC message to the Transcoder input response stream and
   // read the translated response from the transcoder.
   grpc_response_stream_->AddMessage(grpc_msg, true);
-  return ReadTranslatedResponse(out);
+  return ReadTranslatedResponse(out, false);
 }
 
-bool NgxEspTranscodedGrpcServerCall::ReadTranslatedResponse(ngx_chain_t **out) {
+void NgxEspTranscodedGrpcServerCall::Write(
+    const ::grpc::ByteBuffer &msg, std::function<void(bool)> continuation) {
+  if (cln_.data && !r_->header_sent) {
+    StartGzip(msg);
+  }
+  NgxEspGrpcServerCall::Write(msg, std::move(continuation));
+}
+
+void NgxEspTranscodedGrpcServerCall::StartGzip(
+    const ::grpc::ByteBuffer &first_msg) {
+  ngx_esp_loc_conf_t *lc = reinterpret_cast<ngx_esp_loc_conf_t *>(
+      ngx_http_get_module_loc_conf(r_, ngx_esp_module));
+  if (!lc->transcoding_gzip) {
+    return;
+  }
+
+  // Caches must keep the compressed and the plain response apart.
+  AddResponseHeader(r_, kVary, kAcceptEncodingName);
+
+  // ngx_http_gzip_ok() checks Accept-Encoding, and gzip_http_version,
+  // gzip_proxied and gzip_disable, as for nginx's own gzip filter.
+  if (first_msg.Length() < lc->transcoding_gzip_min_length ||
+      ngx_http_gzip_ok(r_) != NGX_OK) {
+    return;
+  }
+
+  utils::InitZStream(&gzip_stream_);
+  if (deflateInit2(&gzip_stream_, lc->transcoding_gzip_comp_level, Z_DEFLATED,
+                   utils::kGzipWindowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+    ngx_log_error(NGX_LOG_ERR, r_->connection->log, 0,
+                  "Failed to initialize response compression.");
+    return;
+  }
+
+  auto h = AddResponseHeader(r_, kContentEncoding, kGzip);
+  if (!h) {
+    deflateEnd(&gzip_stream_);
+    return;
+  }
+  r_->headers_out.content_encoding = h;
+  ngx_http_clear_content_length(r_);
+  gzip_ = true;
+}
+
+void NgxEspTranscodedGrpcServerCall::StopGzip() {
+  deflateEnd(&gzip_stream_);
+  gzip_ = false;
+  if (!r_->header_sent && r_->headers_out.content_encoding) {
+    r_->headers_out.content_encoding->hash = 0;
+    r_->headers_out.content_encoding = nullptr;
+  }
+}
+
+ngx_chain_t *NgxEspTranscodedGrpcServerCall::GzipResponse(const void *data,
+                                                          int size, bool finish,
+                                                          ngx_chain_t **out) {
+  gzip_stream_.next_in = reinterpret_cast<Bytef *>(const_cast<void *>(data));
+  gzip_stream_.avail_in = size;
+
+  *out = nullptr;
+  ngx_chain_t **next = out;
+  ngx_chain_t *cl = nullptr;
+  for (;;) {
+    cl = AllocNgxBufChain(kGzipBufferSize);
+    if (!cl) {
+      return nullptr;
+    }
+    ngx_buf_t *buf = cl->buf;
+    gzip_stream_.next_out = buf->last;
+    gzip_stream_.avail_out = buf->end - buf->last;
+    int rc = deflate(&gzip_stream_, finish ? Z_FINISH : Z_SYNC_FLUSH);
+    if (rc == Z_STREAM_ERROR) {
+      return nullptr;
+    }
+    buf->last = buf->end - gzip_stream_.avail_out;
+    *next = cl;
+    next = &cl->next;
+    if (rc == Z_STREAM_END || gzip_stream_.avail_out != 0) {
+      return cl;
+    }
+  }
+}
+
+bool NgxEspTranscodedGrpcServerCall::ReadTranslatedResponse(ngx_chain_t **out,
+                                                            bool finish) {
+  if (gzip_) {
+    const void *buffer = nullptr;
+    int size = 0;
+    if (!transcoder_->ResponseOutput()->Next(&buffer, &size) || size <= 0) {
+      if (!transcoder_->ResponseStatus().ok()) {
+        HandleError(utils::Status::FromProto(transcoder_->ResponseStatus()));
+        return false;
+      }
+      size = 0;
+    }
+
+    ngx_chain_t *last = GzipResponse(buffer, size, finish, out);
+    if (!last) {
+      ngx_log_error(NGX_LOG_ERR, r_->connection->log, 0,
+                    "Failed to compress the response.");
+      HandleError(utils::Status(
+          NGX_HTTP_INTERNAL_SERVER_ERROR,
+          "Internal error occurred while compressing the response."));
+      return false;
+    }
+    last->buf->last_in_chain = 1;
+    last->buf->flush = 1;
+    return true;
+  }
+
   // Allocate an ngx_buf.
   ngx_buf_t *buf = reinterpret_cast<ngx_buf_t *>(ngx_calloc_buf(r_->pool));
   ngx_chain_t *cl = reinterpret_cast<ngx_chain_t *>(
@@ -257,6 +422,15 @@ void NgxEspTranscodedGrpcServerCall::HandleError(const utils::Status &error) {
   if (ctx) {
     ctx->status = error;
   }
+  if (gzip_) {
+    StopGzip();
+    if (r_->header_sent) {
+      // The JSON error can't follow a compressed body. Close the connection
+      // so that the client sees a truncated response rather than a corrupt
+      // one.
+      return ngx_http_finalize_request(r_, NGX_ERROR);
+    }
+  }
   return ngx_http_finalize_request(r_, ngx_esp_return_error(r_));
 }
 
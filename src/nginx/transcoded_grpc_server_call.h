@@ -41,6 +41,7 @@ extern "C" {
 #include "src/grpc/zero_copy_stream.h"
 #include "src/nginx/grpc_server_call.h"
 #include "src/nginx/zero_copy_stream.h"
+#include "zlib.h"
 
 namespace google {
 namespace api_manager {
@@ -61,12 +62,19 @@ class NgxEspTranscodedGrpcServerCall : public NgxEspGrpcServerCall {
       ngx_http_request_t* r,
       std::shared_ptr<NgxEspTranscodedGrpcServerCall>* out);
 
+  virtual ~NgxEspTranscodedGrpcServerCall();
+
  private:
   // ServerCall::Finish() implementation
   virtual void Finish(
       const utils::Status& status,
       std::multimap<std::string, std::string> response_trailers);
 
+  // ServerCall::Write() implementation. Decides whether to gzip the response
+  // before the headers go out with the first message.
+  virtual void Write(const ::grpc::ByteBuffer& msg,
+                     std::function<void(bool)> continuation);
+
   // NgxEspGrpcServerCall implementation
   virtual bool ConvertRequestBody(std::vector<grpc_slice>* out);
   virtual bool ConvertResponseMessage(const ::grpc::ByteBuffer& msg,
@@ -77,12 +85,28 @@ class NgxEspTranscodedGrpcServerCall : public NgxEspGrpcServerCall {
   NgxEspTranscodedGrpcServerCall(
       ngx_http_request_t* r,
       std::unique_ptr<NgxRequestZeroCopyInputStream> nginx_request_stream,
+      std::unique_ptr<NgxInflateZeroCopyInputStream> inflate_request_stream,
       std::unique_ptr<grpc::GrpcZeroCopyInputStream> grpc_response_stream,
       std::unique_ptr<::google::grpc::transcoding::Transcoder> transcoder);
 
   // Read the translated response message from the transcoder into an
-  // ngx_chain_t.
-  bool ReadTranslatedResponse(ngx_chain_t** out);
+  // ngx_chain_t. If the response is gzipped, finish ends the gzip stream.
+  bool ReadTranslatedResponse(ngx_chain_t** out, bool finish);
+
+  // Starts gzipping the response if the location enables it, the client
+  // accepts it and the first response message is large enough. Adds the
+  // response headers for it.
+  void StartGzip(const ::grpc::ByteBuffer& first_msg);
+
+  // Ends the gzip stream. Removes Content-Encoding if the response headers
+  // have not been sent yet, so that an error response is sent plain.
+  void StopGzip();
+
+  // Compresses the translated response data into a chain of buffers and
+  // returns its last link, or nullptr on failure. The compressed data is
+  // flushed so that streamed messages are not held back.
+  ngx_chain_t* GzipResponse(const void* data, int size, bool finish,
+                            ngx_chain_t** out);
 
   // Handle transcoding error
   void HandleError(const utils::Status& error);
@@ -91,12 +115,21 @@ class NgxEspTranscodedGrpcServerCall : public NgxEspGrpcServerCall {
   // transcoder
   std::unique_ptr<NgxRequestZeroCopyInputStream> nginx_request_stream_;
 
+  // ZeroCopyInputStream that inflates nginx_request_stream_ if the request
+  // body is compressed, nullptr otherwise
+  std::unique_ptr<NgxInflateZeroCopyInputStream> inflate_request_stream_;
+
   // ZeroCopyInputStream that wraps the proto response to be feeded to
   // the transcoder
   std::unique_ptr<grpc::GrpcZeroCopyInputStream> grpc_response_stream_;
 
   // The transcoder that does the actual translation
   std::unique_ptr<::google::grpc::transcoding::Transcoder> transcoder_;
+
+  // Whether the response is gzipped, and the compressor state kept across
+  // the response messages.
+  bool gzip_;
+  z_stream gzip_stream_;
 };
 
 }  // namespace nginx
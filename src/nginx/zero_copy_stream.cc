@@ -26,6 +26,9 @@
 //
 #include "src/nginx/zero_copy_stream.h"
 
+#include "src/api_manager/utils/compression.h"
+#include "src/nginx/util.h"
+
 extern "C" {
 #include "src/http/ngx_http.h"
 }
@@ -36,6 +39,15 @@ namespace nginx {
 
 namespace {
 
+// The size of the buffer the request body is inflated into.
+const size_t kInflateBufferSize = 16 * 1024;
+
+u_char kContentEncoding[] = "content-encoding";
+
+// The Content-Encoding values zlib can inflate.
+const ngx_str_t kInflateEncodings[] = {
+    ngx_string("gzip"), ngx_string("x-gzip"), ngx_string("deflate")};
+
 // Read a file-based ngx_buf_t into a memory-based ngx_buf_t
 ngx_buf_t* ReadFileBuffer(ngx_pool_t* pool, ngx_buf_t* file_buf) {
   // TODO: If the file is too large, read it in chunks.
@@ -171,6 +183,150 @@ bool NgxRequestZeroCopyInputStream::NextBuffer() {
   return true;
 }
 
+NgxInflateZeroCopyInputStream::NgxInflateZeroCopyInputStream(
+    ngx_http_request_t* r, NgxRequestZeroCopyInputStream* input,
+    size_t max_size)
+    : r_(r),
+      input_(input),
+      max_size_(max_size),
+      initialized_(false),
+      finished_(false),
+      output_pending_(false),
+      out_(nullptr),
+      out_size_(0),
+      backed_up_(0),
+      byte_count_(0),
+      status_(utils::Status::OK) {
+  utils::InitZStream(&stream_);
+
+  out_ = reinterpret_cast<u_char*>(ngx_palloc(r_->pool, kInflateBufferSize));
+  if (!out_ || inflateInit2(&stream_, utils::kAutoDetectWindowBits) != Z_OK) {
+    ngx_log_error(NGX_LOG_ERR, r_->connection->log, 0,
+                  "Failed to initialize request body decompression.");
+    status_ = utils::Status(NGX_HTTP_INTERNAL_SERVER_ERROR,
+                            "Internal error decompressing the request data.");
+    return;
+  }
+  initialized_ = true;
+}
+
+NgxInflateZeroCopyInputStream::~NgxInflateZeroCopyInputStream() {
+  if (initialized_) {
+    inflateEnd(&stream_);
+  }
+}
+
+bool NgxInflateZeroCopyInputStream::IsSupportedEncoding(
+    ngx_http_request_t* r) {
+  auto h = ngx_esp_find_headers_in(r, kContentEncoding,
+                                   sizeof(kContentEncoding) - 1);
+  if (h == nullptr) {
+    return false;
+  }
+  for (const auto& encoding : kInflateEncodings) {
+    if (h->value.len == encoding.len &&
+        ngx_strncasecmp(h->value.data, encoding.data, encoding.len) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+utils::Status NgxInflateZeroCopyInputStream::Status() const {
+  return status_.ok() ? input_->Status() : status_;
+}
+
+bool NgxInflateZeroCopyInputStream::Next(const void** data, int* size) {
+  if (!status_.ok()) {
+    return false;
+  }
+
+  if (backed_up_ > 0) {
+    // Return the backed up part of the last output again.
+    *data = out_ + out_size_ - backed_up_;
+    *size = backed_up_;
+    backed_up_ = 0;
+    return true;
+  }
+
+  if (Inflate()) {
+    *data = out_;
+    *size = out_size_;
+    byte_count_ += out_size_;
+    return true;
+  }
+
+  *size = 0;
+  if (!status_.ok() || !input_->Status().ok()) {
+    return false;
+  }
+  if (finished_) {
+    return false;
+  }
+  if (!r_->reading_body && stream_.avail_in == 0) {
+    // NGINX has read the whole body but the compressed stream did not end.
+    status_ = utils::Status(NGX_HTTP_BAD_REQUEST,
+                            "The compressed request body is truncated.");
+    return false;
+  }
+  // There might be more data.
+  return true;
+}
+
+void NgxInflateZeroCopyInputStream::BackUp(int count) {
+  if (0 < count && count <= out_size_ - backed_up_) {
+    backed_up_ += count;
+  }
+}
+
+bool NgxInflateZeroCopyInputStream::Inflate() {
+  while (!finished_) {
+    // Pending output is drained before more input is read, as the end of
+    // the body may already have been reached.
+    if (stream_.avail_in == 0 && !output_pending_) {
+      const void* in = nullptr;
+      int in_size = 0;
+      if (!input_->Next(&in, &in_size) || in_size == 0) {
+        return false;
+      }
+      stream_.next_in = reinterpret_cast<Bytef*>(const_cast<void*>(in));
+      stream_.avail_in = in_size;
+    }
+
+    stream_.next_out = out_;
+    stream_.avail_out = kInflateBufferSize;
+    int ret = inflate(&stream_, Z_NO_FLUSH);
+    if (ret == Z_STREAM_END) {
+      finished_ = true;
+    } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+      ngx_log_error(NGX_LOG_INFO, r_->connection->log, 0,
+                    "Failed to decompress the request body: %s",
+                    stream_.msg ? stream_.msg : "unknown error");
+      status_ = utils::Status(NGX_HTTP_BAD_REQUEST,
+                              "The compressed request body is invalid.");
+      return false;
+    }
+
+    out_size_ = static_cast<int>(kInflateBufferSize - stream_.avail_out);
+    output_pending_ = stream_.avail_out == 0;
+    if (max_size_ != 0 && stream_.total_out > max_size_) {
+      ngx_log_error(NGX_LOG_INFO, r_->connection->log, 0,
+                    "The decompressed request body is larger than %uz bytes",
+                    max_size_);
+      status_ =
+          utils::Status(NGX_HTTP_REQUEST_ENTITY_TOO_LARGE,
+                        "The decompressed request body is too large.");
+      return false;
+    }
+    if (out_size_ > 0) {
+      ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r_->connection->log, 0,
+                     "NgxInflateZeroCopyInputStream: Next %d", out_size_);
+      return true;
+    }
+  }
+  return false;
+}
+
 }  // namespace nginx
 }  // namespace api_manager
 }  // namespace google
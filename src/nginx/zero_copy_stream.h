@@ -33,6 +33,7 @@
 #include "google/protobuf/io/zero_copy_stream.h"
 #include "grpc++/support/byte_buffer.h"
 #include "include/api_manager/utils/status.h"
+#include "zlib.h"
 
 extern "C" {
 #include "src/http/ngx_http.h"
@@ -79,6 +80,60 @@ class NgxRequestZeroCopyInputStream
   utils::Status status_;
 };
 
+// ::google::protobuf::io::ZeroCopyInputStream implementation that inflates a
+// gzip or deflate (zlib) encoded request body read from an
+// NgxRequestZeroCopyInputStream. The body is inflated chunk by chunk as its
+// buffers arrive, the whole body is never held in memory. Fails with 413 if
+// the inflated body is larger than max_size (0 means no limit).
+class NgxInflateZeroCopyInputStream
+    : public ::google::protobuf::io::ZeroCopyInputStream {
+ public:
+  NgxInflateZeroCopyInputStream(ngx_http_request_t* r,
+                                NgxRequestZeroCopyInputStream* input,
+                                size_t max_size);
+  ~NgxInflateZeroCopyInputStream();
+
+  // Returns true if the request body has a Content-Encoding this stream can
+  // inflate.
+  static bool IsSupportedEncoding(ngx_http_request_t* r);
+
+  // Reports the status in case of an error
+  utils::Status Status() const;
+
+  // ZeroCopyInputStream implementation
+  bool Next(const void** data, int* size);
+  void BackUp(int count);
+  bool Skip(int count) { return false; }  // not supported
+  ::google::protobuf::int64 ByteCount() const { return byte_count_; }
+
+ private:
+  // Inflates the available input into out_. Returns false if there is no
+  // output at the moment (more input is needed, the end of the body was
+  // reached or an error occurred).
+  bool Inflate();
+
+  ngx_http_request_t* r_;
+  NgxRequestZeroCopyInputStream* input_;
+  size_t max_size_;
+
+  z_stream stream_;
+  bool initialized_;
+  bool finished_;
+  // True if the last inflate() filled out_, so that zlib may still hold
+  // output for the input it has consumed.
+  bool output_pending_;
+
+  // The inflated output returned by the last Next()
+  u_char* out_;
+  int out_size_;
+  // The number of bytes backed up from the last Next()
+  int backed_up_;
+  // The total number of inflated bytes returned
+  ::google::protobuf::int64 byte_count_;
+
+  utils::Status status_;
+};
+
 }  // namespace nginx
 }  // namespace api_manager
 }  // namespace google
@@ -0,0 +1,135 @@
+// Copyright (C) Extensible Service Proxy Authors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/stubs/logging.h"
+#include "include/api_manager/env_interface.h"
+#include "src/api_manager/rewrite_rule.h"
+
+using ::google::api_manager::ApiManagerEnvInterface;
+using ::google::api_manager::RewriteRule;
+using ::google::api_manager::RewriteRuleSet;
+
+namespace {
+
+const int MAX_REWRITE_SIZE = 1000000;
+
+// An environment only used to log rewrite rule errors.
+class PerfEnv : public ApiManagerEnvInterface {
+ public:
+  void Log(LogLevel level, const char *message) override {
+    if (level == LogLevel::ERROR) {
+      std::cerr << message << "\n";
+    }
+  }
+  std::unique_ptr<::google::api_manager::PeriodicTimer> StartPeriodicTimer(
+      std::chrono::milliseconds interval,
+      std::function<void()> continuation) override {
+    return nullptr;
+  }
+  void RunHTTPRequest(
+      std::unique_ptr<::google::api_manager::HTTPRequest> request) override {}
+  void RunGRPCRequest(
+      std::unique_ptr<::google::api_manager::GRPCRequest> request) override {}
+};
+
+// Rule i rewrites "/api/service<i>/v1/..." into "/service<i>/v1/...".
+// Its literal prefix is "/api/service<i>/v".
+std::string Pattern(int i) {
+  return "^/api/service" + std::to_string(i) + "/v(1|2)/(.*)$";
+}
+
+std::string Replacement(int i) {
+  return "/service" + std::to_string(i) + "/v$1/$2";
+}
+
+// Compare the performance of rewriting an uri matched by the last rule
+// and an uri not matched by any rule.
+// 1. Check the rules one by one.
+// 2. Use RewriteRuleSet with the literal prefix index.
+void RunRules(int rule_count) {
+  PerfEnv env;
+  std::vector<std::unique_ptr<RewriteRule>> rule_list;
+  RewriteRuleSet rule_set;
+  for (int i = 0; i < rule_count; ++i) {
+    rule_list.emplace_back(new RewriteRule(Pattern(i), Replacement(i), &env));
+    rule_set.Add(std::unique_ptr<RewriteRule>(
+        new RewriteRule(Pattern(i), Replacement(i), &env)));
+  }
+
+  const std::vector<std::string> uris = {
+      "/api/service" + std::to_string(rule_count - 1) +
+          "/v1/shelves?key=this-is-an-api-key",
+      "/foo/api/shelves?key=this-is-an-api-key",
+  };
+
+  for (const auto &uri : uris) {
+    std::string destination;
+    int matched = 0;
+
+    // 1. Check the rules one by one.
+    std::clock_t start = std::clock();
+    for (int i = 0; i < MAX_REWRITE_SIZE; i++) {
+      for (auto &rule : rule_list) {
+        if (rule->Check(uri.c_str(), uri.size(), &destination, false)) {
+          ++matched;
+          break;
+        }
+      }
+    }
+    GOOGLE_LOG(INFO) << rule_count << " rules, uri " << uri
+                     << ", 1 million rewrites one by one: "
+                     << 1000.0 * (std::clock() - start) / CLOCKS_PER_SEC
+                     << "ms";
+
+    // 2. Use RewriteRuleSet.
+    std::clock_t start_set = std::clock();
+    for (int i = 0; i < MAX_REWRITE_SIZE; i++) {
+      if (rule_set.Rewrite(uri.c_str(), uri.size(), &destination, false)) {
+        --matched;
+      }
+    }
+    GOOGLE_LOG(INFO) << rule_count << " rules, uri " << uri
+                     << ", 1 million rewrites with rule set: "
+                     << 1000.0 * (std::clock() - start_set) / CLOCKS_PER_SEC
+                     << "ms";
+    GOOGLE_CHECK(matched == 0);
+  }
+}
+
+}  //  namespace
+
+int main() {
+  for (int rule_count : {1, 10, 100}) {
+    RunRules(rule_count);
+  }
+  return 0;
+}
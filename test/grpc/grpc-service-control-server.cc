@@ -0,0 +1,206 @@
+// Copyright (C) Extensible Service Proxy Authors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+// A fake service control server for the gRPC transport.  It answers
+// every Check, AllocateQuota and Report call with an empty (successful)
+// response, and appends a line per call to a log file:
+//
+//   <method> <request as JSON>
+//
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <grpc++/generic/async_generic_service.h>
+#include <grpc++/grpc++.h>
+
+#include "google/api/servicecontrol/v1/quota_controller.pb.h"
+#include "google/api/servicecontrol/v1/service_controller.pb.h"
+#include "google/protobuf/util/json_util.h"
+
+using ::google::api::servicecontrol::v1::AllocateQuotaRequest;
+using ::google::api::servicecontrol::v1::CheckRequest;
+using ::google::api::servicecontrol::v1::ReportRequest;
+using ::grpc::AsyncGenericService;
+using ::grpc::ByteBuffer;
+using ::grpc::GenericServerAsyncReaderWriter;
+using ::grpc::GenericServerContext;
+using ::grpc::InsecureServerCredentials;
+using ::grpc::Server;
+using ::grpc::ServerBuilder;
+using ::grpc::ServerCompletionQueue;
+using ::grpc::Status;
+using ::grpc::WriteOptions;
+
+namespace test {
+namespace grpc {
+namespace {
+
+typedef std::function<void(bool)> Tag;
+
+void *MakeTag(std::function<void(bool)> continuation) {
+  return reinterpret_cast<void *>(new Tag(continuation));
+}
+
+const char kServiceController[] =
+    "/google.api.servicecontrol.v1.ServiceController/";
+const char kQuotaController[] =
+    "/google.api.servicecontrol.v1.QuotaController/";
+
+// Returns an empty request message of a service control method, or
+// nullptr for an unknown method.
+std::unique_ptr<::google::protobuf::Message> NewRequest(
+    const std::string &method) {
+  ::google::protobuf::Message *request = nullptr;
+  if (method == std::string(kServiceController) + "Check") {
+    request = new CheckRequest;
+  } else if (method == std::string(kServiceController) + "Report") {
+    request = new ReportRequest;
+  } else if (method == std::string(kQuotaController) + "AllocateQuota") {
+    request = new AllocateQuotaRequest;
+  }
+  return std::unique_ptr<::google::protobuf::Message>(request);
+}
+
+// A single unary call, alive until its final status is sent.
+class ServiceControlCall {
+ public:
+  ServiceControlCall(AsyncGenericService *service, ServerCompletionQueue *cq,
+                     std::ofstream *log)
+      : service_(service), cq_(cq), log_(log), stream_(&ctx_) {}
+
+  // Waits for the next call, then handles it and starts waiting for the
+  // one after.
+  static void Start(AsyncGenericService *service, ServerCompletionQueue *cq,
+                    std::ofstream *log) {
+    ServiceControlCall *call = new ServiceControlCall(service, cq, log);
+    service->RequestCall(&call->ctx_, &call->stream_, cq, cq,
+                         MakeTag([call](bool ok) {
+                           if (!ok) {
+                             delete call;
+                             return;
+                           }
+                           Start(call->service_, call->cq_, call->log_);
+                           call->Read();
+                         }));
+  }
+
+ private:
+  void Read() {
+    stream_.Read(&request_, MakeTag([this](bool ok) {
+                   if (!ok) {
+                     Finish(Status(::grpc::INVALID_ARGUMENT,
+                                   "Missing request message"));
+                     return;
+                   }
+                   Respond();
+                 }));
+  }
+
+  void Respond() {
+    std::unique_ptr<::google::protobuf::Message> request =
+        NewRequest(ctx_.method());
+    if (!request) {
+      Finish(Status(::grpc::UNIMPLEMENTED, "Unknown method"));
+      return;
+    }
+
+    std::vector<::grpc::Slice> slices;
+    request_.Dump(&slices);
+    std::string body;
+    for (const auto &slice : slices) {
+      body.append(reinterpret_cast<const char *>(slice.begin()), slice.size());
+    }
+    std::string json;
+    if (!request->ParseFromString(body) ||
+        !::google::protobuf::util::MessageToJsonString(*request, &json).ok()) {
+      Finish(Status(::grpc::INVALID_ARGUMENT, "Invalid request message"));
+      return;
+    }
+    *log_ << ctx_.method() << " " << json << std::endl;
+
+    // An empty message is a valid response to any of the methods.
+    ::grpc::Slice empty;
+    ByteBuffer response(&empty, 1);
+    stream_.WriteAndFinish(response, WriteOptions(), Status::OK,
+                           MakeTag([this](bool ok) { delete this; }));
+  }
+
+  void Finish(const Status &status) {
+    stream_.Finish(status, MakeTag([this](bool ok) { delete this; }));
+  }
+
+  AsyncGenericService *service_;
+  ServerCompletionQueue *cq_;
+  std::ofstream *log_;
+  GenericServerContext ctx_;
+  GenericServerAsyncReaderWriter stream_;
+  ByteBuffer request_;
+};
+
+}  // namespace
+
+void Run(const char *addr, const char *log_file) {
+  std::ofstream log(log_file, std::ios::app);
+  AsyncGenericService service;
+  ServerBuilder builder;
+  builder.AddListeningPort(addr, InsecureServerCredentials());
+  builder.RegisterAsyncGenericService(&service);
+  std::unique_ptr<ServerCompletionQueue> cq = builder.AddCompletionQueue();
+  std::unique_ptr<Server> server(builder.BuildAndStart());
+
+  ServiceControlCall::Start(&service, cq.get(), &log);
+
+  std::cout << "Service control server listening at address " << addr
+            << std::endl;
+
+  void *tag;
+  bool ok;
+  while (cq->Next(&tag, &ok)) {
+    Tag *func = reinterpret_cast<Tag *>(tag);
+    (*func)(ok);
+    delete func;
+  }
+}
+
+}  // namespace grpc
+}  // namespace test
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    std::cerr << "Usage: grpc-service-control-server <listening address> "
+                 "<log file>"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  ::test::grpc::Run(argv[1], argv[2]);
+
+  return EXIT_SUCCESS;
+}